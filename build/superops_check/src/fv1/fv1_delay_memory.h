@@ -0,0 +1,136 @@
+// fv1vm: experimental FV-1 virtual machine
+// Copyright (C) 2022 Patrick Dowling <pld@gurkenkiste.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef FV1_DELAY_MEMORY_H_
+#define FV1_DELAY_MEMORY_H_
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+#include "fv1_defs.h"
+
+// TODO struct Address {} for additional type safety
+
+namespace fv1 {
+
+// Generally assue offsets are >= 0
+template <typename Traits>
+class DelayMemory {
+public:
+  using value_type = typename Traits::value_type;
+  using storage_type = typename Traits::storage_type;
+  using buffer_type = typename std::array<typename Traits::storage_type, kDelayMemorySize>;
+
+  explicit DelayMemory(buffer_type &buffer) : buffer_{buffer} {}
+
+  void Reset()
+  {
+    std::fill(buffer_.begin(), buffer_.end(), 0);
+    cursor_ = 0;
+  }
+
+  constexpr int32_t size() { return kDelayMemorySize; }
+
+  // The last read value is only needed for WRAP
+  template <bool update_last_read = true>
+  value_type Load(int32_t index)
+  {
+    const auto value = Traits::Unpack(at(index));
+    if constexpr (update_last_read) last_read_ = value;
+    return value;
+  }
+
+  void Store(int32_t index, value_type value) { at(index) = Traits::Pack(value); }
+
+  template <typename T>
+  void Store(int32_t index, const T &value)
+  {
+    at(index) = Traits::Pack(value.load());
+  }
+
+  value_type last_read() const { return last_read_; }
+
+  void Tick()
+  {
+    auto c = cursor_;
+    if (c)
+      cursor_ = c - 1;
+    else
+      cursor_ = kDelayMemorySize - 1;
+  }
+
+  value_type load_immediate(int32_t index) const { return Traits::Unpack(buffer_[index]); }
+
+  // Access for the instructions of one frame, i.e. until the next Tick. The buffer and cursor are
+  // resolved once into locals, so they aren't reloaded after every store into the buffer (which
+  // could alias cursor_) and each access is the address, the mask and a single load or store.
+  class Frame {
+  public:
+    explicit Frame(DelayMemory &memory)
+        : base_{memory.buffer_.data()}, cursor_{memory.cursor_}, last_read_{memory.last_read_}
+    {}
+
+    template <bool update_last_read = true>
+    value_type Load(int32_t index)
+    {
+      const auto value = Traits::Unpack(at(index));
+      if constexpr (update_last_read) last_read_ = value;
+      return value;
+    }
+
+    void Store(int32_t index, value_type value) { at(index) = Traits::Pack(value); }
+
+    template <typename T>
+    void Store(int32_t index, const T &value)
+    {
+      at(index) = Traits::Pack(value.load());
+    }
+
+    value_type last_read() const { return last_read_; }
+    void set_last_read(value_type value) { last_read_ = value; }
+
+  private:
+    storage_type *const base_;
+    const int32_t cursor_;
+    value_type &last_read_;
+
+    inline storage_type &at(int32_t i) { return base_[(cursor_ + i) & (kDelayMemorySize - 1)]; }
+  };
+
+  Frame frame() { return Frame{*this}; }
+
+  // Raw access for generated code that does its own (cursor + index) & mask
+  storage_type *data() { return buffer_.data(); }
+  int32_t cursor() const { return cursor_; }
+  void set_last_read(value_type value) { last_read_ = value; }
+
+private:
+  buffer_type &buffer_;
+  int32_t cursor_{0};
+  value_type last_read_{0};
+
+  inline storage_type at(int32_t i) const
+  {
+    return buffer_[(cursor_ + i) & (kDelayMemorySize - 1)];
+  }
+
+  inline storage_type &at(int32_t i) { return buffer_[(cursor_ + i) & (kDelayMemorySize - 1)]; }
+};
+
+}  // namespace fv1
+
+#endif  // FV1_DELAY_MEMORY_H_
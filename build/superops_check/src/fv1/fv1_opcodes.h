@@ -0,0 +1,144 @@
+// fv1vm: experimental FV-1 virtual machine
+// Copyright (C) 2022 Patrick Dowling <pld@gurkenkiste.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef FV1_OPCODES_H_
+#define FV1_OPCODES_H_
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+#include "fv1_superops.h"
+
+namespace fv1 {
+
+enum class OPCODE : uint8_t {
+  RDA = 0x00,
+  RMPA = 0x01,
+  WRA = 0x02,
+  WRAP = 0x03,
+  RDAX = 0x04,
+  RDFX = 0x05,  // => LDAX
+  WRAX = 0x06,
+  WRHX = 0x07,
+  WRLX = 0x08,
+  MAXX = 0x09,  // => ABSA
+  MULX = 0x0a,
+  LOG = 0x0b,
+  EXP = 0x0c,
+  SOF = 0x0d,
+  AND = 0x0e,  // CLR
+  OR = 0x0f,
+  XOR = 0x10,   // NOT
+  SKP = 0x11,   // NOP
+  WLDS = 0x12,  // => WLDR
+  JAM = 0x13,
+  CHO_RDA = 0x14,  // => CHO_SOF, CHO_RDAL
+  REAL_OPCODES_LAST,
+  // ALT/PSEUDO OPCODES (start with 0x2.)
+  // TODO we might also use 0x20 | original opcode but that fails with CHO_RDA and NOP
+  CLR = 0x20,
+  NOT,
+  ABSA,
+  LDAX,
+  WLDR,  // 0x40000012, see WLDS
+  CHO_RDAL,
+  CHO_SOF,      // Actually we can probably split these further depending on flags
+  CHO_SOF_RMP,  // VM
+  CHO_SOF_SIN,  // VM
+  CHO_RDA_RMP,  // VM
+  CHO_RDA_SIN,  // VM
+  JMP,          // SKP with no flags but N > 0
+  NOP,          // SKP with not flags and N == 0
+  RDAX_ADD,     // VM, C = 1.0
+  RDAX_SUB,     // VM, C = -1.0
+  RDA_ADD,      // VM, C = 1.0
+  WRAX_MOV,     // VM, C = 1.0
+  WRAX_CLR,     // VM, C = 0
+  SOF_NEG,      // VM, SOF -1.0, 0
+  SOF_HALF,     // VM, SOF 0.5, 0
+  SOF_NEG2,     // VM, SOF -2.0, 0
+  ALLPASS,      // VM, RDA + WRAP
+  LPF1,         // VM, RDFX + WRLX
+  HPF1,         // VM, RDFX + WRHX
+  CHO_INTERP_RMP,  // VM, CHO_RDA_RMP + CHO_RDA_RMP
+  CHO_INTERP_SIN,  // VM, CHO_RDA_SIN + CHO_RDA_SIN
+  RDA_NOSAT,    // VM, result always in range
+  RDAX_NOSAT,   // VM
+  RDFX_NOSAT,   // VM
+  WRAX_NOSAT,   // VM
+  MULX_NOSAT,   // VM
+  SOF_NOSAT,    // VM
+  RDA_SAVE,     // VM, RDA that keeps the value for RDA_CACHED
+  WRA_SAVE,     // VM, WRA that keeps the value for RDA_CACHED
+  RDA_CACHED,   // VM, RDA of a value already read or written in the same frame
+#define FV1_SUPEROP_ENUM(name, ...) name,
+  FV1_SUPEROPS(FV1_SUPEROP_ENUM)  // VM, see kSuperops
+#undef FV1_SUPEROP_ENUM
+  UNKNOWN,
+};
+static constexpr size_t kNumRealOpcodes = static_cast<size_t>(OPCODE::REAL_OPCODES_LAST);
+static constexpr size_t kOpcodeMax = 0x1f;
+static constexpr size_t kNumOpcodes = static_cast<size_t>(OPCODE::UNKNOWN) + 1;
+static constexpr size_t kNumSecondaryOpcodes = 1 /*WLDS/R*/ + 2 /*CHO_*/;
+
+// Superinstructions: a sequence of opcodes that's executed by a single handler, see fv1_superops.h
+// and VM::FuseSuperinstructions.
+static constexpr size_t kMaxSuperopLength = 4;
+struct Superop {
+  OPCODE opcode;
+  size_t length;
+  std::array<OPCODE, kMaxSuperopLength> sequence;
+};
+#define FV1_SUPEROP_COUNT(...) +1
+#define FV1_SUPEROP_ENTRY(name, mnemonic, length, ...) Superop{OPCODE::name, length, {__VA_ARGS__}},
+static constexpr size_t kNumSuperops = 0 FV1_SUPEROPS(FV1_SUPEROP_COUNT);
+static constexpr std::array<Superop, kNumSuperops> kSuperops = {{FV1_SUPEROPS(FV1_SUPEROP_ENTRY)}};
+#undef FV1_SUPEROP_ENTRY
+#undef FV1_SUPEROP_COUNT
+
+// For switch statements that have to list all opcodes
+#define FV1_SUPEROP_CASE(name, ...) case OPCODE::name:
+
+enum SKP_FLAGS : int32_t {
+  NEG = 0x01,  // If ACC is negative
+  GEZ = 0x02,  // If ACC is greater than or equal to zero
+  ZRO = 0x04,  // If ACC is zero
+  ZRC = 0x08,  // If the sign of ACC and PACC are different
+  RUN = 0x10,  // Set after first program execution
+};
+
+enum CHO_SEL : int32_t {
+  SIN0 = 0x00,
+  SIN1 = 0x01,
+  RMP0 = 0x02,
+  RMP1 = 0x03,
+};
+static constexpr int32_t CHO_SEL_MASK = 0x3;
+
+enum CHO_FLAGS : int32_t {
+  SIN = 0x00,
+  COS = 0x01,
+  REG = 0x02,
+  COMPC = 0x04,
+  COMPA = 0x08,
+  RPTR2 = 0x10,
+  NA = 0x20,
+};
+
+}  // namespace fv1
+
+#endif  // FV1_OPCODES_H_
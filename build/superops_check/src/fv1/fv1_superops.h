@@ -0,0 +1,36 @@
+// fv1vm: experimental FV-1 virtual machine
+// Copyright (C) 2022 Patrick Dowling <pld@gurkenkiste.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef FV1_SUPEROPS_H_
+#define FV1_SUPEROPS_H_
+
+// Generated by fv1_superops from 33 programs in ./build/tests, don't edit.
+//
+// X(name, mnemonic, length, opcodes...) for each superinstruction, longest
+// first. The handlers are in vm/vm_execute_superops.h.
+#define FV1_SUPEROPS(X)                                                                          \
+  X(SUPER_0, "wrax clr+cho rdal+wrax clr", 3, OPCODE::WRAX_CLR, OPCODE::CHO_RDAL,                \
+    OPCODE::WRAX_CLR)                                                                            \
+  X(SUPER_1, "cho rda sin+cho rda sin+cho rda sin", 3, OPCODE::CHO_RDA_SIN, OPCODE::CHO_RDA_SIN, \
+    OPCODE::CHO_RDA_SIN)                                                                         \
+  X(SUPER_2, "ldax+mulx+wrax clr", 3, OPCODE::LDAX, OPCODE::MULX, OPCODE::WRAX_CLR)              \
+  X(SUPER_3, "wrax clr+ldax", 2, OPCODE::WRAX_CLR, OPCODE::LDAX)                                 \
+  X(SUPER_4, "cho rdal+wrax clr", 2, OPCODE::CHO_RDAL, OPCODE::WRAX_CLR)                         \
+  X(SUPER_5, "allpass+allpass", 2, OPCODE::ALLPASS, OPCODE::ALLPASS)                             \
+  X(SUPER_6, "wrax clr+rdax add", 2, OPCODE::WRAX_CLR, OPCODE::RDAX_ADD)                         \
+  X(SUPER_7, "wrax clr+rdax nosat", 2, OPCODE::WRAX_CLR, OPCODE::RDAX_NOSAT)
+
+#endif  // FV1_SUPEROPS_H_
@@ -0,0 +1,61 @@
+// fv1vm: experimental FV-1 virtual machine
+// Copyright (C) 2022 Patrick Dowling <pld@gurkenkiste.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef FV1_CPP_GENERATOR_H_
+#define FV1_CPP_GENERATOR_H_
+
+#include <string>
+
+#include "vm/codegen/codegen_runtime.h"
+#include "vm/engines/delay_i32.h"
+#include "vm/engines/engine_i32_v1.h"
+
+namespace fv1 {
+namespace codegen {
+
+using RuntimeI32 = Runtime<engine::EngineI32, engine::DelayStorageI32>;
+
+// Ahead-of-time translation of byte code into C++.
+//
+// Program translates the VM's instructions as they are after lowering and the peephole pass, i.e.
+// all kMaxInstructionCount of them with SKP RUN still in place; the later passes that produce the
+// init/steady programs (stripping the init code, micro-ops, dataflow, superinstructions) are left
+// to the C++ compiler. Bytecode on the other hand writes the optimized programs.
+//
+// Each program becomes a straight-line function with the signature of RuntimeI32::ProgramFn. The
+// body uses the same expressions as the interpreter, but with constant operands, jumps as gotos,
+// program registers as locals and only the LFOs that are read get ticked. So the output is
+// bit-exact with the interpreter, and the C++ compiler gets to do the rest.
+class CppGenerator {
+public:
+  using VM = RuntimeI32::VM;
+
+  // Includes etc. required once per generated file
+  static std::string Preamble();
+
+  // Generate function `name` for the program currently compiled into the vm
+  static std::string Program(const VM &vm, const std::string &name);
+
+  // Generate the byte code of the program currently compiled into the vm as constexpr tables and
+  // a VM::PrecompiledProgram `name` (see VM::Load, VM::Execute). Superinstructions are written as
+  // their first instruction, so the tables don't depend on the generated superinstruction set.
+  static std::string Bytecode(const VM &vm, const std::string &name);
+};
+
+}  // namespace codegen
+}  // namespace fv1
+
+#endif  // FV1_CPP_GENERATOR_H_
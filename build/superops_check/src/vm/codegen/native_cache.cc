@@ -0,0 +1,226 @@
+// fv1vm: experimental FV-1 virtual machine
+// Copyright (C) 2022 Patrick Dowling <pld@gurkenkiste.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "native_cache.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+
+#include "misc/program_stream.h"
+
+#ifdef FV1_NATIVE_CACHE
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <sstream>
+
+extern char **environ;
+#endif
+
+namespace fv1 {
+namespace codegen {
+
+// Name of the generated function, and the extern "C" accessor that's looked up after loading
+static constexpr const char *kProgramName = "fv1_native";
+static constexpr const char *kEntryName = "fv1_native_program";
+
+static uint64_t FNV1a(uint64_t hash, const void *data, size_t length)
+{
+  auto bytes = static_cast<const uint8_t *>(data);
+  for (size_t i = 0; i < length; ++i) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+#ifdef FV1_NATIVE_CACHE
+static uint64_t FNV1aFile(uint64_t hash, const std::string &path)
+{
+  FILE *f = fopen(path.c_str(), "rb");
+  if (!f) return hash;
+  char buffer[1024];
+  size_t length = 0;
+  while ((length = fread(buffer, 1, sizeof(buffer), f)) > 0) hash = FNV1a(hash, buffer, length);
+  fclose(f);
+  return hash;
+}
+#endif
+
+// The object inlines the runtime, delay memory, LFOs etc. so any header it might include counts.
+// They're only read once, rather than for every program compiled.
+static uint64_t HashHeaders(const std::string &include_dir)
+{
+  uint64_t hash = 0xcbf29ce484222325ULL;
+#ifdef FV1_NATIVE_CACHE
+  std::vector<std::string> headers;
+  std::error_code ec;
+  for (std::filesystem::recursive_directory_iterator it{include_dir, ec}, end; !ec && it != end;
+       it.increment(ec)) {
+    if (".h" == it->path().extension()) headers.push_back(it->path().string());
+  }
+  std::sort(headers.begin(), headers.end());
+  for (const auto &header : headers) {
+    hash = FNV1a(hash, header.data(), header.size());
+    hash = FNV1aFile(hash, header);
+  }
+#else
+  (void)include_dir;
+#endif
+  return hash;
+}
+
+NativeCache::NativeCache(const Options &options)
+    : options_{options}, headers_hash_{HashHeaders(options.include_dir)}
+{}
+
+uint64_t NativeCache::Hash(const std::string &code) const
+{
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  hash = FNV1a(hash, code.data(), code.size());
+  hash = FNV1a(hash, options_.compiler.data(), options_.compiler.size());
+  hash = FNV1a(hash, options_.flags.data(), options_.flags.size());
+  return FNV1a(hash, &headers_hash_, sizeof(headers_hash_));
+}
+
+std::string NativeCache::Source(const VM &vm)
+{
+  auto code = CppGenerator::Preamble() + CppGenerator::Program(vm, kProgramName);
+  code += std::string{"extern \"C\" Runtime::ProgramFn "} + kEntryName + "();\n";
+  code += std::string{"Runtime::ProgramFn "} + kEntryName + "() { return " + kProgramName + "; }\n";
+  return code;
+}
+
+#ifdef FV1_NATIVE_CACHE
+
+NativeCache::~NativeCache()
+{
+  for (auto handle : handles_) dlclose(handle);
+}
+
+bool NativeCache::Compile(VM &vm, const char *program)
+{
+  BufferStream<BSWAP_ENABLE> stream{program};
+  vm.Compile(stream);
+
+  const auto code = Source(vm);
+  char filename[32];
+  snprintf(filename, sizeof(filename), "fv1_%016" PRIx64 ".so", Hash(code));
+  auto path = options_.directory + "/" + filename;
+
+  auto native_program = Load(path);
+  if (native_program) {
+    ++hits_;
+  } else {
+    ++misses_;
+    if (Build(code, path)) native_program = Load(path);
+  }
+
+  vm.set_native_program(native_program);
+  return nullptr != native_program;
+}
+
+NativeCache::VM::NativeProgramFn NativeCache::Load(const std::string &path)
+{
+  if (access(path.c_str(), R_OK)) return nullptr;
+
+  auto handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+  if (!handle) return nullptr;
+
+  using EntryFn = VM::NativeProgramFn (*)();
+  auto entry = reinterpret_cast<EntryFn>(dlsym(handle, kEntryName));
+  if (!entry) {
+    dlclose(handle);
+    return nullptr;
+  }
+  handles_.push_back(handle);
+  return entry();
+}
+
+// Build into temporary files first so concurrent processes don't see partial results
+bool NativeCache::Build(const std::string &code, const std::string &path) const
+{
+  std::error_code ec;
+  std::filesystem::create_directories(options_.directory, ec);
+  if (ec) return false;
+
+  auto tmp = path + "." + std::to_string(getpid());
+  auto source = tmp + ".cc";
+  auto log = tmp + ".log";
+  FILE *f = fopen(source.c_str(), "w");
+  if (!f) return false;
+  bool written = code.size() == fwrite(code.data(), 1, code.size(), f);
+  fclose(f);
+
+  bool success = false;
+  if (written) {
+    // The compiler is run directly rather than through the shell, so paths can contain anything;
+    // compiler and flags are split on whitespace.
+    std::vector<std::string> args;
+    std::istringstream command{options_.compiler + " " + options_.flags};
+    for (std::string arg; command >> arg;) args.push_back(arg);
+    for (auto arg : {"-shared", "-fPIC"}) args.push_back(arg);
+    args.push_back("-I" + options_.include_dir);
+    for (auto arg : {std::string{"-o"}, tmp, source}) args.push_back(arg);
+    std::vector<char *> argv;
+    for (auto &arg : args) argv.push_back(arg.data());
+    argv.push_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, log.c_str(),
+                                     O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    pid_t pid = 0;
+    int status = 0;
+    success = 0 == posix_spawnp(&pid, argv[0], &actions, nullptr, argv.data(), environ) &&
+              pid == waitpid(pid, &status, 0) && WIFEXITED(status) && 0 == WEXITSTATUS(status);
+    posix_spawn_file_actions_destroy(&actions);
+    if (success) {
+      std::filesystem::rename(tmp, path, ec);
+      success = !ec;
+    }
+  }
+
+  std::filesystem::remove(tmp, ec);
+  if (success) {
+    std::filesystem::remove(source, ec);
+    std::filesystem::remove(log, ec);
+  }
+  return success;
+}
+
+#else
+
+NativeCache::~NativeCache() {}
+
+bool NativeCache::Compile(VM &vm, const char *program)
+{
+  BufferStream<BSWAP_ENABLE> stream{program};
+  vm.Compile(stream);
+  ++misses_;
+  return false;
+}
+
+#endif  // FV1_NATIVE_CACHE
+
+}  // namespace codegen
+}  // namespace fv1
@@ -0,0 +1,945 @@
+// fv1vm: experimental FV-1 virtual machine
+// Copyright (C) 2022 Patrick Dowling <pld@gurkenkiste.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "jit_x64.h"
+
+#ifdef FV1_JIT_X64
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <memory>
+#endif
+
+namespace fv1 {
+namespace jit {
+
+#ifdef FV1_JIT_X64
+
+static_assert(sizeof(engine::EngineI32::Register) == sizeof(int32_t));
+static_assert(sizeof(engine::DelayStorageI32::storage_type) == sizeof(int32_t));
+
+static constexpr size_t kCodeBufferSize = 64 * 1024;
+
+// Just enough of an x86-64 assembler for the code below. Only 32-bit operations unless noted.
+class Emitter {
+public:
+  enum Reg : int { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+  enum Cond : uint8_t { O, NO, B, AE, Z, NZ, BE, A, S, NS, P, NP, L, GE, LE, G };
+  enum Alu : uint8_t { ADD = 0, OR = 1, AND = 4, SUB = 5, XOR = 6, CMP = 7 };
+
+  Emitter(uint8_t *buffer, size_t size) : buffer_{buffer}, size_{size} {}
+
+  size_t pos() const { return pos_; }
+  bool overflow() const { return overflow_; }
+
+  void mov(Reg dst, Reg src) { op_rr(0x89, src, dst); }
+  void mov64(Reg dst, Reg src) { op_rr(0x89, src, dst, true); }
+  void mov(Reg dst, Reg base, int32_t disp) { op_mem(0x8b, dst, base, disp); }
+  void mov64(Reg dst, Reg base, int32_t disp) { op_mem(0x8b, dst, base, disp, true); }
+  void mov(Reg base, int32_t disp, Reg src) { op_mem(0x89, src, base, disp); }
+  void load_idx(Reg dst, Reg base, Reg index) { op_sib(0x8b, dst, base, index); }
+  void store_idx(Reg base, Reg index, Reg src) { op_sib(0x89, src, base, index); }
+  void mov(Reg dst, int32_t imm)
+  {
+    rex(false, 0, 0, dst);
+    byte(0xb8 + (dst & 7));
+    dword(static_cast<uint32_t>(imm));
+  }
+  void mov64(Reg dst, uint64_t imm)
+  {
+    rex(true, 0, 0, dst);
+    byte(0xb8 + (dst & 7));
+    dword(static_cast<uint32_t>(imm));
+    dword(static_cast<uint32_t>(imm >> 32));
+  }
+  void movsxd(Reg dst, Reg src)
+  {
+    rex(true, dst, 0, src);
+    byte(0x63);
+    modrm(3, dst, src);
+  }
+
+  void alu(Alu op, Reg dst, Reg src) { op_rr(static_cast<uint8_t>(op << 3 | 0x01), src, dst); }
+  void alu(Alu op, Reg dst, int32_t imm)
+  {
+    rex(false, 0, 0, dst);
+    byte(0x81);
+    modrm(3, op, dst);
+    dword(static_cast<uint32_t>(imm));
+  }
+  void add(Reg dst, Reg base, int32_t disp) { op_mem(0x03, dst, base, disp); }
+  void test(Reg a, Reg b) { op_rr(0x85, b, a); }
+  void test(Reg dst, int32_t imm)
+  {
+    rex(false, 0, 0, dst);
+    byte(0xf7);
+    modrm(3, 0, dst);
+    dword(static_cast<uint32_t>(imm));
+  }
+  void neg(Reg dst) { unary(3, dst); }
+  void bitnot(Reg dst) { unary(2, dst); }
+  void shl(Reg dst, uint8_t imm) { shift(false, 4, dst, imm); }
+  void sar(Reg dst, uint8_t imm) { shift(false, 7, dst, imm); }
+  void sar64(Reg dst, uint8_t imm) { shift(true, 7, dst, imm); }
+  void shr64(Reg dst, uint8_t imm) { shift(true, 5, dst, imm); }
+  void imul64(Reg dst, Reg src)
+  {
+    rex(true, dst, 0, src);
+    byte(0x0f);
+    byte(0xaf);
+    modrm(3, dst, src);
+  }
+  void imul64(Reg dst, Reg src, int32_t imm)
+  {
+    rex(true, dst, 0, src);
+    byte(0x69);
+    modrm(3, dst, src);
+    dword(static_cast<uint32_t>(imm));
+  }
+  void cmov(Cond cc, Reg dst, Reg src)
+  {
+    rex(false, dst, 0, src);
+    byte(0x0f);
+    byte(0x40 + cc);
+    modrm(3, dst, src);
+  }
+  void cmp8(Reg base, int32_t disp, uint8_t imm)
+  {
+    rex(false, 0, 0, base);
+    byte(0x80);
+    mem(7, base, disp);
+    byte(imm);
+  }
+
+  // Branches are always rel32 and return the position to patch
+  size_t jmp()
+  {
+    byte(0xe9);
+    return rel32();
+  }
+  size_t jcc(Cond cc)
+  {
+    byte(0x0f);
+    byte(0x80 + cc);
+    return rel32();
+  }
+  void patch(size_t at, size_t target)
+  {
+    if (at + 4 > size_) return;
+    auto rel = static_cast<int32_t>(static_cast<int64_t>(target) - static_cast<int64_t>(at + 4));
+    for (int i = 0; i < 4; ++i) buffer_[at + i] = static_cast<uint8_t>(rel >> (i * 8));
+  }
+
+  void call(Reg reg)
+  {
+    rex(false, 0, 0, reg);
+    byte(0xff);
+    modrm(3, 2, reg);
+  }
+  void push(Reg reg)
+  {
+    rex(false, 0, 0, reg);
+    byte(0x50 + (reg & 7));
+  }
+  void pop(Reg reg)
+  {
+    rex(false, 0, 0, reg);
+    byte(0x58 + (reg & 7));
+  }
+  void add_rsp(int8_t imm) { rsp_imm8(0, imm); }
+  void sub_rsp(int8_t imm) { rsp_imm8(5, imm); }
+  void ret() { byte(0xc3); }
+
+private:
+  uint8_t *buffer_;
+  const size_t size_;
+  size_t pos_ = 0;
+  bool overflow_ = false;
+
+  void byte(int b)
+  {
+    if (pos_ < size_)
+      buffer_[pos_++] = static_cast<uint8_t>(b);
+    else
+      overflow_ = true;
+  }
+  void dword(uint32_t d)
+  {
+    for (int i = 0; i < 4; ++i) byte(static_cast<uint8_t>(d >> (i * 8)));
+  }
+  size_t rel32()
+  {
+    auto at = pos_;
+    dword(0);
+    return at;
+  }
+
+  void rex(bool w, int reg, int index, int base)
+  {
+    int r = 0x40 | (w << 3) | ((reg & 8) >> 1) | ((index & 8) >> 2) | ((base & 8) >> 3);
+    if (0x40 != r) byte(r);
+  }
+  void modrm(int mod, int reg, int rm) { byte((mod << 6) | ((reg & 7) << 3) | (rm & 7)); }
+  // [base + disp32]
+  void mem(int reg, Reg base, int32_t disp)
+  {
+    modrm(2, reg, base);
+    if (4 == (base & 7)) byte(0x24);
+    dword(static_cast<uint32_t>(disp));
+  }
+
+  void op_rr(uint8_t opcode, Reg reg, Reg rm, bool w = false)
+  {
+    rex(w, reg, 0, rm);
+    byte(opcode);
+    modrm(3, reg, rm);
+  }
+  void op_mem(uint8_t opcode, Reg reg, Reg base, int32_t disp, bool w = false)
+  {
+    rex(w, reg, 0, base);
+    byte(opcode);
+    mem(reg, base, disp);
+  }
+  // [base + index * 4]
+  void op_sib(uint8_t opcode, Reg reg, Reg base, Reg index)
+  {
+    rex(false, reg, index, base);
+    byte(opcode);
+    modrm(1, reg, 4);
+    byte((2 << 6) | ((index & 7) << 3) | (base & 7));
+    byte(0);
+  }
+  void unary(int ext, Reg dst)
+  {
+    rex(false, 0, 0, dst);
+    byte(0xf7);
+    modrm(3, ext, dst);
+  }
+  void shift(bool w, int ext, Reg dst, uint8_t imm)
+  {
+    rex(w, 0, 0, dst);
+    byte(0xc1);
+    modrm(3, ext, dst);
+    byte(imm);
+  }
+  void rsp_imm8(int ext, int8_t imm)
+  {
+    rex(true, 0, 0, RSP);
+    byte(0x83);
+    modrm(3, ext, RSP);
+    byte(static_cast<uint8_t>(imm));
+  }
+};
+
+// Turns the compiled instructions into a function that runs one frame.
+//
+// Register usage:
+// RBX = context, RBP = registers, R15 = delay memory, R11 = delay cursor
+// R12 = ACC, R13 = PACC, R14 = previous ACC
+// R8-R10 = cached registers
+// RAX, RCX, RDX, RSI, RDI = scratch
+//
+// R8-R11 are caller-saved so they are spilled/reloaded around calls into C++.
+class CodeGenerator {
+public:
+  using VM = JitEngine::VM;
+  using Context = JitEngine::Context;
+  using CompiledInstruction = VM::CompiledInstruction;
+  using Reg = Emitter::Reg;
+
+  static constexpr Reg CTX = Emitter::RBX;
+  static constexpr Reg REGS = Emitter::RBP;
+  static constexpr Reg DELAY = Emitter::R15;
+  static constexpr Reg CURSOR = Emitter::R11;
+  static constexpr Reg ACC = Emitter::R12;
+  static constexpr Reg PACC = Emitter::R13;
+  static constexpr Reg PREV = Emitter::R14;
+  static constexpr std::array<Reg, 3> kCacheRegs = {Emitter::R8, Emitter::R9, Emitter::R10};
+
+  CodeGenerator(const VM &vm, uint8_t *buffer, size_t size) : vm_{vm}, e_{buffer, size} {}
+
+  // Returns generated size, or 0 on failure
+  size_t Generate()
+  {
+    AllocateRegisters();
+    FindJumpTargets();
+
+    Prologue();
+    int quiet_run = 0;
+    for (int32_t ic = 0; ic < kMaxInstructionCount; ++ic) {
+      labels_[ic] = e_.pos();
+      const auto &instruction = vm_.get_instruction(ic);
+      // In a run of instructions that don't touch ACC, the PACC update settles after two steps
+      // (PACC = previous ACC = ACC) so the rest of the run can be dropped.
+      if (jump_target_[ic] || !IsQuiet(instruction.get_opcode())) quiet_run = 0;
+      if (IsQuiet(instruction.get_opcode()) && quiet_run++ >= 2) continue;
+      if (!Emit(instruction, ic)) return 0;
+    }
+    labels_[kMaxInstructionCount] = e_.pos();
+    Epilogue();
+
+    for (size_t i = 0; i < num_fixups_; ++i) e_.patch(fixups_[i].at, labels_[fixups_[i].target]);
+    return e_.overflow() ? 0 : e_.pos();
+  }
+
+private:
+  struct Fixup {
+    size_t at;
+    int32_t target;
+  };
+
+  const VM &vm_;
+  Emitter e_;
+
+  std::array<int32_t, kNumRegisters> cached_;  // FV-1 register -> index into kCacheRegs or -1
+  std::array<bool, kMaxInstructionCount + 1> jump_target_ = {};
+  std::array<size_t, kMaxInstructionCount + 1> labels_ = {};
+  std::array<Fixup, kMaxInstructionCount> fixups_;
+  size_t num_fixups_ = 0;
+
+  static constexpr int32_t ctx(size_t offset) { return static_cast<int32_t>(offset); }
+  static constexpr int32_t reg_offset(int32_t r)
+  {
+    return r * static_cast<int32_t>(sizeof(int32_t));
+  }
+
+  static bool IsQuiet(OPCODE opcode)
+  {
+    switch (opcode) {
+      case OPCODE::LOG:
+      case OPCODE::EXP:
+      case OPCODE::CHO_RDA:
+      case OPCODE::CHO_SOF:
+      case OPCODE::NOP:
+      case OPCODE::UNKNOWN:
+      case OPCODE::REAL_OPCODES_LAST: return true;
+      default: return false;
+    }
+  }
+
+  static bool HasRegisterOperand(OPCODE opcode)
+  {
+    switch (opcode) {
+      case OPCODE::RDAX:
+      case OPCODE::RDFX:
+      case OPCODE::WRAX:
+      case OPCODE::WRHX:
+      case OPCODE::WRLX:
+      case OPCODE::MAXX:
+      case OPCODE::MULX:
+      case OPCODE::LDAX: return true;
+      default: return false;
+    }
+  }
+
+  // Cache the most used registers. The LFO registers are excluded since they are accessed by the
+  // C++ callbacks (and Tick).
+  void AllocateRegisters()
+  {
+    std::array<int32_t, kNumRegisters> counts = {};
+    for (int32_t ic = 0; ic < kMaxInstructionCount; ++ic) {
+      const auto &instruction = vm_.get_instruction(ic);
+      if (HasRegisterOperand(instruction.get_opcode()))
+        ++counts[instruction.constants[0].loadi() & (kNumRegisters - 1)];
+      else if (OPCODE::RMPA == instruction.get_opcode())
+        ++counts[ADDR_PTR];
+    }
+    for (int32_t r = 0; r < POT0; ++r) counts[r] = 0;
+
+    cached_.fill(-1);
+    for (size_t i = 0; i < kCacheRegs.size(); ++i) {
+      auto max = std::max_element(counts.begin(), counts.end());
+      if (*max < 2) break;
+      cached_[max - counts.begin()] = static_cast<int32_t>(i);
+      *max = 0;
+    }
+  }
+
+  void FindJumpTargets()
+  {
+    jump_target_.fill(false);
+    jump_target_[0] = true;
+    for (int32_t ic = 0; ic < kMaxInstructionCount; ++ic) {
+      const auto &instruction = vm_.get_instruction(ic);
+      auto opcode = instruction.get_opcode();
+      if (OPCODE::SKP == opcode || OPCODE::JMP == opcode)
+        jump_target_[Target(instruction, ic)] = true;
+    }
+    num_fixups_ = 0;
+  }
+
+  static int32_t Target(const CompiledInstruction &instruction, int32_t ic)
+  {
+    return std::min(ic + 1 + instruction.constants[1].loadi(), kMaxInstructionCount);
+  }
+
+  // At most one SKP/JMP per instruction
+  void Branch(size_t at, int32_t target) { fixups_[num_fixups_++] = {at, target}; }
+
+  void LoadRegister(Reg dst, int32_t r)
+  {
+    if (cached_[r] >= 0)
+      e_.mov(dst, kCacheRegs[cached_[r]]);
+    else
+      e_.mov(dst, REGS, reg_offset(r));
+  }
+
+  void StoreRegister(int32_t r, Reg src)
+  {
+    if (cached_[r] >= 0)
+      e_.mov(kCacheRegs[cached_[r]], src);
+    else
+      e_.mov(REGS, reg_offset(r), src);
+  }
+
+  void SpillRegisters()
+  {
+    for (int32_t r = 0; r < static_cast<int32_t>(kNumRegisters); ++r)
+      if (cached_[r] >= 0) e_.mov(REGS, reg_offset(r), kCacheRegs[cached_[r]]);
+  }
+
+  void ReloadRegisters()
+  {
+    for (int32_t r = 0; r < static_cast<int32_t>(kNumRegisters); ++r)
+      if (cached_[r] >= 0) e_.mov(kCacheRegs[cached_[r]], REGS, reg_offset(r));
+  }
+
+  // RAX = (int64_t)EAX * c >> 23, i.e. SF23 * SF23
+  void MulConstant(int32_t c)
+  {
+    e_.movsxd(Emitter::RAX, Emitter::RAX);
+    e_.imul64(Emitter::RAX, Emitter::RAX, c);
+    e_.sar64(Emitter::RAX, 23);
+  }
+
+  // RAX = (int64_t)EAX * ECX >> 23
+  void MulRCX()
+  {
+    e_.movsxd(Emitter::RAX, Emitter::RAX);
+    e_.movsxd(Emitter::RCX, Emitter::RCX);
+    e_.imul64(Emitter::RAX, Emitter::RCX);
+    e_.sar64(Emitter::RAX, 23);
+  }
+
+  // core::SSAT<SF23>, clobbers ECX
+  void Saturate()
+  {
+    e_.mov(Emitter::RCX, SF23::MAX);
+    e_.alu(Emitter::CMP, Emitter::RAX, Emitter::RCX);
+    e_.cmov(Emitter::G, Emitter::RAX, Emitter::RCX);
+    e_.mov(Emitter::RCX, SF23::MIN);
+    e_.alu(Emitter::CMP, Emitter::RAX, Emitter::RCX);
+    e_.cmov(Emitter::L, Emitter::RAX, Emitter::RCX);
+  }
+
+  void StoreAcc()
+  {
+    Saturate();
+    e_.mov(ACC, Emitter::RAX);
+  }
+
+  // core::SX<SF23>
+  void SignExtend()
+  {
+    e_.shl(Emitter::RAX, 32 - SF23::BITS);
+    e_.sar(Emitter::RAX, 32 - SF23::BITS);
+  }
+
+  // core::ABS, clobbers EDX
+  void Abs(Reg reg)
+  {
+    e_.mov(Emitter::RDX, reg);
+    e_.neg(reg);
+    e_.cmov(Emitter::S, reg, Emitter::RDX);
+  }
+
+  // EDX = (cursor + EDX|addr) & mask
+  void DelayIndex(int32_t addr)
+  {
+    e_.mov(Emitter::RDX, CURSOR);
+    if (addr) e_.alu(Emitter::ADD, Emitter::RDX, addr);
+    e_.alu(Emitter::AND, Emitter::RDX, kDelayAddrMask);
+  }
+
+  // EAX = delay[EDX], updates last_read
+  void DelayLoad()
+  {
+    e_.load_idx(Emitter::RAX, DELAY, Emitter::RDX);
+    e_.mov(CTX, ctx(offsetof(Context, last_read)), Emitter::RAX);
+  }
+
+  template <typename Fn, typename... Args>
+  void Call(Fn fn, Args... args)
+  {
+    static_assert(sizeof...(Args) <= 3);
+    SpillRegisters();
+    e_.mov64(Emitter::RDI, CTX);
+    const Reg arg_regs[] = {Emitter::RSI, Emitter::RDX, Emitter::RCX};
+    size_t i = 0;
+    ((e_.mov(arg_regs[i++], args)), ...);
+    e_.mov64(Emitter::RAX, reinterpret_cast<uint64_t>(fn));
+    e_.call(Emitter::RAX);
+    ReloadRegisters();
+    e_.mov(CURSOR, CTX, ctx(offsetof(Context, cursor)));
+  }
+
+  // Result from Read*Lfo: EAX = offset, ECX = coefficient
+  void UnpackLfoValue()
+  {
+    e_.mov64(Emitter::RCX, Emitter::RAX);
+    e_.shr64(Emitter::RCX, 32);
+  }
+
+  // pacc = prev_acc; prev_acc = acc
+  void UpdatePacc()
+  {
+    e_.mov(PACC, PREV);
+    e_.mov(PREV, ACC);
+  }
+
+  void Prologue()
+  {
+    for (auto reg : {Emitter::RBX, Emitter::RBP, Emitter::R12, Emitter::R13, Emitter::R14,
+                     Emitter::R15})
+      e_.push(reg);
+    e_.sub_rsp(8);  // 16 byte stack alignment for calls
+
+    e_.mov64(CTX, Emitter::RDI);
+    e_.mov64(REGS, CTX, ctx(offsetof(Context, registers)));
+    e_.mov64(DELAY, CTX, ctx(offsetof(Context, delay)));
+    e_.mov(CURSOR, CTX, ctx(offsetof(Context, cursor)));
+    e_.mov(ACC, CTX, ctx(offsetof(Context, acc)));
+    e_.mov(PACC, CTX, ctx(offsetof(Context, pacc)));
+    e_.mov(PREV, CTX, ctx(offsetof(Context, prev_acc)));
+    ReloadRegisters();
+  }
+
+  void Epilogue()
+  {
+    SpillRegisters();
+    e_.mov(CTX, ctx(offsetof(Context, acc)), ACC);
+    e_.mov(CTX, ctx(offsetof(Context, pacc)), PACC);
+    e_.mov(CTX, ctx(offsetof(Context, prev_acc)), PREV);
+
+    e_.add_rsp(8);
+    for (auto reg : {Emitter::R15, Emitter::R14, Emitter::R13, Emitter::R12, Emitter::RBP,
+                     Emitter::RBX})
+      e_.pop(reg);
+    e_.ret();
+  }
+
+  bool Emit(const CompiledInstruction &instruction, int32_t ic)
+  {
+    using E = Emitter;
+    const auto c0 = instruction.constants[0].loadi();
+    const auto c1 = instruction.constants[1].loadi();
+    const auto c2 = instruction.constants[2].loadi();
+
+    switch (instruction.get_opcode()) {
+      case OPCODE::RDA:
+        DelayIndex(c0);
+        DelayLoad();
+        MulConstant(c1);
+        e_.alu(E::ADD, E::RAX, ACC);
+        StoreAcc();
+        break;
+
+      case OPCODE::RMPA:
+        LoadRegister(E::RDX, ADDR_PTR);
+        e_.sar(E::RDX, 8);
+        e_.alu(E::ADD, E::RDX, CURSOR);
+        e_.alu(E::AND, E::RDX, kDelayAddrMask);
+        DelayLoad();
+        MulConstant(c0);
+        e_.alu(E::ADD, E::RAX, ACC);
+        StoreAcc();
+        break;
+
+      case OPCODE::WRA:
+        DelayIndex(c0);
+        e_.store_idx(DELAY, E::RDX, ACC);
+        e_.mov(E::RAX, ACC);
+        MulConstant(c1);
+        StoreAcc();
+        break;
+
+      case OPCODE::WRAP:
+        DelayIndex(c0);
+        e_.store_idx(DELAY, E::RDX, ACC);
+        e_.mov(E::RAX, ACC);
+        MulConstant(c1);
+        e_.add(E::RAX, CTX, ctx(offsetof(Context, last_read)));
+        StoreAcc();
+        break;
+
+      case OPCODE::RDAX:
+        LoadRegister(E::RAX, c0);
+        MulConstant(c1);
+        e_.alu(E::ADD, E::RAX, ACC);
+        StoreAcc();
+        break;
+
+      case OPCODE::RDFX:
+        LoadRegister(E::RDX, c0);
+        e_.mov(E::RAX, ACC);
+        e_.alu(E::SUB, E::RAX, E::RDX);
+        MulConstant(c1);
+        e_.alu(E::ADD, E::RAX, E::RDX);
+        StoreAcc();
+        break;
+
+      case OPCODE::WRAX:
+        StoreRegister(c0, ACC);
+        e_.mov(E::RAX, ACC);
+        MulConstant(c1);
+        StoreAcc();
+        break;
+
+      case OPCODE::WRHX:
+        StoreRegister(c0, ACC);
+        e_.mov(E::RAX, ACC);
+        MulConstant(c1);
+        e_.alu(E::ADD, E::RAX, PACC);
+        StoreAcc();
+        break;
+
+      case OPCODE::WRLX:
+        StoreRegister(c0, ACC);
+        e_.mov(E::RAX, PACC);
+        e_.alu(E::SUB, E::RAX, ACC);
+        MulConstant(c1);
+        e_.alu(E::ADD, E::RAX, PACC);
+        StoreAcc();
+        break;
+
+      case OPCODE::MAXX:
+        LoadRegister(E::RAX, c0);
+        MulConstant(c1);
+        Abs(E::RAX);
+        e_.mov(E::RCX, ACC);
+        Abs(E::RCX);
+        e_.alu(E::CMP, E::RAX, E::RCX);
+        e_.cmov(E::LE, E::RAX, E::RCX);
+        StoreAcc();
+        break;
+
+      case OPCODE::MULX:
+        LoadRegister(E::RCX, c0);
+        e_.mov(E::RAX, ACC);
+        MulRCX();
+        StoreAcc();
+        break;
+
+      case OPCODE::SOF:
+        e_.mov(E::RAX, ACC);
+        MulConstant(c0);
+        if (c1) e_.alu(E::ADD, E::RAX, c1);
+        StoreAcc();
+        break;
+
+      case OPCODE::AND:
+      case OPCODE::OR:
+      case OPCODE::XOR: {
+        static constexpr E::Alu ops[] = {E::AND, E::OR, E::XOR};
+        e_.mov(E::RAX, ACC);
+        e_.alu(ops[static_cast<int>(instruction.get_opcode()) - static_cast<int>(OPCODE::AND)],
+               E::RAX, c0);
+        SignExtend();
+        e_.mov(ACC, E::RAX);
+      } break;
+
+      case OPCODE::NOT:
+        e_.mov(E::RAX, ACC);
+        e_.bitnot(E::RAX);
+        SignExtend();
+        e_.mov(ACC, E::RAX);
+        break;
+
+      case OPCODE::CLR: e_.alu(E::XOR, ACC, ACC); break;
+
+      case OPCODE::ABSA:
+        e_.mov(E::RAX, ACC);
+        Abs(E::RAX);
+        StoreAcc();
+        break;
+
+      case OPCODE::LDAX: LoadRegister(ACC, c0); break;
+
+      case OPCODE::SKP: {
+        // All conditions must be met, evaluated before the PACC update
+        size_t no_skip[5];
+        size_t num_no_skip = 0;
+        if (SKP_FLAGS::NEG & c0) {
+          e_.test(ACC, ACC);
+          no_skip[num_no_skip++] = e_.jcc(E::NS);
+        }
+        if (SKP_FLAGS::GEZ & c0) {
+          e_.test(ACC, ACC);
+          no_skip[num_no_skip++] = e_.jcc(E::S);
+        }
+        if (SKP_FLAGS::ZRO & c0) {
+          e_.test(ACC, ACC);
+          no_skip[num_no_skip++] = e_.jcc(E::NZ);
+        }
+        if (SKP_FLAGS::ZRC & c0) {
+          e_.mov(E::RAX, ACC);
+          e_.alu(E::XOR, E::RAX, PACC);
+          no_skip[num_no_skip++] = e_.jcc(E::NS);
+        }
+        if (SKP_FLAGS::RUN & c0) {
+          e_.cmp8(CTX, ctx(offsetof(Context, first_run)), 0);
+          no_skip[num_no_skip++] = e_.jcc(E::NZ);
+        }
+        UpdatePacc();
+        Branch(e_.jmp(), Target(instruction, ic));
+        auto next = e_.pos();
+        for (size_t i = 0; i < num_no_skip; ++i) e_.patch(no_skip[i], next);
+        UpdatePacc();
+        return true;
+      }
+
+      case OPCODE::JMP:
+        UpdatePacc();
+        Branch(e_.jmp(), Target(instruction, ic));
+        return true;
+
+      case OPCODE::WLDS:
+        Call(&JitEngine::Wlds, c0, c1, c2);
+        break;
+
+      case OPCODE::WLDR:
+        Call(&JitEngine::Wldr, c0, c1, c2);
+        break;
+
+      case OPCODE::JAM: Call(&JitEngine::Jam, c0); break;
+
+      case OPCODE::CHO_RDAL:
+        Call(&JitEngine::ReadLfo, c0);
+        StoreAcc();
+        break;
+
+      case OPCODE::CHO_RDA_RMP:
+      case OPCODE::CHO_RDA_SIN:
+        Call(OPCODE::CHO_RDA_RMP == instruction.get_opcode()
+                 ? &JitEngine::ReadRampLfo
+                 : &JitEngine::ReadSinLfo,
+             c0, c1);
+        UnpackLfoValue();
+        e_.alu(E::ADD, E::RAX, c2);
+        e_.alu(E::ADD, E::RAX, CURSOR);
+        e_.alu(E::AND, E::RAX, kDelayAddrMask);
+        e_.mov(E::RDX, E::RAX);
+        DelayLoad();
+        MulRCX();
+        e_.alu(E::ADD, E::RAX, ACC);
+        StoreAcc();
+        break;
+
+      case OPCODE::CHO_SOF_RMP:
+      case OPCODE::CHO_SOF_SIN:
+        Call(OPCODE::CHO_SOF_RMP == instruction.get_opcode()
+                 ? &JitEngine::ReadRampLfo
+                 : &JitEngine::ReadSinLfo,
+             c0, c1);
+        UnpackLfoValue();
+        e_.mov(E::RAX, ACC);
+        MulRCX();
+        if (c2) e_.alu(E::ADD, E::RAX, c2);
+        StoreAcc();
+        break;
+
+      case OPCODE::LOG:  // TODO, see interpreter
+      case OPCODE::EXP:
+      case OPCODE::CHO_RDA:
+      case OPCODE::CHO_SOF:
+      case OPCODE::NOP:
+      case OPCODE::UNKNOWN:
+      // Only in the interpreter programs, see VM::ReduceCoefficients
+      case OPCODE::RDAX_ADD:
+      case OPCODE::RDAX_SUB:
+      case OPCODE::RDA_ADD:
+      case OPCODE::WRAX_MOV:
+      case OPCODE::WRAX_CLR:
+      case OPCODE::SOF_NEG:
+      case OPCODE::SOF_HALF:
+      case OPCODE::SOF_NEG2:
+      case OPCODE::ALLPASS:
+      case OPCODE::LPF1:
+      case OPCODE::HPF1:
+      case OPCODE::CHO_INTERP_RMP:
+      case OPCODE::CHO_INTERP_SIN:
+      case OPCODE::RDA_NOSAT:
+      case OPCODE::RDAX_NOSAT:
+      case OPCODE::RDFX_NOSAT:
+      case OPCODE::WRAX_NOSAT:
+      case OPCODE::MULX_NOSAT:
+      case OPCODE::SOF_NOSAT:
+      case OPCODE::RDA_SAVE:
+      case OPCODE::WRA_SAVE:
+      case OPCODE::RDA_CACHED:
+      FV1_SUPEROPS(FV1_SUPEROP_CASE)
+      case OPCODE::REAL_OPCODES_LAST: break;
+    }
+
+    UpdatePacc();
+    return !e_.overflow();
+  }
+};
+
+JitEngine::JitEngine(VM &vm) : vm_{vm}
+{
+  context_.registers = reinterpret_cast<int32_t *>(vm_.context_.state_.registers_.data());
+  context_.delay = vm_.context_.delay_memory_.data();
+  context_.vm = &vm_;
+}
+
+JitEngine::~JitEngine()
+{
+  Release();
+}
+
+void JitEngine::Release()
+{
+  if (code_) munmap(code_, kCodeBufferSize);
+  code_ = nullptr;
+  code_size_ = 0;
+  program_ = nullptr;
+}
+
+bool JitEngine::Compile()
+{
+  Release();
+  // Only the tables of a precompiled program are available, see VM::Load
+  if (vm_.precompiled()) return false;
+
+  auto buffer = mmap(nullptr, kCodeBufferSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                     -1, 0);
+  if (MAP_FAILED == buffer) return false;
+  code_ = static_cast<uint8_t *>(buffer);
+
+  // Too big for the stack
+  auto generator = std::make_unique<CodeGenerator>(vm_, code_, kCodeBufferSize);
+  code_size_ = generator->Generate();
+  if (!code_size_ || mprotect(code_, kCodeBufferSize, PROT_READ | PROT_EXEC)) {
+    Release();
+    return false;
+  }
+
+  program_ = reinterpret_cast<ProgramFn>(code_);
+  return true;
+}
+
+void JitEngine::Execute(const AudioFrame *in, AudioFrame *out, size_t num_frames)
+{
+  if (!program_) {
+    vm_.Execute(in, out, num_frames);
+    return;
+  }
+
+  auto &state = vm_.context_.state_;
+  auto &delay_memory = vm_.context_.delay_memory_;
+
+  // Same as the interpreter, prev_acc doesn't survive between blocks
+  context_.acc = state.acc_.loadi();
+  context_.pacc = state.pacc_.loadi();
+  context_.prev_acc = context_.acc;
+  context_.last_read = delay_memory.last_read().value;
+  const auto features = vm_.features();
+  const bool stereo = features & VM::FEATURE_STEREO;
+
+  for (; num_frames; --num_frames, ++in, ++out) {
+    state.registers_[ADCL].store(in->l);
+    if (stereo) state.registers_[ADCR].store(in->r);
+
+    context_.cursor = delay_memory.cursor();
+    context_.first_run = state.first_run;
+    program_(&context_);
+
+    vm_.Tick();
+    state.first_run = false;
+    state.registers_[DACL].read(out->l);
+    state.registers_[DACR].read(out->r);
+  }
+
+  state.acc_.storei(context_.acc);
+  if (features & VM::FEATURE_PACC) state.pacc_.storei(context_.pacc);
+  if (features & VM::FEATURE_LAST_READ) delay_memory.set_last_read(SF23{context_.last_read});
+}
+
+static uint64_t PackLfoValue(int32_t offset, int32_t coefficient)
+{
+  return static_cast<uint64_t>(static_cast<uint32_t>(coefficient)) << 32 |
+         static_cast<uint32_t>(offset);
+}
+
+/*static*/ uint64_t JitEngine::ReadSinLfo(Context *context, int32_t n, int32_t flags)
+{
+  auto value = context->vm->context_.sin_lfo_[n].Read(static_cast<CHO_FLAGS>(flags));
+  return PackLfoValue(value.offset, value.coefficient);
+}
+
+/*static*/ uint64_t JitEngine::ReadRampLfo(Context *context, int32_t n, int32_t flags)
+{
+  auto value = context->vm->context_.ramp_lfo_[n].Read(static_cast<CHO_FLAGS>(flags));
+  return PackLfoValue(value.offset, value.coefficient);
+}
+
+/*static*/ int32_t JitEngine::ReadLfo(Context *context, int32_t idx)
+{
+  return context->vm->context_.read_lfo(static_cast<VM::CHO_SEL_IDX>(idx)).value;
+}
+
+/*static*/ void JitEngine::Wlds(Context *context, int32_t n, int32_t f, int32_t a)
+{
+  auto &registers = context->vm->context_.state_.registers_;
+  registers[n ? SIN1_RATE : SIN0_RATE].store(SF23{f});
+  registers[n ? SIN1_RANGE : SIN0_RANGE].store(SF23{a});
+  context->vm->context_.sin_lfo_[n ? 1 : 0].Jam();
+}
+
+/*static*/ void JitEngine::Wldr(Context *context, int32_t n, int32_t f, int32_t a)
+{
+  auto &registers = context->vm->context_.state_.registers_;
+  registers[n ? RMP1_RATE : RMP0_RATE].store(f);
+  registers[n ? RMP1_RANGE : RMP0_RANGE].store(a);
+  context->vm->context_.ramp_lfo_[n ? 1 : 0].Jam();
+}
+
+/*static*/ void JitEngine::Jam(Context *context, int32_t n)
+{
+  context->vm->context_.ramp_lfo_[n].Jam();
+}
+
+#else
+
+JitEngine::JitEngine(VM &vm) : vm_{vm} {}
+JitEngine::~JitEngine() {}
+void JitEngine::Release() {}
+bool JitEngine::Compile()
+{
+  return false;
+}
+void JitEngine::Execute(const AudioFrame *in, AudioFrame *out, size_t num_frames)
+{
+  vm_.Execute(in, out, num_frames);
+}
+
+#endif  // FV1_JIT_X64
+
+}  // namespace jit
+}  // namespace fv1
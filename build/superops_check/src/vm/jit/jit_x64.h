@@ -0,0 +1,109 @@
+// fv1vm: experimental FV-1 virtual machine
+// Copyright (C) 2022 Patrick Dowling <pld@gurkenkiste.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef FV1_JIT_X64_H_
+#define FV1_JIT_X64_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "vm/engines/delay_i32.h"
+#include "vm/engines/engine_i32_v1.h"
+#include "vm/vm.h"
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__))
+#define FV1_JIT_X64
+#endif
+
+namespace fv1 {
+namespace jit {
+
+// x86-64 native code generator for the i32 VM.
+//
+// This takes the optimized byte code of a compiled VM and turns the program (i.e. one frame) into
+// a native function. The frame loop itself, Tick and the I/O registers are still handled here so
+// the VM state stays the single source of truth, and the interpreter can pick up where the JIT left
+// off (and vice versa).
+//
+// - ACC, PACC (and the "previous ACC" needed to derive it) live in machine registers
+// - A few of the most used registers are cached in machine registers for the duration of a frame
+// - Delay addresses are immediates, SKP/JMP are native forward branches
+// - Anything involving the LFOs calls back into the existing C++ implementation
+//
+// The result is bit-exact with the interpreter using EngineI32. On other hosts Compile fails and
+// Execute just uses the VM.
+class JitEngine {
+public:
+  using VM = fv1::VM<engine::EngineI32, engine::DelayStorageI32>;
+  using AudioFrame = VM::AudioFrame;
+
+  explicit JitEngine(VM &vm);
+  ~JitEngine();
+
+  JitEngine(const JitEngine &) = delete;
+  JitEngine &operator=(const JitEngine &) = delete;
+
+  // Generate code for the program currently compiled into the VM.
+  // Returns false if not supported (or the code buffer overflows, or the VM runs a precompiled
+  // program).
+  bool Compile();
+
+  // Same contract as VM::Execute
+  void Execute(const AudioFrame *in, AudioFrame *out, size_t num_frames);
+
+  bool compiled() const { return nullptr != program_; }
+  size_t code_size() const { return code_size_; }
+
+  // State shared with the generated code. The layout is baked into the code.
+  struct Context {
+    int32_t acc = 0;
+    int32_t pacc = 0;
+    int32_t prev_acc = 0;
+    int32_t last_read = 0;
+    int32_t cursor = 0;
+    int32_t first_run = 0;
+    int32_t *registers = nullptr;
+    int32_t *delay = nullptr;
+    VM *vm = nullptr;
+  };
+
+private:
+  using ProgramFn = void (*)(Context *);
+
+  VM &vm_;
+  Context context_;
+
+  uint8_t *code_ = nullptr;
+  size_t code_size_ = 0;
+  ProgramFn program_ = nullptr;
+
+  void Release();
+
+  // Callbacks from generated code
+  static uint64_t ReadSinLfo(Context *context, int32_t n, int32_t flags);
+  static uint64_t ReadRampLfo(Context *context, int32_t n, int32_t flags);
+  static int32_t ReadLfo(Context *context, int32_t idx);
+  static void Wlds(Context *context, int32_t n, int32_t f, int32_t a);
+  static void Wldr(Context *context, int32_t n, int32_t f, int32_t a);
+  static void Jam(Context *context, int32_t n);
+
+  friend class CodeGenerator;
+};
+
+}  // namespace jit
+}  // namespace fv1
+
+#endif  // FV1_JIT_X64_H_
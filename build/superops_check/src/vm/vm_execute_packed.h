@@ -0,0 +1,299 @@
+// fv1vm: experimental FV-1 virtual machine
+// Copyright (C) 2022 Patrick Dowling <pld@gurkenkiste.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+#ifndef FV1_VM_H_
+#error "Don't include or compile this file directly"
+#endif
+
+// Packed byte code (Dispatch::PACKED).
+//
+// A CompiledInstruction is 16 bytes, so a full program is 2 KB (plus 1 KB of handlers for the
+// threaded loop) that competes with the delay memory for cache. The packed encoding is 8 bytes:
+// the opcode in the low byte, then each constant in a field only as wide as the opcode needs it,
+// e.g. 6 bits for a register, 15 bits for a delay address or a 16-bit mantissa and 4-bit shift
+// for a coefficient (the S1.14, S1.9 and S.10 coefficients of the FV-1 are all exact). The handler
+// of each opcode unpacks its own fields, so the layout is known at compile time and the decode is
+// a few shifts and masks.
+//
+// The packed programs are kept separately from the CompiledProgram (see VM::set_packed_programs),
+// so a VM that doesn't use them doesn't carry them. If any constant doesn't fit (e.g. a float
+// engine's coefficients, which aren't short fixed-point values), the program isn't packed and
+// PACKED uses the regular switch loop instead. Superinstructions aren't packed, they run as their
+// first instruction.
+
+namespace fv1 {
+
+template <typename Engine, typename DelayStorage>
+constexpr typename VM<Engine, DelayStorage>::PackedLayout VM<Engine, DelayStorage>::GetPackedLayout(
+    OPCODE opcode)
+{
+  using F = PACKED_FIELD;
+  switch (opcode) {
+    case OPCODE::RDA:
+    case OPCODE::WRA:
+    case OPCODE::WRAP:
+    case OPCODE::RDA_NOSAT: return {F::ADDR, F::COEFF, F::NONE};
+    case OPCODE::RMPA: return {F::COEFF, F::NONE, F::NONE};
+    case OPCODE::RDAX:
+    case OPCODE::RDFX:
+    case OPCODE::WRAX:
+    case OPCODE::WRHX:
+    case OPCODE::WRLX:
+    case OPCODE::MAXX:
+    case OPCODE::RDAX_NOSAT:
+    case OPCODE::RDFX_NOSAT:
+    case OPCODE::WRAX_NOSAT: return {F::REG, F::COEFF, F::NONE};
+    case OPCODE::MULX:
+    case OPCODE::LDAX:
+    case OPCODE::RDAX_ADD:
+    case OPCODE::RDAX_SUB:
+    case OPCODE::WRAX_MOV:
+    case OPCODE::WRAX_CLR:
+    case OPCODE::MULX_NOSAT: return {F::REG, F::NONE, F::NONE};
+    case OPCODE::RDA_ADD: return {F::ADDR, F::NONE, F::NONE};
+    case OPCODE::SOF:
+    case OPCODE::SOF_NOSAT: return {F::COEFF, F::WORD, F::NONE};  // D can be any constant
+    case OPCODE::AND:
+    case OPCODE::OR:
+    case OPCODE::XOR: return {F::MASK, F::NONE, F::NONE};
+    case OPCODE::SKP:
+    case OPCODE::JMP: return {F::SMALL, F::SMALL, F::NONE};
+    case OPCODE::WLDS: return {F::SMALL, F::COEFF, F::COEFF};
+    case OPCODE::WLDR: return {F::SMALL, F::COEFF, F::WORD};
+    case OPCODE::JAM:
+    case OPCODE::CHO_RDAL: return {F::SMALL, F::NONE, F::NONE};
+    case OPCODE::CHO_RDA_RMP:
+    case OPCODE::CHO_RDA_SIN:
+    case OPCODE::CHO_INTERP_RMP:
+    case OPCODE::CHO_INTERP_SIN: return {F::SMALL, F::SMALL, F::ADDR};
+    case OPCODE::CHO_SOF_RMP:
+    case OPCODE::CHO_SOF_SIN: return {F::SMALL, F::SMALL, F::COEFF};
+    case OPCODE::ALLPASS: return {F::ADDR, F::COEFF, F::ADDR};
+    case OPCODE::LPF1:
+    case OPCODE::HPF1: return {F::REG, F::COEFF, F::COEFF};
+    case OPCODE::RDA_SAVE:
+    case OPCODE::WRA_SAVE: return {F::ADDR, F::COEFF, F::SMALL};
+    case OPCODE::RDA_CACHED: return {F::SMALL, F::COEFF, F::NONE};
+    default: return {F::NONE, F::NONE, F::NONE};
+  }
+}
+
+template <typename Engine, typename DelayStorage>
+/*static*/ bool VM<Engine, DelayStorage>::PackInstruction(const CompiledInstruction &instruction,
+                                                         PackedInstruction &packed)
+{
+  auto opcode = instruction.get_opcode();
+  for (const auto &superop : kSuperops)
+    if (superop.opcode == opcode) opcode = superop.sequence[0];
+
+  const auto layout = GetPackedLayout(opcode);
+  packed = static_cast<PackedInstruction>(opcode);
+  unsigned offset = kPackedOpcodeBits;
+  for (size_t i = 0; i < layout.size(); ++i) {
+    const int32_t value = instruction.constants[i].loadi();
+    uint32_t bits = 0;
+    switch (layout[i]) {
+      case PACKED_FIELD::NONE: break;
+      case PACKED_FIELD::REG:
+      case PACKED_FIELD::ADDR:
+      case PACKED_FIELD::SMALL:
+      case PACKED_FIELD::MASK:
+        if (value < 0 || value >= 1 << kPackedFieldBits[static_cast<size_t>(layout[i])])
+          return false;
+        bits = static_cast<uint32_t>(value);
+        break;
+      case PACKED_FIELD::COEFF: {
+        // Smallest shift that leaves a 16-bit mantissa without dropping any bits
+        uint32_t shift = 0;
+        while (shift < 15 && (value >> shift) != int16_t(value >> shift) && !((value >> shift) & 1))
+          ++shift;
+        const int32_t mantissa = value >> shift;
+        if (mantissa != int16_t(mantissa) || mantissa * (int32_t{1} << shift) != value)
+          return false;
+        bits = (static_cast<uint32_t>(mantissa) & 0xffff) | shift << 16;
+        break;
+      }
+      case PACKED_FIELD::WORD:
+        if (value < -(1 << 23) || value >= 1 << 23) return false;
+        bits = static_cast<uint32_t>(value) & 0xffffff;
+        break;
+    }
+    packed |= static_cast<PackedInstruction>(bits) << offset;
+    offset += kPackedFieldBits[static_cast<size_t>(layout[i])];
+  }
+  return true;
+}
+
+template <typename Engine, typename DelayStorage>
+constexpr int32_t VM<Engine, DelayStorage>::DecodePackedField(PACKED_FIELD field, uint32_t bits)
+{
+  bits &= (1U << kPackedFieldBits[static_cast<size_t>(field)]) - 1;
+  switch (field) {
+    case PACKED_FIELD::COEFF:
+      return static_cast<int16_t>(bits & 0xffff) * (int32_t{1} << (bits >> 16));
+    case PACKED_FIELD::WORD: return static_cast<int32_t>(bits << 8) >> 8;
+    default: return static_cast<int32_t>(bits);
+  }
+}
+
+template <typename Engine, typename DelayStorage>
+/*static*/ typename VM<Engine, DelayStorage>::CompiledInstruction
+VM<Engine, DelayStorage>::UnpackInstruction(PackedInstruction packed, const PackedLayout &layout)
+{
+  CompiledInstruction instruction;
+  instruction.set_opcode(static_cast<OPCODE>(packed & 0xff));
+  unsigned offset = kPackedOpcodeBits;
+  for (size_t i = 0; i < layout.size(); ++i) {
+    if (PACKED_FIELD::NONE != layout[i])
+      instruction.constants[i].store(
+          DecodePackedField(layout[i], static_cast<uint32_t>(packed >> offset)));
+    offset += kPackedFieldBits[static_cast<size_t>(layout[i])];
+  }
+  return instruction;
+}
+
+template <typename Engine, typename DelayStorage>
+template <OPCODE opcode>
+/*static*/ typename VM<Engine, DelayStorage>::CompiledInstruction
+VM<Engine, DelayStorage>::UnpackInstruction(PackedInstruction packed)
+{
+  static constexpr auto kLayout = GetPackedLayout(opcode);
+  static constexpr auto kOffset0 = kPackedOpcodeBits;
+  static constexpr auto kOffset1 = kOffset0 + kPackedFieldBits[static_cast<size_t>(kLayout[0])];
+  static constexpr auto kOffset2 = kOffset1 + kPackedFieldBits[static_cast<size_t>(kLayout[1])];
+  CompiledInstruction instruction;
+  instruction.set_opcode(opcode);
+  if constexpr (PACKED_FIELD::NONE != kLayout[0])
+    instruction.constants[0].store(DecodePackedField(kLayout[0], uint32_t(packed >> kOffset0)));
+  if constexpr (PACKED_FIELD::NONE != kLayout[1])
+    instruction.constants[1].store(DecodePackedField(kLayout[1], uint32_t(packed >> kOffset1)));
+  if constexpr (PACKED_FIELD::NONE != kLayout[2])
+    instruction.constants[2].store(DecodePackedField(kLayout[2], uint32_t(packed >> kOffset2)));
+  return instruction;
+}
+
+template <typename Engine, typename DelayStorage>
+/*static*/ bool VM<Engine, DelayStorage>::PackProgram(const Program &program, PackedProgram &packed)
+{
+  packed.length = program.length;
+  packed.valid = true;
+  for (size_t ic = 0; ic < program.length && packed.valid; ++ic)
+    packed.valid = PackInstruction(program.instructions[ic], packed.instructions[ic]);
+  return packed.valid;
+}
+
+template <typename Engine, typename DelayStorage>
+/*static*/ bool VM<Engine, DelayStorage>::Pack(const CompiledProgram &program,
+                                               PackedPrograms &packed)
+{
+  PackProgram(program.init, packed.init);
+  PackProgram(program.steady, packed.steady);
+  return packed.valid();
+}
+
+template <typename Engine, typename DelayStorage>
+void VM<Engine, DelayStorage>::set_packed_programs(PackedPrograms *packed)
+{
+  packed_programs_ = packed;
+  if (packed) Pack(program_, *packed);
+}
+
+#undef OPCODE_DISPATCH_NOP
+#undef OPCODE_DISPATCH_0
+#undef OPCODE_DISPATCH_1
+#undef OPCODE_DISPATCH_2
+#undef OPCODE_DISPATCH_3
+#undef OPCODE_END
+#undef GET_STEP_CONSTANT_
+
+//
+#define OPCODE_DISPATCH_NOP(x) \
+  case OPCODE::x: break
+//
+#define OPCODE_DISPATCH_0(x) \
+  case OPCODE::x: {          \
+    do {                     \
+    } while (0)
+//
+#define OPCODE_DISPATCH_1(x, c0)                                             \
+  case OPCODE::x: {                                                          \
+    auto instruction = UnpackInstruction<OPCODE::x>(instructions[ic]);       \
+    GET_CONSTANT(c0, 0)
+//
+#define OPCODE_DISPATCH_2(x, c0, c1)                                         \
+  case OPCODE::x: {                                                          \
+    auto instruction = UnpackInstruction<OPCODE::x>(instructions[ic]);       \
+    GET_CONSTANT(c0, 0);                                                     \
+    GET_CONSTANT(c1, 1)
+//
+#define OPCODE_DISPATCH_3(x, c0, c1, c2)                                     \
+  case OPCODE::x: {                                                          \
+    auto instruction = UnpackInstruction<OPCODE::x>(instructions[ic]);       \
+    GET_CONSTANT(c0, 0);                                                     \
+    GET_CONSTANT(c1, 1);                                                     \
+    GET_CONSTANT(c2, 2)
+//
+#define OPCODE_END() \
+  }                  \
+  break
+// Packed programs don't contain superinstructions, this only has to compile
+#define GET_STEP_CONSTANT_(type, name, index)                                           \
+  const auto name##_step = UnpackInstruction(                                           \
+      instructions[ic], GetPackedLayout(static_cast<OPCODE>(instructions[ic] & 0xff))); \
+  const type name { name##_step.constants[index] }
+
+template <typename Engine, typename DelayStorage>
+template <uint32_t features>
+void VM<Engine, DelayStorage>::ExecutePacked(const PackedProgram &program, Context &context,
+                                             uint32_t lfos, const AudioFrame *in,
+                                             AudioFrame *out, size_t num_frames)
+{
+  static constexpr bool kLastRead = features & FEATURE_LAST_READ;
+  auto &state = context.state_;
+  typename Engine::Register acc = state.acc_;
+  typename Engine::Register pacc = state.pacc_;
+  [[maybe_unused]] typename Engine::Register prev_acc = acc;
+  auto registers = state.registers_.data();
+  const auto instructions = program.instructions.data();
+  const auto length = static_cast<int32_t>(program.length);
+
+  for (; num_frames; --num_frames, ++in, ++out) {
+    state.registers_[ADCL].store(in->l);
+    if constexpr (features & FEATURE_STEREO) state.registers_[ADCR].store(in->r);
+    auto delay = context.delay_memory_.frame();
+
+    int32_t ic = 0;
+    while (ic < length) {
+      switch (static_cast<OPCODE>(instructions[ic] & 0xff)) {
+#include "vm_execute_ops.h"
+      }
+      if constexpr (features & FEATURE_PACC) {
+        pacc = prev_acc;
+        prev_acc = acc;
+      }
+      ++ic;
+    }
+    context.template Tick<features>(lfos);
+    state.first_run = false;
+    state.registers_[DACL].read(out->l);
+    state.registers_[DACR].read(out->r);
+  }
+
+  if constexpr (features & FEATURE_PACC) state.pacc_ = pacc;
+  state.acc_ = acc;
+}
+
+}  // namespace fv1
@@ -0,0 +1,178 @@
+// fv1vm: experimental FV-1 virtual machine
+// Copyright (C) 2022 Patrick Dowling <pld@gurkenkiste.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+#ifndef FV1_VM_H_
+#error "Don't include or compile this file directly"
+#endif
+
+// Generated by fv1_superops from 33 programs in ./build/tests, don't edit.
+//
+// Superinstruction handlers, included by vm_execute_ops.h. Each step is the body
+// of the handler of the instruction it replaces, see SUPEROP_CONSTANT and
+// SUPEROP_NEXT.
+
+// wrax clr+cho rdal+wrax clr: 5 times in 4 programs
+OPCODE_DISPATCH_0(SUPER_0);
+{
+  SUPEROP_CONSTANT(INT(addr), 0);
+  registers[addr].store(acc);
+  acc.clr();
+}
+SUPEROP_NEXT();
+{
+  SUPEROP_CONSTANT(INT(n), 0);
+  // NOTE n is artificial from VM::Optimize so flags not needed
+  acc.store(context.read_lfo(n.template enum_cast<CHO_SEL_IDX>()));
+}
+SUPEROP_NEXT();
+{
+  SUPEROP_CONSTANT(INT(addr), 0);
+  registers[addr].store(acc);
+  acc.clr();
+}
+OPCODE_END();
+
+// cho rda sin+cho rda sin+cho rda sin: 4 times in 1 programs
+OPCODE_DISPATCH_0(SUPER_1);
+{
+  SUPEROP_CONSTANT(IDX(n), 0);
+  SUPEROP_CONSTANT(INT(flags), 1);
+  SUPEROP_CONSTANT(INT(addr), 2);
+  const auto lfo_value = context.sin_lfo_[n].Read(flags.template enum_cast<CHO_FLAGS>());
+  const auto value = delay.template Load<kLastRead>(addr + lfo_value.offset);
+  acc.store(value * lfo_value.coefficient + acc.load());
+}
+SUPEROP_NEXT();
+{
+  SUPEROP_CONSTANT(IDX(n), 0);
+  SUPEROP_CONSTANT(INT(flags), 1);
+  SUPEROP_CONSTANT(INT(addr), 2);
+  const auto lfo_value = context.sin_lfo_[n].Read(flags.template enum_cast<CHO_FLAGS>());
+  const auto value = delay.template Load<kLastRead>(addr + lfo_value.offset);
+  acc.store(value * lfo_value.coefficient + acc.load());
+}
+SUPEROP_NEXT();
+{
+  SUPEROP_CONSTANT(IDX(n), 0);
+  SUPEROP_CONSTANT(INT(flags), 1);
+  SUPEROP_CONSTANT(INT(addr), 2);
+  const auto lfo_value = context.sin_lfo_[n].Read(flags.template enum_cast<CHO_FLAGS>());
+  const auto value = delay.template Load<kLastRead>(addr + lfo_value.offset);
+  acc.store(value * lfo_value.coefficient + acc.load());
+}
+OPCODE_END();
+
+// ldax+mulx+wrax clr: 3 times in 2 programs
+OPCODE_DISPATCH_0(SUPER_2);
+{
+  SUPEROP_CONSTANT(INT(addr), 0);
+  acc.store(registers[addr]);
+}
+SUPEROP_NEXT();
+{
+  SUPEROP_CONSTANT(INT(addr), 0);
+  acc.store(acc.load() * registers[addr].load());
+}
+SUPEROP_NEXT();
+{
+  SUPEROP_CONSTANT(INT(addr), 0);
+  registers[addr].store(acc);
+  acc.clr();
+}
+OPCODE_END();
+
+// wrax clr+ldax: 12 times in 10 programs
+OPCODE_DISPATCH_0(SUPER_3);
+{
+  SUPEROP_CONSTANT(INT(addr), 0);
+  registers[addr].store(acc);
+  acc.clr();
+}
+SUPEROP_NEXT();
+{
+  SUPEROP_CONSTANT(INT(addr), 0);
+  acc.store(registers[addr]);
+}
+OPCODE_END();
+
+// cho rdal+wrax clr: 8 times in 5 programs
+OPCODE_DISPATCH_0(SUPER_4);
+{
+  SUPEROP_CONSTANT(INT(n), 0);
+  // NOTE n is artificial from VM::Optimize so flags not needed
+  acc.store(context.read_lfo(n.template enum_cast<CHO_SEL_IDX>()));
+}
+SUPEROP_NEXT();
+{
+  SUPEROP_CONSTANT(INT(addr), 0);
+  registers[addr].store(acc);
+  acc.clr();
+}
+OPCODE_END();
+
+// allpass+allpass: 8 times in 3 programs
+OPCODE_DISPATCH_0(SUPER_5);
+{
+  SUPEROP_CONSTANT(INT(read_addr), 0);
+  SUPEROP_CONSTANT(FLOAT(c), 1);
+  SUPEROP_CONSTANT(INT(write_addr), 2);
+  const auto value = delay.template Load<kLastRead>(read_addr);
+  acc.store(value * c + acc.load());
+  prev_acc = acc;
+  delay.Store(write_addr, acc);
+  acc.store(acc.load() * Engine::NEG(c) + value);
+}
+SUPEROP_NEXT();
+{
+  SUPEROP_CONSTANT(INT(read_addr), 0);
+  SUPEROP_CONSTANT(FLOAT(c), 1);
+  SUPEROP_CONSTANT(INT(write_addr), 2);
+  const auto value = delay.template Load<kLastRead>(read_addr);
+  acc.store(value * c + acc.load());
+  prev_acc = acc;
+  delay.Store(write_addr, acc);
+  acc.store(acc.load() * Engine::NEG(c) + value);
+}
+OPCODE_END();
+
+// wrax clr+rdax add: 7 times in 5 programs
+OPCODE_DISPATCH_0(SUPER_6);
+{
+  SUPEROP_CONSTANT(INT(addr), 0);
+  registers[addr].store(acc);
+  acc.clr();
+}
+SUPEROP_NEXT();
+{
+  SUPEROP_CONSTANT(INT(addr), 0);
+  acc.store(registers[addr].load() + acc.load());
+}
+OPCODE_END();
+
+// wrax clr+rdax nosat: 7 times in 5 programs
+OPCODE_DISPATCH_0(SUPER_7);
+{
+  SUPEROP_CONSTANT(INT(addr), 0);
+  registers[addr].store(acc);
+  acc.clr();
+}
+SUPEROP_NEXT();
+{
+  SUPEROP_CONSTANT(INT(addr), 0);
+  SUPEROP_CONSTANT(FLOAT(c), 1);
+  acc.store_unsaturated(registers[addr].load() * c + acc.load());
+}
+OPCODE_END();
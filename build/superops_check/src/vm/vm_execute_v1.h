@@ -0,0 +1,243 @@
+// fv1vm: experimental FV-1 virtual machine
+// Copyright (C) 2022 Patrick Dowling <pld@gurkenkiste.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+#ifndef FV1_VM_H_
+#error "Don't include or compile this file directly"
+#endif
+
+#include "fv1/fv1_instruction.h"
+#include "misc/program_stream.h"
+
+// Some ideas
+// - We can store a pointer to the register in the CompiledInstruction
+//   ...but it doesn't fit the 16 bytes, and registers[addr] is already a single load with an
+//   indexed address. Delay memory goes through a DelayMemory::Frame so at least the buffer and
+//   cursor are resolved once per frame.
+// - We can pack a function pointer in there as well as skip the switch dispatch
+// - ...but then we have a guaranteed function call?
+//
+// The general idea is that the operands we get can be converted to a dedicated format for the VM.
+// The types are annotated (but but strictly enforced). For the (simple) i32 case almost everything
+// is converted to SF23 so working with registers is "easy". It _should_ in theory also be possible
+// to use a float-based math engine but there are some odd boundary cases (like masks).
+//
+// Float math is simpler (e.g. the mult is a single op) but clipping fixed-point boils down to a
+// ssat instruction instead of two compares. OTOH the whole LFO implementation seems to be based
+// around ints as well, so the answer seems to be "it depends".
+//
+// TODO CHO flags, REG. Since the simulated LFO/SIN are synchrounous this seems unneeded?
+// Bit1: REG (000010) function. Using this will register the current LFO outputs for subsequent
+// operations; to be used only on the first access to an LFO (LFO is continuously updated in the
+// background)
+// TODO We could also do a per-instruction increment for finer interpolation
+// TODO There might still be benefit of an explicit MAC for float => VMLA
+
+namespace fv1 {
+
+//
+#define OPCODE_DISPATCH_TODO(x) OPCODE_DISPATCH_NOP(x)
+//
+#define OPCODE_DISPATCH_NOP(x) \
+  case OPCODE::x: break
+//
+#define OPCODE_DISPATCH_0(x) \
+  case OPCODE::x: {          \
+    do {                     \
+    } while (0)
+//
+#define OPCODE_DISPATCH_1(x, c0) \
+  case OPCODE::x: {              \
+    GET_CONSTANT(c0, 0)
+//
+#define OPCODE_DISPATCH_2(x, c0, c1) \
+  case OPCODE::x: {                  \
+    GET_CONSTANT(c0, 0);             \
+    GET_CONSTANT(c1, 1)
+//
+#define OPCODE_DISPATCH_3(x, c0, c1, c2) \
+  case OPCODE::x: {                      \
+    GET_CONSTANT(c0, 0);                 \
+    GET_CONSTANT(c1, 1);                 \
+    GET_CONSTANT(c2, 2)
+//
+#define OPCODE_END() \
+  }                  \
+  break
+
+template <typename Engine, typename DelayStorage>
+void VM<Engine, DelayStorage>::Execute(const AudioFrame *in, AudioFrame *out, size_t num_frames)
+{
+  if (native_program_) {
+    codegen::Runtime<Engine, DelayStorage> runtime{context_.state_, context_.delay_memory_,
+                                                   context_.ramp_lfo_, context_.sin_lfo_};
+    native_program_(runtime, in, out, num_frames);
+    return;
+  }
+  if (block_buffer_ && block_program_.enabled) {
+    ExecuteBlocks(in, out, num_frames);
+    return;
+  }
+  ExecuteInterpreter(in, out, num_frames);
+}
+
+template <typename Engine, typename DelayStorage>
+void VM<Engine, DelayStorage>::ExecuteInterpreter(const AudioFrame *in, AudioFrame *out,
+                                                  size_t num_frames)
+{
+  if (precompiled_)
+    Execute(*precompiled_, context_, in, out, num_frames);
+  else if (Dispatch::PACKED == dispatch_ && packed_programs_)
+    Execute(program_, *packed_programs_, context_, in, out, num_frames);
+  else
+    Execute(program_, context_, dispatch_, in, out, num_frames);
+}
+
+template <typename Engine, typename DelayStorage>
+void VM<Engine, DelayStorage>::Execute(const PrecompiledProgram &program, Context &context,
+                                       const AudioFrame *in, AudioFrame *out, size_t num_frames)
+{
+  static constexpr auto kSwitchLoops = SwitchLoops(FeatureIndices{});
+  const auto features = program.features;
+  ExecutePrograms(kSwitchLoops[features & kSpecializedFeatures], context, features, program.init,
+                  program.steady, program.prologue, in, out, num_frames);
+}
+
+template <typename Engine, typename DelayStorage>
+void VM<Engine, DelayStorage>::Execute(const CompiledProgram &program, Context &context,
+                                       Dispatch dispatch, const AudioFrame *in, AudioFrame *out,
+                                       size_t num_frames)
+{
+  const auto features = program.features;
+  const auto loop = features & kSpecializedFeatures;
+#ifdef FV1_VM_THREADED_DISPATCH
+  if (Dispatch::THREADED == dispatch) {
+    static constexpr auto kThreadedLoops = ThreadedLoops(FeatureIndices{});
+    ExecutePrograms(kThreadedLoops[loop], context, features, program.init, program.steady,
+                    program.prologue.view(), in, out, num_frames);
+    return;
+  }
+#endif
+  static constexpr auto kSwitchLoops = SwitchLoops(FeatureIndices{});
+  ExecutePrograms(kSwitchLoops[loop], context, features, program.init.view(),
+                  program.steady.view(), program.prologue.view(), in, out, num_frames);
+}
+
+template <typename Engine, typename DelayStorage>
+void VM<Engine, DelayStorage>::Execute(const CompiledProgram &program, const PackedPrograms &packed,
+                                       Context &context, const AudioFrame *in, AudioFrame *out,
+                                       size_t num_frames)
+{
+  if (!packed.valid()) {
+    Execute(program, context, Dispatch::SWITCH, in, out, num_frames);
+    return;
+  }
+  static constexpr auto kPackedLoops = PackedLoops(FeatureIndices{});
+  const auto features = program.features;
+  ExecutePrograms(kPackedLoops[features & kSpecializedFeatures], context, features, packed.init,
+                  packed.steady, program.prologue.view(), in, out, num_frames);
+}
+
+// The init program runs on the first frame, the prologue before the steady-state frames of each
+// block
+template <typename Engine, typename DelayStorage>
+template <typename Loop, typename ProgramT>
+void VM<Engine, DelayStorage>::ExecutePrograms(Loop execute, Context &context, uint32_t features,
+                                               ProgramT &&init, ProgramT &&steady,
+                                               ProgramView prologue, const AudioFrame *in,
+                                               AudioFrame *out, size_t num_frames)
+{
+  if (context.state_.first_run && num_frames) {
+    execute(init, context, features, in, out, 1);
+    ++in;
+    ++out;
+    --num_frames;
+  }
+  // The init program still computes the hoisted registers itself, but with whatever ACC the SKP RUN
+  // code leaves. The frames after it need the values from the prologue.
+  if (!context.state_.first_run && prologue.length && num_frames)
+    ExecutePrologue(prologue, context);
+  execute(steady, context, features, in, out, num_frames);
+}
+
+template <typename Engine, typename DelayStorage>
+template <uint32_t features>
+void VM<Engine, DelayStorage>::ExecuteSwitch(ProgramView program, Context &context,
+                                             uint32_t lfos, const AudioFrame *in,
+                                             AudioFrame *out, size_t num_frames)
+{
+  static constexpr bool kLastRead = features & FEATURE_LAST_READ;
+  auto &state = context.state_;
+  typename Engine::Register acc = state.acc_;
+  typename Engine::Register pacc = state.pacc_;
+  [[maybe_unused]] typename Engine::Register prev_acc = acc;
+  auto registers = state.registers_.data();
+  const auto instructions = program.instructions;
+  const auto length = static_cast<int32_t>(program.length);
+
+  for (; num_frames; --num_frames, ++in, ++out) {
+    state.registers_[ADCL].store(in->l);
+    if constexpr (features & FEATURE_STEREO) state.registers_[ADCR].store(in->r);
+    auto delay = context.delay_memory_.frame();
+
+    int32_t ic = 0;
+    while (ic < length) {
+      auto &instruction = instructions[ic];
+      switch (instruction.get_opcode()) {
+#include "vm_execute_ops.h"
+      }
+      // per-opcode updates
+      // We want pacc to be one state delayed, i.e. from before the last execution.
+      // Otherwise instructions like WRLX that use (PACC - ACC) dont' make much sense.
+      if constexpr (features & FEATURE_PACC) {
+        pacc = prev_acc;
+        prev_acc = acc;
+      }
+      ++ic;
+    }
+    context.template Tick<features>(lfos);
+    state.first_run = false;
+    state.registers_[DACL].read(out->l);
+    state.registers_[DACR].read(out->r);
+  }
+
+  if constexpr (features & FEATURE_PACC) state.pacc_ = pacc;
+  state.acc_ = acc;
+}
+
+// The instructions VM::HoistInvariants moved out of the steady-state program. ACC is zero before
+// and after each hoisted sequence and they don't read PACC, so neither carries over.
+template <typename Engine, typename DelayStorage>
+void VM<Engine, DelayStorage>::ExecutePrologue(ProgramView program, Context &context)
+{
+  [[maybe_unused]] static constexpr uint32_t features = 0;
+  static constexpr bool kLastRead = false;
+  typename Engine::Register acc;
+  typename Engine::Register pacc;
+  [[maybe_unused]] typename Engine::Register prev_acc;
+  auto registers = context.state_.registers_.data();
+  const auto instructions = program.instructions;
+  const auto length = static_cast<int32_t>(program.length);
+  auto delay = context.delay_memory_.frame();
+
+  for (int32_t ic = 0; ic < length; ++ic) {
+    auto &instruction = instructions[ic];
+    switch (instruction.get_opcode()) {
+#include "vm_execute_ops.h"
+    }
+  }
+}
+
+}  // namespace fv1
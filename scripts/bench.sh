@@ -0,0 +1,19 @@
+#!/usr/bin/env bash
+# Run the interpreter variants on the wav_tests bank (and anything else passed on the command line)
+
+function fatal() { echo "$*" ; exit 1; }
+
+BANK_DIR=./banks/wav_tests
+FV1_BENCH=./build/fv1_bench
+
+BANK="$BANK_DIR/build/wav_tests.bank"
+
+[ -x "$FV1_BENCH" ] || fatal "$FV1_BENCH not executable"
+
+make -C "$BANK_DIR" bank
+[ -f "$BANK" ] || fatal "$BANK does not exist"
+
+for f in "$BANK" "$@" ; do
+	echo "** $f"
+	$FV1_BENCH -f "$f" || fatal "$f: variants do not match"
+done
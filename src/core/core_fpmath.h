@@ -51,11 +51,11 @@ static constexpr inline int32_t SSAT(const int32_t value)
 }
 #endif
 
-// Sign extend (SBFX)
+// Sign extend (SBFX), i.e. the bits above T::BITS are replaced by copies of the sign bit
 template <typename T>
 static constexpr inline int32_t SX(const int32_t value)
 {
-  return (value & T::MIN) ? value | T::MIN : value;
+  return static_cast<int32_t>(static_cast<uint32_t>(value) << (32 - T::BITS)) >> (32 - T::BITS);
 }
 
 template <typename FP>
@@ -71,6 +71,31 @@ static const char* const mnemonics[(int)OPCODE::UNKNOWN + 1] = {
     "cho rda sin",
     "jmp",
     "nop",
+    "rdax add",
+    "rdax sub",
+    "rda add",
+    "wrax mov",
+    "wrax clr",
+    "sof neg",
+    "sof half",
+    "sof neg2",
+    "allpass",
+    "lpf1",
+    "hpf1",
+    "cho interp rmp",
+    "cho interp sin",
+    "rda nosat",
+    "rdax nosat",
+    "rdfx nosat",
+    "wrax nosat",
+    "mulx nosat",
+    "sof nosat",
+    "rda save",
+    "wra save",
+    "rda cached",
+#define FV1_SUPEROP_MNEMONIC(name, mnemonic, ...) mnemonic,
+    FV1_SUPEROPS(FV1_SUPEROP_MNEMONIC)
+#undef FV1_SUPEROP_MNEMONIC
     "UNKNOWN",
 };
 
@@ -41,14 +41,18 @@ public:
   {
     std::fill(buffer_.begin(), buffer_.end(), 0);
     cursor_ = 0;
+    last_read_ = value_type{0};
   }
 
   constexpr int32_t size() { return kDelayMemorySize; }
 
+  // The last read value is only needed for WRAP
+  template <bool update_last_read = true>
   value_type Load(int32_t index)
   {
-    last_read_ = Traits::Unpack(at(index));
-    return last_read_;
+    const auto value = Traits::Unpack(at(index));
+    if constexpr (update_last_read) last_read_ = value;
+    return value;
   }
 
   void Store(int32_t index, value_type value) { at(index) = Traits::Pack(value); }
@@ -72,6 +76,49 @@ public:
 
   value_type load_immediate(int32_t index) const { return Traits::Unpack(buffer_[index]); }
 
+  // Access for the instructions of one frame, i.e. until the next Tick. The buffer and cursor are
+  // resolved once into locals, so they aren't reloaded after every store into the buffer (which
+  // could alias cursor_) and each access is the address, the mask and a single load or store.
+  class Frame {
+  public:
+    explicit Frame(DelayMemory &memory)
+        : base_{memory.buffer_.data()}, cursor_{memory.cursor_}, last_read_{memory.last_read_}
+    {}
+
+    template <bool update_last_read = true>
+    value_type Load(int32_t index)
+    {
+      const auto value = Traits::Unpack(at(index));
+      if constexpr (update_last_read) last_read_ = value;
+      return value;
+    }
+
+    void Store(int32_t index, value_type value) { at(index) = Traits::Pack(value); }
+
+    template <typename T>
+    void Store(int32_t index, const T &value)
+    {
+      at(index) = Traits::Pack(value.load());
+    }
+
+    value_type last_read() const { return last_read_; }
+    void set_last_read(value_type value) { last_read_ = value; }
+
+  private:
+    storage_type *const base_;
+    const int32_t cursor_;
+    value_type &last_read_;
+
+    inline storage_type &at(int32_t i) { return base_[(cursor_ + i) & (kDelayMemorySize - 1)]; }
+  };
+
+  Frame frame() { return Frame{*this}; }
+
+  // Raw access for generated code that does its own (cursor + index) & mask
+  storage_type *data() { return buffer_.data(); }
+  int32_t cursor() const { return cursor_; }
+  void set_last_read(value_type value) { last_read_ = value; }
+
 private:
   buffer_type &buffer_;
   int32_t cursor_{0};
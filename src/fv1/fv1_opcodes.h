@@ -17,9 +17,12 @@
 #ifndef FV1_OPCODES_H_
 #define FV1_OPCODES_H_
 
+#include <array>
 #include <cstdint>
 #include <cstring>
 
+#include "fv1_superops.h"
+
 namespace fv1 {
 
 enum class OPCODE : uint8_t {
@@ -60,6 +63,31 @@ enum class OPCODE : uint8_t {
   CHO_RDA_SIN,  // VM
   JMP,          // SKP with no flags but N > 0
   NOP,          // SKP with not flags and N == 0
+  RDAX_ADD,     // VM, C = 1.0
+  RDAX_SUB,     // VM, C = -1.0
+  RDA_ADD,      // VM, C = 1.0
+  WRAX_MOV,     // VM, C = 1.0
+  WRAX_CLR,     // VM, C = 0
+  SOF_NEG,      // VM, SOF -1.0, 0
+  SOF_HALF,     // VM, SOF 0.5, 0
+  SOF_NEG2,     // VM, SOF -2.0, 0
+  ALLPASS,      // VM, RDA + WRAP
+  LPF1,         // VM, RDFX + WRLX
+  HPF1,         // VM, RDFX + WRHX
+  CHO_INTERP_RMP,  // VM, CHO_RDA_RMP + CHO_RDA_RMP
+  CHO_INTERP_SIN,  // VM, CHO_RDA_SIN + CHO_RDA_SIN
+  RDA_NOSAT,    // VM, result always in range
+  RDAX_NOSAT,   // VM
+  RDFX_NOSAT,   // VM
+  WRAX_NOSAT,   // VM
+  MULX_NOSAT,   // VM
+  SOF_NOSAT,    // VM
+  RDA_SAVE,     // VM, RDA that keeps the value for RDA_CACHED
+  WRA_SAVE,     // VM, WRA that keeps the value for RDA_CACHED
+  RDA_CACHED,   // VM, RDA of a value already read or written in the same frame
+#define FV1_SUPEROP_ENUM(name, ...) name,
+  FV1_SUPEROPS(FV1_SUPEROP_ENUM)  // VM, see kSuperops
+#undef FV1_SUPEROP_ENUM
   UNKNOWN,
 };
 static constexpr size_t kNumRealOpcodes = static_cast<size_t>(OPCODE::REAL_OPCODES_LAST);
@@ -67,6 +95,24 @@ static constexpr size_t kOpcodeMax = 0x1f;
 static constexpr size_t kNumOpcodes = static_cast<size_t>(OPCODE::UNKNOWN) + 1;
 static constexpr size_t kNumSecondaryOpcodes = 1 /*WLDS/R*/ + 2 /*CHO_*/;
 
+// Superinstructions: a sequence of opcodes that's executed by a single handler, see fv1_superops.h
+// and VM::FuseSuperinstructions.
+static constexpr size_t kMaxSuperopLength = 4;
+struct Superop {
+  OPCODE opcode;
+  size_t length;
+  std::array<OPCODE, kMaxSuperopLength> sequence;
+};
+#define FV1_SUPEROP_COUNT(...) +1
+#define FV1_SUPEROP_ENTRY(name, mnemonic, length, ...) Superop{OPCODE::name, length, {__VA_ARGS__}},
+static constexpr size_t kNumSuperops = 0 FV1_SUPEROPS(FV1_SUPEROP_COUNT);
+static constexpr std::array<Superop, kNumSuperops> kSuperops = {{FV1_SUPEROPS(FV1_SUPEROP_ENTRY)}};
+#undef FV1_SUPEROP_ENTRY
+#undef FV1_SUPEROP_COUNT
+
+// For switch statements that have to list all opcodes
+#define FV1_SUPEROP_CASE(name, ...) case OPCODE::name:
+
 enum SKP_FLAGS : int32_t {
   NEG = 0x01,  // If ACC is negative
   GEZ = 0x02,  // If ACC is greater than or equal to zero
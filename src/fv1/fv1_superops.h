@@ -0,0 +1,26 @@
+// fv1vm: experimental FV-1 virtual machine
+// Copyright (C) 2022 Patrick Dowling <pld@gurkenkiste.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef FV1_SUPEROPS_H_
+#define FV1_SUPEROPS_H_
+
+// Generated by fv1_superops from 0 programs in ./banks, don't edit.
+//
+// X(name, mnemonic, length, opcodes...) for each superinstruction, longest
+// first. The handlers are in vm/vm_execute_superops.h.
+#define FV1_SUPEROPS(X)
+
+#endif  // FV1_SUPEROPS_H_
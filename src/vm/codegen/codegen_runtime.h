@@ -0,0 +1,144 @@
+// fv1vm: experimental FV-1 virtual machine
+// Copyright (C) 2022 Patrick Dowling <pld@gurkenkiste.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef FV1_CODEGEN_RUNTIME_H_
+#define FV1_CODEGEN_RUNTIME_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "vm/vm.h"
+
+namespace fv1 {
+namespace codegen {
+
+// Everything a generated program needs besides its code, i.e. the VM without the interpreter.
+//
+// This is only a view so it can be used on the VM's own state (see VM::set_native_program) or
+// the standalone Instance below. The layout mirrors the VM so the generated functions can use the
+// same expressions as the interpreter (see vm_execute_ops.h). Since the generated code is
+// effectively "inside" this class, the members are public.
+template <typename Engine, typename DelayStorage>
+class Runtime {
+public:
+  using VM = fv1::VM<Engine, DelayStorage>;
+  using AudioFrame = typename VM::AudioFrame;
+  using State = typename VM::State;
+  using Register = typename Engine::Register;
+  using RampLfos = std::array<RampLfoImpl<Engine>, 2>;
+  using SinLfos = std::array<SinLfoImpl<Engine>, 2>;
+
+  // Signature of a generated program
+  using ProgramFn = typename VM::NativeProgramFn;
+
+  // Generated code only ticks the LFOs a program actually reads
+  enum LFO_MASK : uint32_t {
+    LFO_SIN0 = 0x1,
+    LFO_SIN1 = 0x2,
+    LFO_RMP0 = 0x4,
+    LFO_RMP1 = 0x8,
+    LFO_ALL = 0xf,
+  };
+
+  template <uint32_t lfo_mask = LFO_ALL>
+  void Tick()
+  {
+    delay_memory_.Tick();
+    if constexpr (lfo_mask & LFO_RMP0) ramp_lfo_[0].Tick();
+    if constexpr (lfo_mask & LFO_RMP1) ramp_lfo_[1].Tick();
+    if constexpr (lfo_mask & LFO_SIN0) sin_lfo_[0].Tick();
+    if constexpr (lfo_mask & LFO_SIN1) sin_lfo_[1].Tick();
+  }
+
+  // Index as used by CHO_RDAL after VM::Optimize
+  SF23 read_lfo(int32_t idx) const
+  {
+    switch (idx) {
+      case 0: return sin_lfo_[0].sin();
+      case 1: return sin_lfo_[0].cos();
+      case 2: return sin_lfo_[1].sin();
+      case 3: return sin_lfo_[1].cos();
+      case 4: return ramp_lfo_[0].value();
+      case 5: return ramp_lfo_[1].value();
+    }
+    return SF23{0};
+  }
+
+  State &state_;
+  DelayMemory<DelayStorage> &delay_memory_;
+  RampLfos &ramp_lfo_;
+  SinLfos &sin_lfo_;
+};
+
+// Standalone state for running generated programs without a VM (e.g. programs compiled into the
+// firmware with fv1_codegen).
+template <typename Engine, typename DelayStorage>
+class Instance {
+public:
+  using Runtime = codegen::Runtime<Engine, DelayStorage>;
+  using DelayMemoryBuffer = typename Runtime::VM::DelayMemoryBuffer;
+  using AudioFrame = typename Runtime::AudioFrame;
+  using Parameters = typename Runtime::VM::Parameters;
+  using State = typename Runtime::State;
+
+  explicit Instance(DelayMemoryBuffer &delay_memory_buffer)
+      : delay_memory_{delay_memory_buffer},
+        ramp_lfo_{
+            {{&state_.registers_[REGISTER::RMP0_RATE], &state_.registers_[REGISTER::RMP0_RANGE]},
+             {&state_.registers_[REGISTER::RMP1_RATE], &state_.registers_[REGISTER::RMP1_RANGE]}}},
+        sin_lfo_{
+            {{&state_.registers_[REGISTER::SIN0_RATE], &state_.registers_[REGISTER::SIN0_RANGE]},
+             {&state_.registers_[REGISTER::SIN1_RATE], &state_.registers_[REGISTER::SIN1_RANGE]}}}
+  {}
+
+  // Same reset as VM::Compile, call before running a (different) program
+  void Reset()
+  {
+    state_.Reset();
+    delay_memory_.Reset();
+    for (auto &rmp : ramp_lfo_) rmp.Jam();
+    for (auto &sin : sin_lfo_) sin.Jam();
+  }
+
+  void SetParameters(const Parameters &params)
+  {
+    state_.registers_[POT0].store(params.pots[0]);
+    state_.registers_[POT1].store(params.pots[1]);
+    state_.registers_[POT2].store(params.pots[2]);
+  }
+
+  void Execute(typename Runtime::ProgramFn program, const AudioFrame *in, AudioFrame *out,
+               size_t num_frames)
+  {
+    Runtime runtime{state_, delay_memory_, ramp_lfo_, sin_lfo_};
+    program(runtime, in, out, num_frames);
+  }
+
+  const State &state() const { return state_; }
+  const DelayMemory<DelayStorage> &delay_memory() const { return delay_memory_; }
+
+private:
+  State state_;
+  DelayMemory<DelayStorage> delay_memory_;
+  typename Runtime::RampLfos ramp_lfo_;
+  typename Runtime::SinLfos sin_lfo_;
+};
+
+}  // namespace codegen
+}  // namespace fv1
+
+#endif  // FV1_CODEGEN_RUNTIME_H_
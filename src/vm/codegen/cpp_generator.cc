@@ -0,0 +1,424 @@
+// fv1vm: experimental FV-1 virtual machine
+// Copyright (C) 2022 Patrick Dowling <pld@gurkenkiste.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "cpp_generator.h"
+
+#include <array>
+#include <cstdarg>
+#include <cstdio>
+
+#include "fv1/debug/fv1_debug.h"
+
+namespace fv1 {
+namespace codegen {
+
+namespace {
+
+void Append(std::string &s, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+void Append(std::string &s, const char *fmt, ...)
+{
+  char buffer[256];
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(buffer, sizeof(buffer), fmt, args);
+  va_end(args);
+  s += buffer;
+}
+
+bool HasRegisterOperand(OPCODE opcode)
+{
+  switch (opcode) {
+    case OPCODE::RDAX:
+    case OPCODE::RDFX:
+    case OPCODE::WRAX:
+    case OPCODE::WRHX:
+    case OPCODE::WRLX:
+    case OPCODE::MAXX:
+    case OPCODE::MULX:
+    case OPCODE::LDAX: return true;
+    default: return false;
+  }
+}
+
+// Registers 0x00-0x07 are read by the LFOs (and written by WLDx) so they stay in the state, all
+// others only exist as far as the program is concerned and become locals.
+constexpr bool IsLocalRegister(int32_t r)
+{
+  return r > RMP1_RANGE;
+}
+
+class ProgramWriter {
+public:
+  using VM = CppGenerator::VM;
+  using CompiledInstruction = VM::CompiledInstruction;
+
+  explicit ProgramWriter(const VM &vm) : vm_{vm} {}
+
+  std::string Write(const std::string &name)
+  {
+    Analyze();
+
+    Append(code_, "// %s\n", name.c_str());
+    Append(code_,
+           "void %s(Runtime &runtime, const AudioFrame *in, AudioFrame *out, size_t num_frames)\n",
+           name.c_str());
+    Append(code_, "{\n");
+    Append(code_, "  auto &state = runtime.state_;\n");
+    Append(code_, "  [[maybe_unused]] auto &registers = state.registers_;\n");
+    Append(code_, "  [[maybe_unused]] auto &delay_memory = runtime.delay_memory_;\n");
+    Append(code_, "  Register acc = state.acc_;\n");
+    Append(code_, "  Register pacc = state.pacc_;\n");
+    Append(code_, "  Register prev_acc = acc;\n");
+    for (int32_t r = 0; r < static_cast<int32_t>(kNumRegisters); ++r) {
+      if (local_[r])
+        Append(code_, "  Register r%d = registers[%d];  // %s\n", r, r,
+               debug::to_string(static_cast<REGISTER>(r)));
+    }
+    Append(code_, "\n");
+    Append(code_, "  for (; num_frames; --num_frames, ++in, ++out) {\n");
+    Append(code_, "    %s.store(in->l);\n", R(ADCL).c_str());
+    if (vm_.features() & VM::FEATURE_STEREO)
+      Append(code_, "    %s.store(in->r);\n", R(ADCR).c_str());
+
+    for (int32_t ic = 0; ic < kMaxInstructionCount; ++ic) {
+      if (jump_target_[ic]) Append(code_, "  L%d:\n", ic);
+      Instruction(vm_.get_instruction(ic), ic);
+    }
+
+    if (jump_target_[kMaxInstructionCount]) Append(code_, "  end_of_program:\n");
+    Append(code_, "    runtime.Tick<%s>();\n", TickMask().c_str());
+    Append(code_, "    state.first_run = false;\n");
+    Append(code_, "    %s.read(out->l);\n", R(DACL).c_str());
+    Append(code_, "    %s.read(out->r);\n", R(DACR).c_str());
+    Append(code_, "  }\n\n");
+
+    for (int32_t r = 0; r < static_cast<int32_t>(kNumRegisters); ++r)
+      if (local_[r]) Append(code_, "  registers[%d] = r%d;\n", r, r);
+    if (vm_.features() & VM::FEATURE_PACC) Append(code_, "  state.pacc_ = pacc;\n");
+    Append(code_, "  state.acc_ = acc;\n");
+    Append(code_, "}\n\n");
+    return code_;
+  }
+
+private:
+  const VM &vm_;
+  std::string code_;
+
+  std::array<bool, kNumRegisters> local_ = {};
+  std::array<bool, kMaxInstructionCount + 1> jump_target_ = {};
+  uint32_t lfo_mask_ = 0;
+
+  static int32_t Target(const CompiledInstruction &instruction, int32_t ic)
+  {
+    auto target = ic + 1 + instruction.constants[1].loadi();
+    return target < kMaxInstructionCount ? target : kMaxInstructionCount;
+  }
+
+  void Analyze()
+  {
+    local_[ADCL] = local_[ADCR] = local_[DACL] = local_[DACR] = true;
+    for (int32_t ic = 0; ic < kMaxInstructionCount; ++ic) {
+      const auto &instruction = vm_.get_instruction(ic);
+      const auto c0 = instruction.constants[0].loadi();
+      switch (instruction.get_opcode()) {
+        case OPCODE::RMPA: local_[ADDR_PTR] = true; break;
+        case OPCODE::SKP:
+        case OPCODE::JMP: jump_target_[Target(instruction, ic)] = true; break;
+        case OPCODE::CHO_RDA_SIN:
+        case OPCODE::CHO_SOF_SIN:
+          lfo_mask_ |= c0 ? RuntimeI32::LFO_SIN1 : RuntimeI32::LFO_SIN0;
+          break;
+        case OPCODE::CHO_RDA_RMP:
+        case OPCODE::CHO_SOF_RMP:
+          lfo_mask_ |= c0 ? RuntimeI32::LFO_RMP1 : RuntimeI32::LFO_RMP0;
+          break;
+        case OPCODE::CHO_RDAL: {
+          static constexpr uint32_t kLfoMasks[] = {RuntimeI32::LFO_SIN0, RuntimeI32::LFO_SIN0,
+                                                   RuntimeI32::LFO_SIN1, RuntimeI32::LFO_SIN1,
+                                                   RuntimeI32::LFO_RMP0, RuntimeI32::LFO_RMP1};
+          if (c0 >= 0 && c0 < 6) lfo_mask_ |= kLfoMasks[c0];
+        } break;
+        default:
+          if (HasRegisterOperand(instruction.get_opcode()) && IsLocalRegister(c0))
+            local_[c0] = true;
+          break;
+      }
+    }
+  }
+
+  std::string TickMask() const
+  {
+    static constexpr const char *kNames[] = {"Runtime::LFO_SIN0", "Runtime::LFO_SIN1",
+                                             "Runtime::LFO_RMP0", "Runtime::LFO_RMP1"};
+    std::string mask;
+    for (uint32_t i = 0; i < 4; ++i) {
+      if (!(lfo_mask_ & (1U << i))) continue;
+      if (!mask.empty()) mask += " | ";
+      mask += kNames[i];
+    }
+    return mask.empty() ? "0" : mask;
+  }
+
+  std::string R(int32_t r) const
+  {
+    char buffer[32];
+    if (local_[r])
+      snprintf(buffer, sizeof(buffer), "r%d", r);
+    else
+      snprintf(buffer, sizeof(buffer), "registers[%d]", r);
+    return buffer;
+  }
+
+  void Step(const char *indent = "    ")
+  {
+    Append(code_, "%spacc = prev_acc;\n", indent);
+    Append(code_, "%sprev_acc = acc;\n", indent);
+  }
+
+  void Jump(int32_t target, const char *indent)
+  {
+    if (target < kMaxInstructionCount)
+      Append(code_, "%sgoto L%d;\n", indent, target);
+    else
+      Append(code_, "%sgoto end_of_program;\n", indent);
+  }
+
+  // Expressions match vm_execute_ops.h, with the constants inlined
+  void Instruction(const CompiledInstruction &instruction, int32_t ic)
+  {
+    const auto opcode = instruction.get_opcode();
+    const auto c0 = instruction.constants[0].loadi();
+    const auto c1 = instruction.constants[1].loadi();
+    const auto c2 = instruction.constants[2].loadi();
+    const auto r = R(c0 & static_cast<int32_t>(kNumRegisters - 1));
+    const char *rx = r.c_str();
+
+    Append(code_, "    // %d: %s\n", ic, debug::to_string(opcode));
+    switch (opcode) {
+      case OPCODE::RDA:
+        Append(code_, "    acc.store(delay_memory.Load(%d) * SF23{%d} + acc.load());\n", c0, c1);
+        break;
+      case OPCODE::RMPA:
+        Append(code_,
+               "    acc.store(delay_memory.Load(%s.load_addr()) * SF23{%d} + acc.load());\n",
+               R(ADDR_PTR).c_str(), c0);
+        break;
+      case OPCODE::WRA:
+        Append(code_, "    delay_memory.Store(%d, acc);\n", c0);
+        Append(code_, "    acc.store(acc.load() * SF23{%d});\n", c1);
+        break;
+      case OPCODE::WRAP:
+        Append(code_, "    delay_memory.Store(%d, acc);\n", c0);
+        Append(code_, "    acc.store(acc.load() * SF23{%d} + delay_memory.last_read());\n", c1);
+        break;
+      case OPCODE::RDAX:
+        Append(code_, "    acc.store(%s.load() * SF23{%d} + acc.load());\n", rx, c1);
+        break;
+      case OPCODE::RDFX:
+        Append(code_, "    acc.store((acc.load() - %s.load()) * SF23{%d} + %s.load());\n", rx, c1,
+               rx);
+        break;
+      case OPCODE::WRAX:
+        Append(code_, "    %s.store(acc);\n", rx);
+        Append(code_, "    acc.store(acc.load() * SF23{%d});\n", c1);
+        break;
+      case OPCODE::WRHX:
+        Append(code_, "    %s.store(acc);\n", rx);
+        Append(code_, "    acc.store(acc.load() * SF23{%d} + pacc.load());\n", c1);
+        break;
+      case OPCODE::WRLX:
+        Append(code_, "    %s.store(acc);\n", rx);
+        Append(code_, "    acc.store((pacc.load() - acc.load()) * SF23{%d} + pacc.load());\n", c1);
+        break;
+      case OPCODE::MAXX:
+        Append(code_, "    {\n");
+        Append(code_, "      auto abs_rxc = Engine::ABS(%s.load() * SF23{%d});\n", rx, c1);
+        Append(code_, "      auto abs_acc = Engine::ABS(acc.load());\n");
+        Append(code_, "      acc.store(abs_rxc > abs_acc ? abs_rxc : abs_acc);\n");
+        Append(code_, "    }\n");
+        break;
+      case OPCODE::MULX: Append(code_, "    acc.store(acc.load() * %s.load());\n", rx); break;
+      case OPCODE::SOF:
+        Append(code_, "    acc.store(acc.load() * SF23{%d} + SF23{%d});\n", c0, c1);
+        break;
+      case OPCODE::AND:
+      case OPCODE::OR:
+      case OPCODE::XOR:
+        Append(code_, "    acc.storei(core::%s<SF23>(acc.loadi(), 0x%06x));\n",
+               OPCODE::AND == opcode ? "AND" : (OPCODE::OR == opcode ? "OR" : "XOR"), c0);
+        break;
+      case OPCODE::SKP: {
+        std::string condition;
+        auto add = [&condition](const char *c) {
+          if (!condition.empty()) condition += " && ";
+          condition += c;
+        };
+        if (SKP_FLAGS::NEG & c0) add("acc.neg()");
+        if (SKP_FLAGS::GEZ & c0) add("acc.gez()");
+        if (SKP_FLAGS::ZRO & c0) add("acc.zero()");
+        if (SKP_FLAGS::ZRC & c0) add("acc.gez() != pacc.gez()");
+        if (SKP_FLAGS::RUN & c0) add("!state.first_run");
+        Append(code_, "    {\n");
+        Append(code_, "      bool skip = %s;\n", condition.empty() ? "true" : condition.c_str());
+        Step("      ");
+        Append(code_, "      if (skip)\n");
+        Jump(Target(instruction, ic), "        ");
+        Append(code_, "    }\n");
+      }
+        return;
+      case OPCODE::JMP:
+        Step();
+        Jump(Target(instruction, ic), "    ");
+        return;
+      case OPCODE::WLDS:
+        Append(code_, "    registers[SIN%d_RATE].store(SF23{%d});\n", c0 ? 1 : 0, c1);
+        Append(code_, "    registers[SIN%d_RANGE].store(SF23{%d});\n", c0 ? 1 : 0, c2);
+        Append(code_, "    runtime.sin_lfo_[%d].Jam();\n", c0 ? 1 : 0);
+        break;
+      case OPCODE::JAM: Append(code_, "    runtime.ramp_lfo_[%d].Jam();\n", c0); break;
+      case OPCODE::CLR: Append(code_, "    acc.clr();\n"); break;
+      case OPCODE::NOT: Append(code_, "    acc.storei(core::NOT<SF23>(acc.loadi()));\n"); break;
+      case OPCODE::ABSA: Append(code_, "    acc.store(Engine::ABS(acc.load()));\n"); break;
+      case OPCODE::LDAX: Append(code_, "    acc.store(%s);\n", rx); break;
+      case OPCODE::WLDR:
+        Append(code_, "    registers[RMP%d_RATE].store(%d);\n", c0 ? 1 : 0, c1);
+        Append(code_, "    registers[RMP%d_RANGE].store(%d);\n", c0 ? 1 : 0, c2);
+        Append(code_, "    runtime.ramp_lfo_[%d].Jam();\n", c0 ? 1 : 0);
+        break;
+      case OPCODE::CHO_RDAL: Append(code_, "    acc.store(runtime.read_lfo(%d));\n", c0); break;
+      case OPCODE::CHO_RDA_RMP:
+      case OPCODE::CHO_RDA_SIN:
+        Append(code_, "    {\n");
+        Append(code_, "      const auto lfo_value = runtime.%s[%d].Read(CHO_FLAGS(0x%02x));\n",
+               OPCODE::CHO_RDA_RMP == opcode ? "ramp_lfo_" : "sin_lfo_", c0, c1);
+        Append(code_,
+               "      acc.store(delay_memory.Load(%d + lfo_value.offset) * lfo_value.coefficient + "
+               "acc.load());\n",
+               c2);
+        Append(code_, "    }\n");
+        break;
+      case OPCODE::CHO_SOF_RMP:
+      case OPCODE::CHO_SOF_SIN:
+        Append(code_, "    {\n");
+        Append(code_, "      const auto lfo_value = runtime.%s[%d].Read(CHO_FLAGS(0x%02x));\n",
+               OPCODE::CHO_SOF_RMP == opcode ? "ramp_lfo_" : "sin_lfo_", c0, c1);
+        Append(code_, "      acc.store(acc.load() * lfo_value.coefficient + SF23{%d});\n", c2);
+        Append(code_, "    }\n");
+        break;
+      case OPCODE::LOG:
+      case OPCODE::EXP:
+      case OPCODE::CHO_RDA:
+      case OPCODE::CHO_SOF:
+      case OPCODE::NOP:
+      case OPCODE::UNKNOWN:
+      // Only in the interpreter programs, see VM::ReduceCoefficients
+      case OPCODE::RDAX_ADD:
+      case OPCODE::RDAX_SUB:
+      case OPCODE::RDA_ADD:
+      case OPCODE::WRAX_MOV:
+      case OPCODE::WRAX_CLR:
+      case OPCODE::SOF_NEG:
+      case OPCODE::SOF_HALF:
+      case OPCODE::SOF_NEG2:
+      case OPCODE::ALLPASS:
+      case OPCODE::LPF1:
+      case OPCODE::HPF1:
+      case OPCODE::CHO_INTERP_RMP:
+      case OPCODE::CHO_INTERP_SIN:
+      case OPCODE::RDA_NOSAT:
+      case OPCODE::RDAX_NOSAT:
+      case OPCODE::RDFX_NOSAT:
+      case OPCODE::WRAX_NOSAT:
+      case OPCODE::MULX_NOSAT:
+      case OPCODE::SOF_NOSAT:
+      case OPCODE::RDA_SAVE:
+      case OPCODE::WRA_SAVE:
+      case OPCODE::RDA_CACHED:
+      FV1_SUPEROPS(FV1_SUPEROP_CASE)
+      case OPCODE::REAL_OPCODES_LAST: break;
+    }
+    Step();
+  }
+};
+
+void WriteInstructions(std::string &code, const std::string &name,
+                       const CppGenerator::VM::ProgramView &program)
+{
+  if (!program.length) return;
+  Append(code, "static constexpr Runtime::VM::CompiledInstruction %s[] = {\n", name.c_str());
+  for (size_t ic = 0; ic < program.length; ++ic) {
+    const auto &instruction = program.instructions[ic];
+    auto opcode = instruction.get_opcode();
+    for (const auto &superop : kSuperops)
+      if (superop.opcode == opcode) opcode = superop.sequence[0];
+    Append(code, "    {OPCODE{0x%02x}, {", static_cast<unsigned>(opcode));
+    for (size_t i = 0; i < instruction.constants.size(); ++i)
+      Append(code, "%sEngine::Constant{%d}", i ? ", " : "", instruction.constants[i].loadi());
+    Append(code, "}},  // %s\n", debug::to_string(opcode));
+  }
+  code += "};\n";
+}
+
+std::string ViewInitializer(const std::string &name, const CppGenerator::VM::ProgramView &program)
+{
+  if (!program.length) return "{nullptr, 0}";
+  return "{" + name + ", " + std::to_string(program.length) + "}";
+}
+
+}  // namespace
+
+/*static*/ std::string CppGenerator::Preamble()
+{
+  return "// Generated by fv1_codegen, do not edit\n"
+         "\n"
+         "#include \"vm/codegen/codegen_runtime.h\"\n"
+         "#include \"vm/engines/delay_i32.h\"\n"
+         "#include \"vm/engines/engine_i32_v1.h\"\n"
+         "\n"
+         "using namespace fv1;\n"
+         "using Runtime =\n"
+         "    fv1::codegen::Runtime<fv1::engine::EngineI32, fv1::engine::DelayStorageI32>;\n"
+         "using Engine = fv1::engine::EngineI32;\n"
+         "using AudioFrame = Runtime::AudioFrame;\n"
+         "using Register = Runtime::Register;\n"
+         "\n";
+}
+
+/*static*/ std::string CppGenerator::Program(const VM &vm, const std::string &name)
+{
+  ProgramWriter writer{vm};
+  return writer.Write(name);
+}
+
+/*static*/ std::string CppGenerator::Bytecode(const VM &vm, const std::string &name)
+{
+  std::string code;
+  Append(code, "// %s\n", name.c_str());
+  WriteInstructions(code, name + "_init", vm.init_program().view());
+  WriteInstructions(code, name + "_steady", vm.steady_program().view());
+  WriteInstructions(code, name + "_prologue", vm.prologue_program().view());
+  Append(code, "static constexpr Runtime::VM::PrecompiledProgram %s = {\n", name.c_str());
+  Append(code, "    0x%02x, %s, %s,\n", vm.features(),
+         ViewInitializer(name + "_init", vm.init_program().view()).c_str(),
+         ViewInitializer(name + "_steady", vm.steady_program().view()).c_str());
+  Append(code, "    %s};\n\n",
+         ViewInitializer(name + "_prologue", vm.prologue_program().view()).c_str());
+  return code;
+}
+
+}  // namespace codegen
+}  // namespace fv1
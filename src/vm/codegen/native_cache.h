@@ -0,0 +1,86 @@
+// fv1vm: experimental FV-1 virtual machine
+// Copyright (C) 2022 Patrick Dowling <pld@gurkenkiste.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef FV1_NATIVE_CACHE_H_
+#define FV1_NATIVE_CACHE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "vm/codegen/cpp_generator.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define FV1_NATIVE_CACHE
+#endif
+
+namespace fv1 {
+namespace codegen {
+
+// Opt-in cache of programs compiled to shared objects.
+//
+// Compile translates the program with CppGenerator, and looks for a shared object matching the
+// hash of the source in the cache directory. On a miss it's built with the system compiler. The
+// result is loaded and set as the VM's native program, so programs seen before start at native
+// speed. Any failure along the way just leaves the VM using the interpreter.
+//
+// Loaded objects stay loaded until the cache is destroyed, so it has to outlive the VMs using it.
+class NativeCache {
+public:
+  using VM = CppGenerator::VM;
+
+  struct Options {
+    std::string directory = "./build/native_cache";
+    std::string compiler = "c++";
+    std::string flags = "-std=c++17 -O2";
+    std::string include_dir = "./src";  // fv1vm sources
+  };
+
+  explicit NativeCache(const Options &options);
+  ~NativeCache();
+
+  NativeCache(const NativeCache &) = delete;
+  NativeCache &operator=(const NativeCache &) = delete;
+
+  // Compile program (BinaryProgramBuffer layout) into vm. Returns true if a native version was
+  // available, false if it's using the interpreter.
+  bool Compile(VM &vm, const char *program);
+
+  // Key for the generated source of a program, also includes the build options and the headers
+  // under include_dir (that the object inlines) as they were when the cache was constructed
+  uint64_t Hash(const std::string &code) const;
+
+  // What's built for the program currently compiled into the vm
+  static std::string Source(const VM &vm);
+
+  size_t hits() const { return hits_; }
+  size_t misses() const { return misses_; }
+
+private:
+  const Options options_;
+  const uint64_t headers_hash_;
+  std::vector<void *> handles_;
+  size_t hits_ = 0;
+  size_t misses_ = 0;
+
+  VM::NativeProgramFn Load(const std::string &path);
+  bool Build(const std::string &code, const std::string &path) const;
+};
+
+}  // namespace codegen
+}  // namespace fv1
+
+#endif  // FV1_NATIVE_CACHE_H_
@@ -0,0 +1,127 @@
+// fv1vm: experimental FV-1 virtual machine
+// Copyright (C) 2022 Patrick Dowling <pld@gurkenkiste.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef ENGINES_DELAY_F16_H_
+#define ENGINES_DELAY_F16_H_
+
+#include <cstdint>
+#include <cstring>
+
+#include "fv1/fv1_defs.h"
+
+#if defined(__F16C__)
+#include <immintrin.h>
+#define FV1_DELAY_F16_F16C
+#elif defined(__ARM_FP16_FORMAT_IEEE)
+#define FV1_DELAY_F16_FP16
+#endif
+
+// Delay memory as IEEE half floats for use with EngineF32.
+//
+// This halves the size of the DelayMemoryBuffer compared to DelayStorageI32. The 11 bit mantissa
+// is a lot less than S.23, but the exponent keeps quiet signals (e.g. reverb tails) reasonable.
+// Conversion uses F16C on x86 and __fp16 on ARM, with a software fallback.
+namespace fv1 {
+namespace engine {
+
+struct DelayStorageF16 {
+  using value_type = float;
+  using storage_type = uint16_t;
+
+#if defined(FV1_DELAY_F16_F16C)
+  static inline storage_type Pack(const value_type value)
+  {
+    return static_cast<storage_type>(_cvtss_sh(value, _MM_FROUND_TO_NEAREST_INT));
+  }
+  static inline value_type Unpack(const storage_type value) { return _cvtsh_ss(value); }
+#elif defined(FV1_DELAY_F16_FP16)
+  static inline storage_type Pack(const value_type value)
+  {
+    const __fp16 h = value;
+    storage_type s;
+    std::memcpy(&s, &h, sizeof(s));
+    return s;
+  }
+  static inline value_type Unpack(const storage_type value)
+  {
+    __fp16 h;
+    std::memcpy(&h, &value, sizeof(h));
+    return h;
+  }
+#else
+  static inline storage_type Pack(const value_type value) { return FloatToHalf(value); }
+  static inline value_type Unpack(const storage_type value) { return HalfToFloat(value); }
+#endif
+
+  // Software conversions, round-to-nearest-even like the hardware versions.
+  // Based on F. Giesen's "float->half variants" (public domain).
+  static inline storage_type FloatToHalf(const float value)
+  {
+    uint32_t f = as_uint(value);
+    const uint32_t sign = f & 0x80000000U;
+    f ^= sign;
+
+    uint32_t h;
+    if (f >= (127U + 16U) << 23) {
+      // Overflow -> inf, NaN stays NaN
+      h = f > 0x7f800000U ? 0x7e00U : 0x7c00U;
+    } else if (f < 113U << 23) {
+      // Denormal or zero, the float addition does the rounding
+      const uint32_t denorm_magic = ((127U - 15U) + (23U - 10U) + 1U) << 23;
+      h = as_uint(as_float(f) + as_float(denorm_magic)) - denorm_magic;
+    } else {
+      const uint32_t mantissa_odd = (f >> 13) & 1U;
+      f += ((15U - 127U) << 23) + 0xfffU + mantissa_odd;
+      h = f >> 13;
+    }
+    return static_cast<storage_type>(h | (sign >> 16));
+  }
+
+  static inline float HalfToFloat(const storage_type value)
+  {
+    const uint32_t shifted_exp = 0x7c00U << 13;
+    uint32_t f = static_cast<uint32_t>(value & 0x7fffU) << 13;
+    const uint32_t exp = shifted_exp & f;
+    f += (127U - 15U) << 23;
+    if (exp == shifted_exp) {
+      f += (128U - 16U) << 23;  // inf/NaN
+    } else if (!exp) {
+      f += 1U << 23;  // denormal, renormalize
+      f = as_uint(as_float(f) - as_float(113U << 23));
+    }
+    return as_float(f | static_cast<uint32_t>(value & 0x8000U) << 16);
+  }
+
+private:
+  static inline uint32_t as_uint(const float f)
+  {
+    uint32_t u;
+    std::memcpy(&u, &f, sizeof(u));
+    return u;
+  }
+
+  static inline float as_float(const uint32_t u)
+  {
+    float f;
+    std::memcpy(&f, &u, sizeof(f));
+    return f;
+  }
+};
+
+}  // namespace engine
+}  // namespace fv1
+
+#endif  // ENGINES_DELAY_F16_H_
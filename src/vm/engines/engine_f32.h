@@ -0,0 +1,140 @@
+// fv1vm: experimental FV-1 virtual machine
+// Copyright (C) 2022 Patrick Dowling <pld@gurkenkiste.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef ENGINES_ENGINE_F32_H_
+#define ENGINES_ENGINE_F32_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include "fv1/fv1_defs.h"
+#include "vm/vm_types.h"
+
+// Mixed fixed-point/float32 implementation.
+//
+// The arithmetic is done in float, everything that is inherently integer (logical ops, addresses,
+// LFO rates) still sees the S.23 representation via loadi/storei. So AND/OR/XOR/NOT keep their
+// 24-bit semantics, at the cost of a conversion in each direction.
+//
+// Clipping registers to [-1, 1) is optional; without it the results can differ a lot more from
+// the hardware, but it saves two compares per store.
+namespace fv1 {
+namespace engine {
+
+template <bool clip>
+struct EngineF32T {
+  using float_type = float;
+  using float_value = float;
+
+  static constexpr float kScale = static_cast<float>(SF23::MAX + 1);
+  static constexpr float kInvScale = 1.f / kScale;
+
+  static constexpr float_type MIN = -1.f;
+  static constexpr float_type MAX = static_cast<float>(SF23::MAX) * kInvScale;
+  static constexpr float_type ONE = MAX;
+
+  static inline float_type Clip(const float_type v)
+  {
+    if constexpr (clip)
+      return std::clamp(v, MIN, MAX);
+    else
+      return v;
+  }
+
+  // S.23 <-> float. Values with at most 24 significant bits are exact in both directions.
+  static inline float_type FromS23(const int32_t v) { return static_cast<float>(v) * kInvScale; }
+  static inline int32_t ToS23(const float_type v)
+  {
+    return static_cast<int32_t>(std::clamp(v, MIN, MAX) * kScale);
+  }
+
+  struct Register : public RegisterBase<Register> {
+    static constexpr float_type ZERO = 0.f;
+
+    float_value load() const { return value; }
+    int32_t loadi() const { return ToS23(value); }
+
+    void store(const Register &r) { value = r.value; }
+    void store(const float_type v) { value = Clip(v); }
+    // VM::ElideSaturation only applies to the fixed-point engine
+    void store_unsaturated(const float_type v) { value = Clip(v); }
+    // Raw S.23 values, e.g. integer operands or LFO outputs
+    void store(const int32_t v) { value = FromS23(core::SSAT<SF23>(v)); }
+    void store(const SF23 v) { value = FromS23(core::SSAT<SF23>(v.value)); }
+
+    void storei(int32_t v) { value = FromS23(v); }
+
+    void read(float_type &v) const { v = value; }
+
+  private:
+    float_type value{0.f};
+  };
+
+  // Constants are either integers or fixed-point values depending on the operand type, so there's
+  // no conversion on load. Has to stay 32 bits to keep CompiledInstruction compact.
+  struct Constant : public ConstantBase<Constant> {
+    using float_value = float;
+
+    constexpr Constant() = default;
+    // Raw value as returned by loadi, e.g. for precompiled programs
+    explicit constexpr Constant(int32_t raw) : value{raw} {}
+
+    float_value load() const
+    {
+      float f;
+      std::memcpy(&f, &value, sizeof(f));
+      return f;
+    }
+    int32_t loadi() const { return value; }
+
+    inline void store(const int32_t v) { value = v; }
+    inline void store(const SF23 v)
+    {
+      const float f = FromS23(v.value);
+      std::memcpy(&value, &f, sizeof(value));
+    }
+
+    // Also works for float, since FromS23 never generates -0.f
+    bool zero() const { return !value; }
+
+  private:
+    int32_t value{0};
+  };
+  static_assert(sizeof(Constant) == sizeof(int32_t));
+
+  static inline float_type ABS(const float_type value) { return std::fabs(value); }
+  // value * -1.f + 0.f and value * 0.5f + 0.f, which never result in -0.f
+  static inline float_type NEG(const float_type value) { return 0.f - value; }
+  static inline float_type HALF(const float_type value) { return value * 0.5f + 0.f; }
+
+  // Same scaling as EngineI32
+  template <int32_t bits>
+  static inline float_type LfoCoeffToFloat(int32_t f)
+  {
+    return FromS23(f << (SF23::BITS - bits));
+  }
+};
+
+using EngineF32 = EngineF32T<true>;
+using EngineF32NoClip = EngineF32T<false>;
+
+}  // namespace engine
+}  // namespace fv1
+
+#endif  // ENGINES_ENGINE_F32_H_
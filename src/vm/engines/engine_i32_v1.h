@@ -42,6 +42,8 @@ struct EngineI32 {
     void store(const Register &r) { value = r.value; }
     void store(const float_type v) { value = core::SSAT<SF23>(v); }
     void store(const float_value v) { value = core::SSAT<SF23>(v.value); }
+    // Only for values that are known to be in range, see VM::ElideSaturation
+    void store_unsaturated(const float_value v) { value = v.value; }
 
     void storei(int32_t v) { value = v; }
 
@@ -55,6 +57,10 @@ struct EngineI32 {
   struct Constant : public ConstantBase<Constant> {
     using float_value = fv1::SF23;
 
+    constexpr Constant() = default;
+    // Raw value as returned by loadi, e.g. for precompiled programs
+    explicit constexpr Constant(int32_t raw) : value{raw} {}
+
     float_value load() const { return SF23{value}; }
     int32_t loadi() const { return value; }
 
@@ -68,6 +74,9 @@ struct EngineI32 {
   };
 
   static constexpr SF23 ABS(const SF23 value) { return core::ABS(value); }
+  // value * -1.0 and value * 0.5
+  static constexpr SF23 NEG(const SF23 value) { return SF23{-value.value}; }
+  static constexpr SF23 HALF(const SF23 value) { return SF23{value.value >> 1}; }
 
   template <int32_t bits>
   static constexpr float_type LfoCoeffToFloat(int32_t f)
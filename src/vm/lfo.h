@@ -37,6 +37,13 @@ public:
     const typename Engine::float_type coefficient;  // [0, 1)
   };
 
+  // Point to the registers of a different state, e.g. when the state is moved
+  void Bind(const typename Engine::Register *rate, const typename Engine::Register *range)
+  {
+    rate_ = rate;
+    range_ = range;
+  }
+
 protected:
   LfoBase(const typename Engine::Register *rate, const typename Engine::Register *range)
       : rate_{rate}, range_{range}
@@ -75,16 +75,19 @@ public:
   SF23 value() const { return SF23{phase_}; }
 
   // VALID: REG COMPC COMPA RPTR2 NA
-  value_type Read(const CHO_FLAGS flags) const
+  value_type Read(const CHO_FLAGS flags) const { return Read(phase_, flags); }
+
+  // Same for the phase from a different frame (with the same range)
+  value_type Read(const int32_t phase, const CHO_FLAGS flags) const
   {
     if (CHO_FLAGS::NA & flags) {
       // RPTR2 has no effect on NA
-      auto coefficient = crossfade();
+      auto coefficient = crossfade(phase);
       if (CHO_FLAGS::COMPC & flags) coefficient = Engine::ONE - coefficient;
       return value_type{0, coefficient};
     } else {
       const auto r = range();
-      int32_t v = phase_;
+      int32_t v = phase;
       if (CHO_FLAGS::RPTR2 & flags) v = (v + (r >> 1)) & r;
       auto coefficient = Engine::template LfoCoeffToFloat<10>(v & 0x3ff);
       if (CHO_FLAGS::COMPA & flags) v = r - v;
@@ -95,12 +98,13 @@ public:
 
   // TODO Does crossfade go from 0-.5 or 0-1.? v goes from 0.25 at 4096
   // TODO Hardware appears to generate _/^\_ instead of a triangle
-  typename Engine::float_type crossfade() const
+  typename Engine::float_type crossfade() const { return crossfade(phase_); }
+  typename Engine::float_type crossfade(const int32_t phase) const
   {
-    auto v = phase_;
+    auto v = phase;
     auto r = range();
     v = (v > r / 2) ? r - v : v;
-    return v << (2 + amp_shift());
+    return Engine::template LfoCoeffToFloat<SF23::BITS>(v << (2 + amp_shift()));
   }
 
 private:
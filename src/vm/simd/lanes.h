@@ -0,0 +1,120 @@
+// fv1vm: experimental FV-1 virtual machine
+// Copyright (C) 2022 Patrick Dowling <pld@gurkenkiste.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef FV1_SIMD_LANES_H_
+#define FV1_SIMD_LANES_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "fv1/fv1_defs.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace fv1 {
+namespace simd {
+
+// GCC ignores vector_size on typedefs that depend on a template parameter, hence the
+// specializations.
+template <size_t lanes>
+struct VectorTypes;
+
+template <>
+struct VectorTypes<4> {
+  typedef int32_t vector __attribute__((vector_size(4 * sizeof(int32_t))));
+  typedef int64_t wide_vector __attribute__((vector_size(4 * sizeof(int64_t))));
+};
+
+template <>
+struct VectorTypes<8> {
+  typedef int32_t vector __attribute__((vector_size(8 * sizeof(int32_t))));
+  typedef int64_t wide_vector __attribute__((vector_size(8 * sizeof(int64_t))));
+};
+
+template <>
+struct VectorTypes<16> {
+  typedef int32_t vector __attribute__((vector_size(16 * sizeof(int32_t))));
+  typedef int64_t wide_vector __attribute__((vector_size(16 * sizeof(int64_t))));
+};
+
+// S.23 math on N x int32_t using the GCC/clang vector extensions.
+//
+// The semantics are the same as the EngineI32 scalar ops, i.e. the results are bit-exact. With
+// AVX2 enabled 8 lanes map onto a single ymm register, otherwise the compiler splits the vectors
+// into whatever is available. Masks are the result of vector comparisons (all bits set or clear).
+template <size_t lanes>
+struct Lanes {
+  using vector = typename VectorTypes<lanes>::vector;
+  using wide_vector = typename VectorTypes<lanes>::wide_vector;
+
+  static constexpr size_t kLanes = lanes;
+  static constexpr uint32_t kAllLanes = (1U << lanes) - 1;
+
+  static inline vector Broadcast(int32_t value) { return vector{} + value; }
+
+  static inline vector Select(vector mask, vector a, vector b) { return (a & mask) | (b & ~mask); }
+
+  // (int64_t(a) * b) >> 23
+  static inline vector Mul(vector a, vector b)
+  {
+#if defined(__AVX2__)
+    if constexpr (8 == lanes) {
+      // mul_epi32 only uses the even lanes, the odd results end up in the upper half
+      const auto va = reinterpret_cast<__m256i>(a);
+      const auto vb = reinterpret_cast<__m256i>(b);
+      const auto even = _mm256_mul_epi32(va, vb);
+      const auto odd = _mm256_mul_epi32(_mm256_srli_epi64(va, 32), _mm256_srli_epi64(vb, 32));
+      const auto result = _mm256_blend_epi32(_mm256_srli_epi64(even, SF23::FRAC),
+                                             _mm256_slli_epi64(odd, 32 - SF23::FRAC), 0xaa);
+      return reinterpret_cast<vector>(result);
+    }
+#endif
+    const auto product = __builtin_convertvector(a, wide_vector) *
+                         __builtin_convertvector(b, wide_vector);
+    return __builtin_convertvector(product >> SF23::FRAC, vector);
+  }
+
+  static inline vector SSAT(vector value)
+  {
+    const auto min = Broadcast(SF23::MIN);
+    const auto max = Broadcast(SF23::MAX);
+    value = Select(value < min, min, value);
+    return Select(value > max, max, value);
+  }
+
+  static inline vector ABS(vector value) { return Select(value < 0, -value, value); }
+
+  // Sign-extend from bit 23 (core::SX)
+  static inline vector SX(vector value)
+  {
+    return (value << (32 - SF23::BITS)) >> (32 - SF23::BITS);
+  }
+
+  // Bit per lane
+  static inline uint32_t Bits(vector mask)
+  {
+    uint32_t bits = 0;
+    for (size_t l = 0; l < lanes; ++l) bits |= static_cast<uint32_t>(mask[l] & 1) << l;
+    return bits;
+  }
+};
+
+}  // namespace simd
+}  // namespace fv1
+
+#endif  // FV1_SIMD_LANES_H_
@@ -0,0 +1,416 @@
+// fv1vm: experimental FV-1 virtual machine
+// Copyright (C) 2022 Patrick Dowling <pld@gurkenkiste.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef FV1_SIMD_MULTI_INSTANCE_H_
+#define FV1_SIMD_MULTI_INSTANCE_H_
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+#include "vm/engines/delay_i32.h"
+#include "vm/engines/engine_i32_v1.h"
+#include "vm/simd/lanes.h"
+#include "vm/vm.h"
+
+namespace fv1 {
+namespace simd {
+
+// Runs the same program on N independent instances at once, one per vector lane.
+//
+// The byte code (and so the constants) comes from a compiled VM, but each lane has its own
+// registers, ACC/PACC, LFOs and delay memory. The delay memory is interleaved so reads and writes
+// with a constant address are a single vector access; only RMPA and CHO RDA need to gather.
+//
+// SKP is evaluated per lane. As long as all lanes agree it's a normal jump. Otherwise the lanes
+// that skip are masked off until the target is reached, and the other lanes continue on their own.
+// Since jumps only go forward, the lanes have converged again by the end of the program.
+//
+// The LFOs are the scalar SinLfoImpl/RampLfoImpl per lane, reading their rate/range from that
+// lane's registers. The result for each lane is bit-exact with VM<EngineI32, DelayStorageI32>.
+template <size_t lanes = 8>
+class MultiInstance {
+public:
+  using VM = fv1::VM<engine::EngineI32, engine::DelayStorageI32>;
+  using AudioFrame = VM::AudioFrame;
+  using Parameters = VM::Parameters;
+  using DelayMemoryBuffer = std::array<int32_t, kDelayMemorySize * lanes>;
+
+  static constexpr size_t kLanes = lanes;
+
+  // Program is read from the vm, delay memory is maintained externally
+  MultiInstance(const VM &source, DelayMemoryBuffer &delay_memory)
+      : vm_{source},
+        delay_memory_{delay_memory},
+        lfos_{MakeLfos(registers_, std::make_index_sequence<lanes>{})}
+  {
+    Reset();
+  }
+
+  // Same reset as VM::Compile for all lanes, call after compiling a (different) program
+  void Reset();
+
+  void SetParameters(size_t lane, const Parameters &params)
+  {
+    registers_[POT0].values[lane].store(params.pots[0]);
+    registers_[POT1].values[lane].store(params.pots[1]);
+    registers_[POT2].values[lane].store(params.pots[2]);
+  }
+
+  // Frames are interleaved, i.e. lane l of frame i is at [i * kLanes + l]
+  void Execute(const AudioFrame *in, AudioFrame *out, size_t num_frames);
+
+  int32_t load_register(size_t lane, size_t index) const
+  {
+    return registers_[index].values[lane].loadi();
+  }
+
+  int32_t load_acc(size_t lane) const { return acc_[lane]; }
+
+private:
+  using L = Lanes<lanes>;
+  using vector = typename L::vector;
+  using Register = engine::EngineI32::Register;
+  using RampLfo = RampLfoImpl<engine::EngineI32>;
+  using SinLfo = SinLfoImpl<engine::EngineI32>;
+
+  struct alignas(sizeof(vector)) LaneRegister {
+    std::array<Register, lanes> values;
+  };
+  using Registers = std::array<LaneRegister, kNumRegisters>;
+
+  struct Lfos {
+    Lfos(Registers &registers, size_t lane)
+        : ramp{{{&registers[RMP0_RATE].values[lane], &registers[RMP0_RANGE].values[lane]},
+                {&registers[RMP1_RATE].values[lane], &registers[RMP1_RANGE].values[lane]}}},
+          sin{{{&registers[SIN0_RATE].values[lane], &registers[SIN0_RANGE].values[lane]},
+               {&registers[SIN1_RATE].values[lane], &registers[SIN1_RANGE].values[lane]}}}
+    {}
+
+    std::array<RampLfo, 2> ramp;
+    std::array<SinLfo, 2> sin;
+
+    // Index as used by CHO_RDAL after VM::Optimize
+    SF23 read(int32_t idx) const
+    {
+      switch (idx) {
+        case 0: return sin[0].sin();
+        case 1: return sin[0].cos();
+        case 2: return sin[1].sin();
+        case 3: return sin[1].cos();
+        case 4: return ramp[0].value();
+        case 5: return ramp[1].value();
+      }
+      return SF23{0};
+    }
+  };
+
+  template <size_t... lane>
+  static std::array<Lfos, lanes> MakeLfos(Registers &registers, std::index_sequence<lane...>)
+  {
+    return {{Lfos{registers, lane}...}};
+  }
+
+  const VM &vm_;
+  DelayMemoryBuffer &delay_memory_;
+  int32_t cursor_ = 0;
+  bool first_run_ = true;
+
+  vector acc_;
+  vector pacc_;
+  vector prev_acc_;
+  vector last_read_;
+
+  // Lanes that skipped are inactive until ic reaches their resume point.
+  vector resume_;
+  int32_t pending_ = 0;  // max(resume_)
+
+  Registers registers_;
+  std::array<Lfos, lanes> lfos_;
+
+  template <bool masked>
+  int32_t Step(int32_t ic, vector active);
+
+  void Tick()
+  {
+    cursor_ = cursor_ ? cursor_ - 1 : kDelayMemorySize - 1;
+    for (auto &lfo : lfos_) {
+      for (auto &rmp : lfo.ramp) rmp.Tick();
+      for (auto &sin : lfo.sin) sin.Tick();
+    }
+  }
+
+  template <bool masked>
+  static inline void Assign(vector &dst, vector value, vector active)
+  {
+    if constexpr (masked)
+      dst = L::Select(active, value, dst);
+    else
+      dst = value;
+  }
+
+  inline vector load(size_t index) const
+  {
+    vector v;
+    std::memcpy(&v, registers_[index].values.data(), sizeof(v));
+    return v;
+  }
+
+  template <bool masked>
+  inline void store(size_t index, vector value, vector active)
+  {
+    if constexpr (masked) value = L::Select(active, value, load(index));
+    std::memcpy(static_cast<void *>(registers_[index].values.data()), &value, sizeof(value));
+  }
+
+  inline int32_t *delay_at(int32_t index)
+  {
+    return delay_memory_.data() + ((cursor_ + index) & (kDelayMemorySize - 1)) * lanes;
+  }
+
+  template <bool masked>
+  inline vector LoadDelay(int32_t index, vector active)
+  {
+    vector v;
+    std::memcpy(&v, delay_at(index), sizeof(v));
+    Assign<masked>(last_read_, v, active);
+    return v;
+  }
+
+  template <bool masked>
+  inline vector GatherDelay(vector index, vector active)
+  {
+    vector v;
+    for (size_t l = 0; l < lanes; ++l) v[l] = delay_at(index[l])[l];
+    Assign<masked>(last_read_, v, active);
+    return v;
+  }
+
+  template <bool masked>
+  inline void StoreDelay(int32_t index, vector value, vector active)
+  {
+    auto dst = delay_at(index);
+    if constexpr (masked) {
+      vector current;
+      std::memcpy(&current, dst, sizeof(current));
+      value = L::Select(active, value, current);
+    }
+    std::memcpy(dst, &value, sizeof(value));
+  }
+};
+
+template <size_t lanes>
+void MultiInstance<lanes>::Reset()
+{
+  first_run_ = true;
+  acc_ = pacc_ = prev_acc_ = last_read_ = resume_ = L::Broadcast(0);
+  pending_ = 0;
+  for (auto &r : registers_)
+    for (auto &l : r.values) l.clr();
+  std::fill(delay_memory_.begin(), delay_memory_.end(), 0);
+  cursor_ = 0;
+  for (auto &lfo : lfos_) {
+    for (auto &rmp : lfo.ramp) rmp.Jam();
+    for (auto &sin : lfo.sin) sin.Jam();
+  }
+}
+
+template <size_t lanes>
+void MultiInstance<lanes>::Execute(const AudioFrame *in, AudioFrame *out, size_t num_frames)
+{
+  prev_acc_ = acc_;
+  const bool stereo = vm_.features() & VM::FEATURE_STEREO;
+
+  for (; num_frames; --num_frames, in += lanes, out += lanes) {
+    for (size_t l = 0; l < lanes; ++l) {
+      registers_[ADCL].values[l].store(in[l].l);
+      if (stereo) registers_[ADCR].values[l].store(in[l].r);
+    }
+
+    int32_t ic = 0;
+    while (ic < kMaxInstructionCount) {
+      if (ic >= pending_) {
+        ic = Step<false>(ic, L::Broadcast(-1));
+      } else {
+        const vector active = resume_ <= L::Broadcast(ic);
+        if (L::Bits(active)) {
+          ic = Step<true>(ic, active);
+        } else {
+          // Nothing to do until the first lane resumes
+          ic = kMaxInstructionCount;
+          for (size_t l = 0; l < lanes; ++l) ic = std::min(ic, resume_[l]);
+        }
+      }
+    }
+    resume_ = L::Broadcast(0);
+    pending_ = 0;
+
+    Tick();
+    first_run_ = false;
+    for (size_t l = 0; l < lanes; ++l) {
+      registers_[DACL].values[l].read(out[l].l);
+      registers_[DACR].values[l].read(out[l].r);
+    }
+  }
+}
+
+// Execute instruction ic for the active lanes and return the next ic.
+// See vm_execute_ops.h for the scalar versions.
+template <size_t lanes>
+template <bool masked>
+int32_t MultiInstance<lanes>::Step(int32_t ic, vector active)
+{
+  const auto &instruction = vm_.get_instruction(ic);
+  const auto c0 = instruction.constants[0].loadi();
+  const auto c1 = instruction.constants[1].loadi();
+  const auto c2 = instruction.constants[2].loadi();
+  vector acc = acc_;
+  int32_t next = ic + 1;
+
+  // Lanes that jump (SKP/JMP), all of them skip if they agree
+  auto jump = [&](vector skip) {
+    if constexpr (masked) skip &= active;
+    const auto bits = L::Bits(skip);
+    if (!bits) return;
+    const auto target = ic + 1 + c1;
+    if (!masked && L::kAllLanes == bits) {
+      next = target;
+    } else {
+      resume_ = L::Select(skip, L::Broadcast(target), resume_);
+      pending_ = std::max(pending_, target);
+    }
+  };
+
+  switch (instruction.get_opcode()) {
+    case OPCODE::RDA:
+      acc = L::SSAT(L::Mul(LoadDelay<masked>(c0, active), L::Broadcast(c1)) + acc);
+      break;
+    case OPCODE::RMPA: {
+      const auto ptr = (load(ADDR_PTR) >> 8) & kDelayAddrMask;
+      acc = L::SSAT(L::Mul(GatherDelay<masked>(ptr, active), L::Broadcast(c0)) + acc);
+    } break;
+    case OPCODE::WRA:
+      StoreDelay<masked>(c0, acc, active);
+      acc = L::SSAT(L::Mul(acc, L::Broadcast(c1)));
+      break;
+    case OPCODE::WRAP:
+      StoreDelay<masked>(c0, acc, active);
+      acc = L::SSAT(L::Mul(acc, L::Broadcast(c1)) + last_read_);
+      break;
+    case OPCODE::RDAX: acc = L::SSAT(L::Mul(load(c0), L::Broadcast(c1)) + acc); break;
+    case OPCODE::RDFX: {
+      const auto r = load(c0);
+      acc = L::SSAT(L::Mul(acc - r, L::Broadcast(c1)) + r);
+    } break;
+    case OPCODE::WRAX:
+      store<masked>(c0, acc, active);
+      acc = L::SSAT(L::Mul(acc, L::Broadcast(c1)));
+      break;
+    case OPCODE::WRHX:
+      store<masked>(c0, acc, active);
+      acc = L::SSAT(L::Mul(acc, L::Broadcast(c1)) + pacc_);
+      break;
+    case OPCODE::WRLX:
+      store<masked>(c0, acc, active);
+      acc = L::SSAT(L::Mul(pacc_ - acc, L::Broadcast(c1)) + pacc_);
+      break;
+    case OPCODE::MAXX: {
+      const auto abs_rxc = L::ABS(L::Mul(load(c0), L::Broadcast(c1)));
+      const auto abs_acc = L::ABS(acc);
+      acc = L::SSAT(L::Select(abs_rxc > abs_acc, abs_rxc, abs_acc));
+    } break;
+    case OPCODE::MULX: acc = L::SSAT(L::Mul(acc, load(c0))); break;
+    case OPCODE::SOF: acc = L::SSAT(L::Mul(acc, L::Broadcast(c0)) + c1); break;
+    case OPCODE::AND: acc = L::SX(acc & c0); break;
+    case OPCODE::OR: acc = L::SX(acc | c0); break;
+    case OPCODE::XOR: acc = L::SX(acc ^ c0); break;
+    case OPCODE::SKP: {
+      vector skip = L::Broadcast(-1);
+      if (SKP_FLAGS::NEG & c0) skip &= acc < 0;
+      if (SKP_FLAGS::GEZ & c0) skip &= acc >= 0;
+      if (SKP_FLAGS::ZRO & c0) skip &= acc == 0;
+      if (SKP_FLAGS::ZRC & c0) skip &= (acc >= 0) != (pacc_ >= 0);
+      if ((SKP_FLAGS::RUN & c0) && first_run_) skip = L::Broadcast(0);
+      jump(skip);
+    } break;
+    case OPCODE::WLDS: {
+      const auto n = c0 ? 1 : 0;
+      store<masked>(n ? SIN1_RATE : SIN0_RATE, L::SSAT(L::Broadcast(c1)), active);
+      store<masked>(n ? SIN1_RANGE : SIN0_RANGE, L::SSAT(L::Broadcast(c2)), active);
+      for (size_t l = 0; l < lanes; ++l)
+        if (active[l]) lfos_[l].sin[n].Jam();
+    } break;
+    case OPCODE::JAM:
+      for (size_t l = 0; l < lanes; ++l)
+        if (active[l]) lfos_[l].ramp[c0].Jam();
+      break;
+    case OPCODE::CLR: acc = L::Broadcast(0); break;
+    case OPCODE::NOT: acc = L::SX(~acc); break;
+    case OPCODE::ABSA: acc = L::SSAT(L::ABS(acc)); break;
+    case OPCODE::LDAX: acc = load(c0); break;
+    case OPCODE::WLDR: {
+      const auto n = c0 ? 1 : 0;
+      store<masked>(n ? RMP1_RATE : RMP0_RATE, L::SSAT(L::Broadcast(c1)), active);
+      store<masked>(n ? RMP1_RANGE : RMP0_RANGE, L::SSAT(L::Broadcast(c2)), active);
+      for (size_t l = 0; l < lanes; ++l)
+        if (active[l]) lfos_[l].ramp[n].Jam();
+    } break;
+    case OPCODE::CHO_RDAL: {
+      vector value;
+      for (size_t l = 0; l < lanes; ++l) value[l] = lfos_[l].read(c0).value;
+      acc = L::SSAT(value);
+    } break;
+    case OPCODE::CHO_RDA_RMP:
+    case OPCODE::CHO_RDA_SIN: {
+      const auto flags = static_cast<CHO_FLAGS>(c1);
+      vector offset, coefficient;
+      for (size_t l = 0; l < lanes; ++l) {
+        const auto lfo_value = OPCODE::CHO_RDA_RMP == instruction.get_opcode()
+                                   ? lfos_[l].ramp[c0].Read(flags)
+                                   : lfos_[l].sin[c0].Read(flags);
+        offset[l] = c2 + lfo_value.offset;
+        coefficient[l] = lfo_value.coefficient;
+      }
+      acc = L::SSAT(L::Mul(GatherDelay<masked>(offset, active), coefficient) + acc);
+    } break;
+    case OPCODE::CHO_SOF_RMP:
+    case OPCODE::CHO_SOF_SIN: {
+      const auto flags = static_cast<CHO_FLAGS>(c1);
+      vector coefficient;
+      for (size_t l = 0; l < lanes; ++l) {
+        coefficient[l] = OPCODE::CHO_SOF_RMP == instruction.get_opcode()
+                             ? lfos_[l].ramp[c0].Read(flags).coefficient
+                             : lfos_[l].sin[c0].Read(flags).coefficient;
+      }
+      acc = L::SSAT(L::Mul(acc, coefficient) + c2);
+    } break;
+    case OPCODE::JMP: jump(L::Broadcast(-1)); break;
+    default: break;
+  }
+
+  Assign<masked>(acc_, acc, active);
+  Assign<masked>(pacc_, prev_acc_, active);
+  Assign<masked>(prev_acc_, acc_, active);
+  return next;
+}
+
+}  // namespace simd
+}  // namespace fv1
+
+#endif  // FV1_SIMD_MULTI_INSTANCE_H_
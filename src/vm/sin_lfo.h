@@ -59,13 +59,16 @@ public:
     cos_.value = SF23::MIN;
   }
 
-  inline SF23 sin() const { return sin_ * this->range_->load(); }
-  inline SF23 cos() const { return cos_ * this->range_->load(); }
+  inline SF23 sin() const { return sin_ * SF23{this->range_->loadi()}; }
+  inline SF23 cos() const { return cos_ * SF23{this->range_->loadi()}; }
 
   // VALID: (SIN) COS REG COMPC COMPA
-  value_type Read(const CHO_FLAGS flags) const
+  value_type Read(const CHO_FLAGS flags) const { return Read(sin(), cos(), flags); }
+
+  // Same for outputs from a different frame
+  static value_type Read(const SF23 sin, const SF23 cos, const CHO_FLAGS flags)
   {
-    int32_t v = ((CHO_FLAGS::COS & flags) ? cos() : sin()).value;
+    int32_t v = ((CHO_FLAGS::COS & flags) ? cos : sin).value;
     auto coefficient = Engine::template LfoCoeffToFloat<8>(v & 0xff);
     if (CHO_FLAGS::COMPA & flags) v = -v;
     if (CHO_FLAGS::COMPC & flags) coefficient = Engine::ONE - coefficient;
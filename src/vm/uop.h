@@ -0,0 +1,296 @@
+// fv1vm: experimental FV-1 virtual machine
+// Copyright (C) 2022 Patrick Dowling <pld@gurkenkiste.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef FV1_UOP_H_
+#define FV1_UOP_H_
+
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <cstdint>
+
+#include "core/core_fpmath.h"
+#include "fv1/fv1_defs.h"
+
+namespace fv1 {
+
+// Micro-op IR: each FV-1 instruction is broken up into the loads, multiplications, additions etc.
+// it consists of, see VM::BuildMicroOps. Values are SSA, i.e. every op is a value that's defined
+// once and referenced by its index. The math is the S.23 fixed-point math of the I32 engine.
+//
+// Ops are simplified as they are added: anything with only constant operands is folded, identities
+// like x * 1.0 or a saturation of a value that's already in range return the operand, and an op
+// that's identical to an existing one returns that instead (CSE, which also merges LFO reads).
+// Reads of state (registers, delay memory, LFOs) carry an epoch in the upper half of imm, so
+// they're only merged if nothing could have changed the state in between.
+//
+// The per-instruction Steps record which values ACC and PACC hold before and after each
+// instruction, that's what lowering back to the byte code works with.
+namespace uop {
+
+using ValueId = int16_t;
+static constexpr ValueId kNone = -1;
+
+enum class OP : uint8_t {
+  CONST,      // imm
+  INPUT,      // Unknown value, e.g. ACC at the start of the program (imm makes it unique)
+  REG,        // Register imm
+  DELAY,      // Delay memory cell imm
+  LFO,        // LFO value, imm = selector (see VM::BuildMicroOps)
+  LFO_DELAY,  // Delay memory cell imm + a (LFO offset)
+  MUL,        // (a * b) >> FRAC
+  ADD,
+  SUB,
+  SAT,  // Saturate a to S.23
+  ABS,
+  MAX,
+  AND,  // a & imm, sign extended; likewise OR, XOR
+  OR,
+  XOR,
+  NOT,
+};
+
+struct Value {
+  OP op = OP::CONST;
+  bool in_range = true;  // Always a valid S.23 value, i.e. saturation is a no-op
+  ValueId a = kNone;
+  ValueId b = kNone;
+  int32_t imm = 0;
+
+  bool operator==(const Value &other) const
+  {
+    return op == other.op && a == other.a && b == other.b && imm == other.imm;
+  }
+};
+
+struct Step {
+  enum FLAGS : uint8_t {
+    EFFECTS = 0x1,     // Changes state other than ACC
+    CONTROL = 0x2,     // SKP, JMP
+    READS_ACC = 0x4,   // ACC is used by the side effects or the jump condition
+    READS_PACC = 0x8,  // Same for PACC
+  };
+
+  ValueId acc = kNone;     // ACC before the instruction
+  ValueId pacc = kNone;    // PACC before the instruction
+  ValueId result = kNone;  // ACC after the instruction
+  uint8_t flags = 0;
+};
+
+class Function {
+public:
+  static constexpr size_t kMaxValues = 8 * kMaxInstructionCount;
+
+  void Reset()
+  {
+    num_values_ = 0;
+    num_inputs_ = 0;
+    overflow_ = false;
+    hash_.fill(kNone);
+  }
+
+  ValueId Const(int32_t value) { return Emit({OP::CONST, InRange(value), kNone, kNone, value}); }
+  ValueId Input(bool in_range = true)
+  {
+    return Emit({OP::INPUT, in_range, kNone, kNone, num_inputs_++});
+  }
+  ValueId Read(OP op, int32_t index, int32_t epoch, ValueId offset = kNone)
+  {
+    return Emit({op, false, offset, kNone, epoch << 16 | index});
+  }
+  ValueId Unary(OP op, ValueId a, int32_t imm = 0) { return Emit({op, false, a, kNone, imm}); }
+  ValueId Binary(OP op, ValueId a, ValueId b) { return Emit({op, false, a, b, 0}); }
+
+  // Adds a new value unless it can be simplified to an existing one
+  ValueId Emit(Value value);
+
+  // Does v (transitively) use x?
+  bool DependsOn(ValueId v, ValueId x) const
+  {
+    std::bitset<kMaxValues> visited;
+    return DependsOn(v, x, visited);
+  }
+
+  bool constant(ValueId v, int32_t &value) const
+  {
+    if (v == kNone || OP::CONST != (*this)[v].op) return false;
+    value = (*this)[v].imm;
+    return true;
+  }
+
+  size_t num_values() const { return num_values_; }
+  const Value &operator[](ValueId v) const { return values_[static_cast<size_t>(v)]; }
+  bool overflow() const { return overflow_; }
+
+  std::array<Step, kMaxInstructionCount> steps;
+
+private:
+  static constexpr size_t kHashSize = 2 * kMaxValues;
+  static_assert(0 == (kHashSize & (kHashSize - 1)));
+
+  std::array<Value, kMaxValues> values_;
+  std::array<ValueId, kHashSize> hash_;
+  size_t num_values_ = 0;
+  int32_t num_inputs_ = 0;
+  bool overflow_ = false;
+
+  static bool InRange(int32_t value) { return value >= SF23::MIN && value <= SF23::MAX; }
+  static size_t Hash(const Value &value)
+  {
+    auto h = static_cast<uint32_t>(value.op) * 0x9e3779b1U;
+    h = (h ^ static_cast<uint16_t>(value.a)) * 0x85ebca6bU;
+    h = (h ^ static_cast<uint16_t>(value.b)) * 0xc2b2ae35U;
+    h = (h ^ static_cast<uint32_t>(value.imm)) * 0x9e3779b1U;
+    return (h >> 16) & (kHashSize - 1);
+  }
+
+  bool Fold(const Value &value, int32_t &result) const;
+  ValueId Simplify(const Value &value) const;
+  ValueId Find(const Value &value, size_t &slot) const;
+  bool DependsOn(ValueId v, ValueId x, std::bitset<kMaxValues> &visited) const;
+};
+
+inline bool Function::Fold(const Value &value, int32_t &result) const
+{
+  int32_t a = 0, b = 0;
+  if (value.a != kNone && !constant(value.a, a)) return false;
+  if (value.b != kNone && !constant(value.b, b)) return false;
+  switch (value.op) {
+    case OP::MUL: result = (SF23{a} * SF23{b}).value; break;
+    case OP::ADD: result = a + b; break;
+    case OP::SUB: result = a - b; break;
+    case OP::SAT: result = core::SSAT<SF23>(a); break;
+    case OP::ABS: result = core::ABS(a); break;
+    case OP::MAX: result = std::max(a, b); break;
+    case OP::AND: result = core::AND<SF23>(a, value.imm); break;
+    case OP::OR: result = core::OR<SF23>(a, value.imm); break;
+    case OP::XOR: result = core::XOR<SF23>(a, value.imm); break;
+    case OP::NOT: result = core::NOT<SF23>(a); break;
+    default: return false;
+  }
+  return true;
+}
+
+inline ValueId Function::Simplify(const Value &value) const
+{
+  static constexpr int32_t kOne = 1 << SF23::FRAC;
+  int32_t a = 0, b = 0;
+  const bool const_a = constant(value.a, a);
+  const bool const_b = constant(value.b, b);
+  const bool a_in_range = value.a != kNone && (*this)[value.a].in_range;
+  switch (value.op) {
+    case OP::MUL:
+      if ((const_a && !a) || (const_b && !b)) return const_a && !a ? value.a : value.b;
+      if (const_b && kOne == b) return value.a;
+      if (const_a && kOne == a) return value.b;
+      break;
+    case OP::ADD:
+      if (const_b && !b) return value.a;
+      if (const_a && !a) return value.b;
+      break;
+    case OP::SUB:
+      if (const_b && !b) return value.a;
+      break;
+    case OP::SAT:
+      if (a_in_range) return value.a;
+      break;
+    case OP::ABS:
+      if (OP::ABS == (*this)[value.a].op) return value.a;
+      break;
+    case OP::MAX:
+      if (value.a == value.b) return value.a;
+      break;
+    case OP::AND:
+      if (a_in_range && SF23::MASK == (value.imm & SF23::MASK)) return value.a;
+      break;
+    case OP::OR:
+    case OP::XOR:
+      if (a_in_range && !(value.imm & SF23::MASK)) return value.a;
+      break;
+    case OP::NOT:
+      if (a_in_range && OP::NOT == (*this)[value.a].op) return (*this)[value.a].a;
+      break;
+    default: break;
+  }
+  return kNone;
+}
+
+inline ValueId Function::Find(const Value &value, size_t &slot) const
+{
+  for (slot = Hash(value); hash_[slot] != kNone; slot = (slot + 1) & (kHashSize - 1)) {
+    if (values_[static_cast<size_t>(hash_[slot])] == value) return hash_[slot];
+  }
+  return kNone;
+}
+
+inline ValueId Function::Emit(Value value)
+{
+  if (overflow_) return kNone;
+
+  // Commutative ops are canonicalized so CSE finds either order
+  if ((OP::MUL == value.op || OP::ADD == value.op || OP::MAX == value.op) && value.a > value.b)
+    std::swap(value.a, value.b);
+
+  int32_t folded = 0;
+  if (Fold(value, folded)) return Const(folded);
+  const auto simplified = Simplify(value);
+  if (kNone != simplified) return simplified;
+
+  switch (value.op) {
+    case OP::REG:
+    case OP::DELAY:
+    case OP::LFO_DELAY:
+    case OP::SAT:
+    // The logical ops sign extend from bit 23 (core::SX)
+    case OP::AND:
+    case OP::OR:
+    case OP::XOR:
+    case OP::NOT: value.in_range = true; break;
+    case OP::CONST:
+    case OP::INPUT: break;
+    default: value.in_range = false; break;
+  }
+
+  size_t slot = 0;
+  const auto existing = Find(value, slot);
+  if (kNone != existing) return existing;
+  if (num_values_ == kMaxValues) {
+    overflow_ = true;
+    return kNone;
+  }
+  const auto id = static_cast<ValueId>(num_values_++);
+  values_[static_cast<size_t>(id)] = value;
+  hash_[slot] = id;
+  return id;
+}
+
+inline bool Function::DependsOn(ValueId v, ValueId x, std::bitset<kMaxValues> &visited) const
+{
+  // Operands are always defined before the op using them
+  if (v < x) return false;
+  if (v == x) return true;
+  const auto index = static_cast<size_t>(v);
+  if (visited[index]) return false;
+  visited[index] = true;
+  const auto &value = values_[index];
+  return (value.a != kNone && DependsOn(value.a, x, visited)) ||
+         (value.b != kNone && DependsOn(value.b, x, visited));
+}
+
+}  // namespace uop
+}  // namespace fv1
+
+#endif  // FV1_UOP_H_
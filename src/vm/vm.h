@@ -17,9 +17,11 @@
 #ifndef FV1_VM_H_
 #define FV1_VM_H_
 
+#include <algorithm>
 #include <array>
 #include <cstdint>
 #include <type_traits>
+#include <utility>
 
 #include "fv1/fv1_defs.h"
 #include "fv1/fv1_delay_memory.h"
@@ -27,12 +29,27 @@
 #include "fv1/fv1_registers.h"
 #include "ramp_lfo.h"
 #include "sin_lfo.h"
+#include "uop.h"
+
+// Direct-threaded dispatch relies on the GCC/clang "labels as values" extension
+#if defined(__GNUC__) && !defined(FV1_VM_NO_THREADED_DISPATCH)
+#define FV1_VM_THREADED_DISPATCH
+#endif
 
 namespace fv1 {
 
 class ProgramStream;
 struct DecodedInstruction;
 
+namespace jit {
+class JitEngine;
+}
+
+namespace codegen {
+template <typename Engine, typename DelayStorage>
+class Runtime;
+}
+
 // The vague idea is the implement the VM without knowing too many details about the underlying
 // math, and theoretically being able to replace it e.g. with "float math". The way it ended up is
 // that there two very inter-dependent things now (VM, Engine) so it'd probably be better to move
@@ -43,8 +60,9 @@ struct DecodedInstruction;
 // additional information like version and size though, but then the compiled results could be
 // cached.
 //
-// A further extension of that would be add the state/delay into a persistable package, allowing for
-// a single VM to process multiple programs?
+// The state/delay is split off into a Context, so the same CompiledProgram can run with any number
+// of contexts. The other direction (a single VM processing multiple programs) should follow from
+// that.
 
 template <typename Engine, typename DelayStorage>
 class VM {
@@ -56,23 +74,153 @@ public:
   using AudioFrame = AudioFrameT<typename Engine::float_type>;
   using Parameters = ParametersT<typename Engine::float_type>;
 
+  // Bookkeeping a program may need, determined by Compile. The interpreter loops are instantiated
+  // for the kSpecializedFeatures so anything a program doesn't use is compiled out; the individual
+  // LFOs are only checked when ticking.
+  enum FEATURES : uint32_t {
+    FEATURE_PACC = 0x1,       // WRHX, WRLX, SKP ZRC
+    FEATURE_LAST_READ = 0x2,  // WRAP
+    FEATURE_LFO = 0x4,        // Any of the LFOs below
+    FEATURE_STEREO = 0x8,     // Uses ADCR, i.e. mono programs only process ADCL
+    FEATURE_SIN0 = 0x10,
+    FEATURE_SIN1 = 0x20,
+    FEATURE_RMP0 = 0x40,
+    FEATURE_RMP1 = 0x80,
+    FEATURE_ALL = 0xff,
+  };
+  static constexpr uint32_t kSpecializedFeatures = 0xf;
+
+  // Optional optimizer passes, run by Compile in this order (anything required to execute the
+  // program always happens). Each level includes the passes of the previous one; O0 runs the
+  // program exactly as written. PASS_SUPEROPS isn't part of any level until the committed
+  // superinstructions are generated from real programs, it has to be requested explicitly.
+  enum PASS : uint32_t {
+    PASS_PEEPHOLE,      // Cheaper equivalents of single instructions (O1)
+    PASS_STRIP_INIT,    // Remove the SKP RUN init code from the steady-state program (O1)
+    PASS_FEATURES,      // Only maintain the state the program uses, see FEATURES (O2)
+    PASS_MICROOPS,      // Constant folding, CSE and dead code on the micro-op IR, see uop.h (O2)
+    PASS_DATAFLOW,      // Dead register stores, register loads of values already in ACC (O2)
+    PASS_FUSE,          // Common instruction pairs as single opcodes, e.g. RDA/WRAP (O2)
+    PASS_COEFFICIENTS,  // Opcodes without the multiplication for C = 1.0, -1.0, ... (O1)
+    PASS_SATURATION,    // Opcodes without saturation if the result is always in range (O2)
+    PASS_DELAY_REUSE,   // Delay memory cells read again in the same frame use a cached value (O2)
+    PASS_HOIST,         // Register values that only depend on the pots, once per block (O2)
+    PASS_COMPACT,       // Remove NOPs from the programs the interpreter runs (O1)
+    PASS_SUPEROPS,      // Common opcode sequences in a single handler, see fv1_superops.h
+    kNumPasses
+  };
+  enum class OptLevel : uint8_t { O0, O1, O2 };
+
+  static constexpr uint32_t pass_mask(PASS pass) { return 1U << pass; }
+  static constexpr uint32_t passes(OptLevel level)
+  {
+    switch (level) {
+      case OptLevel::O0: return 0;
+      case OptLevel::O1:
+        return pass_mask(PASS_PEEPHOLE) | pass_mask(PASS_STRIP_INIT) |
+               pass_mask(PASS_COEFFICIENTS) | pass_mask(PASS_COMPACT);
+      case OptLevel::O2: return ((1U << kNumPasses) - 1) & ~pass_mask(PASS_SUPEROPS);
+    }
+    return 0;
+  }
+  static constexpr const char *kPassNames[kNumPasses] = {
+      "peephole",   "strip_init",  "features", "microops", "dataflow", "fuse",    "coefficients",
+      "saturation", "delay_reuse", "hoist",    "compact",  "superops"};
+
+  // What a pass changed in the compiled program. Cycles are a rough estimate of the savings per
+  // frame, see EstimatedCost.
+  struct PassStats {
+    uint32_t removed = 0;    // Instructions removed from the steady-state program
+    uint32_t rewritten = 0;  // Instructions replaced with a different opcode
+    int32_t cycles = 0;
+  };
+  using OptimizerReport = std::array<PassStats, kNumPasses>;
+
+  // Interpreter loop used by Execute. THREADED falls back to SWITCH if the compiler doesn't
+  // support computed gotos. PACKED is a switch loop over the 8-byte encoding of the programs (see
+  // vm_execute_packed.h, set_packed_programs), and falls back to SWITCH if a program can't be packed
+  // or there are no packed programs.
+  enum class Dispatch : uint8_t { SWITCH, THREADED, PACKED };
+
+  // Program generated from the compiled instructions (see codegen/cpp_generator.h)
+  using NativeProgramFn = void (*)(codegen::Runtime<Engine, DelayStorage> &runtime,
+                                   const AudioFrame *in, AudioFrame *out, size_t num_frames);
+
+  // Instruction-major execution (see vm_execute_block.h) runs up to kMaxBlockFrames at a time;
+  // fewer than kMinBlockFrames aren't worth it and use the interpreter.
+  static constexpr size_t kMinBlockFrames = 8;
+  static constexpr size_t kMaxBlockFrames = 32;
+
+  // Per-frame state for instruction-major execution. Like the delay memory this is maintained
+  // externally since it's fairly large.
+  struct BlockBuffer {
+    // [0] is the value at the end of the previous frame, i.e. frame f is stored at [f + 1]
+    std::array<std::array<typename Engine::Register, kMaxBlockFrames + 1>, kNumRegisters>
+        registers;
+    std::array<typename Engine::Register, kMaxBlockFrames> acc;
+    std::array<typename Engine::Register, kMaxBlockFrames> pacc;
+    std::array<typename Engine::Register, kMaxBlockFrames> next_pacc;  // See ExecuteBlockStep
+    std::array<typename Engine::float_value, kMaxBlockFrames> last_read;
+    // LFO outputs for each frame, indexed by CHO_SEL_IDX (the ramps are the raw phase)
+    std::array<std::array<SF23, kMaxBlockFrames>, 6> lfo;
+  };
+
   // Delay memory is maintained externally
   explicit VM(DelayMemoryBuffer &delay_memory_buffer);
 
-  // Compile program
-  void Compile(ProgramStream &program);
-
-  // control values used for all frames
-  void SetParameters(const Parameters &params)
+  // Compile program, optionally with a specific set of optimizer passes
+  void Compile(ProgramStream &program, OptLevel level = OptLevel::O2)
   {
-    state_.registers_[POT0].store(params.pots[0]);
-    state_.registers_[POT1].store(params.pots[1]);
-    state_.registers_[POT2].store(params.pots[2]);
+    Compile(program, passes(level));
   }
+  void Compile(ProgramStream &program, uint32_t passes);
+
+  struct CompiledProgram;
+  class Context;
+  struct PrecompiledProgram;
+  // Run a precompiled program instead of compiling one. It's executed in place and has to stay
+  // valid until the next Compile or Load. Only Execute runs it, always with the switch loop (i.e.
+  // without the dispatch, block buffer etc.). The program of a previous Compile is cleared, so
+  // e.g. compiled_program() is empty and the JIT refuses to compile.
+  void Load(const PrecompiledProgram &program);
+  bool precompiled() const { return nullptr != precompiled_; }
+
+  // control values used for all frames
+  void SetParameters(const Parameters &params) { context_.SetParameters(params); }
 
   // Execute the compiled program on each frame in a block
   void Execute(const AudioFrame *in, AudioFrame *out, size_t num_frames);
 
+  // Execute a compiled program with a separate context, e.g. the same program for many voices.
+  // This only runs the interpreter programs, the block buffer and native programs are per VM.
+  static void Execute(const CompiledProgram &program, Context &context, Dispatch dispatch,
+                      const AudioFrame *in, AudioFrame *out, size_t num_frames);
+  // Same with Dispatch::PACKED, packed has to be Pack(program)
+  struct PackedPrograms;
+  static void Execute(const CompiledProgram &program, const PackedPrograms &packed,
+                      Context &context, const AudioFrame *in, AudioFrame *out, size_t num_frames);
+  // Same for a precompiled program, which only needs the tables and a context (i.e. no VM at all)
+  static void Execute(const PrecompiledProgram &program, Context &context, const AudioFrame *in,
+                      AudioFrame *out, size_t num_frames);
+
+  void set_dispatch(Dispatch dispatch) { dispatch_ = dispatch; }
+  Dispatch dispatch() const { return dispatch_; }
+
+  uint32_t features() const { return program_.features; }
+  uint32_t passes() const { return passes_; }
+  const OptimizerReport &optimizer_report() const { return optimizer_report_; }
+
+  // If set, Execute runs this instead of the interpreter. It must have been generated from the
+  // currently compiled program; Compile clears it.
+  void set_native_program(NativeProgramFn program) { native_program_ = program; }
+  NativeProgramFn native_program() const { return native_program_; }
+
+  // If set, Execute runs blocks instruction-major whenever the compiled program allows it
+  void set_block_buffer(BlockBuffer *buffer) { block_buffer_ = buffer; }
+
+  // If set, the programs are also packed into these (now and on each Compile) for Dispatch::PACKED
+  void set_packed_programs(PackedPrograms *packed);
+
   // --
   // Technically these are internal details but it makes it easier for tests
 
@@ -83,11 +231,80 @@ public:
     // There should be three bytes of padding in here in case we want to store additional info
     std::array<typename Engine::Constant, kMaxOperands> constants;
 
-    inline OPCODE get_opcode() const { return opcode; }
-    inline void set_opcode(OPCODE o) { opcode = o; }
+    constexpr OPCODE get_opcode() const { return opcode; }
+    constexpr void set_opcode(OPCODE o) { opcode = o; }
   };
   static_assert(sizeof(CompiledInstruction) == 16);
 
+  // Instructions that are stored elsewhere, e.g. the tables of a PrecompiledProgram
+  struct ProgramView {
+    const CompiledInstruction *instructions = nullptr;
+    size_t length = 0;
+  };
+
+  // What the interpreter loops actually run. SKP RUN is resolved when compiling: the init program
+  // runs on the first frame (where it's never taken) and the steady-state program on all others
+  // (where it always is), with the init code in front removed. Both are compacted, so execution
+  // stops at length instead of running the NOPs up to kMaxInstructionCount.
+  struct Program {
+    size_t length = kMaxInstructionCount;
+    std::array<CompiledInstruction, kMaxInstructionCount> instructions;
+
+    ProgramView view() const { return {instructions.data(), length}; }
+#ifdef FV1_VM_THREADED_DISPATCH
+    // Handler address per instruction, plus one for the end of the program
+    std::array<const void *, kMaxInstructionCount + 1> handlers;
+#endif
+  };
+
+  // The instructions HoistInvariants moves out of the steady-state program. Those are a few short
+  // sequences that only run once per block, so there's room for fewer than in a Program (and it's
+  // only run with the switch loop, see ExecutePrologue).
+  static constexpr size_t kMaxPrologueLength = 32;
+  struct Prologue {
+    size_t length = 0;
+    std::array<CompiledInstruction, kMaxPrologueLength> instructions;
+
+    ProgramView view() const { return {instructions.data(), length}; }
+  };
+
+  // The interpreter programs of a compiled program, generated ahead of time (see
+  // codegen::CppGenerator::Bytecode) so they can be constexpr and live in read-only memory
+  struct PrecompiledProgram {
+    uint32_t features = FEATURE_ALL;
+    ProgramView init;
+    ProgramView steady;
+    ProgramView prologue;
+  };
+
+  // Compact alternative to CompiledInstruction: the opcode in the low byte, then the constants
+  // in fields of the size they need (see PackedLayout).
+  using PackedInstruction = uint64_t;
+  struct PackedProgram {
+    bool valid = false;  // All instructions could be packed
+    size_t length = 0;
+    std::array<PackedInstruction, kMaxInstructionCount> instructions;
+  };
+
+  // What Compile produces for the interpreter. It isn't changed by executing it, so a copy stays
+  // valid after the VM compiles something else.
+  struct CompiledProgram {
+    uint32_t features = FEATURE_ALL;
+    Program init;
+    Program steady;
+    Prologue prologue;  // Runs before the frames of each block
+  };
+
+  // The packed encoding of a compiled program's init and steady-state programs. Like the block
+  // buffer it's maintained externally, so only VMs that use Dispatch::PACKED pay for it.
+  struct PackedPrograms {
+    PackedProgram init;
+    PackedProgram steady;
+
+    bool valid() const { return init.valid && steady.valid; }
+  };
+  static bool Pack(const CompiledProgram &program, PackedPrograms &packed);
+
   struct State {
     bool first_run = true;
     typename Engine::Register acc_;
@@ -103,11 +320,122 @@ public:
     }
   };
 
-  const State &state() const { return state_; }
+  // Result of the dependency analysis for instruction-major execution. The executed instructions
+  // are split into segments that either run one instruction at a time for all frames, or have to
+  // run frame by frame (e.g. a filter that reads its state before it's updated).
+  struct BlockProgram {
+    enum STEP_FLAGS : uint8_t {
+      SAVE_PACC = 0x1,       // ACC before executing is the PACC of the next step
+      PREVIOUS_FRAME = 0x2,  // Register operand is read before it's written in the frame
+    };
+    struct Step {
+      uint8_t ic = 0;
+      uint8_t flags = 0;
+    };
+    struct Segment {
+      uint8_t end = 0;  // Starts at the end of the previous segment
+      bool sequential = false;
+    };
+
+    bool enabled = false;
+    bool acc_zero = false;     // ACC is always zero at the end of a frame
+    bool reads_delay = false;  // Needs to update last_read at the end of the block
+    bool reads_lfo = false;    // CHO
+    bool lfo_reads = false;    // CHO RDA, see CheckLfoReads
+    uint8_t num_steps = 0;
+    uint8_t num_segments = 0;
+    uint64_t written_registers = 0;
+    uint64_t constant_registers = 0;  // Read but never written
+    std::array<Step, kMaxInstructionCount> steps;
+    std::array<Segment, kMaxInstructionCount> segments;
+  };
+
+  // "Fake" index used in VM
+  enum CHO_SEL_IDX : int32_t { SIN0_SIN = 0, SIN0_COS, SIN1_SIN, SIN1_COS, RMP0_VAL, RMP1_VAL };
+
+  // Values of delay memory cells for RDA_CACHED, only valid within a frame
+  static constexpr size_t kMaxDelaySlots = kMaxInstructionCount / 2;
+
+  // Everything a program changes while running: registers, ACC/PACC, LFOs and the delay memory
+  // (the buffer itself is still maintained externally).
+  class Context {
+  public:
+    explicit Context(DelayMemoryBuffer &delay_memory_buffer);
+    // The LFOs point to their rate and range registers, so moving rebinds them. A copy would share
+    // the delay memory buffer.
+    Context(Context &&other) noexcept;
+    Context(const Context &) = delete;
+    Context &operator=(const Context &) = delete;
+
+    // Same as Compile does for the VM's own context
+    void Reset();
+
+    void SetParameters(const Parameters &params)
+    {
+      state_.registers_[POT0].store(params.pots[0]);
+      state_.registers_[POT1].store(params.pots[1]);
+      state_.registers_[POT2].store(params.pots[2]);
+    }
+
+    const State &state() const { return state_; }
+    const DelayMemory<DelayStorage> &delay_memory() const { return delay_memory_; }
+
+  private:
+    friend class VM;
+    friend class jit::JitEngine;
+
+    State state_;
+    DelayMemory<DelayStorage> delay_memory_;
+    std::array<typename DelayStorage::value_type, kMaxDelaySlots> delay_slots_{};
+    std::array<RampLfoImpl<Engine>, 2> ramp_lfo_;
+    std::array<SinLfoImpl<Engine>, 2> sin_lfo_;
+
+    void BindLfos();
+
+    SF23 read_lfo(CHO_SEL_IDX idx) const
+    {
+      switch (idx) {
+        case CHO_SEL_IDX::SIN0_SIN: return sin_lfo_[0].sin(); break;
+        case CHO_SEL_IDX::SIN0_COS: return sin_lfo_[0].cos(); break;
+        case CHO_SEL_IDX::SIN1_SIN: return sin_lfo_[1].sin(); break;
+        case CHO_SEL_IDX::SIN1_COS: return sin_lfo_[1].cos(); break;
+        case CHO_SEL_IDX::RMP0_VAL: return ramp_lfo_[0].value(); break;
+        case CHO_SEL_IDX::RMP1_VAL: return ramp_lfo_[1].value(); break;
+      }
+      return SF23{0};
+    }
+
+    // LFOs that are never read don't need to be ticked, lfos are the program's features
+    template <uint32_t features = FEATURE_ALL>
+    void Tick(uint32_t lfos)
+    {
+      delay_memory_.Tick();
+      if constexpr (features & FEATURE_LFO) {
+        if (lfos & FEATURE_RMP0) ramp_lfo_[0].Tick();
+        if (lfos & FEATURE_RMP1) ramp_lfo_[1].Tick();
+        if (lfos & FEATURE_SIN0) sin_lfo_[0].Tick();
+        if (lfos & FEATURE_SIN1) sin_lfo_[1].Tick();
+      }
+    }
+  };
+
+  const CompiledProgram &compiled_program() const { return program_; }
+  const State &state() const { return context_.state(); }
+  const BlockProgram &block_program() const { return block_program_; }
   const CompiledInstruction &get_instruction(size_t i) const { return instructions_[i]; }
-  const DelayMemory<DelayStorage> &delay_memory() const { return delay_memory_; }
+  const Program &init_program() const { return program_.init; }
+  const Program &steady_program() const { return program_.steady; }
+  const Prologue &prologue_program() const { return program_.prologue; }
+  const DelayMemory<DelayStorage> &delay_memory() const { return context_.delay_memory(); }
+
+  // Test hook, called with the micro-op IR of each program PASS_MICROOPS rewrites (the IR is only
+  // allocated while the pass runs)
+  using MicroOpsObserver = void (*)(const Program &program, const uop::Function &uops);
+  static inline MicroOpsObserver micro_ops_observer = nullptr;
 
 private:
+  friend class jit::JitEngine;
+
   using IndexConstant = IndexConstantT<typename Engine::Constant>;
   using IntegerConstant = IntegerConstantT<typename Engine::Constant>;
   using FloatConstant = FloatConstantT<typename Engine::Constant>;
@@ -116,42 +444,147 @@ private:
   using SinLfo = SinLfoImpl<Engine>;
 
   std::array<CompiledInstruction, kMaxInstructionCount> instructions_;
+  Dispatch dispatch_ = Dispatch::SWITCH;
+  uint32_t passes_ = 0;
+  OptimizerReport optimizer_report_;
+  NativeProgramFn native_program_ = nullptr;
+  const PrecompiledProgram *precompiled_ = nullptr;
+  BlockBuffer *block_buffer_ = nullptr;
+  BlockProgram block_program_;
+  PackedPrograms *packed_programs_ = nullptr;
+  CompiledProgram program_;
 
-  State state_;
-  DelayMemory<DelayStorage> delay_memory_;
-  std::array<RampLfo, 2> ramp_lfo_;
-  std::array<SinLfo, 2> sin_lfo_;
+  Context context_;
 
-  // "Fake" index used in VM
-  enum CHO_SEL_IDX : int32_t { SIN0_SIN = 0, SIN0_COS, SIN1_SIN, SIN1_COS, RMP0_VAL, RMP1_VAL };
+  void Reset();
+  static CompiledInstruction CompileInstruction(const DecodedInstruction &instruction);
+  void Lower();
+  void Optimize();
+  void SplitInitProgram(bool strip_init);
+  void AnalyzeFeatures();
+  bool BuildMicroOps(const Program &program, uop::Function &f) const;
+  PassStats OptimizeMicroOps(Program &program);
+  PassStats OptimizeRegisters(Program &program) const;
+  PassStats FuseInstructions(Program &program) const;
+  PassStats ReduceCoefficients(Program &program) const;
 
-  SF23 read_lfo(CHO_SEL_IDX idx) const
-  {
-    switch (idx) {
-      case CHO_SEL_IDX::SIN0_SIN: return sin_lfo_[0].sin(); break;
-      case CHO_SEL_IDX::SIN0_COS: return sin_lfo_[0].cos(); break;
-      case CHO_SEL_IDX::SIN1_SIN: return sin_lfo_[1].sin(); break;
-      case CHO_SEL_IDX::SIN1_COS: return sin_lfo_[1].cos(); break;
-      case CHO_SEL_IDX::RMP0_VAL: return ramp_lfo_[0].value(); break;
-      case CHO_SEL_IDX::RMP1_VAL: return ramp_lfo_[1].value(); break;
+  // Range of S.23 values, by default everything a register can hold
+  struct ValueRange {
+    int32_t min = SF23::MIN;
+    int32_t max = SF23::MAX;
+
+    bool contains(const ValueRange &other) const { return min <= other.min && other.max <= max; }
+    ValueRange join(const ValueRange &other) const
+    {
+      return {std::min(min, other.min), std::max(max, other.max)};
     }
-    return SF23{0};
-  }
+  };
+  static constexpr int kMaxRangeIterations = 4;
+  PassStats ElideSaturation();
+  PassStats AnalyzeRanges(Program &program, ValueRange &acc, ValueRange &pacc, bool rewrite) const;
+  PassStats ReuseDelayReads(Program &program) const;
+  PassStats HoistInvariants();
+  PassStats CompactProgram(Program &program) const;
+  PassStats FuseSuperinstructions(Program &program) const;
+  static uint64_t RegisterReads(const CompiledInstruction &instruction);
+  static bool IsCoefficient(const typename Engine::Constant &c, int32_t value);
+  static std::array<bool, kMaxInstructionCount + 1> JumpTargets(const Program &program);
+  static int32_t EstimatedCost(OPCODE opcode);
+  static constexpr int32_t kLfoTickCost = 6;
+  static bool ReadsPacc(const CompiledInstruction &instruction);
+  void Link();
 
-  static CompiledInstruction CompileInstruction(const DecodedInstruction &instruction);
-  void Optimize();
-  void Tick()
+  // Size of each field of the packed encoding; a COEFF is a 16-bit mantissa and 4-bit shift, a
+  // WORD is signed and a MASK unsigned
+  enum class PACKED_FIELD : uint8_t { NONE, REG, ADDR, SMALL, COEFF, WORD, MASK };
+  using PackedLayout = std::array<PACKED_FIELD, kMaxOperands>;
+  static constexpr unsigned kPackedFieldBits[] = {0, 6, 15, 8, 20, 24, 24};
+  static constexpr unsigned kPackedOpcodeBits = 8;
+  static constexpr PackedLayout GetPackedLayout(OPCODE opcode);
+  static bool PackProgram(const Program &program, PackedProgram &packed);
+  static bool PackInstruction(const CompiledInstruction &instruction, PackedInstruction &packed);
+  static constexpr int32_t DecodePackedField(PACKED_FIELD field, uint32_t bits);
+  static CompiledInstruction UnpackInstruction(PackedInstruction packed,
+                                               const PackedLayout &layout);
+  // Decode with the layout known at compile time, for the handlers
+  template <OPCODE opcode>
+  static CompiledInstruction UnpackInstruction(PackedInstruction packed);
+
+  void AnalyzeBlockProgram();
+
+  void ExecuteInterpreter(const AudioFrame *in, AudioFrame *out, size_t num_frames);
+  template <typename Loop, typename ProgramT>
+  static void ExecutePrograms(Loop execute, Context &context, uint32_t features,
+                              ProgramT &&init, ProgramT &&steady, ProgramView prologue,
+                              const AudioFrame *in, AudioFrame *out, size_t num_frames);
+  template <uint32_t features>
+  static void ExecuteSwitch(ProgramView program, Context &context, uint32_t lfos,
+                            const AudioFrame *in, AudioFrame *out, size_t num_frames);
+  static void ExecutePrologue(ProgramView program, Context &context);
+  void ExecuteBlocks(const AudioFrame *in, AudioFrame *out, size_t num_frames);
+  void ExecuteBlock(const AudioFrame *in, AudioFrame *out, size_t num_frames);
+  void ExecuteBlockStep(typename BlockProgram::Step step, int32_t cursor, size_t begin,
+                        size_t end);
+  static bool DelayHazard(int32_t read, int32_t span, int32_t write, bool write_first);
+  bool CheckLfoReads(size_t num_frames) const;
+  typename LfoBase<Engine>::LfoValue ReadBlockLfo(OPCODE opcode, size_t n, CHO_FLAGS flags,
+                                                  size_t f) const;
+  template <uint32_t features>
+  static void ExecutePacked(const PackedProgram &program, Context &context, uint32_t lfos,
+                            const AudioFrame *in, AudioFrame *out, size_t num_frames);
+#ifdef FV1_VM_THREADED_DISPATCH
+  template <uint32_t features>
+  static void ExecuteThreaded(const Program &program, Context &context, uint32_t lfos,
+                              const AudioFrame *in, AudioFrame *out, size_t num_frames);
+#endif
+
+  // Interpreter loop instantiations, indexed by (features & kSpecializedFeatures)
+#ifdef FV1_VM_NO_FEATURE_SPECIALIZATION
+  static constexpr uint32_t kFixedFeatures = kSpecializedFeatures;
+#else
+  static constexpr uint32_t kFixedFeatures = 0;
+#endif
+  using ExecuteFn = void (*)(ProgramView, Context &, uint32_t, const AudioFrame *, AudioFrame *,
+                             size_t);
+  using FeatureIndices = std::make_index_sequence<kSpecializedFeatures + 1>;
+
+  template <size_t... features>
+  static constexpr std::array<ExecuteFn, sizeof...(features)> SwitchLoops(
+      std::index_sequence<features...>)
   {
-    delay_memory_.Tick();
-    for (auto &rmp : ramp_lfo_) rmp.Tick();
-    for (auto &sin : sin_lfo_) sin.Tick();
+    return {&VM::ExecuteSwitch<features | kFixedFeatures>...};
   }
+  using ExecutePackedFn = void (*)(const PackedProgram &, Context &, uint32_t,
+                                   const AudioFrame *, AudioFrame *, size_t);
+  template <size_t... features>
+  static constexpr std::array<ExecutePackedFn, sizeof...(features)> PackedLoops(
+      std::index_sequence<features...>)
+  {
+    return {&VM::ExecutePacked<features | kFixedFeatures>...};
+  }
+#ifdef FV1_VM_THREADED_DISPATCH
+  using ExecuteThreadedFn = void (*)(const Program &, Context &, uint32_t, const AudioFrame *,
+                                     AudioFrame *, size_t);
+  template <size_t... features>
+  static constexpr std::array<ExecuteThreadedFn, sizeof...(features)> ThreadedLoops(
+      std::index_sequence<features...>)
+  {
+    return {&VM::ExecuteThreaded<features | kFixedFeatures>...};
+  }
+#endif
+
+  template <uint32_t features = FEATURE_ALL>
+  void Tick() { context_.template Tick<features>(program_.features); }
 };
 }  // namespace fv1
 
 // clang-format off
 #include "vm_impl.h"
 #include "vm_execute_v1.h"
+#include "vm_execute_threaded.h"
+#include "vm_execute_packed.h"
+#include "vm_execute_block.h"
+#include "codegen/codegen_runtime.h"
 // clang-format on
 
 #endif  // FV1_VM_H_
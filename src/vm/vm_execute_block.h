@@ -0,0 +1,641 @@
+// fv1vm: experimental FV-1 virtual machine
+// Copyright (C) 2022 Patrick Dowling <pld@gurkenkiste.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef FV1_VM_H_
+#error "Don't include or compile this file directly"
+#endif
+
+#include <algorithm>
+#include <limits>
+
+// Instruction-major ("block") execution.
+//
+// The interpreter loops run all instructions for one frame, then Tick. If the dependencies allow
+// it, each instruction can instead run for all frames of a block before moving on to the next one,
+// so the dispatch is amortized over the block and the per-frame loops are simple enough for the
+// compiler to vectorize.
+//
+// Each frame gets its own ACC, PACC, last delay read and copy of the written registers (see
+// BlockBuffer), which leaves the dependencies that cross frames:
+// - Registers that are read before they are written, e.g. the state of a RDFX/WRLX filter, see the
+//   value from the previous frame.
+// - Delay reads that are closer than a block to a write of the same memory (or two writes).
+// - ACC at the start of a frame. That's usually zero since programs tend to end with WRAX DACR, 0.
+// AnalyzeBlockProgram turns the range of instructions between the two ends of each such dependency
+// into a sequential segment that runs frame-by-frame. The analysis assumes the worst case of
+// kMaxBlockFrames so it holds for any shorter block.
+//
+// The LFOs only depend on their registers, which the program can't change in the steady state, so
+// their outputs for the whole block are computed up front (see BlockBuffer::lfo). The addresses of
+// CHO RDA move with the LFO and are checked against the writes for each block instead; the rare
+// block where one gets too close runs in the interpreter (see CheckLfoReads).
+//
+// Not supported (i.e. Execute uses the interpreter) are programs with dynamic addresses (RMPA), or
+// control flow besides JMP and SKP RUN.
+
+namespace fv1 {
+
+template <typename Engine, typename DelayStorage>
+void VM<Engine, DelayStorage>::AnalyzeBlockProgram()
+{
+  block_program_ = {};
+
+  // What an instruction depends on, as far as the block execution is concerned
+  struct Access {
+    bool supported = true;
+    bool reads_acc = false;
+    bool kills_acc = false;  // Replaces ACC without reading it
+    bool uses_pacc = false;
+    bool reads_last_read = false;
+    bool reads_lfo = false;
+    bool lfo_read = false;  // Delay read at an LFO offset
+    int32_t read_register = -1;
+    int32_t write_register = -1;
+    int32_t read_delay = -1;
+    int32_t write_delay = -1;
+
+    bool neutral() const { return !reads_acc && !kills_acc; }
+  };
+
+  auto describe = [](const CompiledInstruction &instruction) {
+    Access access;
+    switch (instruction.get_opcode()) {
+      case OPCODE::NOP:
+      case OPCODE::LOG:
+      case OPCODE::EXP:
+      case OPCODE::UNKNOWN:
+      case OPCODE::REAL_OPCODES_LAST:
+      case OPCODE::JMP: break;
+      // Always taken after the first run
+      case OPCODE::SKP:
+        access.supported = SKP_FLAGS::RUN == instruction.constants[0].loadi();
+        break;
+
+      case OPCODE::RDA:
+        access.reads_acc = true;
+        access.read_delay = instruction.constants[0].loadi() & kDelayAddrMask;
+        break;
+      case OPCODE::WRAP: access.reads_last_read = true; [[fallthrough]];
+      case OPCODE::WRA:
+        access.reads_acc = true;
+        access.write_delay = instruction.constants[0].loadi() & kDelayAddrMask;
+        break;
+
+      case OPCODE::RDAX:
+      case OPCODE::RDFX:
+      case OPCODE::MAXX:
+      case OPCODE::MULX:
+        access.reads_acc = true;
+        access.read_register = instruction.constants[0].loadi();
+        break;
+      case OPCODE::LDAX:
+        access.kills_acc = true;
+        access.read_register = instruction.constants[0].loadi();
+        break;
+
+      case OPCODE::WRHX:
+      case OPCODE::WRLX: access.uses_pacc = true; [[fallthrough]];
+      case OPCODE::WRAX:
+        access.reads_acc = true;
+        access.write_register = instruction.constants[0].loadi();
+        // The LFOs are ticked once per frame and would see the wrong values
+        access.supported = access.write_register > RMP1_RANGE;
+        break;
+
+      case OPCODE::CHO_RDAL:
+        access.kills_acc = true;
+        access.reads_lfo = true;
+        break;
+      case OPCODE::CHO_RDA_SIN:
+      case OPCODE::CHO_RDA_RMP: access.lfo_read = true; [[fallthrough]];
+      case OPCODE::CHO_SOF_SIN:
+      case OPCODE::CHO_SOF_RMP:
+        access.reads_acc = true;
+        access.reads_lfo = true;
+        break;
+
+      case OPCODE::SOF:
+      case OPCODE::AND:
+      case OPCODE::OR:
+      case OPCODE::XOR:
+      case OPCODE::NOT:
+      case OPCODE::ABSA: access.reads_acc = true; break;
+      case OPCODE::CLR: access.kills_acc = true; break;
+
+      default: access.supported = false; break;
+    }
+    return access;
+  };
+
+  // Instructions executed after the first run
+  std::array<uint8_t, kMaxInstructionCount> path;
+  size_t length = 0;
+  for (int32_t ic = 0; ic < kMaxInstructionCount; ++ic) {
+    const auto &instruction = instructions_[ic];
+    if (!describe(instruction).supported) return;
+    path[length++] = static_cast<uint8_t>(ic);
+    const auto opcode = instruction.get_opcode();
+    if (OPCODE::JMP == opcode || OPCODE::SKP == opcode) {
+      GET_INT_CONSTANT(n, 1);
+      ic += n;
+    }
+  }
+  auto access_at = [&](size_t p) { return describe(instructions_[path[p]]); };
+
+  std::array<uint8_t, kMaxInstructionCount> flags{};
+  // Last position that has to run sequentially with a position, or -1
+  std::array<int16_t, kMaxInstructionCount> reach;
+  reach.fill(-1);
+  auto sequential = [&reach](size_t first, size_t last) {
+    reach[first] = std::max(reach[first], static_cast<int16_t>(last));
+  };
+
+  // PACC is the ACC from before the previous instruction
+  for (size_t p = 0; p < length; ++p) {
+    if (!access_at(p).uses_pacc) continue;
+    if (!p) return;
+    flags[p - 1] |= BlockProgram::SAVE_PACC;
+  }
+  flags[length - 1] |= BlockProgram::SAVE_PACC;
+
+  // ACC at the start of the frame
+  bool reads_initial_acc = false;
+  for (size_t p = 0; p < length; ++p) {
+    const auto access = access_at(p);
+    if ((BlockProgram::SAVE_PACC & flags[p]) || access.reads_acc) {
+      reads_initial_acc = true;
+      break;
+    }
+    if (access.kills_acc) break;
+  }
+  for (size_t p = length; p--;) {
+    const auto access = access_at(p);
+    if (access.neutral()) continue;
+    const auto &instruction = instructions_[path[p]];
+    switch (instruction.get_opcode()) {
+      case OPCODE::CLR: block_program_.acc_zero = true; break;
+      case OPCODE::WRAX:
+      case OPCODE::WRA: block_program_.acc_zero = instruction.constants[1].zero(); break;
+      case OPCODE::SOF:
+        block_program_.acc_zero =
+            instruction.constants[0].zero() && instruction.constants[1].zero();
+        break;
+      default: break;
+    }
+    break;
+  }
+  if (reads_initial_acc && !block_program_.acc_zero) return;
+
+  // WRAP uses the value of a previous RDA in the same frame
+  for (size_t p = 0; p < length; ++p) {
+    const auto access = access_at(p);
+    if (access.reads_last_read && !block_program_.reads_delay) return;
+    if (access.read_delay >= 0 || access.lfo_read) block_program_.reads_delay = true;
+    if (access.reads_lfo) block_program_.reads_lfo = true;
+    if (access.lfo_read) block_program_.lfo_reads = true;
+  }
+
+  // Registers
+  uint64_t written = 0;
+  std::array<int16_t, kNumRegisters> last_write;
+  for (size_t p = 0; p < length; ++p) {
+    const auto access = access_at(p);
+    if (access.write_register < 0) continue;
+    written |= uint64_t{1} << access.write_register;
+    last_write[access.write_register] = static_cast<int16_t>(p);
+  }
+  uint64_t defined = (uint64_t{1} << ADCL) | (uint64_t{1} << ADCR);
+  uint64_t constant = 0;
+  for (size_t p = 0; p < length; ++p) {
+    const auto access = access_at(p);
+    if (access.read_register >= 0) {
+      const auto bit = uint64_t{1} << access.read_register;
+      if (!(written & bit)) {
+        constant |= bit;
+      } else if (!(defined & bit)) {
+        flags[p] |= BlockProgram::PREVIOUS_FRAME;
+        sequential(p, static_cast<size_t>(last_write[access.read_register]));
+      }
+    }
+    if (access.write_register >= 0) defined |= uint64_t{1} << access.write_register;
+  }
+  written |= uint64_t{1} << ADCL;
+  if (program_.features & FEATURE_STEREO) written |= uint64_t{1} << ADCR;
+  for (auto dac : {DACL, DACR}) {
+    if (!(written & (uint64_t{1} << dac))) constant |= uint64_t{1} << dac;
+  }
+  block_program_.written_registers = written;
+  block_program_.constant_registers = constant;
+
+  // Delay memory
+  for (size_t p = 0; p < length; ++p) {
+    const auto first = access_at(p);
+    if (first.read_delay < 0 && first.write_delay < 0) continue;
+    for (size_t q = p + 1; q < length; ++q) {
+      const auto second = access_at(q);
+      bool hazard = false;
+      if (first.write_delay >= 0 && second.read_delay >= 0)
+        hazard = DelayHazard(second.read_delay, 0, first.write_delay, true);
+      else if (first.read_delay >= 0 && second.write_delay >= 0)
+        hazard = DelayHazard(first.read_delay, 0, second.write_delay, false);
+      else if (first.write_delay >= 0 && second.write_delay >= 0)
+        hazard = DelayHazard(second.write_delay, 0, first.write_delay, true);
+      if (hazard) sequential(p, q);
+    }
+  }
+
+  // Merge overlapping ranges into segments, dropping steps that have no effect
+  auto &program = block_program_;
+  auto add_step = [&](size_t p) {
+    if (access_at(p).neutral() && !(BlockProgram::SAVE_PACC & flags[p])) return;
+    program.steps[program.num_steps++] = {path[p], flags[p]};
+  };
+  auto end_segment = [&program](bool sequential_segment) {
+    const auto begin = program.num_segments ? program.segments[program.num_segments - 1].end : 0;
+    if (program.num_steps == begin) return;
+    program.segments[program.num_segments++] = {program.num_steps, sequential_segment};
+    if (!sequential_segment) program.enabled = true;
+  };
+  for (size_t p = 0; p < length;) {
+    if (reach[p] < 0) {
+      add_step(p++);
+      continue;
+    }
+    end_segment(false);
+    auto last = static_cast<size_t>(reach[p]);
+    for (; p <= last; ++p) {
+      if (reach[p] >= 0) last = std::max(last, static_cast<size_t>(reach[p]));
+      add_step(p);
+    }
+    end_segment(true);
+  }
+  end_segment(false);
+}
+
+// Whether a read of [read, read + span] can see a write from a different frame of the block. A
+// read at distance d = (read address - write address) sees the write from d frames ago. If the
+// write comes first in the program, none of the writes in the block may be from a later frame
+// (i.e. wrapped around); if the read comes first, all of them have to be later.
+template <typename Engine, typename DelayStorage>
+bool VM<Engine, DelayStorage>::DelayHazard(int32_t read, int32_t span, int32_t write,
+                                           bool write_first)
+{
+  static constexpr int32_t kFrames = static_cast<int32_t>(kMaxBlockFrames);
+  if (span >= kDelayMemorySize - 1) return true;
+  const int32_t lo = write_first ? kDelayMemorySize - kFrames + 1 : 1;
+  const int32_t hi = write_first ? kDelayMemorySize - 1 : kFrames - 1;
+  const int32_t d = (read - write) & kDelayAddrMask;
+  return (d <= hi && lo <= d + span) || lo + kDelayMemorySize <= d + span;
+}
+
+// The CHO RDA addresses over the block (from BlockBuffer::lfo) against all delay writes
+template <typename Engine, typename DelayStorage>
+bool VM<Engine, DelayStorage>::CheckLfoReads(size_t num_frames) const
+{
+  const auto &program = block_program_;
+  for (size_t i = 0; i < program.num_steps; ++i) {
+    const auto &instruction = instructions_[program.steps[i].ic];
+    const auto opcode = instruction.get_opcode();
+    if (OPCODE::CHO_RDA_SIN != opcode && OPCODE::CHO_RDA_RMP != opcode) continue;
+    GET_INT_CONSTANT(n, 0);
+    GET_INT_CONSTANT(flags, 1);
+    GET_INT_CONSTANT(addr, 2);
+    int32_t min = std::numeric_limits<int32_t>::max();
+    int32_t max = std::numeric_limits<int32_t>::min();
+    for (size_t f = 0; f < num_frames; ++f) {
+      const auto offset =
+          ReadBlockLfo(opcode, static_cast<size_t>(n), flags.template enum_cast<CHO_FLAGS>(), f)
+              .offset;
+      min = std::min(min, offset);
+      max = std::max(max, offset);
+    }
+    for (size_t j = 0; j < program.num_steps; ++j) {
+      const auto &write = instructions_[program.steps[j].ic];
+      if (OPCODE::WRA != write.get_opcode() && OPCODE::WRAP != write.get_opcode()) continue;
+      if (DelayHazard(addr + min, max - min, write.constants[0].loadi(), j < i)) return false;
+    }
+  }
+  return true;
+}
+
+template <typename Engine, typename DelayStorage>
+typename LfoBase<Engine>::LfoValue VM<Engine, DelayStorage>::ReadBlockLfo(OPCODE opcode, size_t n,
+                                                                          CHO_FLAGS flags,
+                                                                          size_t f) const
+{
+  const auto &lfo = block_buffer_->lfo;
+  if (OPCODE::CHO_RDA_SIN == opcode || OPCODE::CHO_SOF_SIN == opcode)
+    return SinLfo::Read(lfo[SIN0_SIN + 2 * n][f], lfo[SIN0_COS + 2 * n][f], flags);
+  return context_.ramp_lfo_[n].Read(lfo[RMP0_VAL + n][f].value, flags);
+}
+
+template <typename Engine, typename DelayStorage>
+void VM<Engine, DelayStorage>::ExecuteBlocks(const AudioFrame *in, AudioFrame *out,
+                                             size_t num_frames)
+{
+  // SKP RUN is only resolved after the first frame
+  if (context_.state_.first_run && num_frames) {
+    ExecuteInterpreter(in, out, 1);
+    ++in, ++out, --num_frames;
+  }
+  while (num_frames >= kMinBlockFrames) {
+    const auto n = std::min(num_frames, kMaxBlockFrames);
+    ExecuteBlock(in, out, n);
+    in += n, out += n, num_frames -= n;
+  }
+  if (num_frames) ExecuteInterpreter(in, out, num_frames);
+}
+
+template <typename Engine, typename DelayStorage>
+void VM<Engine, DelayStorage>::ExecuteBlock(const AudioFrame *in, AudioFrame *out,
+                                            size_t num_frames)
+{
+  auto &buffer = *block_buffer_;
+  const auto &program = block_program_;
+  auto &state = context_.state_;
+  const auto features = program_.features;
+  const auto cursor = context_.delay_memory_.cursor();
+
+  if (program.reads_lfo) {
+    auto sin_lfo = context_.sin_lfo_;
+    auto ramp_lfo = context_.ramp_lfo_;
+    for (size_t f = 0; f < num_frames; ++f) {
+      for (size_t n = 0; n < 2; ++n) {
+        buffer.lfo[SIN0_SIN + 2 * n][f] = sin_lfo[n].sin();
+        buffer.lfo[SIN0_COS + 2 * n][f] = sin_lfo[n].cos();
+        buffer.lfo[RMP0_VAL + n][f] = ramp_lfo[n].value();
+        sin_lfo[n].Tick();
+        ramp_lfo[n].Tick();
+      }
+    }
+    if (program.lfo_reads && !CheckLfoReads(num_frames)) {
+      ExecuteInterpreter(in, out, num_frames);
+      return;
+    }
+  }
+
+  for (size_t r = 0; r < kNumRegisters; ++r) {
+    const auto bit = uint64_t{1} << r;
+    auto &values = buffer.registers[r];
+    if (program.written_registers & bit)
+      values[0] = state.registers_[r];
+    else if (program.constant_registers & bit)
+      std::fill(values.begin() + 1, values.begin() + 1 + num_frames, state.registers_[r]);
+  }
+  for (size_t f = 0; f < num_frames; ++f) {
+    buffer.registers[ADCL][f + 1].store(in[f].l);
+    if (features & FEATURE_STEREO) buffer.registers[ADCR][f + 1].store(in[f].r);
+  }
+  buffer.acc[0] = state.acc_;
+  if (program.acc_zero) {
+    for (size_t f = 1; f < num_frames; ++f) buffer.acc[f].clr();
+  }
+
+  size_t begin = 0;
+  for (size_t s = 0; s < program.num_segments; ++s) {
+    const auto &segment = program.segments[s];
+    if (segment.sequential) {
+      for (size_t f = 0; f < num_frames; ++f) {
+        for (size_t i = begin; i < segment.end; ++i)
+          ExecuteBlockStep(program.steps[i], cursor, f, f + 1);
+      }
+    } else {
+      for (size_t i = begin; i < segment.end; ++i)
+        ExecuteBlockStep(program.steps[i], cursor, 0, num_frames);
+    }
+    begin = segment.end;
+  }
+
+  for (size_t r = 0; r < kNumRegisters; ++r) {
+    if (program.written_registers & (uint64_t{1} << r))
+      state.registers_[r] = buffer.registers[r][num_frames];
+  }
+  state.acc_ = buffer.acc[num_frames - 1];
+  if (features & FEATURE_PACC) state.pacc_ = buffer.pacc[num_frames - 1];
+  if (features & FEATURE_LAST_READ)
+    context_.delay_memory_.set_last_read(buffer.last_read[num_frames - 1]);
+
+  for (size_t f = 0; f < num_frames; ++f) {
+    buffer.registers[DACL][f + 1].read(out[f].l);
+    buffer.registers[DACR][f + 1].read(out[f].r);
+    Tick();
+  }
+}
+
+// Run one instruction for frames [begin, end)
+template <typename Engine, typename DelayStorage>
+void VM<Engine, DelayStorage>::ExecuteBlockStep(typename BlockProgram::Step step, int32_t cursor,
+                                                size_t begin, size_t end)
+{
+  auto &buffer = *block_buffer_;
+  auto &acc = buffer.acc;
+  auto &pacc = buffer.pacc;
+  auto &next_pacc = buffer.next_pacc;
+  const auto &instruction = instructions_[step.ic];
+
+  // If this step reads PACC itself, the value for the next one is only stored after it's run
+  const bool save_pacc = BlockProgram::SAVE_PACC & step.flags;
+  const bool uses_pacc =
+      OPCODE::WRHX == instruction.get_opcode() || OPCODE::WRLX == instruction.get_opcode();
+  if (save_pacc) {
+    auto &saved = uses_pacc ? next_pacc : pacc;
+    std::copy(acc.begin() + begin, acc.begin() + end, saved.begin() + begin);
+  }
+
+  // Reads from the previous frame are one slot behind, writes are always for the current frame
+  auto source = [&](int32_t index) {
+    return buffer.registers[index].data() + (BlockProgram::PREVIOUS_FRAME & step.flags ? 0 : 1);
+  };
+  auto destination = [&](int32_t index) { return buffer.registers[index].data() + 1; };
+  const auto delay = context_.delay_memory_.data();
+  auto address = [cursor](int32_t addr, size_t f) {
+    return (cursor + addr - static_cast<int32_t>(f)) & kDelayAddrMask;
+  };
+
+  switch (instruction.get_opcode()) {
+    case OPCODE::RDA: {
+      GET_INT_CONSTANT(addr, 0);
+      GET_CONSTANT(FloatConstant, c, 1);
+      for (auto f = begin; f < end; ++f) {
+        const auto value = DelayStorage::Unpack(delay[address(addr, f)]);
+        buffer.last_read[f] = value;
+        acc[f].store(value * c + acc[f].load());
+      }
+    } break;
+
+    case OPCODE::WRA: {
+      GET_INT_CONSTANT(addr, 0);
+      GET_CONSTANT(FloatConstant, c, 1);
+      for (auto f = begin; f < end; ++f) {
+        delay[address(addr, f)] = DelayStorage::Pack(acc[f].load());
+        acc[f].store(acc[f].load() * c);
+      }
+    } break;
+
+    case OPCODE::WRAP: {
+      GET_INT_CONSTANT(addr, 0);
+      GET_CONSTANT(FloatConstant, c, 1);
+      for (auto f = begin; f < end; ++f) {
+        delay[address(addr, f)] = DelayStorage::Pack(acc[f].load());
+        acc[f].store(acc[f].load() * c + buffer.last_read[f]);
+      }
+    } break;
+
+    case OPCODE::RDAX: {
+      GET_INT_CONSTANT(addr, 0);
+      GET_CONSTANT(FloatConstant, c, 1);
+      const auto registers = source(addr);
+      for (auto f = begin; f < end; ++f) acc[f].store(registers[f].load() * c + acc[f].load());
+    } break;
+
+    case OPCODE::RDFX: {
+      GET_INT_CONSTANT(addr, 0);
+      GET_CONSTANT(FloatConstant, c, 1);
+      const auto registers = source(addr);
+      for (auto f = begin; f < end; ++f) {
+        auto r = registers[f].load();
+        acc[f].store((acc[f].load() - r) * c + r);
+      }
+    } break;
+
+    case OPCODE::WRAX: {
+      GET_INT_CONSTANT(addr, 0);
+      GET_CONSTANT(FloatConstant, c, 1);
+      const auto registers = destination(addr);
+      for (auto f = begin; f < end; ++f) {
+        registers[f].store(acc[f]);
+        acc[f].store(acc[f].load() * c);
+      }
+    } break;
+
+    case OPCODE::WRHX: {
+      GET_INT_CONSTANT(addr, 0);
+      GET_CONSTANT(FloatConstant, c, 1);
+      const auto registers = destination(addr);
+      for (auto f = begin; f < end; ++f) {
+        registers[f].store(acc[f]);
+        acc[f].store(acc[f].load() * c + pacc[f].load());
+      }
+    } break;
+
+    case OPCODE::WRLX: {
+      GET_INT_CONSTANT(addr, 0);
+      GET_CONSTANT(FloatConstant, c, 1);
+      const auto registers = destination(addr);
+      for (auto f = begin; f < end; ++f) {
+        registers[f].store(acc[f]);
+        acc[f].store((pacc[f].load() - acc[f].load()) * c + pacc[f].load());
+      }
+    } break;
+
+    case OPCODE::MAXX: {
+      GET_INT_CONSTANT(addr, 0);
+      GET_CONSTANT(FloatConstant, c, 1);
+      const auto registers = source(addr);
+      for (auto f = begin; f < end; ++f) {
+        auto abs_rxc = Engine::ABS(registers[f].load() * c);
+        auto abs_acc = Engine::ABS(acc[f].load());
+        acc[f].store(abs_rxc > abs_acc ? abs_rxc : abs_acc);
+      }
+    } break;
+
+    case OPCODE::MULX: {
+      GET_INT_CONSTANT(addr, 0);
+      const auto registers = source(addr);
+      for (auto f = begin; f < end; ++f) acc[f].store(acc[f].load() * registers[f].load());
+    } break;
+
+    case OPCODE::SOF: {
+      GET_CONSTANT(FloatConstant, c, 0);
+      GET_CONSTANT(FloatConstant, d, 1);
+      for (auto f = begin; f < end; ++f) acc[f].store(acc[f].load() * c + d);
+    } break;
+
+    case OPCODE::AND: {
+      GET_INT_CONSTANT(mask, 0);
+      for (auto f = begin; f < end; ++f) acc[f].storei(core::AND<SF23>(acc[f].loadi(), mask));
+    } break;
+
+    case OPCODE::OR: {
+      GET_INT_CONSTANT(mask, 0);
+      for (auto f = begin; f < end; ++f) acc[f].storei(core::OR<SF23>(acc[f].loadi(), mask));
+    } break;
+
+    case OPCODE::XOR: {
+      GET_INT_CONSTANT(mask, 0);
+      for (auto f = begin; f < end; ++f) acc[f].storei(core::XOR<SF23>(acc[f].loadi(), mask));
+    } break;
+
+    case OPCODE::NOT:
+      for (auto f = begin; f < end; ++f) acc[f].storei(core::NOT<SF23>(acc[f].loadi()));
+      break;
+
+    case OPCODE::ABSA:
+      for (auto f = begin; f < end; ++f) acc[f].store(Engine::ABS(acc[f].load()));
+      break;
+
+    case OPCODE::CLR:
+      for (auto f = begin; f < end; ++f) acc[f].clr();
+      break;
+
+    case OPCODE::LDAX: {
+      GET_INT_CONSTANT(addr, 0);
+      const auto registers = source(addr);
+      for (auto f = begin; f < end; ++f) acc[f].store(registers[f]);
+    } break;
+
+    case OPCODE::CHO_RDAL: {
+      // n is the CHO_SEL_IDX, see VM::Lower
+      GET_INT_CONSTANT(n, 0);
+      const auto &values = buffer.lfo[static_cast<size_t>(n)];
+      for (auto f = begin; f < end; ++f) acc[f].store(values[f]);
+    } break;
+
+    case OPCODE::CHO_RDA_SIN:
+    case OPCODE::CHO_RDA_RMP: {
+      GET_INT_CONSTANT(n, 0);
+      GET_INT_CONSTANT(flags, 1);
+      GET_INT_CONSTANT(addr, 2);
+      for (auto f = begin; f < end; ++f) {
+        const auto lfo_value = ReadBlockLfo(instruction.get_opcode(), static_cast<size_t>(n),
+                                            flags.template enum_cast<CHO_FLAGS>(), f);
+        const auto value = DelayStorage::Unpack(delay[address(addr + lfo_value.offset, f)]);
+        buffer.last_read[f] = value;
+        acc[f].store(value * lfo_value.coefficient + acc[f].load());
+      }
+    } break;
+
+    case OPCODE::CHO_SOF_SIN:
+    case OPCODE::CHO_SOF_RMP: {
+      GET_INT_CONSTANT(n, 0);
+      GET_INT_CONSTANT(flags, 1);
+      GET_CONSTANT(FloatConstant, d, 2);
+      for (auto f = begin; f < end; ++f) {
+        const auto lfo_value = ReadBlockLfo(instruction.get_opcode(), static_cast<size_t>(n),
+                                            flags.template enum_cast<CHO_FLAGS>(), f);
+        acc[f].store(acc[f].load() * lfo_value.coefficient + d);
+      }
+    } break;
+
+    // Only PACC (see above)
+    default: break;
+  }
+
+  if (save_pacc && uses_pacc)
+    std::copy(next_pacc.begin() + begin, next_pacc.begin() + end, pacc.begin() + begin);
+}
+
+}  // namespace fv1
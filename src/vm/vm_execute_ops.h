@@ -0,0 +1,367 @@
+// fv1vm: experimental FV-1 virtual machine
+// Copyright (C) 2022 Patrick Dowling <pld@gurkenkiste.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+#ifndef FV1_VM_H_
+#error "Don't include or compile this file directly"
+#endif
+
+// Opcode handlers shared by the interpreter loops (vm_execute_v1.h, vm_execute_threaded.h).
+// The including file defines the OPCODE_DISPATCH_* and OPCODE_END macros to turn each block into
+// either a switch case or a jump target; the handler bodies themselves stay identical.
+//
+// Expected in scope: instruction, instructions, ic, acc, pacc, prev_acc, registers, delay (the
+// DelayMemory::Frame), context (VM::Context, for the LFOs), features, kLastRead (see VM::FEATURES)
+
+// Order of opcodes is based on hex value. It might also make sense to group by
+// functionality
+
+OPCODE_DISPATCH_2(RDA, INT(addr), FLOAT(c));
+acc.store(delay.template Load<kLastRead>(addr) * c + acc.load());
+OPCODE_END();
+
+OPCODE_DISPATCH_1(RMPA, FLOAT(c));
+auto ptr = registers[ADDR_PTR].load_addr();
+acc.store(delay.template Load<kLastRead>(ptr) * c + acc.load());
+OPCODE_END();
+
+OPCODE_DISPATCH_2(WRA, INT(addr), FLOAT(c));
+delay.Store(addr, acc);
+acc.store(acc.load() * c);
+OPCODE_END();
+
+OPCODE_DISPATCH_2(WRAP, INT(addr), FLOAT(c));
+delay.Store(addr, acc);
+acc.store(acc.load() * c + delay.last_read());
+OPCODE_END();
+
+OPCODE_DISPATCH_2(RDAX, INT(addr), FLOAT(c));
+acc.store(registers[addr].load() * c + acc.load());
+OPCODE_END();
+
+OPCODE_DISPATCH_2(RDFX, INT(addr), FLOAT(c));
+auto r = registers[addr].load();
+acc.store((acc.load() - r) * c + r);
+OPCODE_END();
+
+OPCODE_DISPATCH_2(WRAX, INT(addr), FLOAT(c));
+registers[addr].store(acc);
+acc.store(acc.load() * c);
+OPCODE_END();
+
+OPCODE_DISPATCH_2(WRHX, INT(addr), FLOAT(c));
+registers[addr].store(acc);
+acc.store(acc.load() * c + pacc.load());
+OPCODE_END();
+
+OPCODE_DISPATCH_2(WRLX, INT(addr), FLOAT(c));
+registers[addr].store(acc);
+acc.store((pacc.load() - acc.load()) * c + pacc.load());
+OPCODE_END();
+
+OPCODE_DISPATCH_2(MAXX, INT(addr), FLOAT(c));
+auto abs_rxc = Engine::ABS(registers[addr].load() * c);
+auto abs_acc = Engine::ABS(acc.load());
+acc.store(abs_rxc > abs_acc ? abs_rxc : abs_acc);
+OPCODE_END();
+
+OPCODE_DISPATCH_1(MULX, INT(addr));
+acc.store(acc.load() * registers[addr].load());
+OPCODE_END();
+
+OPCODE_DISPATCH_TODO(LOG);
+OPCODE_DISPATCH_TODO(EXP);
+
+OPCODE_DISPATCH_2(SOF, FLOAT(c), FLOAT(d));
+acc.store(acc.load() * c + d);
+OPCODE_END();
+
+// Logical ops always use SF23
+OPCODE_DISPATCH_1(AND, INT(mask));
+acc.storei(core::AND<SF23>(acc.loadi(), mask));
+OPCODE_END();
+
+OPCODE_DISPATCH_1(OR, INT(mask));
+acc.storei(core::OR<SF23>(acc.loadi(), mask));
+OPCODE_END();
+
+OPCODE_DISPATCH_1(XOR, INT(mask));
+acc.storei(core::XOR<SF23>(acc.loadi(), mask));
+OPCODE_END();
+
+OPCODE_DISPATCH_2(SKP, INT(cmask), INT(n));  // NOTE Optimized to JMP if cmask == 0;
+bool skip = true;
+// All conditions must be met
+if (SKP_FLAGS::NEG & cmask) skip = skip && acc.neg();
+if (SKP_FLAGS::GEZ & cmask) skip = skip && acc.gez();
+if (SKP_FLAGS::ZRO & cmask) skip = skip && acc.zero();
+if (SKP_FLAGS::ZRC & cmask) skip = skip && acc.gez() != pacc.gez();
+// RUN is resolved by VM::SplitInitProgram
+if (skip) ic += n;
+OPCODE_END();
+
+// NOTE Pre-shifted values from VM::Optimize
+OPCODE_DISPATCH_3(WLDS, IDX(n), FLOAT(f), FLOAT(a));
+if (n) {
+  registers[REGISTER::SIN1_RATE].store(f);
+  registers[REGISTER::SIN1_RANGE].store(a);
+  context.sin_lfo_[1].Jam();
+} else {
+  registers[REGISTER::SIN0_RATE].store(f);
+  registers[REGISTER::SIN0_RANGE].store(a);
+  context.sin_lfo_[0].Jam();
+}
+OPCODE_END();
+
+OPCODE_DISPATCH_1(JAM, IDX(n));
+context.ramp_lfo_[n].Jam();
+OPCODE_END();
+
+OPCODE_DISPATCH_0(CLR);
+acc.clr();
+OPCODE_END();
+
+OPCODE_DISPATCH_0(NOT);
+acc.storei(core::NOT<SF23>(acc.loadi()));
+OPCODE_END();
+
+OPCODE_DISPATCH_0(ABSA);
+acc.store(Engine::ABS(acc.load()));
+OPCODE_END();
+
+OPCODE_DISPATCH_1(LDAX, INT(addr));
+acc.store(registers[addr]);
+OPCODE_END();
+
+// NOTE Pre-shifted values from VM::Optimize
+OPCODE_DISPATCH_3(WLDR, IDX(n), FLOAT(f), INT(a));
+if (n) {
+  registers[REGISTER::RMP1_RATE].store(f);
+  registers[REGISTER::RMP1_RANGE].store(a);
+  context.ramp_lfo_[1].Jam();
+} else {
+  registers[REGISTER::RMP0_RATE].store(f);
+  registers[REGISTER::RMP0_RANGE].store(a);
+  context.ramp_lfo_[0].Jam();
+}
+OPCODE_END();
+
+// ********************************************************************************
+// CHO variants
+// - These are still very similar so it might make sense to unify further
+// - OTOH we can only go so far without adding something like a function pointer to the
+// instruction struct, or other additional dispatch.
+//
+// TODO Check handling of COMPA (does the complement affect the coefficient?)
+
+OPCODE_DISPATCH_1(CHO_RDAL, INT(n) /*, flags*/);
+// NOTE n is artificial from VM::Optimize so flags not needed
+acc.store(context.read_lfo(n.template enum_cast<CHO_SEL_IDX>()));
+OPCODE_END();
+
+// CHO RDA: ACC <- ACC + coeff (LFO) * delay[ADDRESS + offset (LFO)]
+OPCODE_DISPATCH_3(CHO_RDA_RMP, IDX(n), INT(flags), INT(addr));
+const auto lfo_value = context.ramp_lfo_[n].Read(flags.template enum_cast<CHO_FLAGS>());
+const auto value = delay.template Load<kLastRead>(addr + lfo_value.offset);
+acc.store(value * lfo_value.coefficient + acc.load());
+OPCODE_END();
+
+OPCODE_DISPATCH_3(CHO_RDA_SIN, IDX(n), INT(flags), INT(addr));
+const auto lfo_value = context.sin_lfo_[n].Read(flags.template enum_cast<CHO_FLAGS>());
+const auto value = delay.template Load<kLastRead>(addr + lfo_value.offset);
+acc.store(value * lfo_value.coefficient + acc.load());
+OPCODE_END();
+
+// CHO SOF: ACC <- coeff (LFO) * ACC + OFFSET
+OPCODE_DISPATCH_3(CHO_SOF_RMP, IDX(n), INT(flags), FLOAT(d));
+const auto lfo_value = context.ramp_lfo_[n].Read(flags.template enum_cast<CHO_FLAGS>());
+acc.store(acc.load() * lfo_value.coefficient + d);
+OPCODE_END();
+
+OPCODE_DISPATCH_3(CHO_SOF_SIN, IDX(n), INT(flags), FLOAT(d));
+const auto lfo_value = context.sin_lfo_[n].Read(flags.template enum_cast<CHO_FLAGS>());
+acc.store(acc.load() * lfo_value.coefficient + d);
+OPCODE_END();
+
+// ********************************************************************************
+
+OPCODE_DISPATCH_2(JMP, INT(flags), INT(n));
+// ignoring flags
+(void)flags;
+ic += n;
+OPCODE_END();
+
+// ********************************************************************************
+// Coefficients that don't need a multiplication, see VM::ReduceCoefficients. The results are the
+// same as the general versions with C = 1.0, -1.0, 0.5, -2.0, 0 respectively.
+
+OPCODE_DISPATCH_1(RDAX_ADD, INT(addr));
+acc.store(registers[addr].load() + acc.load());
+OPCODE_END();
+
+OPCODE_DISPATCH_1(RDAX_SUB, INT(addr));
+acc.store(acc.load() - registers[addr].load());
+OPCODE_END();
+
+OPCODE_DISPATCH_1(RDA_ADD, INT(addr));
+acc.store(delay.template Load<kLastRead>(addr) + acc.load());
+OPCODE_END();
+
+OPCODE_DISPATCH_1(WRAX_MOV, INT(addr));
+registers[addr].store(acc);
+OPCODE_END();
+
+OPCODE_DISPATCH_1(WRAX_CLR, INT(addr));
+registers[addr].store(acc);
+acc.clr();
+OPCODE_END();
+
+OPCODE_DISPATCH_0(SOF_NEG);
+acc.store(Engine::NEG(acc.load()));
+OPCODE_END();
+
+OPCODE_DISPATCH_0(SOF_HALF);
+acc.store(Engine::HALF(acc.load()));
+OPCODE_END();
+
+OPCODE_DISPATCH_0(SOF_NEG2);
+const auto value = acc.load();
+acc.store(Engine::NEG(value + value));
+OPCODE_END();
+
+// ********************************************************************************
+
+// Fused instructions, see VM::FuseInstructions. These replace the second instruction of the pair
+// with the first being a NOP. prev_acc is set to the intermediate result so PACC is the same as if
+// both instructions had run.
+
+// RDA read_addr, C; WRAP write_addr, -C
+OPCODE_DISPATCH_3(ALLPASS, INT(read_addr), FLOAT(c), INT(write_addr));
+const auto value = delay.template Load<kLastRead>(read_addr);
+acc.store(value * c + acc.load());
+prev_acc = acc;
+delay.Store(write_addr, acc);
+acc.store(acc.load() * Engine::NEG(c) + value);
+OPCODE_END();
+
+// RDFX addr, k; WRLX addr, c
+// The PACC of the WRLX is the ACC before the RDFX, so this doesn't depend on PACC.
+OPCODE_DISPATCH_3(LPF1, INT(addr), FLOAT(k), FLOAT(c));
+const auto input = acc.load();
+const auto r = registers[addr].load();
+acc.store((input - r) * k + r);
+prev_acc = acc;
+registers[addr].store(acc);
+acc.store((input - acc.load()) * c + input);
+OPCODE_END();
+
+// RDFX addr, k; WRHX addr, c
+OPCODE_DISPATCH_3(HPF1, INT(addr), FLOAT(k), FLOAT(c));
+const auto input = acc.load();
+const auto r = registers[addr].load();
+acc.store((input - r) * k + r);
+prev_acc = acc;
+registers[addr].store(acc);
+acc.store(acc.load() * c + input);
+OPCODE_END();
+
+// CHO RDA n, flags | COMPC, addr; CHO RDA n, flags, addr + 1 (or COMPC on the second one)
+// The LFO is read once, the coefficients are C and 1-C like Read would return them. flags has
+// COMPC set if the first read uses it.
+OPCODE_DISPATCH_3(CHO_INTERP_RMP, IDX(n), INT(flags), INT(addr));
+const auto lfo_value = context.ramp_lfo_[n].Read(static_cast<CHO_FLAGS>(flags & ~CHO_FLAGS::COMPC));
+const auto complement = Engine::ONE - lfo_value.coefficient;
+const bool compc = CHO_FLAGS::COMPC & flags;
+const auto value = delay.template Load<kLastRead>(addr + lfo_value.offset);
+acc.store(value * (compc ? complement : lfo_value.coefficient) + acc.load());
+prev_acc = acc;
+const auto next = delay.template Load<kLastRead>(addr + 1 + lfo_value.offset);
+acc.store(next * (compc ? lfo_value.coefficient : complement) + acc.load());
+OPCODE_END();
+
+OPCODE_DISPATCH_3(CHO_INTERP_SIN, IDX(n), INT(flags), INT(addr));
+const auto lfo_value = context.sin_lfo_[n].Read(static_cast<CHO_FLAGS>(flags & ~CHO_FLAGS::COMPC));
+const auto complement = Engine::ONE - lfo_value.coefficient;
+const bool compc = CHO_FLAGS::COMPC & flags;
+const auto value = delay.template Load<kLastRead>(addr + lfo_value.offset);
+acc.store(value * (compc ? complement : lfo_value.coefficient) + acc.load());
+prev_acc = acc;
+const auto next = delay.template Load<kLastRead>(addr + 1 + lfo_value.offset);
+acc.store(next * (compc ? lfo_value.coefficient : complement) + acc.load());
+OPCODE_END();
+
+// ********************************************************************************
+// Results that never leave the S.23 range, see VM::ElideSaturation
+
+OPCODE_DISPATCH_2(RDA_NOSAT, INT(addr), FLOAT(c));
+acc.store_unsaturated(delay.template Load<kLastRead>(addr) * c + acc.load());
+OPCODE_END();
+
+OPCODE_DISPATCH_2(RDAX_NOSAT, INT(addr), FLOAT(c));
+acc.store_unsaturated(registers[addr].load() * c + acc.load());
+OPCODE_END();
+
+OPCODE_DISPATCH_2(RDFX_NOSAT, INT(addr), FLOAT(c));
+auto r = registers[addr].load();
+acc.store_unsaturated((acc.load() - r) * c + r);
+OPCODE_END();
+
+OPCODE_DISPATCH_2(WRAX_NOSAT, INT(addr), FLOAT(c));
+registers[addr].store(acc);
+acc.store_unsaturated(acc.load() * c);
+OPCODE_END();
+
+OPCODE_DISPATCH_1(MULX_NOSAT, INT(addr));
+acc.store_unsaturated(acc.load() * registers[addr].load());
+OPCODE_END();
+
+OPCODE_DISPATCH_2(SOF_NOSAT, FLOAT(c), FLOAT(d));
+acc.store_unsaturated(acc.load() * c + d);
+OPCODE_END();
+
+// ********************************************************************************
+// Delay memory cells accessed more than once per frame, see VM::ReuseDelayReads
+
+OPCODE_DISPATCH_3(RDA_SAVE, INT(addr), FLOAT(c), IDX(slot));
+const auto value = delay.template Load<kLastRead>(addr);
+context.delay_slots_[slot] = value;
+acc.store(value * c + acc.load());
+OPCODE_END();
+
+// What a read of the cell would return, which depends on the storage format
+OPCODE_DISPATCH_3(WRA_SAVE, INT(addr), FLOAT(c), IDX(slot));
+delay.Store(addr, acc);
+context.delay_slots_[slot] = DelayStorage::Unpack(DelayStorage::Pack(acc.load()));
+acc.store(acc.load() * c);
+OPCODE_END();
+
+OPCODE_DISPATCH_2(RDA_CACHED, IDX(slot), FLOAT(c));
+const auto value = context.delay_slots_[slot];
+if constexpr (kLastRead) delay.set_last_read(value);
+acc.store(value * c + acc.load());
+OPCODE_END();
+
+// ********************************************************************************
+// Superinstructions, see VM::FuseSuperinstructions
+
+#include "vm_execute_superops.h"
+
+// ********************************************************************************
+
+OPCODE_DISPATCH_NOP(CHO_RDA);  // optimized away
+OPCODE_DISPATCH_NOP(CHO_SOF);  // optimized away
+OPCODE_DISPATCH_NOP(NOP);
+OPCODE_DISPATCH_NOP(UNKNOWN);
+OPCODE_DISPATCH_NOP(REAL_OPCODES_LAST);
@@ -0,0 +1,212 @@
+// fv1vm: experimental FV-1 virtual machine
+// Copyright (C) 2022 Patrick Dowling <pld@gurkenkiste.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+#ifndef FV1_VM_H_
+#error "Don't include or compile this file directly"
+#endif
+
+#ifdef FV1_VM_THREADED_DISPATCH
+
+// Direct-threaded ("computed goto") variant of the interpreter loop.
+//
+// Instead of a switch per instruction, each compiled instruction gets the address of its handler
+// in Program::handlers, and every handler ends by jumping straight to the next one. That gives
+// each handler its own indirect branch which the branch predictor seems to like much better than
+// the single shared one in the switch. The handler bodies are shared with the switch (vm_execute_ops.h).
+//
+// Label addresses are only valid within the function that defines them, so linking the program
+// (filling in the handlers) also happens in here. The function must not be inlined or cloned, since
+// that would result in different label addresses.
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+
+// clang doesn't have noclone (and doesn't clone functions like this either)
+#if defined(__clang__)
+#define FV1_VM_THREADED_ATTRIBUTES __attribute__((noinline))
+#else
+#define FV1_VM_THREADED_ATTRIBUTES __attribute__((noinline, noclone))
+#endif
+
+namespace fv1 {
+
+#undef OPCODE_DISPATCH_NOP
+#undef OPCODE_DISPATCH_0
+#undef OPCODE_DISPATCH_1
+#undef OPCODE_DISPATCH_2
+#undef OPCODE_DISPATCH_3
+#undef OPCODE_END
+
+// per-opcode updates, see ExecuteSwitch
+#define DISPATCH_NEXT()                    \
+  if constexpr (features & FEATURE_PACC) { \
+    pacc = prev_acc;                       \
+    prev_acc = acc;                        \
+  }                                        \
+  ++ic;                                    \
+  goto *handlers[ic]
+//
+#define OPCODE_DISPATCH_NOP(x) \
+  op_##x:                      \
+  DISPATCH_NEXT()
+//
+#define OPCODE_DISPATCH_0(x)                   \
+  op_##x : {                                   \
+    const auto &instruction = instructions[ic]; \
+    (void)instruction
+//
+#define OPCODE_DISPATCH_1(x, c0)                \
+  op_##x : {                                    \
+    const auto &instruction = instructions[ic]; \
+    GET_CONSTANT(c0, 0)
+//
+#define OPCODE_DISPATCH_2(x, c0, c1)            \
+  op_##x : {                                    \
+    const auto &instruction = instructions[ic]; \
+    GET_CONSTANT(c0, 0);                        \
+    GET_CONSTANT(c1, 1)
+//
+#define OPCODE_DISPATCH_3(x, c0, c1, c2)        \
+  op_##x : {                                    \
+    const auto &instruction = instructions[ic]; \
+    GET_CONSTANT(c0, 0);                        \
+    GET_CONSTANT(c1, 1);                        \
+    GET_CONSTANT(c2, 2)
+//
+#define OPCODE_END() \
+  }                  \
+  DISPATCH_NEXT()
+//
+#define OPCODE_LINK(x) labels[static_cast<size_t>(OPCODE::x)] = &&op_##x
+
+template <typename Engine, typename DelayStorage>
+template <uint32_t features>
+FV1_VM_THREADED_ATTRIBUTES void VM<Engine, DelayStorage>::ExecuteThreaded(
+    const Program &program, Context &context, uint32_t lfos, const AudioFrame *in,
+    AudioFrame *out, size_t num_frames)
+{
+  // Link mode, see Link(). That's only ever called with the VM's own (non-const) programs.
+  if (!in) {
+    const void *labels[kNumOpcodes];
+    for (auto &label : labels) label = &&op_UNKNOWN;
+    OPCODE_LINK(RDA);
+    OPCODE_LINK(RMPA);
+    OPCODE_LINK(WRA);
+    OPCODE_LINK(WRAP);
+    OPCODE_LINK(RDAX);
+    OPCODE_LINK(RDFX);
+    OPCODE_LINK(WRAX);
+    OPCODE_LINK(WRHX);
+    OPCODE_LINK(WRLX);
+    OPCODE_LINK(MAXX);
+    OPCODE_LINK(MULX);
+    OPCODE_LINK(LOG);
+    OPCODE_LINK(EXP);
+    OPCODE_LINK(SOF);
+    OPCODE_LINK(AND);
+    OPCODE_LINK(OR);
+    OPCODE_LINK(XOR);
+    OPCODE_LINK(SKP);
+    OPCODE_LINK(WLDS);
+    OPCODE_LINK(JAM);
+    OPCODE_LINK(CHO_RDA);
+    OPCODE_LINK(REAL_OPCODES_LAST);
+    OPCODE_LINK(CLR);
+    OPCODE_LINK(NOT);
+    OPCODE_LINK(ABSA);
+    OPCODE_LINK(LDAX);
+    OPCODE_LINK(WLDR);
+    OPCODE_LINK(CHO_RDAL);
+    OPCODE_LINK(CHO_SOF);
+    OPCODE_LINK(CHO_SOF_RMP);
+    OPCODE_LINK(CHO_SOF_SIN);
+    OPCODE_LINK(CHO_RDA_RMP);
+    OPCODE_LINK(CHO_RDA_SIN);
+    OPCODE_LINK(JMP);
+    OPCODE_LINK(NOP);
+    OPCODE_LINK(RDAX_ADD);
+    OPCODE_LINK(RDAX_SUB);
+    OPCODE_LINK(RDA_ADD);
+    OPCODE_LINK(WRAX_MOV);
+    OPCODE_LINK(WRAX_CLR);
+    OPCODE_LINK(SOF_NEG);
+    OPCODE_LINK(SOF_HALF);
+    OPCODE_LINK(SOF_NEG2);
+    OPCODE_LINK(ALLPASS);
+    OPCODE_LINK(LPF1);
+    OPCODE_LINK(HPF1);
+    OPCODE_LINK(CHO_INTERP_RMP);
+    OPCODE_LINK(CHO_INTERP_SIN);
+    OPCODE_LINK(RDA_NOSAT);
+    OPCODE_LINK(RDAX_NOSAT);
+    OPCODE_LINK(RDFX_NOSAT);
+    OPCODE_LINK(WRAX_NOSAT);
+    OPCODE_LINK(MULX_NOSAT);
+    OPCODE_LINK(SOF_NOSAT);
+    OPCODE_LINK(RDA_SAVE);
+    OPCODE_LINK(WRA_SAVE);
+    OPCODE_LINK(RDA_CACHED);
+#define FV1_SUPEROP_LINK(name, ...) OPCODE_LINK(name);
+    FV1_SUPEROPS(FV1_SUPEROP_LINK)
+#undef FV1_SUPEROP_LINK
+    OPCODE_LINK(UNKNOWN);
+
+    auto &handlers = const_cast<Program &>(program).handlers;
+    for (size_t i = 0; i < program.length; ++i)
+      handlers[i] = labels[static_cast<size_t>(program.instructions[i].get_opcode())];
+    handlers[program.length] = &&end_of_program;
+    return;
+  }
+
+  static constexpr bool kLastRead = features & FEATURE_LAST_READ;
+  auto &state = context.state_;
+  typename Engine::Register acc = state.acc_;
+  typename Engine::Register pacc = state.pacc_;
+  [[maybe_unused]] typename Engine::Register prev_acc = acc;
+  auto registers = state.registers_.data();
+  const auto instructions = program.instructions.data();
+  const auto handlers = program.handlers.data();
+
+  for (; num_frames; --num_frames, ++in, ++out) {
+    state.registers_[ADCL].store(in->l);
+    if constexpr (features & FEATURE_STEREO) state.registers_[ADCR].store(in->r);
+    auto delay = context.delay_memory_.frame();
+
+    int32_t ic = 0;
+    goto *handlers[ic];
+
+#include "vm_execute_ops.h"
+
+  end_of_program:
+    context.template Tick<features>(lfos);
+    state.first_run = false;
+    state.registers_[DACL].read(out->l);
+    state.registers_[DACR].read(out->r);
+  }
+
+  if constexpr (features & FEATURE_PACC) state.pacc_ = pacc;
+  state.acc_ = acc;
+}
+
+#undef OPCODE_LINK
+#undef DISPATCH_NEXT
+#undef FV1_VM_THREADED_ATTRIBUTES
+
+}  // namespace fv1
+
+#pragma GCC diagnostic pop
+
+#endif  // FV1_VM_THREADED_DISPATCH
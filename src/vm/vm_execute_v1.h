@@ -23,6 +23,9 @@
 
 // Some ideas
 // - We can store a pointer to the register in the CompiledInstruction
+//   ...but it doesn't fit the 16 bytes, and registers[addr] is already a single load with an
+//   indexed address. Delay memory goes through a DelayMemory::Frame so at least the buffer and
+//   cursor are resolved once per frame.
 // - We can pack a function pointer in there as well as skip the switch dispatch
 // - ...but then we have a guaranteed function call?
 //
@@ -77,217 +80,164 @@ namespace fv1 {
 template <typename Engine, typename DelayStorage>
 void VM<Engine, DelayStorage>::Execute(const AudioFrame *in, AudioFrame *out, size_t num_frames)
 {
-  typename Engine::Register acc = state_.acc_;
-  typename Engine::Register pacc = state_.pacc_;
-  typename Engine::Register prev_acc = acc;
-  auto registers = state_.registers_.data();
-  const auto instructions = instructions_.data();
-
-  for (; num_frames; --num_frames, ++in, ++out) {
-    state_.registers_[ADCL].store(in->l);
-    state_.registers_[ADCR].store(in->r);
-
-    int32_t ic = 0;
-    while (ic < kMaxInstructionCount) {
-      auto &instruction = instructions[ic];
-      switch (instruction.get_opcode()) {
-        // Order of opcodes is based on hex value. It might also make sense to group by
-        // functionality
-
-        OPCODE_DISPATCH_2(RDA, INT(addr), FLOAT(c));
-        acc.store(delay_memory_.Load(addr) * c + acc.load());
-        OPCODE_END();
-
-        OPCODE_DISPATCH_1(RMPA, FLOAT(c));
-        auto ptr = registers[ADDR_PTR].load_addr();
-        acc.store(delay_memory_.Load(ptr) * c + acc.load());
-        OPCODE_END();
-
-        OPCODE_DISPATCH_2(WRA, INT(addr), FLOAT(c));
-        delay_memory_.Store(addr, acc);
-        acc.store(acc.load() * c);
-        OPCODE_END();
-
-        OPCODE_DISPATCH_2(WRAP, INT(addr), FLOAT(c));
-        delay_memory_.Store(addr, acc);
-        acc.store(acc.load() * c + delay_memory_.last_read());
-        OPCODE_END();
-
-        OPCODE_DISPATCH_2(RDAX, INT(addr), FLOAT(c));
-        acc.store(registers[addr].load() * c + acc.load());
-        OPCODE_END();
-
-        OPCODE_DISPATCH_2(RDFX, INT(addr), FLOAT(c));
-        auto r = registers[addr].load();
-        acc.store((acc.load() - r) * c + r);
-        OPCODE_END();
-
-        OPCODE_DISPATCH_2(WRAX, INT(addr), FLOAT(c));
-        registers[addr].store(acc);
-        acc.store(acc.load() * c);
-        OPCODE_END();
-
-        OPCODE_DISPATCH_2(WRHX, INT(addr), FLOAT(c));
-        registers[addr].store(acc);
-        acc.store(acc.load() * c + pacc.load());
-        OPCODE_END();
-
-        OPCODE_DISPATCH_2(WRLX, INT(addr), FLOAT(c));
-        registers[addr].store(acc);
-        acc.store((pacc.load() - acc.load()) * c + pacc.load());
-        OPCODE_END();
-
-        OPCODE_DISPATCH_2(MAXX, INT(addr), FLOAT(c));
-        auto abs_rxc = Engine::ABS(registers[addr].load() * c);
-        auto abs_acc = Engine::ABS(acc.load());
-        acc.store(abs_rxc > abs_acc ? abs_rxc : abs_acc);
-        OPCODE_END();
-
-        OPCODE_DISPATCH_1(MULX, INT(addr));
-        acc.store(acc.load() * registers[addr].load());
-        OPCODE_END();
-
-        OPCODE_DISPATCH_TODO(LOG);
-        OPCODE_DISPATCH_TODO(EXP);
-
-        OPCODE_DISPATCH_2(SOF, FLOAT(c), FLOAT(d));
-        acc.store(acc.load() * c + d);
-        OPCODE_END();
-
-        // Logical ops always use SF23
-        OPCODE_DISPATCH_1(AND, INT(mask));
-        acc.storei(core::AND<SF23>(acc.loadi(), mask));
-        OPCODE_END();
-
-        OPCODE_DISPATCH_1(OR, INT(mask));
-        acc.storei(core::OR<SF23>(acc.loadi(), mask));
-        OPCODE_END();
-
-        OPCODE_DISPATCH_1(XOR, INT(mask));
-        acc.storei(core::XOR<SF23>(acc.loadi(), mask));
-        OPCODE_END();
-
-        OPCODE_DISPATCH_2(SKP, INT(cmask), INT(n));  // NOTE Optimized to JMP if cmask == 0;
-        bool skip = true;
-        // All conditions must be met
-        if (SKP_FLAGS::NEG & cmask) skip = skip && acc.neg();
-        if (SKP_FLAGS::GEZ & cmask) skip = skip && acc.gez();
-        if (SKP_FLAGS::ZRO & cmask) skip = skip && acc.zero();
-        if (SKP_FLAGS::ZRC & cmask) skip = skip && acc.gez() != pacc.gez();
-        if (SKP_FLAGS::RUN & cmask) skip = skip && !state_.first_run;
-        if (skip) ic += n;
-        OPCODE_END();
-
-        // NOTE Pre-shifted values from VM::Optimize
-        OPCODE_DISPATCH_3(WLDS, IDX(n), FLOAT(f), FLOAT(a));
-        if (n) {
-          registers[REGISTER::SIN1_RATE].store(f);
-          registers[REGISTER::SIN1_RANGE].store(a);
-          sin_lfo_[1].Jam();
-        } else {
-          registers[REGISTER::SIN0_RATE].store(f);
-          registers[REGISTER::SIN0_RANGE].store(a);
-          sin_lfo_[0].Jam();
-        }
-        OPCODE_END();
-
-        OPCODE_DISPATCH_1(JAM, IDX(n));
-        ramp_lfo_[n].Jam();
-        OPCODE_END();
-
-        OPCODE_DISPATCH_0(CLR);
-        acc.clr();
-        OPCODE_END();
-
-        OPCODE_DISPATCH_0(NOT);
-        acc.storei(core::NOT<SF23>(acc.loadi()));
-        OPCODE_END();
-
-        OPCODE_DISPATCH_0(ABSA);
-        acc.store(Engine::ABS(acc.load()));
-        OPCODE_END();
-
-        OPCODE_DISPATCH_1(LDAX, INT(addr));
-        acc.store(registers[addr]);
-        OPCODE_END();
-
-        // NOTE Pre-shifted values from VM::Optimize
-        OPCODE_DISPATCH_3(WLDR, IDX(n), INT(f), INT(a));
-        if (n) {
-          registers[REGISTER::RMP1_RATE].store(f);
-          registers[REGISTER::RMP1_RANGE].store(a);
-          ramp_lfo_[1].Jam();
-        } else {
-          registers[REGISTER::RMP0_RATE].store(f);
-          registers[REGISTER::RMP0_RANGE].store(a);
-          ramp_lfo_[0].Jam();
-        }
-        OPCODE_END();
-
-        // ********************************************************************************
-        // CHO variants
-        // - These are still very similar so it might make sense to unify further
-        // - OTOH we can only go so far without adding something like a function pointer to the
-        // instruction struct, or other additional dispatch.
-        //
-        // TODO Check handling of COMPA (does the complement affect the coefficient?)
+  if (native_program_) {
+    codegen::Runtime<Engine, DelayStorage> runtime{context_.state_, context_.delay_memory_,
+                                                   context_.ramp_lfo_, context_.sin_lfo_};
+    native_program_(runtime, in, out, num_frames);
+    return;
+  }
+  if (block_buffer_ && block_program_.enabled) {
+    ExecuteBlocks(in, out, num_frames);
+    return;
+  }
+  ExecuteInterpreter(in, out, num_frames);
+}
 
-        OPCODE_DISPATCH_1(CHO_RDAL, INT(n) /*, flags*/);
-        // NOTE n is artificial from VM::Optimize so flags not needed
-        acc.store(read_lfo(n.template enum_cast<CHO_SEL_IDX>()));
-        OPCODE_END();
+template <typename Engine, typename DelayStorage>
+void VM<Engine, DelayStorage>::ExecuteInterpreter(const AudioFrame *in, AudioFrame *out,
+                                                  size_t num_frames)
+{
+  if (precompiled_)
+    Execute(*precompiled_, context_, in, out, num_frames);
+  else if (Dispatch::PACKED == dispatch_ && packed_programs_)
+    Execute(program_, *packed_programs_, context_, in, out, num_frames);
+  else
+    Execute(program_, context_, dispatch_, in, out, num_frames);
+}
 
-        // CHO RDA: ACC <- ACC + coeff (LFO) * delay[ADDRESS + offset (LFO)]
-        OPCODE_DISPATCH_3(CHO_RDA_RMP, IDX(n), INT(flags), INT(addr));
-        const auto lfo_value = ramp_lfo_[n].Read(flags.template enum_cast<CHO_FLAGS>());
-        acc.store(delay_memory_.Load(addr + lfo_value.offset) * lfo_value.coefficient + acc.load());
-        OPCODE_END();
+template <typename Engine, typename DelayStorage>
+void VM<Engine, DelayStorage>::Execute(const PrecompiledProgram &program, Context &context,
+                                       const AudioFrame *in, AudioFrame *out, size_t num_frames)
+{
+  static constexpr auto kSwitchLoops = SwitchLoops(FeatureIndices{});
+  const auto features = program.features;
+  ExecutePrograms(kSwitchLoops[features & kSpecializedFeatures], context, features, program.init,
+                  program.steady, program.prologue, in, out, num_frames);
+}
 
-        OPCODE_DISPATCH_3(CHO_RDA_SIN, IDX(n), INT(flags), INT(addr));
-        const auto lfo_value = sin_lfo_[n].Read(flags.template enum_cast<CHO_FLAGS>());
-        acc.store(delay_memory_.Load(addr + lfo_value.offset) * lfo_value.coefficient + acc.load());
-        OPCODE_END();
+template <typename Engine, typename DelayStorage>
+void VM<Engine, DelayStorage>::Execute(const CompiledProgram &program, Context &context,
+                                       Dispatch dispatch, const AudioFrame *in, AudioFrame *out,
+                                       size_t num_frames)
+{
+  const auto features = program.features;
+  const auto loop = features & kSpecializedFeatures;
+#ifdef FV1_VM_THREADED_DISPATCH
+  if (Dispatch::THREADED == dispatch) {
+    static constexpr auto kThreadedLoops = ThreadedLoops(FeatureIndices{});
+    ExecutePrograms(kThreadedLoops[loop], context, features, program.init, program.steady,
+                    program.prologue.view(), in, out, num_frames);
+    return;
+  }
+#endif
+  static constexpr auto kSwitchLoops = SwitchLoops(FeatureIndices{});
+  ExecutePrograms(kSwitchLoops[loop], context, features, program.init.view(),
+                  program.steady.view(), program.prologue.view(), in, out, num_frames);
+}
 
-        // CHO SOF: ACC <- coeff (LFO) * ACC + OFFSET
-        OPCODE_DISPATCH_3(CHO_SOF_RMP, IDX(n), INT(flags), FLOAT(d));
-        const auto lfo_value = ramp_lfo_[n].Read(flags.template enum_cast<CHO_FLAGS>());
-        acc.store(acc.load() * lfo_value.coefficient + d);
-        OPCODE_END();
+template <typename Engine, typename DelayStorage>
+void VM<Engine, DelayStorage>::Execute(const CompiledProgram &program, const PackedPrograms &packed,
+                                       Context &context, const AudioFrame *in, AudioFrame *out,
+                                       size_t num_frames)
+{
+  if (!packed.valid()) {
+    Execute(program, context, Dispatch::SWITCH, in, out, num_frames);
+    return;
+  }
+  static constexpr auto kPackedLoops = PackedLoops(FeatureIndices{});
+  const auto features = program.features;
+  ExecutePrograms(kPackedLoops[features & kSpecializedFeatures], context, features, packed.init,
+                  packed.steady, program.prologue.view(), in, out, num_frames);
+}
 
-        OPCODE_DISPATCH_3(CHO_SOF_SIN, IDX(n), INT(flags), FLOAT(d));
-        const auto lfo_value = sin_lfo_[n].Read(flags.template enum_cast<CHO_FLAGS>());
-        acc.store(acc.load() * lfo_value.coefficient + d);
-        OPCODE_END();
+// The init program runs on the first frame, the prologue before the steady-state frames of each
+// block
+template <typename Engine, typename DelayStorage>
+template <typename Loop, typename ProgramT>
+void VM<Engine, DelayStorage>::ExecutePrograms(Loop execute, Context &context, uint32_t features,
+                                               ProgramT &&init, ProgramT &&steady,
+                                               ProgramView prologue, const AudioFrame *in,
+                                               AudioFrame *out, size_t num_frames)
+{
+  if (context.state_.first_run && num_frames) {
+    execute(init, context, features, in, out, 1);
+    ++in;
+    ++out;
+    --num_frames;
+  }
+  // The init program still computes the hoisted registers itself, but with whatever ACC the SKP RUN
+  // code leaves. The frames after it need the values from the prologue.
+  if (!context.state_.first_run && prologue.length && num_frames)
+    ExecutePrologue(prologue, context);
+  execute(steady, context, features, in, out, num_frames);
+}
 
-        // ********************************************************************************
+template <typename Engine, typename DelayStorage>
+template <uint32_t features>
+void VM<Engine, DelayStorage>::ExecuteSwitch(ProgramView program, Context &context,
+                                             uint32_t lfos, const AudioFrame *in,
+                                             AudioFrame *out, size_t num_frames)
+{
+  static constexpr bool kLastRead = features & FEATURE_LAST_READ;
+  auto &state = context.state_;
+  typename Engine::Register acc = state.acc_;
+  typename Engine::Register pacc = state.pacc_;
+  [[maybe_unused]] typename Engine::Register prev_acc = acc;
+  auto registers = state.registers_.data();
+  const auto instructions = program.instructions;
+  const auto length = static_cast<int32_t>(program.length);
 
-        OPCODE_DISPATCH_2(JMP, INT(flags), INT(n));
-        // ignoring flags
-        (void)flags;
-        ic += n;
-        OPCODE_END();
+  for (; num_frames; --num_frames, ++in, ++out) {
+    state.registers_[ADCL].store(in->l);
+    if constexpr (features & FEATURE_STEREO) state.registers_[ADCR].store(in->r);
+    auto delay = context.delay_memory_.frame();
 
-        OPCODE_DISPATCH_NOP(CHO_RDA);  // optimized away
-        OPCODE_DISPATCH_NOP(CHO_SOF);  // optimized away
-        OPCODE_DISPATCH_NOP(NOP);
-        OPCODE_DISPATCH_NOP(UNKNOWN);
-        OPCODE_DISPATCH_NOP(REAL_OPCODES_LAST);
+    int32_t ic = 0;
+    while (ic < length) {
+      auto &instruction = instructions[ic];
+      switch (instruction.get_opcode()) {
+#include "vm_execute_ops.h"
       }
       // per-opcode updates
       // We want pacc to be one state delayed, i.e. from before the last execution.
       // Otherwise instructions like WRLX that use (PACC - ACC) dont' make much sense.
-      pacc = prev_acc;
-      prev_acc = acc;
+      if constexpr (features & FEATURE_PACC) {
+        pacc = prev_acc;
+        prev_acc = acc;
+      }
       ++ic;
     }
-    Tick();
-    state_.first_run = false;
-    state_.registers_[DACL].read(out->l);
-    state_.registers_[DACR].read(out->r);
+    context.template Tick<features>(lfos);
+    state.first_run = false;
+    state.registers_[DACL].read(out->l);
+    state.registers_[DACR].read(out->r);
   }
 
-  state_.pacc_ = pacc;
-  state_.acc_ = acc;
+  if constexpr (features & FEATURE_PACC) state.pacc_ = pacc;
+  state.acc_ = acc;
+}
+
+// The instructions VM::HoistInvariants moved out of the steady-state program. ACC is zero before
+// and after each hoisted sequence and they don't read PACC, so neither carries over.
+template <typename Engine, typename DelayStorage>
+void VM<Engine, DelayStorage>::ExecutePrologue(ProgramView program, Context &context)
+{
+  [[maybe_unused]] static constexpr uint32_t features = 0;
+  static constexpr bool kLastRead = false;
+  typename Engine::Register acc;
+  typename Engine::Register pacc;
+  [[maybe_unused]] typename Engine::Register prev_acc;
+  auto registers = context.state_.registers_.data();
+  const auto instructions = program.instructions;
+  const auto length = static_cast<int32_t>(program.length);
+  auto delay = context.delay_memory_.frame();
+
+  for (int32_t ic = 0; ic < length; ++ic) {
+    auto &instruction = instructions[ic];
+    switch (instruction.get_opcode()) {
+#include "vm_execute_ops.h"
+    }
+  }
 }
 
 }  // namespace fv1
@@ -18,6 +18,10 @@
 #error "Don't include or compile this file directly"
 #endif
 
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+
 #include "fv1/debug/fv1_debug.h"
 #include "fv1/fv1_instruction.h"
 #include "misc/program_stream.h"
@@ -29,6 +33,19 @@
 #define FLOAT(name) FloatConstant, name
 #define GET_INT_CONSTANT(name, index) GET_CONSTANT(IntegerConstant, name, index)
 
+// Superinstruction handlers (see vm_execute_superops.h) run the handlers of the instructions they
+// replace one after the other. Each step reads its constants from its own instruction, and the
+// per-instruction updates between steps are the same as the interpreter loop's.
+#define SUPEROP_CONSTANT(c, index) GET_STEP_CONSTANT_(c, index)
+#define GET_STEP_CONSTANT_(type, name, index) \
+  const type name { instructions[ic].constants[index] }
+#define SUPEROP_NEXT()                     \
+  if constexpr (features & FEATURE_PACC) { \
+    pacc = prev_acc;                       \
+    prev_acc = acc;                        \
+  }                                        \
+  ++ic
+
 namespace fv1 {
 
 template <typename Engine, typename DelayStorage>
@@ -50,7 +67,7 @@ VM<Engine, DelayStorage>::CompileInstruction(const DecodedInstruction &instructi
 }
 
 template <typename Engine, typename DelayStorage>
-VM<Engine, DelayStorage>::VM(DelayMemoryBuffer &memory_buffer)
+VM<Engine, DelayStorage>::Context::Context(DelayMemoryBuffer &memory_buffer)
     : delay_memory_{memory_buffer},
       ramp_lfo_{
           {{&state_.registers_[REGISTER::RMP0_RATE], &state_.registers_[REGISTER::RMP0_RANGE]},
@@ -61,12 +78,55 @@ VM<Engine, DelayStorage>::VM(DelayMemoryBuffer &memory_buffer)
 {}
 
 template <typename Engine, typename DelayStorage>
-void VM<Engine, DelayStorage>::Compile(ProgramStream &program)
+VM<Engine, DelayStorage>::Context::Context(Context &&other) noexcept
+    : state_{other.state_},
+      delay_memory_{other.delay_memory_},
+      delay_slots_{other.delay_slots_},
+      ramp_lfo_{other.ramp_lfo_},
+      sin_lfo_{other.sin_lfo_}
+{
+  BindLfos();
+}
+
+template <typename Engine, typename DelayStorage>
+void VM<Engine, DelayStorage>::Context::BindLfos()
+{
+  auto &r = state_.registers_;
+  ramp_lfo_[0].Bind(&r[REGISTER::RMP0_RATE], &r[REGISTER::RMP0_RANGE]);
+  ramp_lfo_[1].Bind(&r[REGISTER::RMP1_RATE], &r[REGISTER::RMP1_RANGE]);
+  sin_lfo_[0].Bind(&r[REGISTER::SIN0_RATE], &r[REGISTER::SIN0_RANGE]);
+  sin_lfo_[1].Bind(&r[REGISTER::SIN1_RATE], &r[REGISTER::SIN1_RANGE]);
+}
+
+template <typename Engine, typename DelayStorage>
+void VM<Engine, DelayStorage>::Context::Reset()
 {
   state_.Reset();
+  // Programs without FEATURE_LAST_READ don't update the last read, so it mustn't carry over
   delay_memory_.Reset();
+  delay_slots_.fill({});
   for (auto &rmp : ramp_lfo_) rmp.Jam();
   for (auto &sin : sin_lfo_) sin.Jam();
+}
+
+template <typename Engine, typename DelayStorage>
+VM<Engine, DelayStorage>::VM(DelayMemoryBuffer &memory_buffer) : context_{memory_buffer}
+{
+  Link();
+}
+
+template <typename Engine, typename DelayStorage>
+void VM<Engine, DelayStorage>::Reset()
+{
+  native_program_ = nullptr;
+  precompiled_ = nullptr;
+  context_.Reset();
+}
+
+template <typename Engine, typename DelayStorage>
+void VM<Engine, DelayStorage>::Compile(ProgramStream &program, uint32_t passes)
+{
+  Reset();
 
   size_t instruction_count = 0;
   while (program.available()) {
@@ -75,55 +135,107 @@ void VM<Engine, DelayStorage>::Compile(ProgramStream &program)
     ++instruction_count;
   }
 
-  Optimize();
+  passes_ = passes;
+  optimizer_report_ = {};
+  Lower();
+  if (passes & pass_mask(PASS_PEEPHOLE)) Optimize();
+  SplitInitProgram(passes & pass_mask(PASS_STRIP_INIT));
+  program_.features = FEATURE_ALL;
+  if (passes & pass_mask(PASS_FEATURES)) AnalyzeFeatures();
+  if (passes & pass_mask(PASS_MICROOPS)) {
+    OptimizeMicroOps(program_.init);
+    optimizer_report_[PASS_MICROOPS] = OptimizeMicroOps(program_.steady);
+  }
+  if (passes & pass_mask(PASS_DATAFLOW)) {
+    OptimizeRegisters(program_.init);
+    optimizer_report_[PASS_DATAFLOW] = OptimizeRegisters(program_.steady);
+  }
+  if (passes & pass_mask(PASS_FUSE)) {
+    FuseInstructions(program_.init);
+    optimizer_report_[PASS_FUSE] = FuseInstructions(program_.steady);
+  }
+  if (passes & pass_mask(PASS_COEFFICIENTS)) {
+    ReduceCoefficients(program_.init);
+    optimizer_report_[PASS_COEFFICIENTS] = ReduceCoefficients(program_.steady);
+  }
+  if (passes & pass_mask(PASS_SATURATION))
+    optimizer_report_[PASS_SATURATION] = ElideSaturation();
+  if (passes & pass_mask(PASS_DELAY_REUSE)) {
+    ReuseDelayReads(program_.init);
+    optimizer_report_[PASS_DELAY_REUSE] = ReuseDelayReads(program_.steady);
+  }
+  program_.prologue.length = 0;
+  if (passes & pass_mask(PASS_HOIST)) optimizer_report_[PASS_HOIST] = HoistInvariants();
+  if (passes & pass_mask(PASS_COMPACT)) {
+    CompactProgram(program_.init);
+    optimizer_report_[PASS_COMPACT] = CompactProgram(program_.steady);
+  }
+  if (passes & pass_mask(PASS_SUPEROPS)) {
+    FuseSuperinstructions(program_.init);
+    optimizer_report_[PASS_SUPEROPS] = FuseSuperinstructions(program_.steady);
+  }
+  AnalyzeBlockProgram();
+  Link();
 }
 
-// NOTES
-// - Patterns of CHO (i.e. interpolation) that are two reads from the same LFO with 1-C and C
 template <typename Engine, typename DelayStorage>
-void VM<Engine, DelayStorage>::Optimize()
+void VM<Engine, DelayStorage>::Load(const PrecompiledProgram &program)
 {
-  for (auto &instruction : instructions_) {
-    auto opcode = instruction.get_opcode();
-    switch (opcode) {
-      // RDFX: If C is zero, just load accumulator => LDAX
-      case OPCODE::RDFX:
-        if (instruction.constants[1].zero()) instruction.set_opcode(OPCODE::LDAX);
-        break;
-
-        // MAXX: If C 0, get absolute value of accumulator
-      case OPCODE::MAXX:
-        if (instruction.constants[1].zero()) instruction.set_opcode(OPCODE::ABSA);
-        break;
+  Reset();
+  passes_ = 0;
+  optimizer_report_ = {};
+  program_.features = program.features;
+  block_program_ = {};
+  // Anything else that reads the compiled program (JIT, codegen, simd::MultiInstance, ...) would
+  // run the previous one, so it's left empty.
+  instructions_.fill({});
+  for (auto *p : {&program_.init, &program_.steady}) {
+    p->instructions.fill({});
+    p->length = 0;
+  }
+  program_.prologue = {};
+  Link();
+  precompiled_ = &program;
+}
 
-      // Logical operations: double-check mask
-      // AND: if no mask => CLR
-      // XOR: if all bits => NOT
-      case OPCODE::AND:
-      case OPCODE::OR:
-      case OPCODE::XOR:
-        if (OPCODE::AND == opcode && instruction.constants[0].zero())
-          instruction.set_opcode(OPCODE::CLR);
-        else if (OPCODE::XOR == opcode && 0xffffff == instruction.constants[0].loadi())
-          instruction.set_opcode(OPCODE::NOT);
-        break;
+// Resolve anything the interpreter needs per instruction that isn't part of the byte code itself
+template <typename Engine, typename DelayStorage>
+void VM<Engine, DelayStorage>::Link()
+{
+#ifdef FV1_VM_THREADED_DISPATCH
+  // The handlers are specific to the instantiation
+  static constexpr auto kThreadedLoops = ThreadedLoops(FeatureIndices{});
+  const auto link = kThreadedLoops[program_.features & kSpecializedFeatures];
+  link(program_.init, context_, 0, nullptr, nullptr, 0);
+  link(program_.steady, context_, 0, nullptr, nullptr, 0);
+#endif
+  if (packed_programs_) Pack(program_, *packed_programs_);
+}
 
-      // SKP with no offset => NOP
-      // SKP with no flags => JMP
-      case OPCODE::SKP:
-        if (instruction.constants[1].zero()) {
-          instruction.set_opcode(OPCODE::NOP);
-        } else if (instruction.constants[0].zero()) {
-          instruction.set_opcode(OPCODE::JMP);
-        }
-        break;
+// Rewrite instructions into the form the VM executes, this isn't optional
+template <typename Engine, typename DelayStorage>
+void VM<Engine, DelayStorage>::Lower()
+{
+  for (int32_t ic = 0; ic < kMaxInstructionCount; ++ic) {
+    auto &instruction = instructions_[ic];
+    auto opcode = instruction.get_opcode();
+    switch (opcode) {
+      // Jumps past the end of the program are clamped to the end of the program.
+      case OPCODE::SKP: {
+        GET_INT_CONSTANT(n, 1);
+        if (ic + n >= kMaxInstructionCount)
+          instruction.constants[1].store(kMaxInstructionCount - 1 - ic);
+      } break;
 
       // WLDS: Pre-shift values (n, f, a)
       case OPCODE::WLDS: {
         GET_INT_CONSTANT(f, 1);  // 0-511
         GET_INT_CONSTANT(a, 2);  // 0-32767
-        instruction.constants[1].store(SF23{f << SinLfo::kRateShift});
-        instruction.constants[2].store(SF23{f << SinLfo::kRangeShift});
+        // NOTE f aliases constants[1], so the range has always been derived from the shifted
+        // rate instead of a. Read it once so this doesn't depend on the engine's representation.
+        const int32_t rate = f << SinLfo::kRateShift;
+        instruction.constants[1].store(SF23{rate});
+        instruction.constants[2].store(SF23{rate << SinLfo::kRangeShift});
       } break;
 
       // WLDR: Pre-shift values (n, f, a)
@@ -131,7 +243,7 @@ void VM<Engine, DelayStorage>::Optimize()
         // [1] = rate = I16
         // [2] = range = 0x0, 0x1, 0x2, 0x3, so we'll convert to register
         GET_INT_CONSTANT(a, 2);
-        instruction.constants[2].store(SF23{a << RampLfo::kRangeShift});
+        instruction.constants[2].store(a << RampLfo::kRangeShift);
       } break;
 
       // CHO_RDA
@@ -178,4 +290,1365 @@ void VM<Engine, DelayStorage>::Optimize()
   }
 }
 
+// PASS_PEEPHOLE: Cheaper equivalents of single instructions
+// NOTES
+// - Patterns of CHO (i.e. interpolation) that are two reads from the same LFO with 1-C and C
+template <typename Engine, typename DelayStorage>
+void VM<Engine, DelayStorage>::Optimize()
+{
+  auto &stats = optimizer_report_[PASS_PEEPHOLE];
+  for (int32_t ic = 0; ic < kMaxInstructionCount; ++ic) {
+    auto &instruction = instructions_[ic];
+    auto opcode = instruction.get_opcode();
+    switch (opcode) {
+      // RDFX: If C is zero, just load accumulator => LDAX
+      case OPCODE::RDFX:
+        if (instruction.constants[1].zero()) instruction.set_opcode(OPCODE::LDAX);
+        break;
+
+        // MAXX: If C 0, get absolute value of accumulator
+      case OPCODE::MAXX:
+        if (instruction.constants[1].zero()) instruction.set_opcode(OPCODE::ABSA);
+        break;
+
+      // Logical operations: double-check mask
+      // AND: if no mask => CLR
+      // XOR: if all bits => NOT
+      case OPCODE::AND:
+      case OPCODE::OR:
+      case OPCODE::XOR:
+        if (OPCODE::AND == opcode && instruction.constants[0].zero())
+          instruction.set_opcode(OPCODE::CLR);
+        else if (OPCODE::XOR == opcode && 0xffffff == instruction.constants[0].loadi())
+          instruction.set_opcode(OPCODE::NOT);
+        break;
+
+      // SKP with no offset => NOP
+      // SKP with no flags => JMP
+      case OPCODE::SKP:
+        if (instruction.constants[1].zero())
+          instruction.set_opcode(OPCODE::NOP);
+        else if (instruction.constants[0].zero())
+          instruction.set_opcode(OPCODE::JMP);
+        break;
+
+      default: break;
+    }
+    if (opcode != instruction.get_opcode()) {
+      ++stats.rewritten;
+      stats.cycles += EstimatedCost(opcode) - EstimatedCost(instruction.get_opcode());
+    }
+  }
+}
+
+// SKP RUN is only evaluated by the interpreter loops on the first frame, so it's resolved here
+// instead: in the init program it's never taken, in the steady-state program it's always taken
+// (i.e. only the other conditions remain, if any).
+//
+// PASS_STRIP_INIT: Whatever the steady-state program always jumps over at the start can then be
+// removed. PACC lags ACC by one instruction though, so if the first remaining instruction reads it
+// one NOP has to stay in front to preserve that. Since all jumps are forward and relative they
+// don't need to be adjusted; jumps to the end of the program land on the end of the shorter
+// program.
+template <typename Engine, typename DelayStorage>
+void VM<Engine, DelayStorage>::SplitInitProgram(bool strip_init)
+{
+  auto resolve_run = [](CompiledInstruction &instruction, bool run) {
+    if (OPCODE::SKP != instruction.get_opcode()) return;
+    const int32_t flags = instruction.constants[0].loadi();
+    if (!(SKP_FLAGS::RUN & flags)) return;
+    if (!run)
+      instruction.set_opcode(OPCODE::NOP);
+    else if (SKP_FLAGS::RUN == flags)
+      instruction.set_opcode(OPCODE::JMP);
+    else
+      instruction.constants[0].store(flags & ~SKP_FLAGS::RUN);
+  };
+
+  program_.init.length = kMaxInstructionCount;
+  program_.init.instructions = instructions_;
+  for (auto &instruction : program_.init.instructions) resolve_run(instruction, false);
+
+  // Resolved in place, there's no room for another copy on the stack
+  auto &steady = program_.steady.instructions;
+  steady = instructions_;
+  for (auto &instruction : steady) resolve_run(instruction, true);
+
+  size_t start = 0;
+  while (strip_init && start < kMaxInstructionCount) {
+    const auto &instruction = steady[start];
+    if (OPCODE::JMP == instruction.get_opcode())
+      start += 1 + static_cast<size_t>(instruction.constants[1].loadi());
+    else if (OPCODE::NOP == instruction.get_opcode())
+      ++start;
+    else
+      break;
+  }
+  if (start && start < kMaxInstructionCount && ReadsPacc(steady[start]))
+    steady[--start].set_opcode(OPCODE::NOP);
+
+  auto &stats = optimizer_report_[PASS_STRIP_INIT];
+  for (size_t ic = 0; ic < start; ++ic) {
+    ++stats.removed;
+    stats.cycles += EstimatedCost(steady[ic].get_opcode());
+  }
+
+  program_.steady.length = kMaxInstructionCount - start;
+  std::copy(steady.begin() + static_cast<std::ptrdiff_t>(start), steady.end(), steady.begin());
+  std::fill(steady.begin() + static_cast<std::ptrdiff_t>(program_.steady.length), steady.end(),
+            CompiledInstruction{});
+}
+
+// PASS_MICROOPS: Translates the program into the micro-op IR (see uop.h) and back. What the IR
+// finds out about each instruction's result is applied to the byte code:
+// - instructions that don't change ACC and have no other effects become NOPs;
+// - ACC values that are known at compile time are loaded with CLR or SOF 0, k;
+// - SKP with a known condition becomes a JMP or NOP;
+// - instructions whose result is never used are removed (DCE). The IR tells which instructions
+//   actually use ACC or PACC, e.g. the ACC of SOF 0, k is only multiplied by zero.
+//
+// The IR uses the fixed-point math, so other engines skip this.
+//
+// Jumps aren't followed, at a jump target everything is unknown again. Since ACC and PACC on the
+// other path aren't tracked either, the instructions right before jumps and their targets are kept.
+template <typename Engine, typename DelayStorage>
+bool VM<Engine, DelayStorage>::BuildMicroOps(const Program &program, uop::Function &f) const
+{
+  using uop::OP;
+  using uop::Step;
+  using uop::ValueId;
+  f.Reset();
+
+  const auto is_target = JumpTargets(program);
+  const uint8_t read_effects = program_.features & FEATURE_LAST_READ ? Step::EFFECTS : 0;
+  std::array<ValueId, kNumRegisters> registers;
+  registers.fill(uop::kNone);
+  int32_t register_epoch = 0, delay_epoch = 0, lfo_epoch = 0;
+  ValueId acc = f.Input(), pacc = f.Input(), last_read = f.Input();
+
+  auto reg = [&](const typename Engine::Constant &c) {
+    const auto r = static_cast<size_t>(c.loadi()) % kNumRegisters;
+    auto &value = registers[r];
+    if (uop::kNone == value) value = f.Read(OP::REG, static_cast<int32_t>(r), register_epoch);
+    return value;
+  };
+  auto forget_registers = [&]() {
+    registers.fill(uop::kNone);
+    ++register_epoch;
+  };
+  auto constant = [&](const typename Engine::Constant &c) { return f.Const(c.loadi()); };
+  // SAT(x * k + y)
+  auto mac = [&](ValueId x, ValueId k, ValueId y) {
+    return f.Unary(OP::SAT, f.Binary(OP::ADD, f.Binary(OP::MUL, x, k), y));
+  };
+  // The coefficient and offset of a CHO read only depend on the LFO state and the flags
+  enum LFO_PART : int32_t { RDAL, RMP_COEFFICIENT, RMP_OFFSET, SIN_COEFFICIENT, SIN_OFFSET };
+  auto lfo = [&](LFO_PART part, const typename Engine::Constant &n,
+                 const typename Engine::Constant &flags) {
+    return f.Read(OP::LFO, part << 12 | n.loadi() << 8 | (flags.loadi() & 0xff), lfo_epoch);
+  };
+
+  for (size_t ic = 0; ic < program.length; ++ic) {
+    const auto &instruction = program.instructions[ic];
+    const auto opcode = instruction.get_opcode();
+    const auto &constants = instruction.constants;
+    if (is_target[ic]) {
+      acc = f.Input();
+      pacc = f.Input();
+      last_read = f.Input();
+      forget_registers();
+      ++delay_epoch;
+      ++lfo_epoch;
+    }
+
+    auto &step = f.steps[ic];
+    step = {acc, pacc, acc, 0};
+    switch (opcode) {
+      case OPCODE::RDA:
+        last_read = f.Read(OP::DELAY, constants[0].loadi() & kDelayAddrMask, delay_epoch);
+        step.result = mac(last_read, constant(constants[1]), acc);
+        step.flags = read_effects;
+        break;
+      case OPCODE::RMPA:
+        last_read = f.Input();
+        step.result = mac(last_read, constant(constants[0]), acc);
+        step.flags = read_effects;
+        break;
+      case OPCODE::WRA:
+      case OPCODE::WRAP:
+        ++delay_epoch;
+        step.result = OPCODE::WRA == opcode
+                          ? f.Unary(OP::SAT, f.Binary(OP::MUL, acc, constant(constants[1])))
+                          : mac(acc, constant(constants[1]), last_read);
+        step.flags = Step::EFFECTS | Step::READS_ACC;
+        break;
+      case OPCODE::RDAX: step.result = mac(reg(constants[0]), constant(constants[1]), acc); break;
+      case OPCODE::RDFX: {
+        const auto r = reg(constants[0]);
+        step.result = mac(f.Binary(OP::SUB, acc, r), constant(constants[1]), r);
+      } break;
+      case OPCODE::WRAX:
+      case OPCODE::WRHX:
+      case OPCODE::WRLX: {
+        const auto c = constant(constants[1]);
+        if (OPCODE::WRAX == opcode)
+          step.result = f.Unary(OP::SAT, f.Binary(OP::MUL, acc, c));
+        else if (OPCODE::WRHX == opcode)
+          step.result = mac(acc, c, pacc);
+        else
+          step.result = mac(f.Binary(OP::SUB, pacc, acc), c, pacc);
+        const auto r = static_cast<size_t>(constants[0].loadi()) % kNumRegisters;
+        registers[r] = acc;
+        // The LFO rate and range registers change what CHO reads
+        if (r <= RMP1_RANGE) ++lfo_epoch;
+        step.flags = Step::EFFECTS | Step::READS_ACC;
+      } break;
+      case OPCODE::MAXX: {
+        const auto rxc = f.Binary(OP::MUL, reg(constants[0]), constant(constants[1]));
+        step.result = f.Unary(
+            OP::SAT, f.Binary(OP::MAX, f.Unary(OP::ABS, rxc), f.Unary(OP::ABS, acc)));
+      } break;
+      case OPCODE::MULX:
+        step.result = f.Unary(OP::SAT, f.Binary(OP::MUL, acc, reg(constants[0])));
+        break;
+      case OPCODE::SOF:
+        step.result = mac(acc, constant(constants[0]), constant(constants[1]));
+        break;
+      case OPCODE::AND: step.result = f.Unary(OP::AND, acc, constants[0].loadi()); break;
+      case OPCODE::OR: step.result = f.Unary(OP::OR, acc, constants[0].loadi()); break;
+      case OPCODE::XOR: step.result = f.Unary(OP::XOR, acc, constants[0].loadi()); break;
+      case OPCODE::NOT: step.result = f.Unary(OP::NOT, acc); break;
+      case OPCODE::SKP:
+        step.flags = Step::CONTROL | Step::READS_ACC;
+        if (SKP_FLAGS::ZRC & constants[0].loadi()) step.flags |= Step::READS_PACC;
+        break;
+      case OPCODE::JMP: step.flags = Step::CONTROL; break;
+      case OPCODE::NOP: break;
+      case OPCODE::WLDS:
+      case OPCODE::WLDR:
+      case OPCODE::JAM:
+        forget_registers();
+        ++lfo_epoch;
+        step.flags = Step::EFFECTS;
+        break;
+      case OPCODE::CLR: step.result = f.Const(0); break;
+      case OPCODE::ABSA: step.result = f.Unary(OP::SAT, f.Unary(OP::ABS, acc)); break;
+      case OPCODE::LDAX: step.result = reg(constants[0]); break;
+      case OPCODE::CHO_RDAL:
+        step.result = f.Unary(OP::SAT, lfo(RDAL, constants[0], constants[1]));
+        break;
+      case OPCODE::CHO_RDA_RMP:
+      case OPCODE::CHO_RDA_SIN: {
+        const bool sin = OPCODE::CHO_RDA_SIN == opcode;
+        const auto offset = lfo(sin ? SIN_OFFSET : RMP_OFFSET, constants[0], constants[1]);
+        const auto coefficient =
+            lfo(sin ? SIN_COEFFICIENT : RMP_COEFFICIENT, constants[0], constants[1]);
+        last_read =
+            f.Read(OP::LFO_DELAY, constants[2].loadi() & kDelayAddrMask, delay_epoch, offset);
+        step.result = mac(last_read, coefficient, acc);
+        step.flags = read_effects;
+      } break;
+      case OPCODE::CHO_SOF_RMP:
+      case OPCODE::CHO_SOF_SIN: {
+        const bool sin = OPCODE::CHO_SOF_SIN == opcode;
+        const auto coefficient =
+            lfo(sin ? SIN_COEFFICIENT : RMP_COEFFICIENT, constants[0], constants[1]);
+        step.result = mac(acc, coefficient, constant(constants[2]));
+      } break;
+      default:
+        // Not modelled, assume it uses and changes everything
+        step.result = last_read = f.Input();
+        step.flags = Step::EFFECTS | Step::READS_ACC | Step::READS_PACC;
+        forget_registers();
+        ++delay_epoch;
+        ++lfo_epoch;
+        break;
+    }
+    pacc = acc;
+    acc = step.result;
+  }
+  return !f.overflow();
+}
+
+template <typename Engine, typename DelayStorage>
+typename VM<Engine, DelayStorage>::PassStats VM<Engine, DelayStorage>::OptimizeMicroOps(
+    Program &program)
+{
+  if constexpr (!std::is_same_v<typename Engine::float_value, SF23>) return {};
+  // The IR is far larger than anything else the VM keeps, so it only exists during the pass
+  const auto uops = std::make_unique<uop::Function>();
+  const auto &f = *uops;
+  if (!BuildMicroOps(program, *uops)) return {};
+  if (micro_ops_observer) micro_ops_observer(program, f);
+
+  using uop::Step;
+  PassStats stats;
+  auto rewrite = [&stats](CompiledInstruction &instruction, OPCODE new_opcode) {
+    const auto opcode = instruction.get_opcode();
+    instruction.set_opcode(new_opcode);
+    if (OPCODE::NOP == new_opcode)
+      ++stats.removed;
+    else
+      ++stats.rewritten;
+    stats.cycles += EstimatedCost(opcode) - EstimatedCost(new_opcode);
+  };
+
+  for (size_t ic = 0; ic < program.length; ++ic) {
+    auto &instruction = program.instructions[ic];
+    const auto &step = f.steps[ic];
+    const auto opcode = instruction.get_opcode();
+    int32_t acc = 0, pacc = 0, result = 0;
+    if (OPCODE::SKP == opcode) {
+      const auto flags = instruction.constants[0].loadi();
+      if (!f.constant(step.acc, acc)) continue;
+      if ((SKP_FLAGS::ZRC & flags) && !f.constant(step.pacc, pacc)) continue;
+      bool skip = true;
+      if (SKP_FLAGS::NEG & flags) skip = skip && acc < 0;
+      if (SKP_FLAGS::GEZ & flags) skip = skip && acc >= 0;
+      if (SKP_FLAGS::ZRO & flags) skip = skip && !acc;
+      if (SKP_FLAGS::ZRC & flags) skip = skip && (acc >= 0) != (pacc >= 0);
+      rewrite(instruction, skip ? OPCODE::JMP : OPCODE::NOP);
+    } else if (step.flags || OPCODE::NOP == opcode) {
+      continue;
+    } else if (step.result == step.acc) {
+      rewrite(instruction, OPCODE::NOP);
+    } else if (f.constant(step.result, result)) {
+      if (!result) {
+        if (OPCODE::CLR != opcode) rewrite(instruction, OPCODE::CLR);
+      } else if (OPCODE::SOF != opcode || !instruction.constants[0].zero()) {
+        rewrite(instruction, OPCODE::SOF);
+        instruction.constants[0].store(SF23{0});
+        instruction.constants[1].store(SF23{result});
+      }
+    }
+  }
+
+  // Folding loses track of where a constant came from, so with a constant ACC or PACC the opcode
+  // has to tell whether it's used.
+  auto uses = [&f](const CompiledInstruction &instruction, uop::ValueId result, uop::ValueId x,
+                   bool pacc) {
+    int32_t value = 0;
+    if (!f.constant(x, value)) return f.DependsOn(result, x);
+    if (pacc) return ReadsPacc(instruction);
+    switch (instruction.get_opcode()) {
+      case OPCODE::CLR:
+      case OPCODE::LDAX:
+      case OPCODE::CHO_RDAL: return false;
+      case OPCODE::SOF: return !instruction.constants[0].zero();
+      default: return true;
+    }
+  };
+
+  // Backwards, whether ACC before the next instruction and PACC before the next two are used
+  const auto is_target = JumpTargets(program);
+  bool acc_used = true, pacc_used = true, pacc_used2 = true;
+  for (size_t ic = program.length; ic-- > 0;) {
+    auto &instruction = program.instructions[ic];
+    const auto &step = f.steps[ic];
+    const bool used = ic + 2 >= program.length || acc_used || pacc_used2 || is_target[ic + 1] ||
+                      is_target[ic + 2];
+    bool reads_acc = used, reads_pacc = false;
+    if (OPCODE::NOP != instruction.get_opcode()) {
+      if (!used && !step.flags) {
+        rewrite(instruction, OPCODE::NOP);
+      } else if (step.flags & Step::CONTROL) {
+        reads_acc = reads_pacc = true;
+      } else {
+        reads_acc = (step.flags & Step::READS_ACC) ||
+                    (used && uses(instruction, step.result, step.acc, false));
+        reads_pacc = (step.flags & Step::READS_PACC) ||
+                     (used && uses(instruction, step.result, step.pacc, true));
+      }
+    }
+    acc_used = reads_acc;
+    pacc_used2 = pacc_used;
+    pacc_used = reads_pacc;
+  }
+  return stats;
+}
+
+// PASS_DATAFLOW: Register accesses that don't change the result.
+//
+// Going forward, ACC is tracked as being equal to a register after WRAX REGn, 1.0 or LDAX REGn.
+// Loading or storing that register again is then a NOP. The common WRAX REGn, 0; RDAX REGn, C
+// becomes WRAX REGn, C since ACC is zero when reading the register back; this changes PACC for the
+// instruction after the pair though, so it only happens if that doesn't read PACC.
+//
+// Going backwards, a WRAX is dead if the register is overwritten on all paths before it's read
+// again. Registers are live at the end of the program since they're visible outside of the frame,
+// so the state after each frame doesn't change. What remains of a dead WRAX is the scaling of ACC.
+// WRHX and WRLX have no equivalent without the store, so they stay.
+//
+// Instructions that become NOPs are removed by PASS_COMPACT.
+template <typename Engine, typename DelayStorage>
+typename VM<Engine, DelayStorage>::PassStats VM<Engine, DelayStorage>::OptimizeRegisters(
+    Program &program) const
+{
+  PassStats stats;
+  const size_t length = program.length;
+  auto &instructions = program.instructions;
+  auto rewrite = [&](CompiledInstruction &instruction, OPCODE opcode) {
+    stats.cycles += EstimatedCost(instruction.get_opcode()) - EstimatedCost(opcode);
+    ++stats.rewritten;
+    instruction.set_opcode(opcode);
+  };
+  auto jump_target = [](const CompiledInstruction &instruction, size_t ic) {
+    return ic + 1 + static_cast<size_t>(instruction.constants[1].loadi());
+  };
+  auto is_jump = [](const CompiledInstruction &instruction) {
+    return OPCODE::SKP == instruction.get_opcode() || OPCODE::JMP == instruction.get_opcode();
+  };
+
+  auto is_one = [](const typename Engine::Constant &c) {
+    return IsCoefficient(c, 1 << SF23::FRAC);
+  };
+
+  const auto is_target = JumpTargets(program);
+  const bool pacc_at_end = (program_.features | kFixedFeatures) & FEATURE_PACC;
+
+  // Forward: register equal to ACC, or -1
+  int32_t equal = -1;
+  for (size_t ic = 0; ic < length; ++ic) {
+    auto &instruction = instructions[ic];
+    if (is_target[ic]) equal = -1;
+    const int32_t r = instruction.constants[0].loadi();
+    switch (instruction.get_opcode()) {
+      case OPCODE::LDAX:
+        if (r == equal) rewrite(instruction, OPCODE::NOP);
+        equal = r;
+        break;
+      case OPCODE::WRAX: {
+        if (is_one(instruction.constants[1])) {
+          if (r == equal) rewrite(instruction, OPCODE::NOP);
+          equal = r;
+          break;
+        }
+        equal = -1;
+        if (!instruction.constants[1].zero() || ic + 1 >= length || is_target[ic + 1]) break;
+        auto &next = instructions[ic + 1];
+        if (OPCODE::RDAX != next.get_opcode() || r != next.constants[0].loadi()) break;
+        if (ic + 2 < length ? ReadsPacc(instructions[ic + 2]) : pacc_at_end) break;
+        instruction.constants[1] = next.constants[1];
+        rewrite(next, OPCODE::NOP);
+        ++ic;
+      } break;
+      case OPCODE::NOP:
+      case OPCODE::JMP:
+      case OPCODE::SKP: break;
+      case OPCODE::WLDS:
+      case OPCODE::WLDR:
+      case OPCODE::JAM:
+        if (equal >= 0 && equal <= RMP1_RANGE) equal = -1;
+        break;
+      default: equal = -1; break;
+    }
+  }
+
+  // Backward: live registers, everything is live at the end
+  std::array<uint64_t, kMaxInstructionCount + 1> live;
+  live.fill(~uint64_t{0});
+  for (size_t ic = length; ic--;) {
+    auto &instruction = instructions[ic];
+    const auto opcode = instruction.get_opcode();
+    uint64_t live_out = OPCODE::JMP == opcode ? 0 : live[ic + 1];
+    if (is_jump(instruction)) live_out |= live[jump_target(instruction, ic)];
+
+    if (OPCODE::WRAX == opcode || OPCODE::WRHX == opcode || OPCODE::WRLX == opcode) {
+      const auto bit = uint64_t{1} << instruction.constants[0].loadi();
+      if (OPCODE::WRAX == opcode && !(live_out & bit)) {
+        if (instruction.constants[1].zero()) {
+          rewrite(instruction, OPCODE::CLR);
+        } else if (is_one(instruction.constants[1])) {
+          rewrite(instruction, OPCODE::NOP);
+        } else {
+          instruction.constants[0] = instruction.constants[1];
+          instruction.constants[1].store(SF23{0});
+          rewrite(instruction, OPCODE::SOF);
+        }
+      } else {
+        live_out &= ~bit;
+      }
+    }
+    live[ic] = live_out | RegisterReads(instruction);
+  }
+  return stats;
+}
+
+// Registers an instruction reads, not including the ones read by the LFOs when ticking
+template <typename Engine, typename DelayStorage>
+/*static*/ uint64_t VM<Engine, DelayStorage>::RegisterReads(const CompiledInstruction &instruction)
+{
+  static constexpr uint64_t kLfoRegisters = (uint64_t{1} << (RMP1_RANGE + 1)) - 1;
+  switch (instruction.get_opcode()) {
+    case OPCODE::RDAX:
+    case OPCODE::RDFX:
+    case OPCODE::MAXX:
+    case OPCODE::MULX:
+    case OPCODE::LDAX:
+    case OPCODE::RDAX_ADD:
+    case OPCODE::RDAX_SUB:
+    case OPCODE::RDAX_NOSAT:
+    case OPCODE::RDFX_NOSAT:
+    case OPCODE::MULX_NOSAT:
+    case OPCODE::LPF1:
+    case OPCODE::HPF1: return uint64_t{1} << instruction.constants[0].loadi();
+    case OPCODE::RMPA: return uint64_t{1} << ADDR_PTR;
+    case OPCODE::WLDS:
+    case OPCODE::WLDR:
+    case OPCODE::JAM:
+    case OPCODE::CHO_RDA_SIN:
+    case OPCODE::CHO_RDA_RMP:
+    case OPCODE::CHO_SOF_SIN:
+    case OPCODE::CHO_SOF_RMP:
+    case OPCODE::CHO_RDAL:
+    case OPCODE::CHO_INTERP_RMP:
+    case OPCODE::CHO_INTERP_SIN: return kLfoRegisters;
+    case OPCODE::RDA:
+    case OPCODE::WRA:
+    case OPCODE::WRAP:
+    case OPCODE::WRAX:
+    case OPCODE::WRHX:
+    case OPCODE::WRLX:
+    case OPCODE::LOG:
+    case OPCODE::EXP:
+    case OPCODE::SOF:
+    case OPCODE::AND:
+    case OPCODE::OR:
+    case OPCODE::XOR:
+    case OPCODE::SKP:
+    case OPCODE::CLR:
+    case OPCODE::NOT:
+    case OPCODE::ABSA:
+    case OPCODE::JMP:
+    case OPCODE::NOP:
+    case OPCODE::RDA_ADD:
+    case OPCODE::WRAX_MOV:
+    case OPCODE::WRAX_CLR:
+    case OPCODE::SOF_NEG:
+    case OPCODE::SOF_HALF:
+    case OPCODE::SOF_NEG2:
+    case OPCODE::ALLPASS:
+    case OPCODE::RDA_NOSAT:
+    case OPCODE::WRAX_NOSAT:
+    case OPCODE::SOF_NOSAT:
+    case OPCODE::RDA_SAVE:
+    case OPCODE::WRA_SAVE:
+    case OPCODE::RDA_CACHED: return 0;
+    default: return ~uint64_t{0};
+  }
+}
+
+// PASS_FUSE: Pairs of instructions that are common enough to have their own opcode.
+//
+// The fused opcode replaces the second instruction and the first becomes a NOP, which PASS_COMPACT
+// removes. So a jump to the first instruction still executes both, and the fused handler only has
+// to produce the PACC of the second one (the NOP in front sets up the same PACC for it as the first
+// instruction would have). Jumps to the second instruction prevent the fusion.
+template <typename Engine, typename DelayStorage>
+typename VM<Engine, DelayStorage>::PassStats VM<Engine, DelayStorage>::FuseInstructions(
+    Program &program) const
+{
+  PassStats stats;
+  const auto is_target = JumpTargets(program);
+  for (size_t ic = 1; ic < program.length; ++ic) {
+    auto &first = program.instructions[ic - 1];
+    auto &second = program.instructions[ic];
+    if (is_target[ic]) continue;
+
+    CompiledInstruction fused = second;
+    switch (first.get_opcode()) {
+      // RDA read_addr, C; WRAP write_addr, -C => ALLPASS read_addr, C, write_addr
+      case OPCODE::RDA:
+        if (OPCODE::WRAP == second.get_opcode() &&
+            Engine::NEG(first.constants[1].load()) == second.constants[1].load()) {
+          fused.set_opcode(OPCODE::ALLPASS);
+          fused.constants = {first.constants[0], first.constants[1], second.constants[0]};
+        }
+        break;
+      // RDFX addr, k; WRLX addr, c => LPF1 addr, k, c
+      // RDFX addr, k; WRHX addr, c => HPF1 addr, k, c
+      // With c = -1 these are the usual one-pole filters, otherwise shelving filters.
+      case OPCODE::RDFX:
+        if ((OPCODE::WRLX == second.get_opcode() || OPCODE::WRHX == second.get_opcode()) &&
+            first.constants[0].loadi() == second.constants[0].loadi()) {
+          fused.set_opcode(OPCODE::WRLX == second.get_opcode() ? OPCODE::LPF1 : OPCODE::HPF1);
+          fused.constants = {first.constants[0], first.constants[1], second.constants[1]};
+        }
+        break;
+      // CHO RDA n, flags | COMPC, addr; CHO RDA n, flags, addr + 1 => CHO_INTERP n, flags, addr
+      // Either of them may have COMPC. REG makes no difference since the LFOs only change between
+      // frames, so it's dropped.
+      case OPCODE::CHO_RDA_RMP:
+      case OPCODE::CHO_RDA_SIN:
+        if (first.get_opcode() == second.get_opcode() &&
+            first.constants[0].loadi() == second.constants[0].loadi() &&
+            ((first.constants[1].loadi() ^ second.constants[1].loadi()) & ~CHO_FLAGS::REG) ==
+                CHO_FLAGS::COMPC &&
+            first.constants[2].loadi() + 1 == second.constants[2].loadi()) {
+          fused.set_opcode(OPCODE::CHO_RDA_RMP == first.get_opcode() ? OPCODE::CHO_INTERP_RMP
+                                                                      : OPCODE::CHO_INTERP_SIN);
+          fused.constants = first.constants;
+          fused.constants[1].store(first.constants[1].loadi() & ~CHO_FLAGS::REG);
+        }
+        break;
+      default: break;
+    }
+    if (fused.get_opcode() == second.get_opcode()) continue;
+
+    stats.rewritten += 2;
+    stats.cycles += EstimatedCost(first.get_opcode()) + EstimatedCost(second.get_opcode()) -
+                    EstimatedCost(fused.get_opcode()) - EstimatedCost(OPCODE::NOP);
+    first.set_opcode(OPCODE::NOP);
+    second = fused;
+    ++ic;
+  }
+  return stats;
+}
+
+// PASS_COEFFICIENTS: Coefficients that turn the multiplication into something simpler. These only
+// exist in the interpreter programs, the other engines see the original instructions.
+// SOF 1.0, 0 doesn't change ACC at all, the NOP is then removed by PASS_COMPACT.
+template <typename Engine, typename DelayStorage>
+typename VM<Engine, DelayStorage>::PassStats VM<Engine, DelayStorage>::ReduceCoefficients(
+    Program &program) const
+{
+  static constexpr int32_t kOne = 1 << SF23::FRAC;
+
+  PassStats stats;
+  for (size_t ic = 0; ic < program.length; ++ic) {
+    auto &instruction = program.instructions[ic];
+    const auto opcode = instruction.get_opcode();
+    const auto &c = instruction.constants[1];
+    auto new_opcode = opcode;
+    switch (opcode) {
+      case OPCODE::RDAX:
+        if (IsCoefficient(c, kOne))
+          new_opcode = OPCODE::RDAX_ADD;
+        else if (IsCoefficient(c, -kOne))
+          new_opcode = OPCODE::RDAX_SUB;
+        break;
+      case OPCODE::RDA:
+        if (IsCoefficient(c, kOne)) new_opcode = OPCODE::RDA_ADD;
+        break;
+      case OPCODE::WRAX:
+        if (IsCoefficient(c, kOne))
+          new_opcode = OPCODE::WRAX_MOV;
+        else if (c.zero())
+          new_opcode = OPCODE::WRAX_CLR;
+        break;
+      case OPCODE::SOF:
+        if (!c.zero()) break;
+        if (IsCoefficient(instruction.constants[0], kOne))
+          new_opcode = OPCODE::NOP;
+        else if (IsCoefficient(instruction.constants[0], -kOne))
+          new_opcode = OPCODE::SOF_NEG;
+        else if (IsCoefficient(instruction.constants[0], kOne / 2))
+          new_opcode = OPCODE::SOF_HALF;
+        else if (IsCoefficient(instruction.constants[0], -2 * kOne))
+          new_opcode = OPCODE::SOF_NEG2;
+        break;
+      default: break;
+    }
+    if (opcode != new_opcode) {
+      instruction.set_opcode(new_opcode);
+      ++stats.rewritten;
+      stats.cycles += EstimatedCost(opcode) - EstimatedCost(new_opcode);
+    }
+  }
+  return stats;
+}
+
+// PASS_SATURATION: Interval analysis of ACC, PACC and the registers to find the instructions whose
+// result can never leave the S.23 range; these use opcodes that skip the saturation. Only the
+// fixed-point engine saturates explicitly, so for anything else this does nothing.
+//
+// Registers are unknown at the start of a frame, as is anything read from the delay memory. ACC
+// and PACC carry over from the previous frame, so the steady-state program is analyzed until its
+// ranges at the end are contained in the ones it started with (or gives up and assumes the full
+// range).
+template <typename Engine, typename DelayStorage>
+typename VM<Engine, DelayStorage>::PassStats VM<Engine, DelayStorage>::ElideSaturation()
+{
+  if constexpr (!std::is_same_v<typename Engine::float_value, SF23>) return {};
+
+  ValueRange acc{0, 0}, pacc{0, 0};
+  AnalyzeRanges(program_.init, acc, pacc, true);
+
+  for (int i = 0; i < kMaxRangeIterations; ++i) {
+    auto end_acc = acc, end_pacc = pacc;
+    AnalyzeRanges(program_.steady, end_acc, end_pacc, false);
+    if (acc.contains(end_acc) && pacc.contains(end_pacc)) break;
+    acc = acc.join(end_acc);
+    pacc = pacc.join(end_pacc);
+    if (i + 1 == kMaxRangeIterations) acc = pacc = ValueRange{};
+  }
+  return AnalyzeRanges(program_.steady, acc, pacc, true);
+}
+
+// Runs the program on ranges instead of values. Each instruction's result is computed without
+// saturation first, if that fits into S.23 the instruction can skip it.
+//
+// Jumps only go forward, so the ACC arriving at each target is collected on the way. Registers
+// aren't tracked through jumps, they're reset to the full range at each target instead.
+template <typename Engine, typename DelayStorage>
+typename VM<Engine, DelayStorage>::PassStats VM<Engine, DelayStorage>::AnalyzeRanges(
+    Program &program, ValueRange &acc, ValueRange &pacc, bool rewrite) const
+{
+  // Intermediate results before saturation
+  struct Wide {
+    int64_t min, max;
+    Wide(const ValueRange &range) : min{range.min}, max{range.max} {}
+    Wide(int64_t lo, int64_t hi) : min{lo}, max{hi} {}
+
+    Wide operator+(const Wide &other) const { return {min + other.min, max + other.max}; }
+    Wide operator-(const Wide &other) const { return {min - other.max, max - other.min}; }
+    Wide operator*(const Wide &other) const
+    {
+      const int64_t products[4] = {min * other.min, min * other.max, max * other.min,
+                                   max * other.max};
+      const auto [lo, hi] = std::minmax_element(std::begin(products), std::end(products));
+      return {*lo >> SF23::FRAC, *hi >> SF23::FRAC};
+    }
+    int64_t abs() const { return std::max(-min, max); }
+    bool fits() const { return min >= SF23::MIN && max <= SF23::MAX; }
+    ValueRange clamp() const
+    {
+      return {static_cast<int32_t>(std::clamp<int64_t>(min, SF23::MIN, SF23::MAX)),
+              static_cast<int32_t>(std::clamp<int64_t>(max, SF23::MIN, SF23::MAX))};
+    }
+  };
+  static constexpr ValueRange kFull{};
+  static constexpr ValueRange kEmpty{SF23::MAX, SF23::MIN};
+  static constexpr ValueRange kLfoCoefficient{0, SF23::MAX};
+  auto constant = [](const typename Engine::Constant &c) { return Wide{c.loadi(), c.loadi()}; };
+  // The ramp crossfade depends on the range register, which is whatever the program writes
+  auto lfo_coefficient = [](OPCODE opcode, int32_t flags) {
+    const bool sin = OPCODE::CHO_RDA_SIN == opcode || OPCODE::CHO_SOF_SIN == opcode ||
+                     OPCODE::CHO_INTERP_SIN == opcode;
+    return sin || !(CHO_FLAGS::NA & flags) ? kLfoCoefficient : kFull;
+  };
+
+  std::array<ValueRange, kNumRegisters> registers;
+  std::array<ValueRange, kMaxInstructionCount + 1> incoming;
+  incoming.fill(kEmpty);
+
+  PassStats stats;
+  for (size_t ic = 0; ic < program.length; ++ic) {
+    auto &instruction = program.instructions[ic];
+    const auto opcode = instruction.get_opcode();
+    const auto &constants = instruction.constants;
+    if (incoming[ic].min <= incoming[ic].max) {
+      acc = acc.join(incoming[ic]);
+      pacc = pacc.join(incoming[ic]);
+      registers.fill(kFull);
+    }
+
+    const Wide a{acc};
+    // Only meaningful for the opcodes with a register operand
+    auto &reg = registers[static_cast<size_t>(constants[0].loadi()) % kNumRegisters];
+    ValueRange mid = acc;  // PACC of the next instruction
+    Wide result = a;
+    auto new_opcode = opcode;
+    switch (opcode) {
+      case OPCODE::RDA:
+        result = a + Wide{kFull} * constant(constants[1]);
+        if (result.fits()) new_opcode = OPCODE::RDA_NOSAT;
+        break;
+      case OPCODE::RMPA: result = a + Wide{kFull} * constant(constants[0]); break;
+      case OPCODE::WRA: result = a * constant(constants[1]); break;
+      case OPCODE::WRAP: result = a * constant(constants[1]) + Wide{kFull}; break;
+      case OPCODE::RDAX:
+        result = a + Wide{reg} * constant(constants[1]);
+        if (result.fits()) new_opcode = OPCODE::RDAX_NOSAT;
+        break;
+      case OPCODE::RDFX:
+        result = (a - Wide{reg}) * constant(constants[1]) + Wide{reg};
+        if (result.fits()) new_opcode = OPCODE::RDFX_NOSAT;
+        break;
+      case OPCODE::WRAX:
+        result = a * constant(constants[1]);
+        if (result.fits()) new_opcode = OPCODE::WRAX_NOSAT;
+        reg = acc;
+        break;
+      case OPCODE::WRHX:
+        result = a * constant(constants[1]) + Wide{pacc};
+        reg = acc;
+        break;
+      case OPCODE::WRLX:
+        result = (Wide{pacc} - a) * constant(constants[1]) + Wide{pacc};
+        reg = acc;
+        break;
+      case OPCODE::MAXX: {
+        const auto rxc = (Wide{reg} * constant(constants[1])).abs();
+        result = {0, std::max(rxc, a.abs())};
+      } break;
+      case OPCODE::MULX:
+        result = a * Wide{reg};
+        if (result.fits()) new_opcode = OPCODE::MULX_NOSAT;
+        break;
+      case OPCODE::SOF:
+        result = a * constant(constants[0]) + constant(constants[1]);
+        if (result.fits()) new_opcode = OPCODE::SOF_NOSAT;
+        break;
+      case OPCODE::SKP:
+      case OPCODE::JMP: {
+        auto &target = incoming[ic + 1 + static_cast<size_t>(constants[1].loadi())];
+        target = target.join(acc);
+        // Only reachable through another jump
+        if (OPCODE::JMP == opcode) result = Wide{mid = kEmpty};
+      } break;
+      case OPCODE::WLDS:
+      case OPCODE::WLDR:
+        std::fill(registers.begin(), registers.begin() + RMP1_RANGE + 1, kFull);
+        break;
+      case OPCODE::JAM:
+      case OPCODE::NOP:
+      case OPCODE::CHO_RDA:
+      case OPCODE::CHO_SOF: break;
+      case OPCODE::CLR: result = {0, 0}; break;
+      case OPCODE::WRAX_MOV: reg = acc; break;
+      case OPCODE::WRAX_CLR:
+        reg = acc;
+        result = {0, 0};
+        break;
+      case OPCODE::ABSA: result = {0, a.abs()}; break;
+      case OPCODE::LDAX: result = Wide{reg}; break;
+      case OPCODE::CHO_RDA_RMP:
+      case OPCODE::CHO_RDA_SIN:
+        result = a + Wide{kFull} * Wide{lfo_coefficient(opcode, constants[1].loadi())};
+        break;
+      case OPCODE::CHO_SOF_RMP:
+      case OPCODE::CHO_SOF_SIN:
+        result = a * Wide{lfo_coefficient(opcode, constants[1].loadi())} + constant(constants[2]);
+        break;
+      case OPCODE::RDAX_ADD: result = a + Wide{reg}; break;
+      case OPCODE::RDAX_SUB: result = a - Wide{reg}; break;
+      case OPCODE::RDA_ADD: result = a + Wide{kFull}; break;
+      case OPCODE::SOF_NEG: result = Wide{0, 0} - a; break;
+      case OPCODE::SOF_HALF: result = {a.min >> 1, a.max >> 1}; break;
+      case OPCODE::SOF_NEG2: result = Wide{0, 0} - (a + a); break;
+      case OPCODE::ALLPASS:
+        mid = (a + Wide{kFull} * constant(constants[1])).clamp();
+        result = Wide{mid} * (Wide{0, 0} - constant(constants[1])) + Wide{kFull};
+        break;
+      case OPCODE::LPF1:
+      case OPCODE::HPF1:
+        mid = ((a - Wide{reg}) * constant(constants[1]) + Wide{reg}).clamp();
+        reg = mid;
+        result = OPCODE::LPF1 == opcode ? (a - Wide{mid}) * constant(constants[2]) + a
+                                        : Wide{mid} * constant(constants[2]) + a;
+        break;
+      case OPCODE::CHO_INTERP_RMP:
+      case OPCODE::CHO_INTERP_SIN: {
+        const Wide coefficient{lfo_coefficient(opcode, constants[1].loadi())};
+        mid = (a + Wide{kFull} * coefficient).clamp();
+        result = Wide{mid} + Wide{kFull} * coefficient;
+      } break;
+      case OPCODE::AND:
+      case OPCODE::OR:
+      case OPCODE::XOR:
+      case OPCODE::NOT:
+      case OPCODE::LOG:
+      case OPCODE::EXP:
+      case OPCODE::CHO_RDAL: result = Wide{kFull}; break;
+      default:
+        result = Wide{kFull};
+        registers.fill(kFull);
+        break;
+    }
+    pacc = mid;
+    acc = result.clamp();
+
+    if (rewrite && opcode != new_opcode) {
+      instruction.set_opcode(new_opcode);
+      ++stats.rewritten;
+      stats.cycles += EstimatedCost(opcode) - EstimatedCost(new_opcode);
+    }
+  }
+  acc = acc.join(incoming[program.length]);
+  pacc = pacc.join(incoming[program.length]);
+  return stats;
+}
+
+// PASS_DELAY_REUSE: Delay memory cells that are read again within a frame, without a write to the
+// same cell in between. The first access (an RDA, or the WRA that wrote the value) keeps the value
+// in a slot, the later reads use that instead of going through the delay memory. Addresses are
+// compared modulo the delay memory size like the accesses themselves.
+//
+// Jumps only go forward, so at a jump target the values known on all paths are the ones that were
+// known before the first jump to it; a write in between would have removed them on the way.
+template <typename Engine, typename DelayStorage>
+typename VM<Engine, DelayStorage>::PassStats VM<Engine, DelayStorage>::ReuseDelayReads(
+    Program &program) const
+{
+  struct Access {
+    int32_t addr;
+    int32_t ic;  // Instruction that knows the value
+  };
+
+  PassStats stats;
+  auto &instructions = program.instructions;
+  std::array<int16_t, kMaxInstructionCount + 1> first_jump;
+  first_jump.fill(-1);
+  for (size_t ic = program.length; ic--;) {
+    const auto &instruction = instructions[ic];
+    if (OPCODE::SKP == instruction.get_opcode() || OPCODE::JMP == instruction.get_opcode())
+      first_jump[ic + 1 + static_cast<size_t>(instruction.constants[1].loadi())] =
+          static_cast<int16_t>(ic);
+  }
+  std::array<Access, kMaxInstructionCount> known;
+  size_t num_known = 0;
+  // Each address is known at most once
+  auto forget = [&](int32_t addr) {
+    for (size_t i = 0; i < num_known; ++i) {
+      if (known[i].addr != addr) continue;
+      known[i] = known[--num_known];
+      break;
+    }
+  };
+
+  // The instruction each read can take its value from, or -1
+  std::array<int16_t, kMaxInstructionCount> source;
+  source.fill(-1);
+  for (size_t ic = 0; ic < program.length; ++ic) {
+    const auto &instruction = instructions[ic];
+    if (first_jump[ic] >= 0) {
+      const int32_t jump = first_jump[ic];
+      num_known = static_cast<size_t>(
+          std::remove_if(known.begin(), known.begin() + num_known,
+                         [jump](const Access &a) { return a.ic > jump; }) -
+          known.begin());
+    }
+    const int32_t addr = instruction.constants[0].loadi() & kDelayAddrMask;
+    switch (instruction.get_opcode()) {
+      case OPCODE::RDA:
+      case OPCODE::RDA_ADD:
+      case OPCODE::RDA_NOSAT: {
+        auto access = std::find_if(known.begin(), known.begin() + num_known,
+                                   [addr](const Access &a) { return a.addr == addr; });
+        if (access != known.begin() + num_known)
+          source[ic] = static_cast<int16_t>(access->ic);
+        else
+          known[num_known++] = {addr, static_cast<int32_t>(ic)};
+      } break;
+      case OPCODE::WRA:
+        forget(addr);
+        known[num_known++] = {addr, static_cast<int32_t>(ic)};
+        break;
+      case OPCODE::WRAP: forget(addr); break;
+      case OPCODE::ALLPASS: forget(instruction.constants[2].loadi() & kDelayAddrMask); break;
+      default: break;
+    }
+  }
+
+  std::array<int16_t, kMaxInstructionCount> slot;
+  slot.fill(-1);
+  size_t num_slots = 0;
+  auto rewrite = [&](CompiledInstruction &instruction, OPCODE opcode) {
+    stats.cycles += EstimatedCost(instruction.get_opcode()) - EstimatedCost(opcode);
+    ++stats.rewritten;
+    instruction.set_opcode(opcode);
+  };
+  for (size_t ic = 0; ic < program.length; ++ic) {
+    if (source[ic] < 0) continue;
+    const auto s = static_cast<size_t>(source[ic]);
+    auto &first = instructions[s];
+    if (slot[s] < 0) {
+      if (num_slots == kMaxDelaySlots) break;
+      slot[s] = static_cast<int16_t>(num_slots++);
+      first.constants[2].store(slot[s]);
+      rewrite(first, OPCODE::WRA == first.get_opcode() ? OPCODE::WRA_SAVE : OPCODE::RDA_SAVE);
+    }
+    auto &instruction = instructions[ic];
+    instruction.constants[0].store(slot[s]);
+    rewrite(instruction, OPCODE::RDA_CACHED);
+  }
+  return stats;
+}
+
+// PASS_HOIST: Move register computations that only depend on the pots out of the steady-state
+// program. The pots only change between calls to Execute, so these run once per block before the
+// frames (see ExecutePrologue). The init program keeps them. Whatever doesn't fit into the
+// prologue (kMaxPrologueLength) stays where it is.
+//
+// A hoisted sequence has ACC = 0 before it (after WRAX REGn, 0 or CLR) and ends with WRAX REGn, 0,
+// so removing it leaves ACC unchanged for the rest of the program; the instruction after it mustn't
+// read PACC. It has to run on every frame, i.e. no jumps into or over it. It may read the pots,
+// registers the steady-state program never writes, and registers written by hoisted instructions
+// before it. The registers it writes can't be written anywhere else or be read earlier in the
+// frame, where the value from the previous frame would be visible.
+template <typename Engine, typename DelayStorage>
+typename VM<Engine, DelayStorage>::PassStats VM<Engine, DelayStorage>::HoistInvariants()
+{
+  PassStats stats;
+  auto &instructions = program_.steady.instructions;
+  const size_t length = program_.steady.length;
+  const bool pacc_at_end = (program_.features | kFixedFeatures) & FEATURE_PACC;
+
+  auto clears_acc = [](const CompiledInstruction &instruction) {
+    return OPCODE::WRAX_CLR == instruction.get_opcode() || OPCODE::CLR == instruction.get_opcode();
+  };
+  auto hoistable = [](OPCODE opcode) {
+    switch (opcode) {
+      case OPCODE::RDAX:
+      case OPCODE::RDAX_ADD:
+      case OPCODE::RDAX_SUB:
+      case OPCODE::RDAX_NOSAT:
+      case OPCODE::LDAX:
+      case OPCODE::RDFX:
+      case OPCODE::RDFX_NOSAT:
+      case OPCODE::MULX:
+      case OPCODE::MULX_NOSAT:
+      case OPCODE::MAXX:
+      case OPCODE::SOF:
+      case OPCODE::SOF_NEG:
+      case OPCODE::SOF_HALF:
+      case OPCODE::SOF_NEG2:
+      case OPCODE::SOF_NOSAT:
+      case OPCODE::AND:
+      case OPCODE::OR:
+      case OPCODE::XOR:
+      case OPCODE::NOT:
+      case OPCODE::CLR:
+      case OPCODE::ABSA:
+      case OPCODE::NOP:
+      case OPCODE::WRAX:
+      case OPCODE::WRAX_MOV:
+      case OPCODE::WRAX_CLR:
+      case OPCODE::WRAX_NOSAT: return true;
+      default: return false;
+    }
+  };
+  auto written_registers = [](const CompiledInstruction &instruction) -> uint64_t {
+    switch (instruction.get_opcode()) {
+      case OPCODE::WRAX:
+      case OPCODE::WRHX:
+      case OPCODE::WRLX:
+      case OPCODE::WRAX_MOV:
+      case OPCODE::WRAX_CLR:
+      case OPCODE::WRAX_NOSAT:
+      case OPCODE::LPF1:
+      case OPCODE::HPF1: return uint64_t{1} << instruction.constants[0].loadi();
+      case OPCODE::WLDS:
+      case OPCODE::WLDR: return (uint64_t{1} << (RMP1_RANGE + 1)) - 1;
+      default: return 0;
+    }
+  };
+
+  // The inputs are written on every frame
+  uint64_t written = (uint64_t{1} << ADCL) | (uint64_t{1} << ADCR);
+  uint64_t written_again = written;
+  std::array<size_t, kNumRegisters> first_read;
+  first_read.fill(length);
+  // Instructions a jump might skip
+  std::array<bool, kMaxInstructionCount + 1> conditional = {};
+  const auto is_target = JumpTargets(program_.steady);
+  for (size_t ic = 0; ic < length; ++ic) {
+    const auto &instruction = instructions[ic];
+    const auto writes = written_registers(instruction);
+    written_again |= written & writes;
+    written |= writes;
+    const auto reads = RegisterReads(instruction);
+    for (size_t r = 0; r < kNumRegisters; ++r) {
+      if ((reads & (uint64_t{1} << r)) && first_read[r] == length) first_read[r] = ic;
+    }
+    if (OPCODE::SKP == instruction.get_opcode() || OPCODE::JMP == instruction.get_opcode()) {
+      const auto target = ic + 1 + static_cast<size_t>(instruction.constants[1].loadi());
+      std::fill(conditional.begin() + static_cast<std::ptrdiff_t>(ic + 1),
+                conditional.begin() + static_cast<std::ptrdiff_t>(target), true);
+    }
+  }
+
+  // ACC is zero before the instruction if the one in front of it (ignoring NOPs) clears it. At the
+  // start of the program that's the last instruction of the previous frame.
+  auto acc_zero_before = [&](size_t ic) {
+    size_t p = ic;
+    while (p && OPCODE::NOP == instructions[p - 1].get_opcode()) --p;
+    for (size_t t = p; t <= ic; ++t)
+      if (is_target[t]) return false;
+    if (p) return clears_acc(instructions[p - 1]);
+
+    p = length;
+    while (p && OPCODE::NOP == instructions[p - 1].get_opcode()) --p;
+    for (size_t t = p; t <= length; ++t)
+      if (is_target[t]) return false;
+    return p && !conditional[p - 1] && clears_acc(instructions[p - 1]);
+  };
+
+  uint64_t invariant = ~written;
+  for (size_t start = 0; start < length; ++start) {
+    if (conditional[start] || !acc_zero_before(start)) continue;
+
+    // Longest sequence that ends with a usable WRAX REGn, 0
+    uint64_t readable = invariant;
+    uint64_t hoisted = 0;
+    size_t end = length;
+    size_t prologue_length = program_.prologue.length;
+    for (size_t ic = start; ic < length; ++ic) {
+      const auto &instruction = instructions[ic];
+      if (ic > start && (is_target[ic] || conditional[ic])) break;
+      if (!hoistable(instruction.get_opcode())) break;
+      if (OPCODE::NOP != instruction.get_opcode() && ++prologue_length > kMaxPrologueLength) break;
+      if (RegisterReads(instruction) & ~readable) break;
+      const auto writes = written_registers(instruction);
+      if (writes) {
+        const auto r = static_cast<size_t>(instruction.constants[0].loadi());
+        if ((writes & written_again) || first_read[r] < ic) break;
+        readable |= writes;
+      }
+      if (OPCODE::WRAX_CLR == instruction.get_opcode() &&
+          !(ic + 1 < length ? ReadsPacc(instructions[ic + 1]) : pacc_at_end)) {
+        end = ic;
+        hoisted = readable;
+      }
+    }
+    if (end == length) continue;
+
+    for (size_t ic = start; ic <= end; ++ic) {
+      auto &instruction = instructions[ic];
+      if (OPCODE::NOP == instruction.get_opcode()) continue;
+      program_.prologue.instructions[program_.prologue.length++] = instruction;
+      ++stats.removed;
+      stats.cycles += EstimatedCost(instruction.get_opcode()) - EstimatedCost(OPCODE::NOP);
+      instruction.set_opcode(OPCODE::NOP);
+    }
+    invariant = hoisted;
+    start = end;
+  }
+  return stats;
+}
+
+// Compare a coefficient to an S.23 value, independent of how the engine stores it
+template <typename Engine, typename DelayStorage>
+/*static*/ bool VM<Engine, DelayStorage>::IsCoefficient(const typename Engine::Constant &c,
+                                                        int32_t value)
+{
+  typename Engine::Constant expected;
+  expected.store(SF23{value});
+  return c.loadi() == expected.loadi();
+}
+
+template <typename Engine, typename DelayStorage>
+/*static*/ std::array<bool, kMaxInstructionCount + 1> VM<Engine, DelayStorage>::JumpTargets(
+    const Program &program)
+{
+  std::array<bool, kMaxInstructionCount + 1> is_target = {};
+  for (size_t ic = 0; ic < program.length; ++ic) {
+    const auto &instruction = program.instructions[ic];
+    if (OPCODE::SKP == instruction.get_opcode() || OPCODE::JMP == instruction.get_opcode())
+      is_target[ic + 1 + static_cast<size_t>(instruction.constants[1].loadi())] = true;
+  }
+  return is_target;
+}
+
+// PASS_COMPACT: Remove the NOPs from a program and adjust the jumps accordingly; jumps that end up
+// at the next instruction are NOPs themselves and removed in the next iteration.
+//
+// A NOP isn't quite free since it still advances PACC. It's only observable by the instruction
+// following it though, so one NOP stays if that reads PACC. At the end of the program PACC carries
+// over into the next frame, so the last NOP also stays if the program maintains PACC.
+template <typename Engine, typename DelayStorage>
+typename VM<Engine, DelayStorage>::PassStats VM<Engine, DelayStorage>::CompactProgram(
+    Program &program) const
+{
+  PassStats stats;
+  const bool keep_last = (program_.features | kFixedFeatures) & FEATURE_PACC;
+  auto &instructions = program.instructions;
+  auto is_jump = [](const CompiledInstruction &instruction) {
+    return OPCODE::SKP == instruction.get_opcode() || OPCODE::JMP == instruction.get_opcode();
+  };
+
+  bool changed = true;
+  while (changed) {
+    const size_t length = program.length;
+
+    // Position of each instruction in the compacted program
+    std::array<uint8_t, kMaxInstructionCount + 1> position;
+    size_t num_kept = 0;
+    for (size_t ic = 0; ic < length; ++ic) {
+      position[ic] = static_cast<uint8_t>(num_kept);
+      if (OPCODE::NOP != instructions[ic].get_opcode() ||
+          (ic + 1 < length ? ReadsPacc(instructions[ic + 1]) : keep_last)) {
+        ++num_kept;
+      } else {
+        ++stats.removed;
+        stats.cycles += EstimatedCost(OPCODE::NOP);
+      }
+    }
+    position[length] = static_cast<uint8_t>(num_kept);
+    changed = num_kept != length;
+
+    // Instructions only move towards the start so this works in place
+    for (size_t ic = 0; ic < length; ++ic) {
+      if (position[ic] == position[ic + 1]) continue;
+      auto &instruction = instructions[position[ic]];
+      instruction = instructions[ic];
+      if (!is_jump(instruction)) continue;
+      const auto target = ic + 1 + static_cast<size_t>(instruction.constants[1].loadi());
+      const auto n = position[target] - position[ic] - 1;
+      if (n) {
+        instruction.constants[1].store(n);
+      } else {
+        stats.cycles += EstimatedCost(instruction.get_opcode()) - EstimatedCost(OPCODE::NOP);
+        ++stats.rewritten;
+        instruction.set_opcode(OPCODE::NOP);
+        changed = true;
+      }
+    }
+    std::fill(instructions.begin() + static_cast<std::ptrdiff_t>(num_kept), instructions.end(),
+              CompiledInstruction{});
+    program.length = num_kept;
+  }
+  return stats;
+}
+
+// PASS_SUPEROPS: Opcode sequences that are common in the programs fv1_superops was run on have a
+// single handler, which saves the dispatches in between (see fv1/fv1_superops.h).
+//
+// Only the first instruction of a sequence gets the superinstruction's opcode. Its handler runs
+// the following instructions as well and continues after the last one, but they keep their own
+// opcodes so a jump into the middle of the sequence still works. None of the sequences contain
+// jumps. This runs last so the sequences match what the interpreter actually executes.
+template <typename Engine, typename DelayStorage>
+typename VM<Engine, DelayStorage>::PassStats VM<Engine, DelayStorage>::FuseSuperinstructions(
+    Program &program) const
+{
+  PassStats stats;
+  auto &instructions = program.instructions;
+  size_t ic = 0;
+  while (ic < program.length) {
+    // The table is sorted longest first
+    auto matches = [&](const Superop &superop) {
+      if (ic + superop.length > program.length) return false;
+      for (size_t i = 0; i < superop.length; ++i)
+        if (superop.sequence[i] != instructions[ic + i].get_opcode()) return false;
+      return true;
+    };
+    auto superop = std::find_if(kSuperops.begin(), kSuperops.end(), matches);
+    if (kSuperops.end() == superop) {
+      ++ic;
+      continue;
+    }
+    for (size_t i = 0; i < superop->length; ++i)
+      stats.cycles += EstimatedCost(instructions[ic + i].get_opcode());
+    stats.cycles -= EstimatedCost(superop->opcode);
+    ++stats.rewritten;
+    instructions[ic].set_opcode(superop->opcode);
+    ic += superop->length;
+  }
+  return stats;
+}
+
+template <typename Engine, typename DelayStorage>
+/*static*/ bool VM<Engine, DelayStorage>::ReadsPacc(const CompiledInstruction &instruction)
+{
+  switch (instruction.get_opcode()) {
+    case OPCODE::WRHX:
+    case OPCODE::WRLX: return true;
+    case OPCODE::SKP: return SKP_FLAGS::ZRC & instruction.constants[0].loadi();
+    default: return false;
+  }
+}
+
+template <typename Engine, typename DelayStorage>
+void VM<Engine, DelayStorage>::AnalyzeFeatures()
+{
+  static constexpr uint32_t kLfoFeatures[] = {FEATURE_SIN0, FEATURE_SIN0, FEATURE_SIN1,
+                                              FEATURE_SIN1, FEATURE_RMP0, FEATURE_RMP1};
+  uint32_t features = 0;
+  for (const auto &instruction : instructions_) {
+    GET_INT_CONSTANT(c0, 0);
+    if (ReadsPacc(instruction)) features |= FEATURE_PACC;
+    switch (instruction.get_opcode()) {
+      case OPCODE::WRAP: features |= FEATURE_LAST_READ; break;
+      case OPCODE::CHO_RDA_SIN:
+      case OPCODE::CHO_SOF_SIN: features |= c0 ? FEATURE_SIN1 : FEATURE_SIN0; break;
+      case OPCODE::CHO_RDA_RMP:
+      case OPCODE::CHO_SOF_RMP: features |= c0 ? FEATURE_RMP1 : FEATURE_RMP0; break;
+      case OPCODE::CHO_RDAL: features |= kLfoFeatures[c0]; break;
+      default: break;
+    }
+    switch (instruction.get_opcode()) {
+      case OPCODE::RDAX:
+      case OPCODE::RDFX:
+      case OPCODE::WRAX:
+      case OPCODE::WRHX:
+      case OPCODE::WRLX:
+      case OPCODE::MAXX:
+      case OPCODE::MULX:
+      case OPCODE::LDAX:
+        if (ADCR == c0) features |= FEATURE_STEREO;
+        break;
+      default: break;
+    }
+  }
+  if (features & (FEATURE_SIN0 | FEATURE_SIN1 | FEATURE_RMP0 | FEATURE_RMP1))
+    features |= FEATURE_LFO;
+  program_.features = features;
+
+  // PACC is updated after every instruction, the rest is per frame
+  auto &stats = optimizer_report_[PASS_FEATURES];
+  if (!(features & FEATURE_PACC)) stats.cycles += static_cast<int32_t>(program_.steady.length);
+  if (!(features & FEATURE_STEREO)) ++stats.cycles;
+  if (!(features & FEATURE_LAST_READ)) ++stats.cycles;
+  for (auto lfo : {FEATURE_SIN0, FEATURE_SIN1, FEATURE_RMP0, FEATURE_RMP1})
+    if (!(features & lfo)) stats.cycles += kLfoTickCost;
+}
+
+// Rough cost of an instruction in the interpreter loops, including the dispatch. This is only
+// used to estimate what the optimizer passes save, not for any decisions.
+template <typename Engine, typename DelayStorage>
+/*static*/ int32_t VM<Engine, DelayStorage>::EstimatedCost(OPCODE opcode)
+{
+  static constexpr int32_t kDispatch = 3;
+  for (const auto &superop : kSuperops) {
+    if (superop.opcode != opcode) continue;
+    auto cost = -static_cast<int32_t>(superop.length - 1) * kDispatch;
+    for (size_t i = 0; i < superop.length; ++i) cost += EstimatedCost(superop.sequence[i]);
+    return cost;
+  }
+  switch (opcode) {
+    case OPCODE::NOP:
+    case OPCODE::JMP:
+    case OPCODE::CLR:
+    case OPCODE::NOT: return kDispatch;
+    case OPCODE::LOG:
+    case OPCODE::EXP: return kDispatch + 8;
+    case OPCODE::RDA:
+    case OPCODE::WRA:
+    case OPCODE::WRAP:
+    case OPCODE::RMPA: return kDispatch + 4;
+    case OPCODE::RDA_ADD:
+    case OPCODE::RDA_NOSAT: return kDispatch + 3;
+    case OPCODE::RDA_SAVE:
+    case OPCODE::WRA_SAVE: return kDispatch + 5;
+    case OPCODE::ALLPASS: return kDispatch + 6;
+    case OPCODE::LPF1:
+    case OPCODE::HPF1: return kDispatch + 3;
+    case OPCODE::RDAX_ADD:
+    case OPCODE::RDAX_SUB:
+    case OPCODE::WRAX_MOV:
+    case OPCODE::WRAX_CLR:
+    case OPCODE::SOF_NEG:
+    case OPCODE::SOF_HALF:
+    case OPCODE::SOF_NEG2:
+    case OPCODE::RDAX_NOSAT:
+    case OPCODE::RDFX_NOSAT:
+    case OPCODE::WRAX_NOSAT:
+    case OPCODE::MULX_NOSAT:
+    case OPCODE::SOF_NOSAT: return kDispatch + 1;
+    case OPCODE::CHO_RDA_SIN:
+    case OPCODE::CHO_RDA_RMP:
+    case OPCODE::CHO_SOF_SIN:
+    case OPCODE::CHO_SOF_RMP:
+    case OPCODE::CHO_RDAL: return kDispatch + 10;
+    case OPCODE::CHO_INTERP_RMP:
+    case OPCODE::CHO_INTERP_SIN: return kDispatch + 14;
+    case OPCODE::WLDS:
+    case OPCODE::WLDR:
+    case OPCODE::JAM: return kDispatch + 6;
+    default: return kDispatch + 2;
+  }
+}
+
 }  // namespace fv1
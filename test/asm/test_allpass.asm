@@ -0,0 +1,24 @@
+; RDA/WRAP all-pass pairs, some of which can't be fused. WRHX and SKP ZRC read the PACC of the
+; WRAP in front of them.
+mem ap1 100
+mem ap2 150
+mem ap3 77
+	rdax adcl, 0.5
+	rda ap1#, 0.6
+	wrap ap1, -0.6
+	rda ap2#, 0.5
+	wrap ap2, -0.5
+	wrhx reg0, 0.5
+	skp neg, mid
+	rda ap3#, 0.7
+mid:
+	wrap ap3, -0.7
+	rda ap1+50, 0.5
+	wrap ap2, 0.5
+	wrax dacl, 0
+	rda ap3#, 0.4
+	wrap ap3, -0.4
+	skp zrc, end
+	sof -1.0, 0.1
+end:
+	wrax dacr, 0
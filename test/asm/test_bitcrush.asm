@@ -0,0 +1,8 @@
+; Masks with the sign bit set stay in the packed program
+	ldax ADCL
+	and 0xfff000
+	wrax DACL, 0
+	ldax ADCR
+	xor 0x800000
+	or 0xc00000
+	wrax DACR, 0
@@ -0,0 +1,64 @@
+; Reverb without LFOs, so it can run instruction-major. The short allpass, filters and the
+; feedback register need sequential segments.
+mem ap1 156
+mem ap2 223
+mem aps 20
+mem del1 3500
+mem del2 4256
+equ krt reg0
+equ gain reg1
+equ lp1 reg2
+equ hp1 reg3
+equ tmp reg4
+equ env reg5
+equ fb reg6
+
+	skp run, start
+	sof 0, 0.5
+	wrax gain, 0
+start:
+	rdax pot0, 0.7
+	sof 0.7, 0.25
+	wrax krt, 0
+	rdax adcl, 0.25
+	rdax adcr, 0.25
+	mulx gain
+	rda ap1#, 0.6
+	wrap ap1, -0.6
+	rda ap2#, 0.6
+	wrap ap2, -0.6
+	rda aps#, 0.5
+	wrap aps, -0.5
+	wrax tmp, 1.0
+	rda del2#, 1.0
+	mulx krt
+	rdax tmp, 1.0
+	rdfx lp1, 0.3
+	wrlx lp1, -1.0
+	rdfx hp1, 0.01
+	wrhx hp1, -0.5
+	wra del1, 0
+	rda del1#, 1.0
+	mulx krt
+	rdax fb, 0.2
+	wra del2, 0
+	rda del1, 0.8
+	rda del2+1000, 0.6
+	wrax fb, 1.0
+	wrax dacl, 0
+	rda del2, 0.8
+	rda del1+1500, 0.6
+	rdax tmp, -0.5
+	sof -2.0, 0
+	sof 1.0, 0.01
+	wrax dacr, 1.0
+	absa
+	maxx env, 0.99
+	wrax env, 0
+	ldax pot1
+	and 0x7ffff0
+	or 0x10
+	xor 0x5
+	not
+	wrax reg7, 0
+	clr
@@ -0,0 +1,22 @@
+; Interpolated CHO RDA pairs, some of which can't be fused. The WRHX reads the PACC from the middle
+; of the pair in front of it.
+mem	delay	2048
+
+	skp	run, start
+	wlds	sin0, 100, 1024
+	wlds	sin1, 20, 512
+start:
+	ldax	adcl
+	wra	delay, 0
+	cho	rda, sin0, sin|reg|compc, delay
+	cho	rda, sin0, sin, delay + 1
+	cho	rda, sin1, cos|compa, delay + 100
+	cho	rda, sin1, cos|compa|compc, delay + 101
+	wrhx	reg1, 0.5
+	cho	rda, sin0, sin|compc, delay + 200
+	cho	rda, sin0, cos, delay + 201
+	cho	rda, sin0, sin|compc, delay + 300
+	cho	rda, sin1, sin, delay + 301
+	cho	rda, sin1, sin|compc, delay + 400
+	cho	rda, sin1, sin, delay + 402
+	wrax	dacl, 0
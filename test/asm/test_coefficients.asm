@@ -0,0 +1,20 @@
+; Coefficients that don't need a multiplication, including the saturating cases
+mem delay 100
+	rdax adcl, 1.0
+	rdax adcr, -1.0
+	wrax reg0, 1.0
+	sof -1.0, 0
+	wrax reg1, 0
+	rdax reg0, 1.0
+	sof 0.5, 0
+	wrax reg2, 1.0
+	sof -2.0, 0
+	sof 1.0, 0
+	wra delay, 1.0
+	rda delay#, 1.0
+	wrax dacl, 0
+	rdax reg1, -1.0
+	sof -2.0, 0
+	sof -2.0, 0
+	sof 0.5, 0.25
+	wrax dacr, 0
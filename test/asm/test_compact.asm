@@ -0,0 +1,21 @@
+; NOPs in between instructions and jump targets, some of them need to stay for PACC
+	ldax adcl
+	nop
+	skp neg, negative
+	nop
+	nop
+	sof 1.0, 0.1
+	nop
+negative:
+	nop
+	wrax dacl, 0
+	nop
+	nop
+	ldax adcl
+	nop
+	wrlx reg0, -0.5
+	skp zrc, end
+	nop
+	sof -1.0, 0
+end:
+	wrax dacr, 0
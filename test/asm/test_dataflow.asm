@@ -0,0 +1,29 @@
+; Register stores that are dead or only feed the next instruction, and loads of values already in
+; ACC. WRHX/WRLX read PACC so the stores in front of them stay as they are.
+	ldax adcl
+	wrax reg0, 0
+	rdax reg0, 0.5
+	wrax reg1, 1.0
+	ldax reg1
+	wrax reg2, 0.5
+	wrax reg3, 0
+	rdax adcr, 1.0
+	wrax reg2, 1.0
+	wrax reg3, 0
+	rdax reg2, 1.0
+	wrax dacl, 0
+	rdax reg1, 0.25
+	wrhx reg4, 0.5
+	wrax dacr, 0
+	ldax adcl
+	wrax reg5, 0
+	rdax reg5, 0.75
+	wrlx reg6, -0.5
+	wrax reg7, 0
+	ldax adcl
+	wrax reg8, 0.5
+	skp neg, over
+	wrax reg8, 0
+over:
+	rdax reg8, 1.0
+	wrax reg9, 0
@@ -0,0 +1,23 @@
+; Delay memory cells that are read again in the same frame
+mem delay 100
+mem short 10
+
+	rdax adcl, 1.0
+	wra delay, 0.5
+	rda delay, 0.25		; Written above
+	rda delay#, 0.5
+	rda delay+50, 0.5
+	wrax reg0, 0
+	rda delay#, -0.5	; Read above
+	wra short, 0
+	rda short#, 0.5
+	wrap delay+50, 0.5
+	rda delay+50, 0.5	; Written in between
+	wrax reg1, 0
+	ldax adcr
+	skp neg, target
+	rda delay+20, 0.5
+target:
+	rda delay#, 0.5		; Read before the jump
+	rda delay+20, 0.5	; Might not have been read
+	wrax dacl, 0
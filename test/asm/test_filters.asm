@@ -0,0 +1,20 @@
+; RDFX/WRLX and RDFX/WRHX one-pole and shelving filters, some of which can't be fused. The WRHX
+; after the shelf reads the PACC from the middle of it.
+	ldax adcl
+	rdfx reg0, 0.1
+	wrlx reg0, -1.0
+	rdfx reg1, 0.05
+	wrhx reg1, -0.5
+	wrax reg2, 0
+	rdax adcr, 1.0
+	rdfx reg3, 0.2
+	wrlx reg4, -1.0
+	rdfx reg5, 0.3
+	wrlx reg5, 0.5
+	wrhx reg6, 0.5
+	wrax dacl, 0
+	skp gez, over
+	rdfx reg7, 0.4
+over:
+	wrlx reg7, -1.0
+	wrax dacr, 0
@@ -0,0 +1,34 @@
+; Register values that only depend on the pots, and some that look like they do but don't
+	skp run, start
+	sof 0, 0.5
+	wrax reg5, 0		; Only written by the init code
+start:
+	rdax pot0, 0.7
+	sof 0.7, 0.25
+	wrax reg0, 0
+	rdax pot1, 1.0
+	mulx reg0
+	wrax reg1, 0
+	rdax adcl, 1.0		; Not constant
+	mulx reg1
+	wrax reg2, 0
+	rdax pot2, 0.5
+	mulx reg5
+	wrax reg3, 0
+	ldax reg4		; Read before it's written
+	wrax dacr, 0
+	rdax pot0, 0.5
+	wrax reg4, 0
+	ldax adcl
+	skp neg, skip
+	clr
+	rdax pot1, 0.5		; Conditional
+	wrax reg6, 0
+skip:
+	clr
+	rdax pot1, 0.25
+	wrax reg7, 0
+	wrhx reg8, 0.5		; Reads PACC
+	rdax reg2, 1.0
+	rdax reg3, 1.0
+	wrax dacl, 0
@@ -0,0 +1,13 @@
+; The SKP RUN block leaves ACC non-zero, and the hoisted sequence at the start reads it. The init
+; frame computes REG0 from that ACC, all frames after it (including the rest of the first block)
+; from the ACC = 0 the previous frame ends with.
+	skp run, start
+	sof 0, -0.5
+start:
+	wrax reg0, 0.5
+	rdax pot0, 0.5
+	wrax reg1, 0
+	rdax adcl, 0.5
+	rdax reg0, 1.0
+	rdax reg1, 1.0
+	wrax dacl, 0
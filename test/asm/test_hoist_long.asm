@@ -0,0 +1,41 @@
+; More pot-only register values than fit into the prologue
+	rdax pot0, 0.5
+	sof 0.5, 0.1
+	wrax reg0, 0
+	rdax pot1, 0.5
+	sof 0.5, 0.2
+	wrax reg1, 0
+	rdax pot2, 0.5
+	sof 0.5, 0.3
+	wrax reg2, 0
+	rdax pot0, 0.5
+	sof 0.5, 0.4
+	wrax reg3, 0
+	rdax pot1, 0.5
+	sof 0.5, 0.5
+	wrax reg4, 0
+	rdax pot2, 0.5
+	sof 0.5, 0.6
+	wrax reg5, 0
+	rdax pot0, 0.5
+	sof 0.5, 0.7
+	wrax reg6, 0
+	rdax pot1, 0.5
+	sof 0.5, 0.8
+	wrax reg7, 0
+	rdax pot2, 0.5
+	sof 0.5, 0.9
+	wrax reg8, 0
+	rdax pot0, 0.5
+	sof 0.5, 0.10
+	wrax reg9, 0
+	rdax pot1, 0.5
+	sof 0.5, 0.11
+	wrax reg10, 0
+	rdax pot2, 0.5
+	sof 0.5, 0.12
+	wrax reg11, 0
+	rdax adcl, 0.5
+	rdax reg0, 0.25
+	rdax reg11, 0.25
+	wrax dacl, 0
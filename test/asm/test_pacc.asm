@@ -0,0 +1,15 @@
+; Back-to-back instructions that read PACC, which is the ACC from before the previous instruction
+; in each case, not the ACC they start with (e.g. in instruction-major execution).
+	rda 16000, -2.0
+	sof -2.0, -0.27
+	rdfx reg1, 0
+	wrhx reg1, -1.0
+	wrax reg2, -0.5
+	wrlx reg2, 1.83
+	wrhx dacr, -0.03
+	wrax dacr, 0
+	rdax adcl, 1.0
+	wrlx reg3, 0.5
+	wrhx reg4, -0.7
+	wrhx reg5, 0.3
+	wrax dacl, 0
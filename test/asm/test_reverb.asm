@@ -0,0 +1,115 @@
+; Reverb-ish program that exercises most opcodes (used to compare engines)
+mem ap1 156
+mem ap2 223
+mem ap3 332
+mem ap4 548
+mem dap1a 2187
+mem dap1b 2989
+mem del1 3500
+mem dap2a 2693
+mem dap2b 2176
+mem del2 4256
+mem temp 1
+equ krt reg0
+equ kap reg1
+equ apout reg2
+equ lp1 reg3
+equ lp2 reg4
+equ hp1 reg5
+equ tmp reg6
+	skp run, start
+	wlds sin0, 12, 100
+	wldr rmp0, 100, 4096
+start:
+	rdax pot0, 0.7
+	sof 0.7, 0.25
+	wrax krt, 0
+	rdax adcl, 0.25
+	rdax adcr, 0.25
+	rda ap1#, 0.6
+	wrap ap1, -0.6
+	rda ap2#, 0.6
+	wrap ap2, -0.6
+	rda ap3#, 0.6
+	wrap ap3, -0.6
+	rda ap4#, 0.6
+	wrap ap4, -0.6
+	wrax apout, 0
+	rda del2#, 1.0
+	mulx krt
+	rdax apout, 1.0
+	rda dap1a#, 0.6
+	wrap dap1a, -0.6
+	rda dap1b#, 0.6
+	wrap dap1b, -0.6
+	rdfx lp1, 0.3
+	wrlx lp1, -1.0
+	rdfx hp1, 0.01
+	wrhx hp1, -0.5
+	wra del1, 0
+	rda del1#, 1.0
+	mulx krt
+	rdax apout, 1.0
+	rda dap2a#, 0.6
+	wrap dap2a, -0.6
+	rda dap2b#, 0.6
+	wrap dap2b, -0.6
+	rdfx lp2, 0.3
+	wrlx lp2, -1.0
+	wra del2, 0
+	rda del1, 0.8
+	rda del2+1000, 0.6
+	wrax tmp, 1.0
+	wrax dacl, 0
+	rda del2, 0.8
+	rda del1+1500, 0.6
+	rdax tmp, -0.5
+	sof -2.0, 0
+	sof 1.0, 0
+	sof 0.5, 0.1
+	sof -1.0, 0
+	wrax dacr, 0
+	cho rda, sin0, sin|reg|compc, ap4+50
+	cho rda, sin0, sin, ap4+51
+	wra temp, 0
+	cho rda, rmp0, reg|compc, del1
+	cho rda, rmp0, 0, del1+1
+	cho rda, rmp0, rptr2|compc, del1
+	cho rda, rmp0, rptr2, del1+1
+	cho sof, rmp0, na|compc, 0.0
+	cho rda, rmp0, na, temp
+	rdax dacr, 0.5
+	wrax dacr, 0
+	rdax adcl, 1.0
+	skp zrc, z1
+	sof 1.0, 0.01
+z1:	skp neg, n1
+	sof -1.0, 0
+n1:	maxx reg7, 0.5
+	wrax reg7, 0.99
+	and 0x7ffff0
+	or 0x10
+	xor 0x5
+	absa
+	wrax reg8, 0
+	ldax pot1
+	mulx adcr
+	wrax reg9, 0
+	rdax reg9, 1.0
+	wrhx reg10, 0.5
+	wrlx reg11, -0.5
+	wrax reg12, 0
+	cho rdal, sin0
+	wrax reg13, 0
+	cho rdal, rmp0
+	wrax reg14, 0
+	clr
+	or 0x100 << 8
+	rdax reg14, 0.001
+	wrax addr_ptr, 0
+	rmpa 0.7
+	rdax reg12, 1.0
+	sof 0.5, 0
+	wrax reg15, 0
+	cho sof, sin0, cos|compa, 0.25
+	wrax reg16, 0
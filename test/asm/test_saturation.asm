@@ -0,0 +1,24 @@
+; Results that can or can't leave the S.23 range depending on the inputs. ACC is clear at the end
+; of the frame, and only the full-scale inputs and the jump target make the ranges unknown again.
+mem delay 100
+
+	rdax adcl, 0.5
+	sof 0.25, 0
+	rdax adcr, 0.5
+	rdax adcl, 0.75
+	wrax reg0, 0
+	rdax reg0, 0.5
+	mulx pot0
+	sof -2.0, 0.1
+	wrax reg1, 1.5
+	rdfx reg1, 0.5
+	clr
+	rda delay, 0.75
+	rda delay+10, 0.75
+	wrax dacl, 0
+	ldax adcl
+	skp neg, target
+	clr
+target:
+	rdax adcr, 0.5
+	wrax dacr, 0
@@ -0,0 +1,18 @@
+; Micro-op IR: constant folding, CSE and dead code
+	sof 0, 0.5
+	sof 0.5, 0
+	wrax reg0, 0
+	cho rdal, sin0
+	wrax reg1, 1.0
+	cho rdal, sin0
+	wrax reg2, 0
+	rdax adcl, 0.5
+	wrax reg3, 1.0
+	ldax reg3
+	rdax reg4, 0
+	wrax dacl, 0
+	skp zro, zero
+	sof 0, 0.125
+zero:
+	or 0x100
+	wrax dacr, 0
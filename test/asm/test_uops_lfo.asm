@@ -0,0 +1,9 @@
+; CHO RDAL before and after a write to the LFO range: the second read can't reuse the first
+	skp run, start
+	wlds sin0, 100, 16384
+start:
+	cho rdal, sin0
+	wrax dacl, 1.0
+	wrax sin0_range, 1.0
+	cho rdal, sin0
+	wrax dacr, 0
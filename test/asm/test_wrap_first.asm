@@ -0,0 +1,6 @@
+; WRAP before any RDA in the frame, i.e. with the last read of the previous frame
+	ldax adcl
+	wrap 1000, 0.5
+	wrax dacl, 0
+	rda 2000, 1.0
+	wrax dacr, 0
@@ -0,0 +1,118 @@
+// fv1vm: experimental FV-1 virtual machine
+// Copyright (C) 2022 Patrick Dowling <pld@gurkenkiste.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// Built by 'make superops_check' against a copy of the sources with a generated superinstruction
+// table (the table is compiled in, so the other binaries only have the committed one).
+//
+// Runs each program on the command line with and without PASS_SUPEROPS in every dispatch mode and
+// compares the output and registers. Fails if anything differs, or if nothing was fused at all.
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#include "misc/program_stream.h"
+#include "vm/engines/delay_i32.h"
+#include "vm/engines/engine_i32_v1.h"
+#include "vm/vm.h"
+
+using fv1::BinaryProgramBuffer;
+using VM = fv1::VM<fv1::engine::EngineI32, fv1::engine::DelayStorageI32>;
+using AudioFrame = VM::AudioFrame;
+
+// Long enough for every delay memory cell to be written and read back, like ExpectBitExact
+static constexpr size_t kNumFrames = fv1::kDelayMemorySize + 4096;
+static constexpr size_t kBlockSizes[] = {32, 7, 1, 45, 100, 8, 13, 64, 31, 33, 256, 2};
+
+struct Instance {
+  std::unique_ptr<VM::DelayMemoryBuffer> delay_memory = std::make_unique<VM::DelayMemoryBuffer>();
+  std::unique_ptr<VM> vm = std::make_unique<VM>(*delay_memory);
+  std::unique_ptr<VM::PackedPrograms> packed = std::make_unique<VM::PackedPrograms>();
+};
+
+static bool Check(const char *path, const BinaryProgramBuffer &program, VM::Dispatch dispatch,
+                  uint32_t &fused)
+{
+  Instance expected, actual;
+  fv1::BufferStream<fv1::BSWAP_ENABLE> expected_stream{program.data()};
+  expected.vm->Compile(expected_stream, VM::passes(VM::OptLevel::O2));
+  fv1::BufferStream<fv1::BSWAP_ENABLE> actual_stream{program.data()};
+  actual.vm->Compile(actual_stream,
+                     VM::passes(VM::OptLevel::O2) | VM::pass_mask(VM::PASS_SUPEROPS));
+  fused += actual.vm->optimizer_report()[VM::PASS_SUPEROPS].rewritten;
+  expected.vm->set_dispatch(dispatch);
+  actual.vm->set_dispatch(dispatch);
+  for (auto *instance : {&expected, &actual})
+    instance->vm->set_packed_programs(instance->packed.get());
+
+  std::vector<AudioFrame> block_in, expected_out, actual_out;
+  VM::Parameters pots;
+  int32_t t = 0;
+  for (size_t b = 0; static_cast<size_t>(t) < kNumFrames; ++b) {
+    const size_t block_size = kBlockSizes[b % std::size(kBlockSizes)];
+    block_in.resize(block_size);
+    expected_out.resize(block_size);
+    actual_out.resize(block_size);
+    for (auto &frame : block_in) {
+      frame = {((t * 4099) & 0xffffff) - 0x800000, ((t * 997) & 0xfffff) - 0x80000};
+      ++t;
+    }
+    pots.pots[0] = (t & 0x3ff) << 13;
+    pots.pots[1] = (t & 0x7f) << 16;
+    pots.pots[2] = ((t >> 7) & 0xff) << 15;
+    for (auto *instance : {&expected, &actual}) instance->vm->SetParameters(pots);
+    expected.vm->Execute(block_in.data(), expected_out.data(), block_size);
+    actual.vm->Execute(block_in.data(), actual_out.data(), block_size);
+    for (size_t i = 0; i < block_size; ++i) {
+      if (expected_out[i].l != actual_out[i].l || expected_out[i].r != actual_out[i].r) {
+        fprintf(stderr, "%s dispatch %d: t=%d frame %zu differs\n", path,
+                static_cast<int>(dispatch), t, i);
+        return false;
+      }
+    }
+  }
+  // ADCR isn't stored without FEATURE_STEREO
+  for (size_t r = 0; r < fv1::kNumRegisters; ++r) {
+    if (fv1::ADCR == r) continue;
+    if (expected.vm->state().registers_[r].loadi() != actual.vm->state().registers_[r].loadi()) {
+      fprintf(stderr, "%s dispatch %d: register %zu differs\n", path, static_cast<int>(dispatch),
+              r);
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  uint32_t fused = 0;
+  for (int i = 1; i < argc; ++i) {
+    BinaryProgramBuffer program;
+    FILE *f = fopen(argv[i], "rb");
+    if (!f || program.size() != fread(program.data(), 1, program.size(), f)) {
+      fprintf(stderr, "Failed to read '%s'\n", argv[i]);
+      if (f) fclose(f);
+      return EXIT_FAILURE;
+    }
+    fclose(f);
+    for (auto dispatch : {VM::Dispatch::SWITCH, VM::Dispatch::THREADED, VM::Dispatch::PACKED}) {
+      if (!Check(argv[i], program, dispatch, fused)) return EXIT_FAILURE;
+    }
+  }
+  printf("%zu superinstructions, %u fused\n", fv1::kNumSuperops, fused);
+  return fv1::kNumSuperops && fused ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,147 @@
+// fv1vm: experimental FV-1 virtual machine
+// Copyright (C) 2022 Patrick Dowling <pld@gurkenkiste.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <gtest/gtest.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <dlfcn.h>
+#include <stdlib.h>
+#endif
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "test_vm.h"
+#include "vm/codegen/cpp_generator.h"
+
+namespace fv1tests {
+
+using TestCodegen = TestVMImpl<fv1::engine::EngineI32, fv1::engine::DelayStorageI32, 1>;
+using namespace fv1;
+using codegen::CppGenerator;
+
+static bool contains(const std::string &s, const char *what)
+{
+  return std::string::npos != s.find(what);
+}
+
+TEST_F(TestCodegen, Program)
+{
+  Compile("test_chorda_rmp.bin");
+  auto code = CppGenerator::Program(vm_, "test_chorda_rmp");
+
+  EXPECT_TRUE(contains(code, "void test_chorda_rmp(Runtime &runtime,"));
+  // skp RUN, start
+  EXPECT_TRUE(contains(code, "bool skip = !state.first_run;"));
+  EXPECT_TRUE(contains(code, "goto L2;"));
+  EXPECT_TRUE(contains(code, "  L2:\n"));
+  // Only RMP0 is read
+  EXPECT_TRUE(contains(code, "runtime.Tick<Runtime::LFO_RMP0>();"));
+  // I/O and program registers are locals
+  EXPECT_TRUE(contains(code, "Register r20 = registers[20];  // ADCL"));
+  EXPECT_TRUE(contains(code, "r22.read(out->l);"));
+  EXPECT_FALSE(contains(code, "end_of_program"));
+}
+
+TEST_F(TestCodegen, NoLfo)
+{
+  Compile("test_register_fx.bin");
+  auto code = CppGenerator::Program(vm_, "test_register_fx");
+
+  EXPECT_TRUE(contains(code, "runtime.Tick<0>();"));
+  EXPECT_FALSE(contains(code, "goto"));
+}
+
+TEST_F(TestCodegen, Bytecode)
+{
+  Compile("test_chorda_rmp.bin");
+  auto code = CppGenerator::Bytecode(vm_, "test_chorda_rmp");
+
+  EXPECT_TRUE(contains(code, "Runtime::VM::CompiledInstruction test_chorda_rmp_init[] = {"));
+  EXPECT_TRUE(contains(code, "Runtime::VM::PrecompiledProgram test_chorda_rmp = {"));
+  // wldr RMP0 in the init program only
+  EXPECT_TRUE(contains(code, "    {OPCODE{0x24}, {Engine::Constant{0}, "));
+  EXPECT_EQ(code.find("OPCODE{0x24}"), code.rfind("OPCODE{0x24}"));
+  // No hoisted instructions
+  EXPECT_TRUE(contains(code, "{nullptr, 0}};"));
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+
+// The functions of all test programs are built into a shared object with the system compiler, and
+// run as the VM's native program against the interpreter.
+TEST_F(TestCodegen, BitExact)
+{
+  const auto programs = AllTestPrograms();
+  ASSERT_FALSE(programs.empty());
+  std::string code = CppGenerator::Preamble();
+  std::string table;
+  for (size_t p = 0; p < programs.size(); ++p) {
+    Compile(programs[p]);
+    const auto name = "test_program_" + std::to_string(p);
+    code += CppGenerator::Program(vm_, name);
+    table += "    " + name + ",\n";
+  }
+  code += "extern \"C\" const Runtime::ProgramFn test_programs[];\n";
+  code += "const Runtime::ProgramFn test_programs[] = {\n" + table + "};\n";
+
+  char directory[] = "/tmp/fv1_codegen_XXXXXX";
+  ASSERT_NE(nullptr, mkdtemp(directory));
+  const std::string scratch{directory};
+  const auto source = scratch + "/programs.cc";
+  const auto object = scratch + "/programs.so";
+  const auto log = scratch + "/log.txt";
+  std::ofstream{source} << code;
+
+  std::string command = "c++ -std=c++17 -O1 -shared -fPIC -I./src -o " + object + " " + source;
+  if (std::system((command + " > " + log + " 2>&1").c_str())) {
+    std::ifstream file{log};
+    std::stringstream output;
+    output << file.rdbuf();
+    ADD_FAILURE() << command << "\n" << output.str();
+  }
+
+  auto handle = dlopen(object.c_str(), RTLD_NOW | RTLD_LOCAL);
+  EXPECT_NE(nullptr, handle) << dlerror();
+  auto functions =
+      handle ? static_cast<const VM::NativeProgramFn *>(dlsym(handle, "test_programs")) : nullptr;
+  EXPECT_NE(nullptr, functions);
+  for (size_t p = 0; functions && p < programs.size(); ++p) {
+    const auto name = programs[p].path + "@" + std::to_string(programs[p].offset);
+    Compile(programs[p]);
+    auto &reference = CompileReference();
+    vm_.set_native_program(functions[p]);
+    ExpectBitExact(name, Execute(reference), Execute(vm_));
+    // Registers are visible outside the program, ADCR isn't stored without FEATURE_STEREO
+    for (size_t r = 0; r < kNumRegisters; ++r) {
+      if (ADCR == r) continue;
+      EXPECT_EQ(reference.state().registers_[r].loadi(), vm_.state().registers_[r].loadi())
+          << name << " register " << r;
+    }
+  }
+
+  vm_.set_native_program(nullptr);
+  if (handle) dlclose(handle);
+  std::error_code ec;
+  std::filesystem::remove_all(scratch, ec);
+}
+
+#endif
+
+}  // namespace fv1tests
@@ -0,0 +1,138 @@
+// fv1vm: experimental FV-1 virtual machine
+// Copyright (C) 2022 Patrick Dowling <pld@gurkenkiste.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "test_vm.h"
+#include "vm/engines/delay_i32.h"
+#include "vm/engines/engine_i32_v1.h"
+#include "vm/jit/jit_x64.h"
+
+namespace fv1tests {
+
+using TestJitX64 = TestVMImpl<fv1::engine::EngineI32, fv1::engine::DelayStorageI32, 7>;
+using namespace fv1;
+
+static constexpr int kNumBlocks = 64;
+
+#ifdef FV1_JIT_X64
+
+TEST_F(TestJitX64, BitExact)
+{
+  const auto programs = AllTestPrograms();
+  ASSERT_FALSE(programs.empty());
+  for (const auto &test_program : programs) {
+    const auto program = test_program.path + "@" + std::to_string(test_program.offset);
+    // Inputs depend only on the frame number, so both runs see the same data
+    auto run = [&](auto &&execute, int block) {
+      for (int i = 0; i < static_cast<int>(kNumFrames); ++i) {
+        int32_t n = block * static_cast<int32_t>(kNumFrames) + i;
+        in[i] = {SF23::MAX - n * 4096, SF23::MIN + n * 2048};
+      }
+      params.pots[0] = (block * 64) & SF23::MAX;
+      params.pots[1] = SF23::MAX - ((block * 256) & SF23::MAX);
+      vm_.SetParameters(params);
+      execute();
+    };
+
+    std::vector<VM::AudioFrame> expected;
+    std::vector<std::array<int32_t, kNumRegisters>> expected_registers;
+    Compile(test_program);
+    for (int block = 0; block < kNumBlocks; ++block) {
+      run([&]() { vm_.Execute(in, out, kNumFrames); }, block);
+      expected.insert(expected.end(), out, out + kNumFrames);
+      auto &registers = expected_registers.emplace_back();
+      for (size_t r = 0; r < kNumRegisters; ++r) registers[r] = vm_.state().registers_[r].loadi();
+    }
+
+    Compile(test_program);
+    jit::JitEngine jit{vm_};
+    ASSERT_TRUE(jit.Compile()) << program;
+    EXPECT_GT(jit.code_size(), 0U);
+    for (int block = 0; block < kNumBlocks; ++block) {
+      run([&]() { jit.Execute(in, out, kNumFrames); }, block);
+      for (size_t i = 0; i < kNumFrames; ++i)
+        ASSERT_EQ(expected[block * kNumFrames + i], out[i]) << program << " block " << block;
+      for (size_t r = 0; r < kNumRegisters; ++r)
+        ASSERT_EQ(expected_registers[block][r], vm_.state().registers_[r].loadi())
+            << program << " block " << block << " register " << r;
+    }
+  }
+}
+
+// The VM state is shared, so switching between the JIT and the interpreter is seamless
+TEST_F(TestJitX64, Interleaved)
+{
+  std::vector<VM::AudioFrame> expected;
+  Compile("test_reverb.bin");
+  for (int block = 0; block < kNumBlocks; ++block) {
+    for (size_t i = 0; i < kNumFrames; ++i) in[i] = {static_cast<int32_t>(i) << 16, block << 12};
+    vm_.Execute(in, out, kNumFrames);
+    expected.insert(expected.end(), out, out + kNumFrames);
+  }
+
+  Compile("test_reverb.bin");
+  jit::JitEngine jit{vm_};
+  ASSERT_TRUE(jit.Compile());
+  for (int block = 0; block < kNumBlocks; ++block) {
+    for (size_t i = 0; i < kNumFrames; ++i) in[i] = {static_cast<int32_t>(i) << 16, block << 12};
+    if (block & 1)
+      vm_.Execute(in, out, kNumFrames);
+    else
+      jit.Execute(in, out, kNumFrames);
+    for (size_t i = 0; i < kNumFrames; ++i)
+      ASSERT_EQ(expected[block * kNumFrames + i], out[i]) << "block " << block;
+  }
+}
+
+// Loading a precompiled program leaves nothing to compile, so it doesn't run the program compiled
+// before
+TEST_F(TestJitX64, Precompiled)
+{
+  Compile("test_copy.bin");
+  auto init = std::make_unique<VM::Program>(vm_.init_program());
+  auto steady = std::make_unique<VM::Program>(vm_.steady_program());
+  const VM::PrecompiledProgram precompiled{vm_.features(), init->view(), steady->view(), {}};
+
+  Compile("test_inv.bin");
+  vm_.Load(precompiled);
+  jit::JitEngine jit{vm_};
+  EXPECT_FALSE(jit.Compile());
+  for (size_t i = 0; i < kNumFrames; ++i)
+    in[i] = {SF23::MAX - static_cast<int32_t>(i) * 4096, SF23::MIN + static_cast<int32_t>(i)};
+  jit.Execute(in, out, kNumFrames);
+  for (size_t i = 0; i < kNumFrames; ++i) EXPECT_EQ(in[i], out[i]) << "frame " << i;
+}
+
+#else
+
+TEST_F(TestJitX64, Fallback)
+{
+  Compile("test_inv.bin");
+  jit::JitEngine jit{vm_};
+  EXPECT_FALSE(jit.Compile());
+  jit.Execute(in, out, 1);
+  EXPECT_FALSE(vm_.state().first_run);
+}
+
+#endif
+
+}  // namespace fv1tests
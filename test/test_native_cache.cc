@@ -0,0 +1,153 @@
+// fv1vm: experimental FV-1 virtual machine
+// Copyright (C) 2022 Patrick Dowling <pld@gurkenkiste.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+#include "test_vm.h"
+#include "vm/codegen/native_cache.h"
+
+namespace fv1tests {
+
+using TestNativeCache = TestVMImpl<fv1::engine::EngineI32, fv1::engine::DelayStorageI32, 16>;
+using namespace fv1;
+using codegen::NativeCache;
+
+#ifdef FV1_NATIVE_CACHE
+
+// Each test uses a new cache directory that's removed afterwards. The name has a quote and a space
+// since the paths are passed to the compiler.
+struct TestCache {
+  NativeCache::Options options;
+
+  TestCache()
+  {
+    char directory[] = "/tmp/fv1 native'cache_XXXXXX";
+    options.directory = mkdtemp(directory);
+  }
+  ~TestCache() { std::filesystem::remove_all(options.directory); }
+};
+
+TEST_F(TestNativeCache, BitExact)
+{
+  TestCache test_cache;
+  NativeCache cache{test_cache.options};
+
+  const auto programs = AllTestPrograms();
+  ASSERT_FALSE(programs.empty());
+  for (const auto &program : programs) {
+    const auto name = program.path + "@" + std::to_string(program.offset);
+    Compile(program);
+    auto &reference = CompileReference();
+    ASSERT_TRUE(cache.Compile(vm_, buffer_.data())) << name;
+    EXPECT_NE(nullptr, vm_.native_program());
+    ExpectBitExact(name, Execute(reference), Execute(vm_));
+    // Registers are visible outside the program, ADCR isn't stored without FEATURE_STEREO
+    for (size_t r = 0; r < kNumRegisters; ++r) {
+      if (ADCR == r) continue;
+      EXPECT_EQ(reference.state().registers_[r].loadi(), vm_.state().registers_[r].loadi())
+          << name << " register " << r;
+    }
+  }
+  EXPECT_EQ(0U, cache.hits());
+  EXPECT_EQ(programs.size(), cache.misses());
+
+  // Seen before
+  ASSERT_TRUE(cache.Compile(vm_, buffer_.data()));
+  EXPECT_EQ(1U, cache.hits());
+
+  // Compile clears the native program
+  Compile("test_inv.bin");
+  EXPECT_EQ(nullptr, vm_.native_program());
+}
+
+// The objects inline the runtime headers, so changing those has to change the key
+TEST_F(TestNativeCache, Key)
+{
+  TestCache test_cache;
+  test_cache.options.include_dir = test_cache.options.directory;
+  auto write_header = [&](const char *contents) {
+    FILE *f = fopen((test_cache.options.include_dir + "/runtime.h").c_str(), "w");
+    ASSERT_NE(nullptr, f);
+    fputs(contents, f);
+    fclose(f);
+  };
+
+  Compile("test_reverb.bin");
+  const auto code = NativeCache::Source(vm_);
+  write_header("struct Runtime { int a; };\n");
+  NativeCache cache{test_cache.options};
+  const auto key = cache.Hash(code);
+  EXPECT_EQ(key, cache.Hash(code));
+  EXPECT_EQ(key, NativeCache{test_cache.options}.Hash(code));
+
+  // The headers are read when the cache is constructed
+  write_header("struct Runtime { int a, b; };\n");
+  EXPECT_EQ(key, cache.Hash(code));
+  EXPECT_NE(key, NativeCache{test_cache.options}.Hash(code));
+
+  Compile("test_inv.bin");
+  EXPECT_NE(cache.Hash(code), cache.Hash(NativeCache::Source(vm_)));
+}
+
+// The source is generated from the compiled program, which a precompiled one replaces
+TEST_F(TestNativeCache, Precompiled)
+{
+  Compile("test_copy.bin");
+  auto init = std::make_unique<VM::Program>(vm_.init_program());
+  auto steady = std::make_unique<VM::Program>(vm_.steady_program());
+  const VM::PrecompiledProgram precompiled{vm_.features(), init->view(), steady->view(), {}};
+
+  Compile("test_inv.bin");
+  const auto compiled = NativeCache::Source(vm_);
+  vm_.Load(precompiled);
+  const auto loaded = NativeCache::Source(vm_);
+  EXPECT_NE(compiled, loaded);
+  Compile("test_reverb.bin");
+  vm_.Load(precompiled);
+  EXPECT_EQ(loaded, NativeCache::Source(vm_));
+
+  // Same for the interpreter programs
+  auto buffer = std::make_unique<VM::DelayMemoryBuffer>();
+  VM::Context context{*buffer};
+  context.Reset();
+  EXPECT_EQ(0U, vm_.compiled_program().steady.length);
+  in[0] = {SF23::MAX, SF23::MIN};
+  for (auto dispatch : {VM::Dispatch::SWITCH, VM::Dispatch::THREADED, VM::Dispatch::PACKED}) {
+    VM::Execute(vm_.compiled_program(), context, dispatch, in, out, 1);
+    EXPECT_EQ(0, out[0].l);
+  }
+}
+
+TEST_F(TestNativeCache, Fallback)
+{
+  TestCache test_cache;
+  test_cache.options.compiler = "false";
+  NativeCache cache{test_cache.options};
+
+  Compile("test_inv.bin");
+  EXPECT_FALSE(cache.Compile(vm_, buffer_.data()));
+  EXPECT_EQ(nullptr, vm_.native_program());
+  vm_.Execute(in, out, 1);
+  EXPECT_FALSE(vm_.state().first_run);
+}
+
+#endif
+
+}  // namespace fv1tests
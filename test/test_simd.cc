@@ -0,0 +1,101 @@
+// fv1vm: experimental FV-1 virtual machine
+// Copyright (C) 2022 Patrick Dowling <pld@gurkenkiste.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <vector>
+
+#include "test_vm.h"
+#include "vm/simd/multi_instance.h"
+
+namespace fv1tests {
+
+using TestSimd = TestVMImpl<fv1::engine::EngineI32, fv1::engine::DelayStorageI32, 16>;
+using namespace fv1;
+
+static constexpr int kNumBlocks = 32;
+
+template <size_t lanes>
+static void CheckLanes(TestSimd::VM &vm, const char *program, const BinaryProgramBuffer &buffer)
+{
+  using MultiInstance = simd::MultiInstance<lanes>;
+  using AudioFrame = typename MultiInstance::AudioFrame;
+  static constexpr size_t kNumFrames = 16;
+
+  // Every lane gets different input and pots, so SKP conditions diverge
+  auto input = [](size_t lane, int block, size_t i) {
+    auto phase = static_cast<int32_t>((block * kNumFrames + i) * (lane + 1) * 997) & 0xffff;
+    return AudioFrame{(phase << 8) - 0x800000, static_cast<int32_t>(lane) << 19};
+  };
+  auto parameters = [](size_t lane, int block) {
+    typename MultiInstance::Parameters params;
+    params.pots[0] = static_cast<int32_t>((lane * 3 + static_cast<size_t>(block)) & 0xf) << 19;
+    params.pots[1] = static_cast<int32_t>(lane) << 20;
+    return params;
+  };
+
+  // Reference, one lane at a time
+  std::vector<AudioFrame> expected(kNumBlocks * kNumFrames * lanes);
+  std::vector<std::array<int32_t, kNumRegisters>> expected_registers(lanes);
+  for (size_t lane = 0; lane < lanes; ++lane) {
+    BufferStream<BSWAP_ENABLE> stream{buffer.data()};
+    vm.Compile(stream);
+    for (int block = 0; block < kNumBlocks; ++block) {
+      AudioFrame in[kNumFrames], out[kNumFrames];
+      for (size_t i = 0; i < kNumFrames; ++i) in[i] = input(lane, block, i);
+      vm.SetParameters(parameters(lane, block));
+      vm.Execute(in, out, kNumFrames);
+      for (size_t i = 0; i < kNumFrames; ++i)
+        expected[(block * kNumFrames + i) * lanes + lane] = out[i];
+    }
+    for (size_t r = 0; r < kNumRegisters; ++r)
+      expected_registers[lane][r] = vm.state().registers_[r].loadi();
+  }
+
+  auto delay_memory = std::make_unique<typename MultiInstance::DelayMemoryBuffer>();
+  auto multi = std::make_unique<MultiInstance>(vm, *delay_memory);
+  std::vector<AudioFrame> in(kNumFrames * lanes), out(kNumFrames * lanes);
+  for (int block = 0; block < kNumBlocks; ++block) {
+    for (size_t lane = 0; lane < lanes; ++lane) {
+      for (size_t i = 0; i < kNumFrames; ++i) in[i * lanes + lane] = input(lane, block, i);
+      multi->SetParameters(lane, parameters(lane, block));
+    }
+    multi->Execute(in.data(), out.data(), kNumFrames);
+    for (size_t i = 0; i < kNumFrames * lanes; ++i) {
+      ASSERT_EQ(expected[block * kNumFrames * lanes + i], out[i])
+          << program << " block " << block << " lane " << i % lanes;
+    }
+  }
+  for (size_t lane = 0; lane < lanes; ++lane) {
+    for (size_t r = 0; r < kNumRegisters; ++r)
+      ASSERT_EQ(expected_registers[lane][r], multi->load_register(lane, r))
+          << program << " lane " << lane << " register " << r;
+  }
+}
+
+TEST_F(TestSimd, BitExact)
+{
+  for (auto program : {"test_reverb.bin", "test_chorda_rmp.bin", "test_cho_rdal.bin",
+                       "test_skp_run.bin", "test_rmpa.bin", "test_mask.bin",
+                       "test_register_fx.bin", "test_registers.bin"}) {
+    Compile(program);
+    CheckLanes<8>(vm_, program, buffer_);
+    CheckLanes<4>(vm_, program, buffer_);
+  }
+}
+
+}  // namespace fv1tests
@@ -21,6 +21,13 @@
 #include <gtest/gtest.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
 #include "fv1/debug/fv1_debug.h"
 #include "misc/program_stream.h"
 #include "vm/vm.h"
@@ -61,21 +68,107 @@ protected:
   typename VM::AudioFrame out[kNumFrames];
   typename VM::Parameters params;
 
-  void Compile(const char *filename)
+  void Compile(const char *filename, uint32_t passes = VM::passes(VM::OptLevel::O2))
   {
-    static const std::string ROOT_PATH{"./build/tests/"};
-    std::string path = ROOT_PATH + filename;
+    Compile(TestProgram{kTestProgramPath + filename, 0}, passes);
+  }
+
+  // A program in a single program .bin or a bank
+  struct TestProgram {
+    std::string path;
+    size_t offset = 0;
+  };
 
+  void Compile(const TestProgram &program, uint32_t passes = VM::passes(VM::OptLevel::O2))
+  {
     using namespace fv1;
-    int fd = open(path.c_str(), O_RDONLY);
-    ASSERT_GE(fd, 0) << path;
-    auto bytes_read = read(fd, buffer_.data(), buffer_.size());
+    int fd = open(program.path.c_str(), O_RDONLY);
+    ASSERT_GE(fd, 0) << program.path;
+    auto bytes_read = pread(fd, buffer_.data(), buffer_.size(), (off_t)program.offset);
     close(fd);
-    ASSERT_EQ(bytes_read, (ssize_t)buffer_.size());
+    ASSERT_EQ(bytes_read, (ssize_t)buffer_.size()) << program.path;
 
     BufferStream<BSWAP_ENABLE> stream{buffer_.data()};
-    vm_.Compile(stream);
+    vm_.Compile(stream, passes);
   }
+
+  // All assembled test programs, and the programs of the wav_tests bank if it's been built
+  static std::vector<TestProgram> AllTestPrograms()
+  {
+    std::vector<TestProgram> programs;
+    for (const auto &entry : std::filesystem::directory_iterator{kTestProgramPath}) {
+      if (".bin" == entry.path().extension()) programs.push_back({entry.path().string(), 0});
+    }
+    std::sort(programs.begin(), programs.end(),
+              [](const auto &lhs, const auto &rhs) { return lhs.path < rhs.path; });
+    if (std::filesystem::exists(kWavTestsBankPath)) {
+      for (size_t p = 0; p < 8; ++p) programs.push_back({kWavTestsBankPath, p * 512});
+    }
+    return programs;
+  }
+  static inline const std::string kTestProgramPath{"./build/tests/"};
+  static inline const std::string kWavTestsBankPath{"./banks/wav_tests/build/wav_tests.bank"};
+
+  // A second VM to compare vm_ against, with the program of the last Compile
+  VM &CompileReference(uint32_t passes = VM::passes(VM::OptLevel::O2))
+  {
+    if (!reference_) {
+      reference_delay_memory_ = std::make_unique<typename VM::DelayMemoryBuffer>();
+      reference_ = std::make_unique<VM>(*reference_delay_memory_);
+    }
+    fv1::BufferStream<fv1::BSWAP_ENABLE> stream{buffer_.data()};
+    reference_->Compile(stream, passes);
+    return *reference_;
+  }
+
+  // For ExpectBitExact
+  using ExecuteFn = std::function<void(const typename VM::Parameters &,
+                                       const typename VM::AudioFrame *,
+                                       typename VM::AudioFrame *, size_t)>;
+  static ExecuteFn Execute(VM &vm)
+  {
+    return [&vm](const typename VM::Parameters &pots, const typename VM::AudioFrame *block_in,
+                 typename VM::AudioFrame *block_out, size_t block_size) {
+      vm.SetParameters(pots);
+      vm.Execute(block_in, block_out, block_size);
+    };
+  }
+
+  // Runs the same input through both in blocks of varying size, with the pots changing between
+  // blocks, and compares the outputs. It's long enough for every delay memory cell to be written
+  // and read back, e.g. the taps at the end of the delay lines in test_reverb.
+  void ExpectBitExact(const std::string &name, const ExecuteFn &expected_fn,
+                      const ExecuteFn &actual_fn, size_t total_frames = kBitExactFrames)
+  {
+    using AudioFrame = typename VM::AudioFrame;
+    static constexpr size_t kBlockSizes[] = {32, 7, 1, 45, 100, 8, 13, 64, 31, 33, 256, 2};
+    std::vector<AudioFrame> block_in, expected, actual;
+    typename VM::Parameters pots;
+    int32_t t = 0;
+    for (size_t b = 0; static_cast<size_t>(t) < total_frames; ++b) {
+      const size_t block_size = kBlockSizes[b % std::size(kBlockSizes)];
+      block_in.resize(block_size);
+      expected.resize(block_size);
+      actual.resize(block_size);
+      for (auto &frame : block_in) {
+        frame = {((t * 4099) & 0xffffff) - 0x800000, ((t * 997) & 0xfffff) - 0x80000};
+        ++t;
+      }
+      pots.pots[0] = (t & 0x3ff) << 13;
+      pots.pots[1] = (t & 0x7f) << 16;
+      pots.pots[2] = ((t >> 7) & 0xff) << 15;
+
+      expected_fn(pots, block_in.data(), expected.data(), block_size);
+      actual_fn(pots, block_in.data(), actual.data(), block_size);
+      for (size_t i = 0; i < block_size; ++i)
+        ASSERT_EQ(expected[i], actual[i]) << name << " t=" << t << " frame " << i;
+    }
+  }
+  static constexpr size_t kBitExactFrames = fv1::kDelayMemorySize + 4096;
+
+private:
+  std::unique_ptr<typename VM::DelayMemoryBuffer> reference_delay_memory_;
+  std::unique_ptr<VM> reference_;
 };
 
 }  // namespace fv1tests
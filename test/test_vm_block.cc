@@ -0,0 +1,116 @@
+// fv1vm: experimental FV-1 virtual machine
+// Copyright (C) 2022 Patrick Dowling <pld@gurkenkiste.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <vector>
+
+#include "test_vm.h"
+#include "vm/engines/delay_i32.h"
+#include "vm/engines/engine_i32_v1.h"
+
+namespace fv1tests {
+
+using TestVMBlock = TestVMImpl<fv1::engine::EngineI32, fv1::engine::DelayStorageI32, 1>;
+using namespace fv1;
+
+TEST_F(TestVMBlock, Analysis)
+{
+  Compile("test_block.bin");
+  const auto &program = vm_.block_program();
+  EXPECT_TRUE(program.enabled);
+  EXPECT_TRUE(program.acc_zero);
+  EXPECT_TRUE(program.reads_delay);
+
+  size_t num_sequential = 0;
+  for (size_t s = 0; s < program.num_segments; ++s)
+    num_sequential += program.segments[s].sequential;
+  EXPECT_GT(num_sequential, 0U);
+  EXPECT_LT(num_sequential, program.num_segments);
+
+  // Skipped after the first run
+  EXPECT_EQ(3U, program.steps[0].ic);
+  EXPECT_TRUE(program.constant_registers & (uint64_t{1} << REG1));
+
+  // LFOs per frame
+  for (auto name : {"test_cho_interp.bin", "test_chorda_rmp.bin", "test_cho_rdal.bin"}) {
+    Compile(name);
+    EXPECT_TRUE(vm_.block_program().enabled) << name;
+    EXPECT_TRUE(vm_.block_program().reads_lfo) << name;
+  }
+  EXPECT_FALSE(vm_.block_program().lfo_reads);
+  Compile("test_chorda_rmp.bin");
+  EXPECT_TRUE(vm_.block_program().lfo_reads);
+
+  // Back-to-back PACC readers
+  Compile("test_pacc.bin");
+  EXPECT_TRUE(vm_.block_program().enabled);
+
+  // Conditional SKP
+  Compile("test_reverb.bin");
+  EXPECT_FALSE(vm_.block_program().enabled);
+  // Address from ADDR_PTR
+  Compile("test_rmpa.bin");
+  EXPECT_FALSE(vm_.block_program().enabled);
+}
+
+// Block execution has to be indistinguishable from the interpreter for any block size
+TEST_F(TestVMBlock, BitExact)
+{
+  auto block_buffer = std::make_unique<VM::BlockBuffer>();
+  vm_.set_block_buffer(block_buffer.get());
+
+  const auto programs = AllTestPrograms();
+  ASSERT_FALSE(programs.empty());
+  for (const auto &program : programs) {
+    const auto name = program.path + "@" + std::to_string(program.offset);
+    Compile(program);
+    auto &reference = CompileReference();
+
+    // The state has to match after every block, not just the output
+    auto execute = [&](const VM::Parameters &pots, const VM::AudioFrame *block_in,
+                       VM::AudioFrame *block_out, size_t block_size) {
+      Execute(vm_)(pots, block_in, block_out, block_size);
+      const auto &expected_state = reference.state();
+      const auto &state = vm_.state();
+      ASSERT_EQ(expected_state.acc_.loadi(), state.acc_.loadi()) << name;
+      ASSERT_EQ(expected_state.pacc_.loadi(), state.pacc_.loadi()) << name;
+      for (size_t r = 0; r < kNumRegisters; ++r) {
+        ASSERT_EQ(expected_state.registers_[r].loadi(), state.registers_[r].loadi())
+            << name << " register " << r;
+      }
+      ASSERT_EQ(reference.delay_memory().last_read(), vm_.delay_memory().last_read()) << name;
+    };
+    ExpectBitExact(name, Execute(reference), execute);
+    if (HasFailure()) return;
+  }
+}
+
+// The CHO RDA addresses sweep past the writes, so some of the blocks fall back to the interpreter
+TEST_F(TestVMBlock, LfoReads)
+{
+  auto block_buffer = std::make_unique<VM::BlockBuffer>();
+  vm_.set_block_buffer(block_buffer.get());
+
+  for (auto program : {"test_cho_interp.bin", "test_chorda_rmp.bin", "test_rmp.bin"}) {
+    Compile(program);
+    ASSERT_TRUE(vm_.block_program().enabled) << program;
+    ExpectBitExact(program, Execute(CompileReference()), Execute(vm_));
+  }
+}
+
+}  // namespace fv1tests
@@ -0,0 +1,157 @@
+// fv1vm: experimental FV-1 virtual machine
+// Copyright (C) 2022 Patrick Dowling <pld@gurkenkiste.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <memory>
+
+#include "test_vm.h"
+#include "vm/engines/delay_f16.h"
+#include "vm/engines/delay_i32.h"
+#include "vm/engines/engine_f32.h"
+#include "vm/engines/engine_i32_v1.h"
+
+namespace fv1tests {
+
+using TestVMF32 = TestVMImpl<fv1::engine::EngineF32, fv1::engine::DelayStorageF16, 64>;
+using TestVMF32NoClip = TestVMImpl<fv1::engine::EngineF32NoClip, fv1::engine::DelayStorageF16, 1>;
+using namespace fv1;
+using engine::DelayStorageF16;
+using engine::EngineF32;
+
+static_assert(sizeof(TestVMF32::VM::DelayMemoryBuffer) == kDelayMemorySize * sizeof(uint16_t));
+
+TEST(DelayStorageF16, Conversion)
+{
+  // Exactly representable
+  for (float f : {0.f, -0.f, 1.f, -1.f, 0.5f, -0.25f, 0.099975586f, 6.1035156e-05f}) {
+    EXPECT_EQ(f, DelayStorageF16::Unpack(DelayStorageF16::Pack(f)));
+    EXPECT_EQ(f, DelayStorageF16::HalfToFloat(DelayStorageF16::FloatToHalf(f)));
+  }
+
+  // Hardware and software conversions agree, including rounding and denormals
+  for (int32_t i = -(1 << 23); i < (1 << 23); i += 97) {
+    const float f = EngineF32::FromS23(i);
+    const auto h = DelayStorageF16::Pack(f);
+    ASSERT_EQ(h, DelayStorageF16::FloatToHalf(f)) << f;
+    ASSERT_EQ(DelayStorageF16::Unpack(h), DelayStorageF16::HalfToFloat(h)) << f;
+    ASSERT_LE(std::fabs(DelayStorageF16::Unpack(h) - f), std::fabs(f) / 2048.f + 3e-8f) << f;
+  }
+}
+
+TEST_F(TestVMF32, sof)
+{
+  Compile("test_sof.bin");
+
+  vm_.Execute(in, out, 1);
+  EXPECT_EQ(0.5f, out[0].l);
+  EXPECT_EQ(-1.f, out[0].r);
+}
+
+// Logical ops work on the S.23 representation
+TEST_F(TestVMF32, mask)
+{
+  Compile("test_mask.bin");
+
+  vm_.Execute(in, out, 1);
+
+  auto &registers = vm_.state().registers_;
+  EXPECT_EQ(registers[REG0].loadi(), 0);
+  EXPECT_EQ(registers[REG1].loadi(), 0xf0f);
+  EXPECT_EQ(registers[REG2].loadi(), SF23::MAX);
+  EXPECT_EQ(registers[REG3].loadi(), SF23::MIN);
+  EXPECT_EQ(registers[REG4].loadi(), -1);
+  EXPECT_EQ(registers[REG5].loadi(), 0x7fffff);
+}
+
+// Value read back from delay memory
+static int32_t RoundTrip(int32_t value)
+{
+  auto f = DelayStorageF16::Unpack(DelayStorageF16::Pack(EngineF32::FromS23(value)));
+  return EngineF32::ToS23(f);
+}
+
+TEST_F(TestVMF32, RegisterFunctions)
+{
+  Compile("test_registers.bin");
+  vm_.Execute(in, out, 1);
+
+  auto &registers = vm_.state().registers_;
+  EXPECT_EQ(registers[REG0].loadi(), 0x3fffff);
+  EXPECT_EQ(registers[REG1].loadi(), 0x1fffff);
+  EXPECT_EQ(registers[REG16].loadi(), 32 << 8);
+  EXPECT_EQ(registers[REG2].loadi(), 0xfffff);
+  EXPECT_EQ(registers[REG4].loadi(), RoundTrip(0x12345));
+  EXPECT_EQ(registers[ADDR_PTR].loadi(), (16384 + 32) << 8);
+  EXPECT_EQ(registers[REG5].loadi(), RoundTrip(0x67890));
+}
+
+TEST_F(TestVMF32, Clip)
+{
+  Compile("test_inv.bin");
+  vm_.Execute(in, out, 1);
+  EXPECT_EQ(-1.f, out[0].l);
+  EXPECT_EQ(EngineF32::MAX, out[0].r);
+}
+
+TEST_F(TestVMF32NoClip, Clip)
+{
+  Compile("test_inv.bin");
+  vm_.Execute(in, out, 1);
+  EXPECT_EQ(-1.f, out[0].l);
+  EXPECT_EQ(2.f, out[0].r);
+}
+
+// Not bit-exact of course, but it should be close to the fixed-point version
+TEST_F(TestVMF32, CompareI32)
+{
+  using ReferenceVM = fv1::VM<engine::EngineI32, engine::DelayStorageI32>;
+  auto reference_delay_memory = std::make_unique<ReferenceVM::DelayMemoryBuffer>();
+  auto reference = std::make_unique<ReferenceVM>(*reference_delay_memory);
+  ReferenceVM::AudioFrame reference_in[kNumFrames];
+  ReferenceVM::AudioFrame reference_out[kNumFrames];
+
+  for (auto program : {"test_reverb.bin", "test_chorda_rmp.bin", "test_register_fx.bin",
+                       "test_coefficients.bin", "test_allpass.bin", "test_filters.bin",
+                       "test_cho_interp.bin", "test_delay_reuse.bin"}) {
+    Compile(program);
+    BufferStream<BSWAP_ENABLE> stream{buffer_.data()};
+    reference->Compile(stream);
+
+    float max_error = 0.f;
+    for (size_t block = 0; block < 64; ++block) {
+      for (size_t i = 0; i < kNumFrames; ++i) {
+        const auto t = static_cast<float>(block * kNumFrames + i);
+        in[i] = {0.5f * std::sin(t * 0.01f), block < 32 ? 0.25f : 0.f};
+        reference_in[i] = {EngineF32::ToS23(in[i].l), EngineF32::ToS23(in[i].r)};
+      }
+      vm_.Execute(in, out, kNumFrames);
+      reference->Execute(reference_in, reference_out, kNumFrames);
+
+      auto error = [](float value, int32_t expected) {
+        return std::fabs(value - EngineF32::FromS23(expected));
+      };
+      for (size_t i = 0; i < kNumFrames; ++i) {
+        max_error = std::max(max_error, error(out[i].l, reference_out[i].l));
+        max_error = std::max(max_error, error(out[i].r, reference_out[i].r));
+      }
+    }
+    EXPECT_LT(max_error, 1e-3f) << program;
+  }
+}
+
+}  // namespace fv1tests
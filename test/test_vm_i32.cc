@@ -16,6 +16,10 @@
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <memory>
+#include <vector>
+
 #include "test_vm.h"
 #include "vm/engines/delay_i32.h"
 #include "vm/engines/engine_i32_v1.h"
@@ -24,6 +28,7 @@ namespace fv1tests {
 
 using TestVMI32 = TestVMImpl<fv1::engine::EngineI32, fv1::engine::DelayStorageI32, 1>;
 using namespace fv1;
+using AudioFrame = TestVMI32::VM::AudioFrame;
 
 TEST_F(TestVMI32, first_run)
 {
@@ -107,7 +112,345 @@ TEST_F(TestVMI32, skp_run)
   EXPECT_EQ(0, out[0].r);
 }
 
-// NOTE Offset is .10 so [-1.0, 1.0)
+TEST_F(TestVMI32, SplitInitProgram)
+{
+  Compile("test_skp_run.bin", VM::passes(VM::OptLevel::O2) & ~VM::pass_mask(VM::PASS_MICROOPS));
+  const auto &init = vm_.init_program();
+  EXPECT_EQ(3U, init.length);
+  EXPECT_EQ(OPCODE::LDAX, init.instructions[0].get_opcode());
+  EXPECT_EQ(OPCODE::CLR, init.instructions[1].get_opcode());
+
+  const auto &steady = vm_.steady_program();
+  EXPECT_EQ(4U, steady.length);
+  EXPECT_EQ(OPCODE::JMP, steady.instructions[1].get_opcode());
+  EXPECT_EQ(1, steady.instructions[1].constants[1].loadi());
+
+  // Init code in front is removed
+  Compile("test_register_fx.bin");
+  EXPECT_EQ(OPCODE::LDAX, vm_.steady_program().instructions[0].get_opcode());
+  // ...and ACC is clear at the end of the frame, so the first RDAX doesn't saturate
+  Compile("test_block.bin");
+  EXPECT_EQ(OPCODE::RDAX_NOSAT, vm_.steady_program().instructions[0].get_opcode());
+}
+
+TEST_F(TestVMI32, CompactProgram)
+{
+  Compile("test_copy.bin");
+  EXPECT_EQ(4U, vm_.init_program().length);
+  EXPECT_EQ(4U, vm_.steady_program().length);
+  EXPECT_EQ(OPCODE::NOP, vm_.steady_program().instructions[4].get_opcode());
+
+  // Jumps over NOPs are adjusted, the last NOP keeps PACC in sync for the next frame
+  Compile("test_skp_jump.bin");
+  EXPECT_EQ(OPCODE::JMP, vm_.steady_program().instructions[1].get_opcode());
+  Compile("test_register_fx.bin");
+  EXPECT_EQ(8U, vm_.steady_program().length);
+  EXPECT_EQ(OPCODE::NOP, vm_.steady_program().instructions[7].get_opcode());
+
+  Compile("test_compact.bin");
+  const auto &program = vm_.steady_program();
+  EXPECT_EQ(11U, program.length);
+  EXPECT_EQ(OPCODE::SKP, program.instructions[1].get_opcode());
+  EXPECT_EQ(1, program.instructions[1].constants[1].loadi());
+  EXPECT_EQ(OPCODE::NOP, program.instructions[5].get_opcode());
+  EXPECT_EQ(OPCODE::WRLX, program.instructions[6].get_opcode());
+  EXPECT_EQ(OPCODE::SKP, program.instructions[7].get_opcode());
+  EXPECT_EQ(1, program.instructions[7].constants[1].loadi());
+}
+
+TEST_F(TestVMI32, OptimizeRegisters)
+{
+  Compile("test_dataflow.bin", VM::passes(VM::OptLevel::O2) & ~VM::pass_mask(VM::PASS_COMPACT) &
+                                   ~VM::pass_mask(VM::PASS_COEFFICIENTS) &
+                                   ~VM::pass_mask(VM::PASS_SATURATION) &
+                                   ~VM::pass_mask(VM::PASS_MICROOPS));
+  const auto &program = vm_.steady_program();
+  auto opcode = [&program](size_t ic) { return program.instructions[ic].get_opcode(); };
+
+  // WRAX REG0, 0; RDAX REG0, 0.5
+  EXPECT_EQ(OPCODE::WRAX, opcode(1));
+  EXPECT_EQ((SF23::MAX + 1) / 2, program.instructions[1].constants[1].loadi());
+  EXPECT_EQ(OPCODE::NOP, opcode(2));
+  // LDAX REG1 after WRAX REG1, 1.0
+  EXPECT_EQ(OPCODE::NOP, opcode(4));
+  // Overwritten before being read
+  EXPECT_EQ(OPCODE::SOF, opcode(5));
+  EXPECT_EQ((SF23::MAX + 1) / 2, program.instructions[5].constants[0].loadi());
+  EXPECT_EQ(0, program.instructions[5].constants[1].loadi());
+  EXPECT_EQ(OPCODE::CLR, opcode(6));
+  EXPECT_EQ(OPCODE::WRAX, opcode(9));
+  // WRHX reads PACC
+  EXPECT_EQ(OPCODE::WRHX, opcode(13));
+  // WRLX reads PACC
+  EXPECT_EQ(OPCODE::WRAX, opcode(16));
+  EXPECT_EQ(OPCODE::RDAX, opcode(17));
+  // Read if the SKP is taken, jump target
+  EXPECT_EQ(OPCODE::WRAX, opcode(21));
+  EXPECT_EQ(OPCODE::WRAX, opcode(23));
+  EXPECT_EQ(OPCODE::RDAX, opcode(24));
+
+  const auto &stats = vm_.optimizer_report()[VM::PASS_DATAFLOW];
+  EXPECT_EQ(4U, stats.rewritten);
+  EXPECT_GT(stats.cycles, 0);
+
+  Compile("test_dataflow.bin", VM::passes(VM::OptLevel::O1));
+  EXPECT_EQ(OPCODE::RDAX, vm_.steady_program().instructions[2].get_opcode());
+  EXPECT_EQ(0U, vm_.optimizer_report()[VM::PASS_DATAFLOW].rewritten);
+}
+
+TEST_F(TestVMI32, ReduceCoefficients)
+{
+  Compile("test_coefficients.bin",
+          VM::passes(VM::OptLevel::O1) & ~VM::pass_mask(VM::PASS_COMPACT));
+  const auto &program = vm_.steady_program();
+  const OPCODE expected[] = {
+      OPCODE::RDAX_ADD, OPCODE::RDAX_SUB, OPCODE::WRAX_MOV, OPCODE::SOF_NEG,  OPCODE::WRAX_CLR,
+      OPCODE::RDAX_ADD, OPCODE::SOF_HALF, OPCODE::WRAX_MOV, OPCODE::SOF_NEG2, OPCODE::NOP,
+      OPCODE::WRA,      OPCODE::RDA_ADD,  OPCODE::WRAX_CLR, OPCODE::RDAX_SUB, OPCODE::SOF_NEG2,
+      OPCODE::SOF_NEG2, OPCODE::SOF,      OPCODE::WRAX_CLR};
+  for (size_t ic = 0; ic < std::size(expected); ++ic)
+    EXPECT_EQ(expected[ic], program.instructions[ic].get_opcode()) << ic;
+  // Not in the instructions the other engines use
+  EXPECT_EQ(OPCODE::RDAX, vm_.get_instruction(0).get_opcode());
+
+  const auto &stats = vm_.optimizer_report()[VM::PASS_COEFFICIENTS];
+  EXPECT_EQ(16U, stats.rewritten);
+  EXPECT_GT(stats.cycles, 0);
+}
+
+TEST_F(TestVMI32, FuseInstructions)
+{
+  Compile("test_allpass.bin", VM::passes(VM::OptLevel::O2) & ~VM::pass_mask(VM::PASS_COMPACT) &
+                                  ~VM::pass_mask(VM::PASS_COEFFICIENTS) &
+                                  ~VM::pass_mask(VM::PASS_SATURATION));
+  const auto &program = vm_.steady_program();
+  const OPCODE expected[] = {
+      OPCODE::RDAX, OPCODE::NOP,     OPCODE::ALLPASS, OPCODE::NOP, OPCODE::ALLPASS, OPCODE::WRHX,
+      OPCODE::SKP,  OPCODE::RDA,     OPCODE::WRAP,    OPCODE::RDA, OPCODE::WRAP,    OPCODE::WRAX,
+      OPCODE::NOP,  OPCODE::ALLPASS, OPCODE::SKP,     OPCODE::SOF, OPCODE::WRAX};
+  for (size_t ic = 0; ic < std::size(expected); ++ic)
+    EXPECT_EQ(expected[ic], program.instructions[ic].get_opcode()) << ic;
+  EXPECT_EQ(6U, vm_.optimizer_report()[VM::PASS_FUSE].rewritten);
+
+  // The NOPs in front are removed
+  Compile("test_allpass.bin", VM::passes(VM::OptLevel::O2));
+  EXPECT_EQ(OPCODE::ALLPASS, vm_.steady_program().instructions[1].get_opcode());
+  EXPECT_EQ(OPCODE::ALLPASS, vm_.steady_program().instructions[2].get_opcode());
+
+  Compile("test_filters.bin", VM::passes(VM::OptLevel::O2) & ~VM::pass_mask(VM::PASS_COMPACT) &
+                                  ~VM::pass_mask(VM::PASS_COEFFICIENTS) &
+                                  ~VM::pass_mask(VM::PASS_SATURATION) &
+                                  ~VM::pass_mask(VM::PASS_MICROOPS));
+  const OPCODE expected_filters[] = {
+      OPCODE::LDAX, OPCODE::NOP,  OPCODE::LPF1, OPCODE::NOP, OPCODE::HPF1, OPCODE::WRAX,
+      OPCODE::RDAX, OPCODE::RDFX, OPCODE::WRLX, OPCODE::NOP, OPCODE::LPF1, OPCODE::WRHX,
+      OPCODE::WRAX, OPCODE::SKP,  OPCODE::RDFX, OPCODE::WRLX, OPCODE::WRAX};
+  for (size_t ic = 0; ic < std::size(expected_filters); ++ic)
+    EXPECT_EQ(expected_filters[ic], program.instructions[ic].get_opcode()) << ic;
+  EXPECT_EQ(6U, vm_.optimizer_report()[VM::PASS_FUSE].rewritten);
+
+  Compile("test_cho_interp.bin", VM::passes(VM::OptLevel::O2) & ~VM::pass_mask(VM::PASS_COMPACT) &
+                                     ~VM::pass_mask(VM::PASS_SATURATION));
+  const OPCODE expected_cho[] = {
+      OPCODE::LDAX,           OPCODE::WRA,         OPCODE::NOP,         OPCODE::CHO_INTERP_SIN,
+      OPCODE::NOP,            OPCODE::CHO_INTERP_SIN, OPCODE::WRHX,     OPCODE::CHO_RDA_SIN,
+      OPCODE::CHO_RDA_SIN,    OPCODE::CHO_RDA_SIN, OPCODE::CHO_RDA_SIN, OPCODE::CHO_RDA_SIN,
+      OPCODE::CHO_RDA_SIN,    OPCODE::WRAX_CLR};
+  for (size_t ic = 0; ic < std::size(expected_cho); ++ic)
+    EXPECT_EQ(expected_cho[ic], program.instructions[ic].get_opcode()) << ic;
+  EXPECT_EQ(4U, vm_.optimizer_report()[VM::PASS_FUSE].rewritten);
+  EXPECT_EQ(CHO_FLAGS::COMPC, program.instructions[3].constants[1].loadi());
+  EXPECT_EQ(CHO_FLAGS::COS | CHO_FLAGS::COMPA, program.instructions[5].constants[1].loadi());
+
+  Compile("test_chorda_rmp.bin", VM::passes(VM::OptLevel::O2));
+  EXPECT_EQ(OPCODE::CHO_INTERP_RMP, vm_.steady_program().instructions[2].get_opcode());
+}
+
+TEST_F(TestVMI32, ReuseDelayReads)
+{
+  Compile("test_delay_reuse.bin", VM::passes(VM::OptLevel::O2) & ~VM::pass_mask(VM::PASS_COMPACT) &
+                                      ~VM::pass_mask(VM::PASS_SATURATION));
+  const auto &program = vm_.steady_program();
+  const OPCODE expected[] = {
+      OPCODE::RDAX_ADD, OPCODE::WRA_SAVE, OPCODE::RDA_CACHED, OPCODE::RDA_SAVE, OPCODE::RDA,
+      OPCODE::WRAX_CLR, OPCODE::RDA_CACHED, OPCODE::WRA,      OPCODE::RDA,      OPCODE::WRAP,
+      OPCODE::RDA,      OPCODE::WRAX_CLR,   OPCODE::LDAX,     OPCODE::SKP,      OPCODE::RDA,
+      OPCODE::RDA_CACHED, OPCODE::RDA,      OPCODE::WRAX_CLR};
+  for (size_t ic = 0; ic < std::size(expected); ++ic)
+    EXPECT_EQ(expected[ic], program.instructions[ic].get_opcode()) << ic;
+  EXPECT_EQ(0, program.instructions[1].constants[2].loadi());
+  EXPECT_EQ(0, program.instructions[2].constants[0].loadi());
+  EXPECT_EQ(1, program.instructions[3].constants[2].loadi());
+  EXPECT_EQ(1, program.instructions[6].constants[0].loadi());
+  EXPECT_EQ(1, program.instructions[15].constants[0].loadi());
+  EXPECT_EQ(5U, vm_.optimizer_report()[VM::PASS_DELAY_REUSE].rewritten);
+}
+
+TEST_F(TestVMI32, HoistInvariants)
+{
+  Compile("test_hoist.bin", VM::passes(VM::OptLevel::O2) & ~VM::pass_mask(VM::PASS_SATURATION));
+  const auto &prologue = vm_.prologue_program();
+  const OPCODE expected[] = {OPCODE::RDAX, OPCODE::SOF,  OPCODE::WRAX_CLR, OPCODE::RDAX_ADD,
+                             OPCODE::MULX, OPCODE::WRAX_CLR, OPCODE::RDAX,  OPCODE::MULX,
+                             OPCODE::WRAX_CLR};
+  ASSERT_EQ(std::size(expected), prologue.length);
+  for (size_t ic = 0; ic < std::size(expected); ++ic)
+    EXPECT_EQ(expected[ic], prologue.instructions[ic].get_opcode()) << ic;
+  EXPECT_EQ(REG0, prologue.instructions[2].constants[0].loadi());
+  EXPECT_EQ(REG1, prologue.instructions[5].constants[0].loadi());
+  EXPECT_EQ(REG3, prologue.instructions[8].constants[0].loadi());
+  EXPECT_EQ(9U, vm_.optimizer_report()[VM::PASS_HOIST].removed);
+
+  // The prologue is bounded, the sequences that don't fit stay in the steady-state program
+  Compile("test_hoist_long.bin");
+  EXPECT_EQ(size_t{30}, vm_.prologue_program().length);
+  EXPECT_EQ(30U, vm_.optimizer_report()[VM::PASS_HOIST].removed);
+  EXPECT_EQ(REG9, vm_.prologue_program().instructions[29].constants[0].loadi());
+  ExpectBitExact("test_hoist_long.bin", Execute(CompileReference(VM::passes(VM::OptLevel::O1))),
+                 Execute(vm_));
+  Compile("test_hoist.bin", VM::passes(VM::OptLevel::O2) & ~VM::pass_mask(VM::PASS_SATURATION));
+
+  // The steady-state program starts with the first instruction that isn't hoisted
+  EXPECT_EQ(OPCODE::RDAX_ADD, vm_.steady_program().instructions[0].get_opcode());
+  EXPECT_EQ(ADCL, vm_.steady_program().instructions[0].constants[0].loadi());
+
+  // Pots change between blocks
+  auto reference_delay_memory = std::make_unique<VM::DelayMemoryBuffer>();
+  auto reference = std::make_unique<VM>(*reference_delay_memory);
+  BufferStream<BSWAP_ENABLE> stream{buffer_.data()};
+  reference->Compile(stream, VM::passes(VM::OptLevel::O1));
+  int32_t t = 0;
+  for (size_t num_frames : {1, 32, 7, 1, 16}) {
+    std::vector<AudioFrame> block_in(num_frames), expected_out(num_frames), actual(num_frames);
+    for (auto &frame : block_in) {
+      frame = {((t * 4099) & 0xffffff) - 0x800000, ((t * 997) & 0xfffff) - 0x80000};
+      ++t;
+    }
+    params.pots[0] = (t & 0x3ff) << 13;
+    params.pots[1] = SF23::MAX - ((t & 0x7f) << 16);
+    params.pots[2] = (t & 0xff) << 15;
+    reference->SetParameters(params);
+    vm_.SetParameters(params);
+    reference->Execute(block_in.data(), expected_out.data(), num_frames);
+    vm_.Execute(block_in.data(), actual.data(), num_frames);
+    for (size_t i = 0; i < num_frames; ++i)
+      ASSERT_EQ(expected_out[i], actual[i]) << "t=" << t << " frame " << i;
+    // ADCR isn't stored without FEATURE_STEREO
+    for (size_t r = 0; r < kNumRegisters; ++r) {
+      if (ADCR == r) continue;
+      ASSERT_EQ(reference->state().registers_[r].loadi(), vm_.state().registers_[r].loadi())
+          << "register " << r;
+    }
+  }
+}
+
+// The frames after the init frame in the same block also need the prologue
+TEST_F(TestVMI32, HoistAfterInit)
+{
+  auto packed = std::make_unique<VM::PackedPrograms>();
+  vm_.set_packed_programs(packed.get());
+  for (auto dispatch : {VM::Dispatch::SWITCH, VM::Dispatch::THREADED, VM::Dispatch::PACKED}) {
+    Compile("test_hoist_acc.bin");
+    vm_.set_dispatch(dispatch);
+    ASSERT_EQ(3U, vm_.prologue_program().length);
+    ExpectBitExact("test_hoist_acc.bin", Execute(CompileReference(VM::passes(VM::OptLevel::O1))),
+                   Execute(vm_));
+  }
+}
+
+TEST_F(TestVMI32, OptimizeMicroOps)
+{
+  // The IR is freed when the pass is done, so keep a copy. The steady-state program is last.
+  static uop::Function uops;
+  VM::micro_ops_observer = [](const VM::Program &, const uop::Function &f) { uops = f; };
+  Compile("test_uops.bin", VM::pass_mask(VM::PASS_PEEPHOLE) | VM::pass_mask(VM::PASS_MICROOPS));
+  VM::micro_ops_observer = nullptr;
+  const auto &program = vm_.steady_program();
+  const OPCODE expected[] = {OPCODE::NOP,  OPCODE::SOF, OPCODE::WRAX, OPCODE::CHO_RDAL,
+                             OPCODE::WRAX, OPCODE::NOP, OPCODE::WRAX, OPCODE::RDAX,
+                             OPCODE::WRAX, OPCODE::NOP, OPCODE::NOP,  OPCODE::WRAX,
+                             OPCODE::JMP,  OPCODE::SOF, OPCODE::OR,   OPCODE::WRAX};
+  for (size_t ic = 0; ic < std::size(expected); ++ic)
+    EXPECT_EQ(expected[ic], program.instructions[ic].get_opcode()) << ic;
+
+  // SOF 0.5, 0 of the constant 0.5 is folded into SOF 0, 0.25
+  EXPECT_TRUE(program.instructions[1].constants[0].zero());
+  EXPECT_EQ((SF23::MAX + 1) / 4, program.instructions[1].constants[1].loadi());
+  // Both CHO RDAL read the same LFO value
+  EXPECT_EQ(uops.steps[3].result, uops.steps[5].result);
+  EXPECT_EQ(uops.steps[3].result, uops.steps[5].acc);
+
+  const auto &stats = vm_.optimizer_report()[VM::PASS_MICROOPS];
+  EXPECT_EQ(4U, stats.removed);
+  EXPECT_EQ(2U, stats.rewritten);
+  EXPECT_GT(stats.cycles, 0);
+
+  // Not across a write to the LFO range
+  Compile("test_uops_lfo.bin", VM::passes(VM::OptLevel::O2));
+  const auto &steady_program = vm_.steady_program();
+  size_t num_rdal = 0;
+  for (size_t ic = 0; ic < steady_program.length; ++ic)
+    num_rdal += OPCODE::CHO_RDAL == steady_program.instructions[ic].get_opcode();
+  EXPECT_EQ(2U, num_rdal);
+  ExpectBitExact("test_uops_lfo.bin", Execute(CompileReference(VM::passes(VM::OptLevel::O0))),
+                 Execute(vm_));
+}
+
+TEST_F(TestVMI32, ElideSaturation)
+{
+  Compile("test_saturation.bin", VM::passes(VM::OptLevel::O2) & ~VM::pass_mask(VM::PASS_COMPACT) &
+                                     ~VM::pass_mask(VM::PASS_DATAFLOW) &
+                                     ~VM::pass_mask(VM::PASS_MICROOPS));
+  const auto &program = vm_.steady_program();
+  const OPCODE expected[] = {
+      OPCODE::RDAX_NOSAT, OPCODE::SOF_NOSAT,  OPCODE::RDAX_NOSAT, OPCODE::RDAX,
+      OPCODE::WRAX_CLR,   OPCODE::RDAX_NOSAT, OPCODE::MULX_NOSAT, OPCODE::SOF,
+      OPCODE::WRAX,       OPCODE::RDFX,       OPCODE::CLR,        OPCODE::RDA_NOSAT,
+      OPCODE::RDA,        OPCODE::WRAX_CLR,   OPCODE::LDAX,       OPCODE::SKP,
+      OPCODE::CLR,        OPCODE::RDAX,       OPCODE::WRAX_CLR};
+  for (size_t ic = 0; ic < std::size(expected); ++ic)
+    EXPECT_EQ(expected[ic], program.instructions[ic].get_opcode()) << ic;
+  EXPECT_EQ(6U, vm_.optimizer_report()[VM::PASS_SATURATION].rewritten);
+}
+
+// The superinstructions depend on the generated table, so this only checks that whatever got
+// fused matches its sequence and leaves the rest of the program alone. The committed table may be
+// empty, 'make superops_check' runs the handlers of a generated one.
+TEST_F(TestVMI32, FuseSuperinstructions)
+{
+  uint32_t total = 0;
+  for (auto program : {"test_reverb.bin", "test_allpass.bin", "test_cho_interp.bin",
+                       "test_cho_rdal.bin", "test_register_fx.bin", "test_delay_reuse.bin"}) {
+    Compile(program);
+    std::vector<OPCODE> expected;
+    for (size_t ic = 0; ic < vm_.steady_program().length; ++ic)
+      expected.push_back(vm_.steady_program().instructions[ic].get_opcode());
+
+    Compile(program, VM::passes(VM::OptLevel::O2) | VM::pass_mask(VM::PASS_SUPEROPS));
+    const auto &steady_program = vm_.steady_program();
+    ASSERT_EQ(expected.size(), steady_program.length) << program;
+    uint32_t rewritten = 0;
+    for (size_t ic = 0; ic < steady_program.length; ++ic) {
+      const auto opcode = steady_program.instructions[ic].get_opcode();
+      if (opcode == expected[ic]) continue;
+      auto superop = std::find_if(kSuperops.begin(), kSuperops.end(),
+                                  [opcode](const Superop &s) { return s.opcode == opcode; });
+      ASSERT_NE(kSuperops.end(), superop) << program << " " << ic;
+      ASSERT_LE(ic + superop->length, steady_program.length) << program << " " << ic;
+      EXPECT_EQ(superop->sequence[0], expected[ic]) << program << " " << ic;
+      for (size_t i = 1; i < superop->length; ++i) {
+        EXPECT_EQ(superop->sequence[i], expected[ic + i]) << program << " " << ic;
+        EXPECT_EQ(expected[ic + i], steady_program.instructions[ic + i].get_opcode());
+      }
+      ic += superop->length - 1;
+      ++rewritten;
+    }
+    EXPECT_EQ(rewritten, vm_.optimizer_report()[VM::PASS_SUPEROPS].rewritten) << program;
+    total += rewritten;
+  }
+  EXPECT_TRUE(total || !kNumSuperops);
+}
+
 TEST_F(TestVMI32, sof)
 {
   Compile("test_sof.bin");
@@ -194,4 +537,241 @@ TEST_F(TestVMI32, RegisterFX)
   EXPECT_EQ(registers[DACR].load(), -1677824);
 }
 
+TEST_F(TestVMI32, ThreadedDispatch)
+{
+  vm_.set_dispatch(VM::Dispatch::THREADED);
+  for (auto program : {"test_inv.bin", "test_register_fx.bin", "test_skp_run.bin",
+                       "test_chorda_rmp.bin", "test_reverb.bin"}) {
+    Compile(program);
+    ExpectBitExact(program, Execute(CompileReference()), Execute(vm_));
+  }
+}
+
+TEST_F(TestVMI32, PackedDispatch)
+{
+  vm_.set_dispatch(VM::Dispatch::PACKED);
+  auto packed = std::make_unique<VM::PackedPrograms>();
+  vm_.set_packed_programs(packed.get());
+  for (auto program : {"test_inv.bin", "test_register_fx.bin", "test_skp_run.bin",
+                       "test_chorda_rmp.bin", "test_allpass.bin", "test_reverb.bin",
+                       "test_mask.bin", "test_rmp.bin", "test_bitcrush.bin"}) {
+    Compile(program);
+    // The fixed-point coefficients, addresses etc. of the I32 engine always fit
+    EXPECT_TRUE(packed->valid()) << program;
+    EXPECT_EQ(vm_.steady_program().length, packed->steady.length) << program;
+    ExpectBitExact(program, Execute(CompileReference()), Execute(vm_));
+  }
+
+  // Masks are unsigned, so the sign bit doesn't stop them from being packed
+  Compile("test_bitcrush.bin");
+  const auto &steady_program = vm_.steady_program();
+  size_t num_masks = 0;
+  for (size_t ic = 0; ic < steady_program.length; ++ic) {
+    const auto &instruction = steady_program.instructions[ic];
+    if (OPCODE::AND == instruction.get_opcode() || OPCODE::XOR == instruction.get_opcode() ||
+        OPCODE::OR == instruction.get_opcode())
+      num_masks += 0 != (instruction.constants[0].loadi() & SF23::kIntRange);
+  }
+  EXPECT_EQ(3U, num_masks);
+  EXPECT_TRUE(packed->steady.valid);
+
+  // Packed when they're set, i.e. for the program that's already compiled
+  vm_.set_packed_programs(nullptr);
+  Compile("test_reverb.bin");
+  *packed = {};
+  vm_.set_packed_programs(packed.get());
+  EXPECT_TRUE(packed->valid());
+  EXPECT_EQ(vm_.steady_program().length, packed->steady.length);
+}
+
+TEST_F(TestVMI32, LoadPrecompiled)
+{
+  using Constant = engine::EngineI32::Constant;
+  // ldax ADCL; wrax DACL, 0 as generated by CppGenerator::Bytecode
+  static constexpr VM::CompiledInstruction kCopy[] = {
+      {OPCODE::LDAX, {Constant{ADCL}, Constant{0}, Constant{0}}},
+      {OPCODE::WRAX_CLR, {Constant{DACL}, Constant{0}, Constant{0}}},
+  };
+  static constexpr VM::PrecompiledProgram kPrecompiled = {0, {kCopy, 2}, {kCopy, 2}, {}};
+  static_assert(OPCODE::WRAX_CLR == kPrecompiled.steady.instructions[1].get_opcode());
+
+  vm_.Load(kPrecompiled);
+  for (int i = 0; i < 4; ++i) {
+    in[0] = {SF23::MAX - i * 4096, SF23::MIN + i * 4096};
+    vm_.Execute(in, out, 1);
+    EXPECT_EQ(in[0].l, out[0].l) << "frame " << i;
+  }
+
+  for (auto program : {"test_skp_run.bin", "test_chorda_rmp.bin", "test_hoist.bin",
+                       "test_reverb.bin"}) {
+    Compile(program);
+    // Stand-in for tables in read-only memory
+    auto init = std::make_unique<VM::Program>(vm_.init_program());
+    auto steady = std::make_unique<VM::Program>(vm_.steady_program());
+    auto prologue = std::make_unique<VM::Prologue>(vm_.prologue_program());
+    const VM::PrecompiledProgram precompiled{vm_.features(), init->view(), steady->view(),
+                                             prologue->view()};
+    vm_.Load(precompiled);
+    ExpectBitExact(program, Execute(CompileReference()), Execute(vm_));
+
+    // Only the tables and a context
+    auto buffer = std::make_unique<VM::DelayMemoryBuffer>();
+    VM::Context context{*buffer};
+    context.Reset();
+    ExpectBitExact(program, Execute(CompileReference()),
+                   [&](const VM::Parameters &pots, const AudioFrame *block_in,
+                       AudioFrame *block_out, size_t block_size) {
+                     context.SetParameters(pots);
+                     VM::Execute(precompiled, context, block_in, block_out, block_size);
+                   });
+  }
+}
+
+TEST_F(TestVMI32, SharedProgram)
+{
+  static constexpr size_t kNumVoices = 3;
+  static constexpr size_t kBlockSize = 8;
+  auto voice_input = [](size_t voice, size_t block, std::vector<AudioFrame> &frames) {
+    for (size_t i = 0; i < frames.size(); ++i) {
+      const auto t = static_cast<int32_t>((block * kBlockSize + i) * (voice + 3));
+      frames[i] = {((t * 4099) & 0xffffff) - 0x800000, ((t * 997) & 0xfffff) - 0x80000};
+    }
+  };
+  auto voice_params = [](size_t voice) {
+    VM::Parameters pots;
+    for (size_t p = 0; p < 3; ++p) pots.pots[p] = static_cast<int32_t>((voice + p) << 20);
+    return pots;
+  };
+  auto vm_packed = std::make_unique<VM::PackedPrograms>();
+  vm_.set_packed_programs(vm_packed.get());
+
+  for (auto program : {"test_chorda_rmp.bin", "test_hoist.bin", "test_reverb.bin"}) {
+    for (auto dispatch : {VM::Dispatch::SWITCH, VM::Dispatch::THREADED, VM::Dispatch::PACKED}) {
+      // Each voice on its own
+      std::vector<AudioFrame> frames(kBlockSize);
+      std::vector<std::vector<AudioFrame>> expected(kNumVoices);
+      vm_.set_dispatch(dispatch);
+      for (size_t v = 0; v < kNumVoices; ++v) {
+        Compile(program);
+        vm_.SetParameters(voice_params(v));
+        for (size_t b = 0; b < 4; ++b) {
+          voice_input(v, b, frames);
+          expected[v].resize((b + 1) * kBlockSize);
+          vm_.Execute(frames.data(), expected[v].data() + b * kBlockSize, kBlockSize);
+        }
+      }
+
+      // One copy of the program, interleaved
+      Compile(program);
+      const auto compiled = std::make_unique<VM::CompiledProgram>(vm_.compiled_program());
+      const auto packed = std::make_unique<VM::PackedPrograms>();
+      ASSERT_TRUE(VM::Pack(*compiled, *packed)) << program;
+      Compile("test_skp_run.bin");
+      // Contiguous, and growing the vector moves the contexts that already exist
+      std::vector<VM::DelayMemoryBuffer> buffers(kNumVoices);
+      std::vector<VM::Context> contexts;
+      for (size_t v = 0; v < kNumVoices; ++v) {
+        contexts.emplace_back(buffers[v]);
+        contexts.back().Reset();
+        contexts.back().SetParameters(voice_params(v));
+      }
+      std::vector<AudioFrame> actual(kBlockSize);
+      for (size_t b = 0; b < 4; ++b) {
+        for (size_t v = 0; v < kNumVoices; ++v) {
+          voice_input(v, b, frames);
+          if (VM::Dispatch::PACKED == dispatch)
+            VM::Execute(*compiled, *packed, contexts[v], frames.data(), actual.data(), kBlockSize);
+          else
+            VM::Execute(*compiled, contexts[v], dispatch, frames.data(), actual.data(), kBlockSize);
+          for (size_t i = 0; i < kBlockSize; ++i) {
+            ASSERT_EQ(expected[v][b * kBlockSize + i], actual[i])
+                << program << " voice " << v << " block " << b << " frame " << i;
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST_F(TestVMI32, OptLevel)
+{
+  // O0 only does what's required to run the program
+  Compile("test_optimize.bin", VM::passes(VM::OptLevel::O0));
+  EXPECT_EQ(0U, vm_.passes());
+  EXPECT_EQ(OPCODE::RDFX, vm_.get_instruction(1).get_opcode());
+  EXPECT_EQ(VM::FEATURE_ALL, vm_.features());
+  EXPECT_EQ(size_t{kMaxInstructionCount}, vm_.steady_program().length);
+  for (const auto &stats : vm_.optimizer_report()) {
+    EXPECT_EQ(0U, stats.removed);
+    EXPECT_EQ(0U, stats.rewritten);
+  }
+
+  Compile("test_optimize.bin", VM::passes(VM::OptLevel::O1));
+  EXPECT_EQ(OPCODE::LDAX, vm_.get_instruction(1).get_opcode());
+  EXPECT_EQ(VM::FEATURE_ALL, vm_.features());
+  const auto &report = vm_.optimizer_report();
+  EXPECT_GE(report[VM::PASS_PEEPHOLE].rewritten, 7U);
+  EXPECT_GT(report[VM::PASS_PEEPHOLE].cycles, 0);
+  EXPECT_GT(report[VM::PASS_COMPACT].removed, 100U);
+
+  // Individual passes
+  Compile("test_register_fx.bin");
+  const auto steady_length = vm_.steady_program().length;
+  Compile("test_register_fx.bin", VM::pass_mask(VM::PASS_STRIP_INIT));
+  EXPECT_EQ(size_t{kMaxInstructionCount - 1}, vm_.steady_program().length);
+  EXPECT_EQ(1U, vm_.optimizer_report()[VM::PASS_STRIP_INIT].removed);
+  Compile("test_register_fx.bin", VM::passes(VM::OptLevel::O2));
+  EXPECT_EQ(steady_length, vm_.steady_program().length);
+  EXPECT_EQ(VM::FEATURE_PACC, vm_.features());
+}
+
+// Same output and registers at all levels
+TEST_F(TestVMI32, OptLevelBitExact)
+{
+  for (const auto &program : AllTestPrograms()) {
+    const auto name = program.path + "@" + std::to_string(program.offset);
+    for (auto level : {VM::OptLevel::O1, VM::OptLevel::O2}) {
+      Compile(program, VM::passes(level));
+      auto &reference = CompileReference(VM::passes(VM::OptLevel::O0));
+      ExpectBitExact(name, Execute(reference), Execute(vm_));
+      // Registers are visible outside the program, ADCR isn't stored without FEATURE_STEREO
+      for (size_t r = 0; r < kNumRegisters; ++r) {
+        if (ADCR == r) continue;
+        EXPECT_EQ(reference.state().registers_[r].loadi(), vm_.state().registers_[r].loadi())
+            << name << " register " << r;
+      }
+    }
+  }
+}
+
+// Nothing carries over from the previous program, e.g. the last delay read for a WRAP that runs
+// before the first RDA
+TEST_F(TestVMI32, CompileResets)
+{
+  Compile("test_reverb.bin");
+  for (int32_t t = 0; t < 4096; ++t) {
+    in[0] = {((t * 4099) & 0xffffff) - 0x800000, 0};
+    vm_.Execute(in, out, 1);
+  }
+  ASSERT_NE(0, vm_.delay_memory().last_read().value);
+
+  Compile("test_wrap_first.bin");
+  EXPECT_EQ(0, vm_.delay_memory().last_read().value);
+  ExpectBitExact("test_wrap_first.bin", Execute(CompileReference()), Execute(vm_));
+}
+
+TEST_F(TestVMI32, Features)
+{
+  Compile("test_copy.bin");
+  EXPECT_EQ(VM::FEATURE_STEREO, vm_.features());
+
+  Compile("test_register_fx.bin");
+  EXPECT_EQ(VM::FEATURE_PACC, vm_.features());
+
+  Compile("test_reverb.bin");
+  EXPECT_EQ(VM::FEATURE_PACC | VM::FEATURE_LAST_READ | VM::FEATURE_LFO | VM::FEATURE_STEREO |
+                VM::FEATURE_SIN0 | VM::FEATURE_RMP0,
+            vm_.features());
+}
+
 }  // namespace fv1tests
@@ -0,0 +1,375 @@
+// fv1vm: experimental FV-1 virtual machine
+// Copyright (C) 2022 Patrick Dowling <pld@gurkenkiste.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <getopt.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "fv1_tools.h"
+#include "misc/program_stream.h"
+#include "vm/codegen/native_cache.h"
+#include "vm/engines/delay_f16.h"
+#include "vm/engines/delay_i32.h"
+#include "vm/engines/engine_f32.h"
+#include "vm/engines/engine_i32_v1.h"
+#include "vm/jit/jit_x64.h"
+#include "vm/simd/multi_instance.h"
+#include "vm/vm.h"
+
+static constexpr uint32_t kSampleRate = 32000U;
+
+#define VERBOSE(...) \
+  if (options.verbose) INFO(__VA_ARGS__)
+
+static struct option long_opts[] = {
+    {"blocksize", required_argument, nullptr, 'z'},
+    {"file", required_argument, nullptr, 'f'},
+    {"help", no_argument, nullptr, 'h'},
+    {"opt_level", required_argument, nullptr, 'O'},
+    {"program", required_argument, nullptr, 'p'},
+    {"sample_count", required_argument, nullptr, 's'},
+    {"verbose", no_argument, nullptr, 'v'},
+    {nullptr, 0, nullptr, 0},
+};
+
+static const char *short_opts = "f:hO:p:s:vz:";
+
+static struct {
+  std::string file = "";
+  int program = -1;
+  size_t sample_count = 10 * kSampleRate;
+  size_t blocksize = 32;
+  int opt_level = 2;
+
+  bool verbose = false;
+} options;
+
+void Usage()
+{
+  INFO("fv1_bench options: Run program(s) with the available interpreter variants and compare");
+  INFO(" --blocksize\t-z\tBlocksize (%zu)", options.blocksize);
+  INFO(" --file\t-f\tProgram/bank input file");
+  INFO(" --help\t-h\tShow this message");
+  INFO(" --opt_level\t-O\tOptimizer level 0-2 (%d), the native variant always uses 2",
+       options.opt_level);
+  INFO(" --program\t-p\tNumber of program to use if bank file (0-7), default is all");
+  INFO(" --sample_count\t-s\tNumber of samples to compute per run (%zu)", options.sample_count);
+  INFO(" --verbose\t-v\tExtra output");
+}
+
+bool ParseCommandLine(int argc, char **argv)
+{
+  int ch = 0;
+  do {
+    ch = getopt_long(argc, argv, short_opts, long_opts, NULL);
+    switch (ch) {
+      case 'f': options.file = optarg; break;
+      case 'h': return false;
+      case 'O': options.opt_level = atoi(optarg); break;
+      case 'p': options.program = atoi(optarg); break;
+      case 's': sscanf(optarg, "%zu", &options.sample_count); break;
+      case 'z': sscanf(optarg, "%zu", &options.blocksize); break;
+      case 'v': options.verbose = true; break;
+      case '?': return false;
+      case 0:
+      case -1:
+      default: break;
+    }
+  } while (-1 != ch);
+
+  if (options.program < -1 || options.program > 7) return false;
+  if (!options.sample_count) return false;
+  if (!options.blocksize) return false;
+  if (options.opt_level < 0 || options.opt_level > 2) return false;
+
+  return true;
+}
+
+using VM = fv1::VM<fv1::engine::EngineI32, fv1::engine::DelayStorageI32>;
+using VMF32 = fv1::VM<fv1::engine::EngineF32, fv1::engine::DelayStorageF16>;
+
+static fv1tools::BinaryFile binary_file;
+static VM::DelayMemoryBuffer delay_memory_buffer;
+static VM vm{delay_memory_buffer};
+static VM::BlockBuffer block_buffer;
+static VM::PackedPrograms packed_programs;
+static VMF32::DelayMemoryBuffer delay_memory_buffer_f32;
+static VMF32 vm_f32{delay_memory_buffer_f32};
+
+// Each variant configures the VM before the program is compiled
+struct Variant {
+  enum Backend { INTERPRETER, JIT, NATIVE, F32, SIMD };
+
+  const char *name;
+  void (*configure)(VM &vm);
+  Backend backend = INTERPRETER;
+  bool exact = true;  // Output expected to match the reference
+};
+
+static const Variant variants[] = {
+    {"switch", [](VM &v) { v.set_dispatch(VM::Dispatch::SWITCH); }},
+    {"threaded", [](VM &v) { v.set_dispatch(VM::Dispatch::THREADED); }},
+    // 8-byte instructions if the program can be packed, otherwise the same as "switch"
+    {"packed",
+     [](VM &v) {
+       v.set_dispatch(VM::Dispatch::PACKED);
+       v.set_packed_programs(&packed_programs);
+     }},
+    // Instruction-major if the program allows it, otherwise the same as "switch"
+    {"block",
+     [](VM &v) {
+       v.set_dispatch(VM::Dispatch::SWITCH);
+       v.set_block_buffer(&block_buffer);
+     }},
+#ifdef FV1_JIT_X64
+    {"jit", [](VM &v) { v.set_dispatch(VM::Dispatch::SWITCH); }, Variant::JIT},
+#endif
+#ifdef FV1_NATIVE_CACHE
+    {"native", [](VM &v) { v.set_dispatch(VM::Dispatch::SWITCH); }, Variant::NATIVE},
+#endif
+    // Float engine using the switch interpreter, so it compares directly with the reference
+    {"f32", nullptr, Variant::F32, false},
+    // Same input on all lanes, ns/sample is per lane (i.e. per channel)
+    {"simd8", nullptr, Variant::SIMD},
+};
+
+static fv1::codegen::NativeCache native_cache{{}};
+
+// Runs the same input on every lane of a simd::MultiInstance, the first lane is the output
+struct MultiInstanceRunner {
+  using MultiInstance = fv1::simd::MultiInstance<8>;
+  using AudioFrame = MultiInstance::AudioFrame;
+  using Parameters = MultiInstance::Parameters;
+  static constexpr size_t kLanes = MultiInstance::kLanes;
+
+  MultiInstance::DelayMemoryBuffer lane_delay_memory;
+  MultiInstance multi_instance{vm, lane_delay_memory};
+  std::vector<AudioFrame> in;
+  std::vector<AudioFrame> out;
+
+  void SetParameters(const Parameters &params)
+  {
+    for (size_t l = 0; l < kLanes; ++l) multi_instance.SetParameters(l, params);
+  }
+
+  void Execute(const AudioFrame *src, AudioFrame *dst, size_t num_frames)
+  {
+    in.resize(num_frames * kLanes);
+    out.resize(num_frames * kLanes);
+    for (size_t i = 0; i < num_frames; ++i)
+      for (size_t l = 0; l < kLanes; ++l) in[i * kLanes + l] = src[i];
+    multi_instance.Execute(in.data(), out.data(), num_frames);
+    for (size_t i = 0; i < num_frames; ++i) dst[i] = out[i * kLanes];
+  }
+};
+
+static MultiInstanceRunner multi_instance_runner;
+
+struct Result {
+  double ns_per_sample = 0.0;
+  uint32_t checksum = 0;
+};
+
+// All engines see the same S.23 input, and the checksum is over S.23 output
+template <typename T>
+static T FromS23(int32_t value)
+{
+  if constexpr (std::is_floating_point<T>::value)
+    return fv1::engine::EngineF32::FromS23(value);
+  else
+    return value;
+}
+
+template <typename T>
+static int32_t ToS23(T value)
+{
+  if constexpr (std::is_floating_point<T>::value)
+    return fv1::engine::EngineF32::ToS23(value);
+  else
+    return value;
+}
+
+// Input is deterministic noise, pots are swept per block so all variants see the same data
+template <typename VMType, typename Execute>
+static Result Measure(VMType &target, Execute execute)
+{
+  using AudioFrame = typename VMType::AudioFrame;
+  using sample_type = decltype(AudioFrame::l);
+
+  std::vector<AudioFrame> in(options.blocksize);
+  std::vector<AudioFrame> out(options.blocksize);
+  typename VMType::Parameters params;
+
+  uint32_t seed = 0x1234567;
+  auto noise = [&seed]() {
+    seed = seed * 1664525U + 1013904223U;
+    return FromS23<sample_type>(static_cast<int32_t>(seed >> 8) - 0x800000);
+  };
+
+  Result result;
+  std::chrono::steady_clock::duration elapsed{0};
+  size_t block = 0;
+  auto sample_count = options.sample_count;
+  while (sample_count) {
+    auto blocksize = sample_count > options.blocksize ? options.blocksize : sample_count;
+    for (size_t i = 0; i < blocksize; ++i) in[i] = {noise(), noise()};
+    for (int i = 0; i < fv1::kNumPots; ++i) {
+      auto pot = static_cast<int32_t>((block * static_cast<size_t>(i + 1)) & 0x3ff) << 13;
+      params.pots[i] = FromS23<sample_type>(pot);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    target.SetParameters(params);
+    execute(in.data(), out.data(), blocksize);
+    elapsed += std::chrono::steady_clock::now() - start;
+
+    for (size_t i = 0; i < blocksize; ++i) {
+      result.checksum = result.checksum * 31U + static_cast<uint32_t>(ToS23(out[i].l));
+      result.checksum = result.checksum * 31U + static_cast<uint32_t>(ToS23(out[i].r));
+    }
+    sample_count -= blocksize;
+    ++block;
+  }
+
+  result.ns_per_sample =
+      static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) /
+      static_cast<double>(options.sample_count);
+  return result;
+}
+
+static void PrintOptimizerReport(const VM &v)
+{
+  const auto &report = v.optimizer_report();
+  for (size_t pass = 0; pass < VM::kNumPasses; ++pass) {
+    if (!(v.passes() & VM::pass_mask(static_cast<VM::PASS>(pass)))) continue;
+    INFO("     %-12s removed %3u rewritten %3u ~%d cycles/frame", VM::kPassNames[pass],
+         report[pass].removed, report[pass].rewritten, report[pass].cycles);
+  }
+}
+
+// Size of the steady-state program the interpreter walks through each frame, and of the VM that
+// holds it (the packed programs and block buffer are only needed for those variants)
+static void PrintFootprint(const VM &v)
+{
+  const auto length = v.steady_program().length;
+  if (packed_programs.steady.valid) {
+    INFO("     footprint %3zu instructions %5zu bytes, packed %5zu bytes", length,
+         length * sizeof(VM::CompiledInstruction), length * sizeof(VM::PackedInstruction));
+  } else {
+    INFO("     footprint %3zu instructions %5zu bytes, not packable", length,
+         length * sizeof(VM::CompiledInstruction));
+  }
+  INFO("     VM %zu bytes (program %zu), packed programs %zu bytes, block buffer %zu bytes",
+       sizeof(VM), sizeof(VM::CompiledProgram), sizeof(VM::PackedPrograms),
+       sizeof(VM::BlockBuffer));
+}
+
+static Result Run(const char *p, const Variant &variant)
+{
+  if (Variant::F32 == variant.backend) {
+    fv1::BufferStream<fv1::BSWAP_ENABLE> program{p};
+    vm_f32.Compile(program, static_cast<VMF32::OptLevel>(options.opt_level));
+    return Measure(vm_f32, [](const VMF32::AudioFrame *in, VMF32::AudioFrame *out, size_t n) {
+      vm_f32.Execute(in, out, n);
+    });
+  }
+
+  if (Variant::SIMD == variant.backend) {
+    fv1::BufferStream<fv1::BSWAP_ENABLE> program{p};
+    vm.Compile(program, static_cast<VM::OptLevel>(options.opt_level));
+    multi_instance_runner.multi_instance.Reset();
+    auto result = Measure(multi_instance_runner, [](const VM::AudioFrame *in, VM::AudioFrame *out,
+                                                    size_t n) {
+      multi_instance_runner.Execute(in, out, n);
+    });
+    result.ns_per_sample /= static_cast<double>(MultiInstanceRunner::kLanes);
+    return result;
+  }
+
+  vm.set_block_buffer(nullptr);
+  vm.set_packed_programs(nullptr);
+  variant.configure(vm);
+  if (Variant::NATIVE == variant.backend) {
+    if (!native_cache.Compile(vm, p)) ERR("** Native compilation failed, using interpreter");
+  } else {
+    fv1::BufferStream<fv1::BSWAP_ENABLE> program{p};
+    vm.Compile(program, static_cast<VM::OptLevel>(options.opt_level));
+  }
+
+  fv1::jit::JitEngine jit{vm};
+  if (Variant::JIT == variant.backend && !jit.Compile())
+    ERR("** JIT compilation failed, using interpreter");
+
+  return Measure(vm, [&](const VM::AudioFrame *in, VM::AudioFrame *out, size_t n) {
+    if (Variant::JIT == variant.backend)
+      jit.Execute(in, out, n);
+    else
+      vm.Execute(in, out, n);
+  });
+}
+
+int main(int argc, char **argv)
+{
+  if (!ParseCommandLine(argc, argv)) {
+    Usage();
+    return EXIT_FAILURE;
+  }
+
+  if (!binary_file.Read(options.file)) {
+    ERR("** Failed to read input file '%s': %s", options.file.c_str(), strerror(errno));
+    return EXIT_FAILURE;
+  } else {
+    VERBOSE("** Read %zu bytes from '%s'", binary_file.length(), options.file.c_str());
+  }
+
+  if (!binary_file.valid_length()) {
+    ERR("%zu bytes, what is it?", binary_file.length());
+    return EXIT_FAILURE;
+  }
+
+  int first = options.program < 0 ? 0 : options.program;
+  int last = options.program < 0 ? 7 : options.program;
+
+  bool mismatch = false;
+  INFO("%-4s %-12s %10s %8s %10s", "PROG", "VARIANT", "ns/sample", "speedup", "checksum");
+  for (int index = first; index <= last; ++index) {
+    auto p = binary_file.program(index);
+    if (!p) break;
+    if (options.verbose) fv1tools::print_program_info(binary_file.get_bank_info(), index);
+
+    Result reference;
+    for (const auto &variant : variants) {
+      auto result = Run(p, variant);
+      if (&variant == variants) reference = result;
+
+      bool match = result.checksum == reference.checksum;
+      INFO("%-4d %-12s %10.2f %7.2fx   %08x%s", index, variant.name, result.ns_per_sample,
+           reference.ns_per_sample / result.ns_per_sample, result.checksum,
+           match || !variant.exact ? "" : " MISMATCH");
+      mismatch = mismatch || (variant.exact && !match);
+      if (&variant == variants && options.verbose) PrintOptimizerReport(vm);
+      if (!strcmp(variant.name, "packed")) PrintFootprint(vm);
+    }
+  }
+
+  return mismatch ? EXIT_FAILURE : EXIT_SUCCESS;
+}
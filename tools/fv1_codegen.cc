@@ -0,0 +1,157 @@
+// fv1vm: experimental FV-1 virtual machine
+// Copyright (C) 2022 Patrick Dowling <pld@gurkenkiste.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <getopt.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "fv1_tools.h"
+#include "misc/program_stream.h"
+#include "vm/codegen/cpp_generator.h"
+
+#define VERBOSE(...) \
+  if (options.verbose) ERR(__VA_ARGS__)
+
+static struct option long_opts[] = {
+    {"bytecode", no_argument, nullptr, 'b'},      {"file", required_argument, nullptr, 'f'},
+    {"help", no_argument, nullptr, 'h'},          {"name", required_argument, nullptr, 'n'},
+    {"output", required_argument, nullptr, 'o'},  {"program", required_argument, nullptr, 'p'},
+    {"verbose", no_argument, nullptr, 'v'},       {nullptr, 0, nullptr, 0},
+};
+
+static const char *short_opts = "bf:hn:o:p:v";
+
+static struct {
+  bool bytecode = false;
+  std::string file = "";
+  std::string name = "fv1_program";
+  std::string output = "";
+  int program = -1;
+  bool verbose = false;
+} options;
+
+static void Usage()
+{
+  INFO("fv1_codegen options: Generate C++ functions from program or bank");
+  INFO(" --bytecode\t-b\tGenerate precompiled byte code instead of functions");
+  INFO(" --file\t-f\tProgram/bank input file");
+  INFO(" --help\t-h\tShow this message");
+  INFO(" --name\t-n\tPrefix for generated names (%s)", options.name.c_str());
+  INFO(" --output\t-o\tOutput file, default is stdout");
+  INFO(" --program\t-p\tNumber of program to use if bank file (0-7), default is all");
+  INFO(" --verbose\t-v\tExtra output (on stderr)");
+  INFO("Generates <name>_<n> with the signature of fv1::codegen::RuntimeI32::ProgramFn for each");
+  INFO("program, and a table <name>_programs[] of all generated functions.");
+  INFO("With --bytecode, <name>_<n> are constexpr VM::PrecompiledProgram for VM::Load instead,");
+  INFO("and <name>_programs[] points to them.");
+}
+
+static bool ParseCommandLine(int argc, char **argv)
+{
+  int ch = 0;
+  do {
+    ch = getopt_long(argc, argv, short_opts, long_opts, NULL);
+    switch (ch) {
+      case 'b': options.bytecode = true; break;
+      case 'f': options.file = optarg; break;
+      case 'h': return false;
+      case 'n': options.name = optarg; break;
+      case 'o': options.output = optarg; break;
+      case 'p': options.program = atoi(optarg); break;
+      case 'v': options.verbose = true; break;
+      case '?': return false;
+      case 0:
+      case -1:
+      default: break;
+    }
+  } while (-1 != ch);
+
+  if (options.program < -1 || options.program > 7) return false;
+  if (options.name.empty()) return false;
+
+  return true;
+}
+
+using fv1::codegen::CppGenerator;
+
+static fv1tools::BinaryFile binary_file;
+static CppGenerator::VM::DelayMemoryBuffer delay_memory_buffer;
+static CppGenerator::VM vm{delay_memory_buffer};
+
+int main(int argc, char **argv)
+{
+  if (!ParseCommandLine(argc, argv)) {
+    Usage();
+    return EXIT_FAILURE;
+  }
+
+  if (!binary_file.Read(options.file)) {
+    ERR("** Failed to read input file '%s': %s", options.file.c_str(), strerror(errno));
+    return EXIT_FAILURE;
+  } else {
+    VERBOSE("** Read %zu bytes from '%s'", binary_file.length(), options.file.c_str());
+  }
+
+  if (!binary_file.valid_length()) {
+    ERR("%zu bytes, what is it?", binary_file.length());
+    return EXIT_FAILURE;
+  }
+
+  int first = options.program < 0 ? 0 : options.program;
+  int last = options.program < 0 ? 7 : options.program;
+
+  std::string code = CppGenerator::Preamble();
+  std::string table;
+  for (int index = first; index <= last; ++index) {
+    auto p = binary_file.program(index);
+    if (!p) break;
+
+    auto name = options.name + "_" + std::to_string(index);
+    VERBOSE("** Generating program %d as %s", index, name.c_str());
+
+    fv1::BufferStream<fv1::BSWAP_ENABLE> program{p};
+    vm.Compile(program);
+    if (options.bytecode) {
+      code += CppGenerator::Bytecode(vm, name);
+      table += "    &" + name + ",\n";
+    } else {
+      code += CppGenerator::Program(vm, name);
+      table += "    " + name + ",\n";
+    }
+  }
+  if (table.empty()) {
+    ERR("Invalid program index %d", options.program);
+    return EXIT_FAILURE;
+  }
+  const std::string type =
+      options.bytecode ? "Runtime::VM::PrecompiledProgram *const" : "Runtime::ProgramFn";
+  code += "extern const " + type + " " + options.name + "_programs[];\n";
+  code += "const " + type + " " + options.name + "_programs[] = {\n" + table + "};\n";
+
+  FILE *f = options.output.empty() ? stdout : fopen(options.output.c_str(), "w");
+  if (!f) {
+    ERR("** Failed to open output file '%s': %s", options.output.c_str(), strerror(errno));
+    return EXIT_FAILURE;
+  }
+  fwrite(code.data(), 1, code.size(), f);
+  if (f != stdout) fclose(f);
+
+  return EXIT_SUCCESS;
+}
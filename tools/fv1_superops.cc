@@ -0,0 +1,387 @@
+// fv1vm: experimental FV-1 virtual machine
+// Copyright (C) 2022 Patrick Dowling <pld@gurkenkiste.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <getopt.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include "fv1/debug/fv1_debug.h"
+#include "fv1_tools.h"
+#include "misc/program_stream.h"
+#include "vm/engines/delay_i32.h"
+#include "vm/engines/engine_i32_v1.h"
+#include "vm/vm.h"
+
+#define VERBOSE(...) \
+  if (options.verbose) ERR(__VA_ARGS__)
+
+static struct option long_opts[] = {
+    {"count", required_argument, nullptr, 'c'},  {"dir", required_argument, nullptr, 'd'},
+    {"help", no_argument, nullptr, 'h'},         {"length", required_argument, nullptr, 'l'},
+    {"source", required_argument, nullptr, 's'}, {"verbose", no_argument, nullptr, 'v'},
+    {"write", no_argument, nullptr, 'w'},        {nullptr, 0, nullptr, 0},
+};
+
+static const char *short_opts = "c:d:hl:s:vw";
+
+static struct {
+  std::vector<std::string> dirs;
+  size_t count = 8;
+  size_t length = 3;
+  std::string source = "./src";
+  bool verbose = false;
+  bool write = false;
+} options;
+
+static void Usage()
+{
+  INFO("fv1_superops options: Find common opcode sequences in compiled programs");
+  INFO(" --count\t-c\tNumber of superinstructions to generate, 0 for none (%zu)", options.count);
+  INFO(" --dir\t-d\tDirectory of .bin/.bank files to scan, can be repeated");
+  INFO(" --help\t-h\tShow this message");
+  INFO(" --length\t-l\tLongest sequence to consider, 2-%zu (%zu)", fv1::kMaxSuperopLength,
+       options.length);
+  INFO(" --source\t-s\tSource directory (%s)", options.source.c_str());
+  INFO(" --verbose\t-v\tExtra output (on stderr)");
+  INFO(" --write\t-w\tWrite the generated files into the source directory");
+  INFO("Programs are compiled with all optimizer passes except the superinstructions themselves.");
+  INFO("Sequences are ranked by the number of dispatches they save. The handlers are put together");
+  INFO("from <source>/vm/vm_execute_ops.h, and --write replaces fv1/fv1_superops.h and");
+  INFO("vm/vm_execute_superops.h; the VM has to be rebuilt to use them.");
+}
+
+static bool ParseCommandLine(int argc, char **argv)
+{
+  int ch = 0;
+  do {
+    ch = getopt_long(argc, argv, short_opts, long_opts, NULL);
+    switch (ch) {
+      case 'c': options.count = strtoul(optarg, nullptr, 0); break;
+      case 'd': options.dirs.push_back(optarg); break;
+      case 'h': return false;
+      case 'l': options.length = strtoul(optarg, nullptr, 0); break;
+      case 's': options.source = optarg; break;
+      case 'v': options.verbose = true; break;
+      case 'w': options.write = true; break;
+      case '?': return false;
+      case 0:
+      case -1:
+      default: break;
+    }
+  } while (-1 != ch);
+
+  if (options.dirs.empty()) return false;
+  if (options.length < 2 || options.length > fv1::kMaxSuperopLength) return false;
+
+  return true;
+}
+
+using fv1::OPCODE;
+using VM = fv1::VM<fv1::engine::EngineI32, fv1::engine::DelayStorageI32>;
+using Sequence = std::vector<OPCODE>;
+
+// Handler from vm_execute_ops.h
+struct Handler {
+  std::vector<std::string> constants;  // e.g. INT(addr)
+  std::vector<std::string> body;
+  bool fusable = false;
+};
+
+struct Candidate {
+  Sequence sequence;
+  size_t count = 0;
+  size_t programs = 0;
+  int last_program = -1;
+
+  size_t saved() const { return count * (sequence.size() - 1); }
+};
+
+static fv1tools::BinaryFile binary_file;
+static VM::DelayMemoryBuffer delay_memory_buffer;
+static VM vm{delay_memory_buffer};
+
+// Opcode names as used in the sources, the mnemonics are the same in lower case
+static std::string opcode_name(OPCODE opcode)
+{
+  std::string name = fv1::debug::to_string(opcode);
+  for (auto &c : name) c = ' ' == c ? '_' : static_cast<char>(toupper(c));
+  return name;
+}
+
+static std::string mnemonic(const Sequence &sequence)
+{
+  std::string mnemonic;
+  for (auto opcode : sequence) {
+    if (!mnemonic.empty()) mnemonic += "+";
+    mnemonic += fv1::debug::to_string(opcode);
+  }
+  return mnemonic;
+}
+
+// Handlers that can be a step of a superinstruction are the ones that only use their constants,
+// i.e. don't jump (ic) or look at the instruction itself.
+static bool ParseHandlers(const std::string &filename, std::map<std::string, Handler> &handlers)
+{
+  std::ifstream file{filename};
+  if (!file) return false;
+
+  static const std::regex dispatch{R"(^OPCODE_DISPATCH_(\w+)\((\w+)(, (.*))?\);.*)"};
+  static const std::regex uses_instruction{R"(\b(ic|instruction|GET_\w+)\b)"};
+  std::string line;
+  Handler *handler = nullptr;
+  while (std::getline(file, line)) {
+    std::smatch match;
+    if (std::regex_match(line, match, dispatch)) {
+      handler = nullptr;
+      if (!isdigit(match[1].str()[0])) continue;  // NOP, TODO
+      handler = &handlers[match[2]];
+      handler->fusable = true;
+      // Constants are split at the top level commas, ignoring comments
+      static const std::regex comment{R"(\s*/\*.*?\*/)"};
+      std::string constant;
+      int depth = 0;
+      for (auto c : std::regex_replace(match[4].str(), comment, "")) {
+        if (',' == c && !depth) {
+          handler->constants.push_back(constant);
+          constant.clear();
+          continue;
+        }
+        if ('(' == c) ++depth;
+        if (')' == c) --depth;
+        if (' ' != c) constant += c;
+      }
+      if (!constant.empty()) handler->constants.push_back(constant);
+    } else if (handler) {
+      if ("OPCODE_END();" == line) {
+        handler = nullptr;
+      } else {
+        if (std::regex_search(line, uses_instruction)) handler->fusable = false;
+        handler->body.push_back(line);
+      }
+    }
+  }
+  return true;
+}
+
+static const char kLicense[] =
+    "// fv1vm: experimental FV-1 virtual machine\n"
+    "// Copyright (C) 2022 Patrick Dowling <pld@gurkenkiste.com>\n"
+    "//\n"
+    "// This program is free software: you can redistribute it and/or modify\n"
+    "// it under the terms of the GNU General Public License as published by\n"
+    "// the Free Software Foundation, either version 3 of the License, or\n"
+    "// (at your option) any later version.\n"
+    "//\n"
+    "// This program is distributed in the hope that it will be useful,\n"
+    "// but WITHOUT ANY WARRANTY; without even the implied warranty of\n"
+    "// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n"
+    "// GNU General Public License for more details.\n"
+    "//\n"
+    "// You should have received a copy of the GNU General Public License\n"
+    "// along with this program.  If not, see <https://www.gnu.org/licenses/>.\n";
+
+static std::string GenerateTable(const std::vector<Candidate> &superops, const std::string &origin)
+{
+  // Entries are wrapped to fit the line length
+  static constexpr size_t kMaxLineLength = 96;
+  std::vector<std::string> lines{"#define FV1_SUPEROPS(X)"};
+  for (size_t i = 0; i < superops.size(); ++i) {
+    const auto &sequence = superops[i].sequence;
+    std::vector<std::string> args{"SUPER_" + std::to_string(i), "\"" + mnemonic(sequence) + "\"",
+                                  std::to_string(sequence.size())};
+    for (auto opcode : sequence) args.push_back("OPCODE::" + opcode_name(opcode));
+    std::string line = "  X(";
+    for (size_t a = 0; a < args.size(); ++a) {
+      auto arg = args[a] + (a + 1 < args.size() ? "," : ")");
+      if (line.size() + 1 + arg.size() > kMaxLineLength) {
+        lines.push_back(line);
+        line = "    ";
+      }
+      if (' ' != line.back() && '(' != line.back()) line += " ";
+      line += arg;
+    }
+    lines.push_back(line);
+  }
+  size_t width = 0;
+  for (const auto &line : lines) width = std::max(width, line.size());
+
+  std::string code = kLicense;
+  code += "\n#ifndef FV1_SUPEROPS_H_\n#define FV1_SUPEROPS_H_\n\n";
+  code += "// Generated by fv1_superops" + origin + ", don't edit.\n";
+  code += "//\n";
+  code += "// X(name, mnemonic, length, opcodes...) for each superinstruction, longest\n";
+  code += "// first. The handlers are in vm/vm_execute_superops.h.\n";
+  for (size_t i = 0; i < lines.size(); ++i) {
+    code += lines[i];
+    if (i + 1 < lines.size()) code += std::string(width + 1 - lines[i].size(), ' ') + "\\";
+    code += "\n";
+  }
+  code += "\n#endif  // FV1_SUPEROPS_H_\n";
+  return code;
+}
+
+static std::string GenerateHandlers(const std::vector<Candidate> &superops,
+                                    const std::map<std::string, Handler> &handlers,
+                                    const std::string &origin)
+{
+  std::string code = kLicense;
+  code += "//\n";
+  code += "#ifndef FV1_VM_H_\n#error \"Don't include or compile this file directly\"\n#endif\n\n";
+  code += "// Generated by fv1_superops" + origin + ", don't edit.\n";
+  code += "//\n";
+  code += "// Superinstruction handlers, included by vm_execute_ops.h. Each step is the body\n";
+  code += "// of the handler of the instruction it replaces, see SUPEROP_CONSTANT and\n";
+  code += "// SUPEROP_NEXT.\n";
+  for (size_t i = 0; i < superops.size(); ++i) {
+    const auto &superop = superops[i];
+    code += "\n// " + mnemonic(superop.sequence) + ": " + std::to_string(superop.count) +
+            " times in " + std::to_string(superop.programs) + " programs\n";
+    code += "OPCODE_DISPATCH_0(SUPER_" + std::to_string(i) + ");\n";
+    for (size_t step = 0; step < superop.sequence.size(); ++step) {
+      if (step) code += "SUPEROP_NEXT();\n";
+      const auto &handler = handlers.at(opcode_name(superop.sequence[step]));
+      code += "{\n";
+      for (size_t c = 0; c < handler.constants.size(); ++c)
+        code += "  SUPEROP_CONSTANT(" + handler.constants[c] + ", " + std::to_string(c) + ");\n";
+      for (const auto &line : handler.body) code += line.empty() ? "\n" : "  " + line + "\n";
+      code += "}\n";
+    }
+    code += "OPCODE_END();\n";
+  }
+  return code;
+}
+
+static bool WriteFile(const std::string &filename, const std::string &code)
+{
+  FILE *f = fopen(filename.c_str(), "w");
+  if (!f) {
+    ERR("** Failed to open output file '%s': %s", filename.c_str(), strerror(errno));
+    return false;
+  }
+  fwrite(code.data(), 1, code.size(), f);
+  fclose(f);
+  INFO("** Wrote %s", filename.c_str());
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  if (!ParseCommandLine(argc, argv)) {
+    Usage();
+    return EXIT_FAILURE;
+  }
+
+  std::map<std::string, Handler> handlers;
+  const auto handler_file = options.source + "/vm/vm_execute_ops.h";
+  if (!ParseHandlers(handler_file, handlers)) {
+    ERR("** Failed to read handlers from '%s': %s", handler_file.c_str(), strerror(errno));
+    return EXIT_FAILURE;
+  }
+  auto fusable = [&](OPCODE opcode) {
+    auto handler = handlers.find(opcode_name(opcode));
+    return handlers.end() != handler && handler->second.fusable;
+  };
+
+  std::vector<std::filesystem::path> files;
+  for (const auto &dir : options.dirs) {
+    std::error_code error;
+    for (const auto &entry : std::filesystem::recursive_directory_iterator(dir, error)) {
+      const auto extension = entry.path().extension();
+      if (entry.is_regular_file() && (".bin" == extension || ".bank" == extension))
+        files.push_back(entry.path());
+    }
+    if (error) {
+      ERR("** Failed to scan '%s': %s", dir.c_str(), error.message().c_str());
+      return EXIT_FAILURE;
+    }
+  }
+  std::sort(files.begin(), files.end());
+
+  // The superinstructions currently built in are left out so the result doesn't depend on them
+  const auto passes = VM::passes(VM::OptLevel::O2) & ~VM::pass_mask(VM::PASS_SUPEROPS);
+  std::map<Sequence, Candidate> candidates;
+  int num_programs = 0;
+  for (const auto &file : files) {
+    if (!binary_file.Read(file.string()) || !binary_file.valid_length()) {
+      VERBOSE("** Skipping '%s'", file.c_str());
+      continue;
+    }
+    const int num_file_programs = 512 == binary_file.length() ? 1 : 8;
+    VERBOSE("** %s: %d program(s)", file.c_str(), num_file_programs);
+    for (int index = 0; index < num_file_programs; ++index, ++num_programs) {
+      fv1::BufferStream<fv1::BSWAP_ENABLE> program{binary_file.program(index)};
+      vm.Compile(program, passes);
+      const auto &steady_program = vm.steady_program();
+      for (size_t ic = 0; ic < steady_program.length; ++ic) {
+        Sequence sequence;
+        for (size_t i = ic; i < steady_program.length && sequence.size() < options.length; ++i) {
+          const auto opcode = steady_program.instructions[i].get_opcode();
+          if (!fusable(opcode)) break;
+          sequence.push_back(opcode);
+          if (sequence.size() < 2) continue;
+          auto &candidate = candidates[sequence];
+          candidate.sequence = sequence;
+          ++candidate.count;
+          if (candidate.last_program != num_programs) ++candidate.programs;
+          candidate.last_program = num_programs;
+        }
+      }
+    }
+  }
+  INFO("** %d programs in %zu files", num_programs, files.size());
+
+  std::vector<Candidate> ranked;
+  for (const auto &candidate : candidates) ranked.push_back(candidate.second);
+  std::stable_sort(ranked.begin(), ranked.end(), [](const Candidate &a, const Candidate &b) {
+    return a.saved() > b.saved();
+  });
+  if (ranked.size() > options.count) ranked.resize(options.count);
+  if (ranked.empty() && options.count) {
+    ERR("** No sequences found");
+    return EXIT_FAILURE;
+  }
+  for (const auto &candidate : ranked) {
+    INFO("%-40s %6zu times in %4zu programs, %6zu dispatches saved",
+         mnemonic(candidate.sequence).c_str(), candidate.count, candidate.programs,
+         candidate.saved());
+  }
+
+  if (options.write) {
+    // VM::FuseSuperinstructions takes the first match
+    std::stable_sort(ranked.begin(), ranked.end(), [](const Candidate &a, const Candidate &b) {
+      return a.sequence.size() > b.sequence.size();
+    });
+    std::string origin = " from " + std::to_string(num_programs) + " programs in";
+    for (const auto &dir : options.dirs) origin += " " + dir;
+    if (!WriteFile(options.source + "/fv1/fv1_superops.h", GenerateTable(ranked, origin)) ||
+        !WriteFile(options.source + "/vm/vm_execute_superops.h",
+                   GenerateHandlers(ranked, handlers, origin)))
+      return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}